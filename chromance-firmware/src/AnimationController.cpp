@@ -1,6 +1,7 @@
 #include "AnimationController.h"
 #include "AnimationRegistry.h"
 #include "animations/Animation.h"
+#include "Sequence.h"
 
 AnimationController::AnimationController(LedController &controller, Configuration &config)
     : ledController(controller), configuration(config)
@@ -21,6 +22,7 @@ AnimationController::~AnimationController()
     }
   }
   animations.clear();
+  delete recorder;
 }
 
 void AnimationController::recalculateAutoPulseTypes()
@@ -49,32 +51,54 @@ void AnimationController::init()
   recalculateAutoPulseTypes();
 
   baseColor = random(0xFFFF);
-  lastRandomPulse = millis();
+  lastRandomPulse = now();
 }
 
 void AnimationController::update()
 {
-  // Fade all dots to create trails
-  float decay = 0.97f;
-  ledController.fade(decay);
+  // Apply everything the web side queued since the last frame
+  processCommands();
 
-  // Advance ripples
-  for (int i = 0; i < Constants::NUMBER_OF_RIPPLES; i++)
+  // Switch between drawing straight into the strip buffer and compositing.
+  // The primary animation keeps its trails across the switch.
+  bool wantLayers = hasActiveLayers();
+  if (wantLayers != layering)
   {
-    ripples[i].advance(ledController);
+    if (wantLayers)
+    {
+      memcpy(primaryBuffer, ledController.ledColors, sizeof(primaryBuffer));
+    }
+    else
+    {
+      memcpy(ledController.ledColors, primaryBuffer, sizeof(primaryBuffer));
+    }
+    layering = wantLayers;
+  }
+
+  if (layering)
+  {
+    renderLayers();
+  }
+  else
+  {
+    renderPrimary();
   }
 
   // Show strips
   ledController.show();
 
-  // Update current animation
-  if (currentAutoPulseType < animations.size() && animations[currentAutoPulseType])
+  if (recorder)
   {
-    animations[currentAutoPulseType]->update();
+    recorder->capture(ledController.ledColors, now());
+    if (!recorder->isRecording())
+    {
+      delete recorder;
+      recorder = nullptr;
+    }
   }
 
   // Check for new animation trigger
-  if (numberOfAutoPulseTypes > 0 && millis() - lastRandomPulse >= Constants::randomPulseTime)
+  if (numberOfAutoPulseTypes > 0 && now() - lastRandomPulse >= Constants::randomPulseTime)
   {
     bool readyToSwitch = true;
 
@@ -100,7 +124,7 @@ void AnimationController::update()
         getNextAnimation();
         startAnimation(currentAutoPulseType);
 
-        lastRandomPulse = millis();
+        lastRandomPulse = now();
       }
       else
       {
@@ -109,13 +133,449 @@ void AnimationController::update()
         {
           rollNewBaseColor();
           animations[currentAutoPulseType]->run();
-          lastRandomPulse = millis();
+          lastRandomPulse = now();
         }
       }
     }
   }
 }
 
+void AnimationController::processCommands()
+{
+  AnimationCommand command;
+  bool changed = !configPublished;
+  while (commandQueue.pop(command))
+  {
+    executeCommand(command);
+    processedCommands++;
+    changed = true;
+  }
+
+  // Configuration only changes through commands, so it is serialized again
+  // only after some ran; layer costs move every frame
+  if (changed)
+  {
+    publishConfig();
+  }
+  publishLayers();
+}
+
+void AnimationController::publishConfig()
+{
+  ConfigSnapshot &snapshot = configSnapshot.writable();
+
+  JsonDocument global;
+  JsonObject globalObj = global.to<JsonObject>();
+  configuration.serialize(globalObj);
+  JsonArray list = globalObj["animations"].to<JsonArray>();
+  snapshot.animations.resize(animations.size());
+  for (size_t i = 0; i < animations.size(); i++)
+  {
+    snapshot.animations[i] = "";
+    if (animations[i] == nullptr)
+    {
+      continue;
+    }
+    JsonObject entry = list.add<JsonObject>();
+    entry["id"] = i;
+    entry["name"] = animations[i]->getName();
+    entry["enabled"] = animations[i]->isEnabled();
+
+    JsonDocument config;
+    JsonObject configObj = config.to<JsonObject>();
+    animations[i]->getConfig(configObj);
+    serializeJson(config, snapshot.animations[i]);
+  }
+  snapshot.global = "";
+  serializeJson(global, snapshot.global);
+  snapshot.published = true;
+
+  configSnapshot.publish();
+  configPublished = true;
+}
+
+void AnimationController::publishLayers()
+{
+  LayerSnapshot &snapshot = layerSnapshot.writable();
+  snapshot.primaryAnimation = currentAutoPulseType;
+  snapshot.primaryBlend = primaryBlend;
+  snapshot.primaryOpacity = primaryOpacity;
+  for (int i = 0; i < MAX_LAYERS; i++)
+  {
+    snapshot.settings[i] = layers[i].settings;
+    snapshot.lastCostMicros[i] = layers[i].lastCostMicros;
+    snapshot.renderedFrames[i] = layers[i].renderedFrames;
+    snapshot.skippedFrames[i] = layers[i].skippedFrames;
+  }
+  snapshot.published = true;
+  layerSnapshot.publish();
+}
+
+void AnimationController::executeCommand(const AnimationCommand &command)
+{
+  switch (command.type)
+  {
+  case COMMAND_CHANGE_ANIMATION:
+    if (command.animation < 0 || command.animation >= (int)animations.size())
+    {
+      Serial.println("Ignoring command for unknown animation");
+      return;
+    }
+    // Manually selecting an animation disables auto switching
+    autoSwitching = false;
+    changeAnimation(command.animation);
+    break;
+  case COMMAND_SET_AUTO_SWITCHING:
+    setAutoSwitching(command.enabled);
+    break;
+  case COMMAND_SET_ANIMATION_CONFIG:
+  {
+    Animation *anim = getAnimation(command.animation);
+    if (anim == nullptr)
+    {
+      Serial.println("Ignoring command for unknown animation");
+      return;
+    }
+    JsonDocument doc;
+    if (deserializeJson(doc, command.payload))
+    {
+      Serial.println("Ignoring malformed animation config");
+      return;
+    }
+    anim->setConfig(doc.as<JsonObject>());
+    recalculateAutoPulseTypes();
+    notifyStateChange();
+    break;
+  }
+  case COMMAND_SET_GLOBAL_CONFIG:
+  {
+    JsonDocument doc;
+    if (deserializeJson(doc, command.payload))
+    {
+      Serial.println("Ignoring malformed global config");
+      return;
+    }
+    configuration.deserialize(doc.as<JsonObject>());
+    notifyStateChange();
+    break;
+  }
+  case COMMAND_SAVE_CONFIGURATION:
+    configuration.save();
+    break;
+  case COMMAND_SET_LAYER:
+    applyLayerCommand(command.payload);
+    break;
+  case COMMAND_RECORD_SEQUENCE:
+  {
+    JsonDocument doc;
+    if (deserializeJson(doc, command.payload) || !doc["frames"].is<int>())
+    {
+      Serial.println("Ignoring malformed record command");
+      return;
+    }
+    int interval = doc["interval"].is<int>() ? doc["interval"].as<int>() : 33;
+    startRecording(doc["frames"].as<int>(), interval);
+    break;
+  }
+  }
+}
+
+void AnimationController::renderPrimary()
+{
+  Animation *current = nullptr;
+  if (currentAutoPulseType < animations.size())
+  {
+    current = animations[currentAutoPulseType];
+  }
+
+  // Fade or clear whatever the current animation will not overwrite
+  prepareCanvas(current, canvasDark);
+
+  // Update current animation
+  if (current)
+  {
+    current->update();
+    if (current->getRenderContract() != RENDER_RIPPLES_ONLY)
+    {
+      canvasDark = false;
+    }
+  }
+
+  // Advance ripples
+  if (getActiveRippleCount() > 0)
+  {
+    canvasDark = false;
+  }
+  for (int i = 0; i < Constants::NUMBER_OF_RIPPLES; i++)
+  {
+    ripples[i].advance(ledController, now());
+  }
+}
+
+void AnimationController::renderLayers()
+{
+  memset(composite, 0, sizeof(composite));
+
+  for (int i = 0; i < MAX_LAYERS; i++)
+  {
+    if (layers[i].settings.enabled && layers[i].settings.position == LAYER_BACKGROUND)
+    {
+      renderLayer(layers[i]);
+      blendLayer(composite, layers[i].buffer, layers[i].settings.blend, layers[i].settings.opacity);
+    }
+  }
+
+  // Every layer draws into the strip buffer, so swap each one in and out
+  memcpy(ledController.ledColors, primaryBuffer, sizeof(primaryBuffer));
+  renderPrimary();
+  memcpy(primaryBuffer, ledController.ledColors, sizeof(primaryBuffer));
+  blendLayer(composite, primaryBuffer, primaryBlend, primaryOpacity);
+
+  for (int i = 0; i < MAX_LAYERS; i++)
+  {
+    if (layers[i].settings.enabled && layers[i].settings.position == LAYER_FOREGROUND)
+    {
+      renderLayer(layers[i]);
+      blendLayer(composite, layers[i].buffer, layers[i].settings.blend, layers[i].settings.opacity);
+    }
+  }
+
+  memcpy(ledController.ledColors, composite, sizeof(composite));
+}
+
+void AnimationController::renderLayer(AnimationLayer &layer)
+{
+  Animation *animation = getAnimation(layer.settings.animation);
+
+  // The primary animation owns the instance while it is showing
+  if (animation == nullptr || layer.settings.animation == currentAutoPulseType)
+  {
+    memset(layer.buffer, 0, sizeof(layer.buffer));
+    layer.needsRun = true;
+    return;
+  }
+
+  // Pay back time spent over budget by holding the previous frame
+  if (layer.debtMicros > 0)
+  {
+    layer.debtMicros = layer.debtMicros > layer.settings.budgetMicros ? layer.debtMicros - layer.settings.budgetMicros : 0;
+    layer.skippedFrames++;
+    return;
+  }
+
+  unsigned long start = micros();
+  memcpy(ledController.ledColors, layer.buffer, sizeof(layer.buffer));
+
+  prepareCanvas(animation, layer.canvasDark);
+  if (layer.needsRun || (animation->isFinished() && now() - layer.lastRun >= Constants::randomPulseTime))
+  {
+    layer.needsRun = false;
+    layer.canvasDark = false;
+    layer.lastRun = now();
+    animation->run();
+  }
+  animation->update();
+  layer.canvasDark = false;
+
+  memcpy(layer.buffer, ledController.ledColors, sizeof(layer.buffer));
+
+  layer.lastCostMicros = micros() - start;
+  layer.renderedFrames++;
+  if (layer.settings.budgetMicros > 0 && layer.lastCostMicros > layer.settings.budgetMicros)
+  {
+    layer.debtMicros += layer.lastCostMicros - layer.settings.budgetMicros;
+  }
+}
+
+bool AnimationController::hasActiveLayers() const
+{
+  for (int i = 0; i < MAX_LAYERS; i++)
+  {
+    if (layers[i].settings.enabled && layers[i].settings.animation >= 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AnimationController::isLayerAnimation(int animation) const
+{
+  for (int i = 0; i < MAX_LAYERS; i++)
+  {
+    if (layers[i].settings.enabled && layers[i].settings.animation == animation)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AnimationController::setLayer(int slot, const LayerSettings &settings)
+{
+  if (slot < 0 || slot >= MAX_LAYERS)
+  {
+    Serial.println("Invalid layer slot");
+    return false;
+  }
+
+  Animation *animation = getAnimation(settings.animation);
+  if (settings.animation >= 0 && animation == nullptr)
+  {
+    Serial.println("Invalid layer animation");
+    return false;
+  }
+  if (animation && animation->getRenderContract() == RENDER_RIPPLES_ONLY)
+  {
+    Serial.println("Ripple animations can only be the primary layer");
+    return false;
+  }
+
+  AnimationLayer &layer = layers[slot];
+  if (layer.settings.animation != settings.animation)
+  {
+    Animation *previous = getAnimation(layer.settings.animation);
+    if (previous && layer.settings.animation != currentAutoPulseType)
+    {
+      previous->stop();
+    }
+    memset(layer.buffer, 0, sizeof(layer.buffer));
+    layer.needsRun = true;
+  }
+  layer.settings = settings;
+  layer.debtMicros = 0;
+  layer.renderedFrames = 0;
+  layer.skippedFrames = 0;
+  return true;
+}
+
+bool AnimationController::startRecording(unsigned long frames, uint16_t frameMillis)
+{
+  if (recorder == nullptr)
+  {
+    recorder = new SequenceRecorder();
+  }
+  if (frames == 0 || !recorder->start(Sequence::DEFAULT_PATH, frameMillis, frames, now()))
+  {
+    delete recorder;
+    recorder = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void AnimationController::setPrimaryBlend(BlendMode mode, byte opacity)
+{
+  primaryBlend = mode;
+  primaryOpacity = opacity;
+}
+
+static byte clampByte(int value)
+{
+  return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+void AnimationController::applyLayerCommand(const char *json)
+{
+  JsonDocument doc;
+  if (deserializeJson(doc, json))
+  {
+    Serial.println("Ignoring malformed layer command");
+    return;
+  }
+
+  BlendMode mode;
+  if (doc["primary"].is<JsonObject>())
+  {
+    JsonObject primary = doc["primary"];
+    BlendMode blend = primaryBlend;
+    if (primary["blend"].is<const char *>() && parseBlendMode(primary["blend"], mode))
+    {
+      blend = mode;
+    }
+    byte opacity = primary["opacity"].is<int>() ? clampByte(primary["opacity"].as<int>()) : primaryOpacity;
+    setPrimaryBlend(blend, opacity);
+  }
+
+  if (doc["slot"].is<int>())
+  {
+    int slot = doc["slot"];
+    if (slot < 0 || slot >= MAX_LAYERS)
+    {
+      Serial.println("Invalid layer slot");
+      return;
+    }
+
+    // Fields that are not given keep their current value
+    LayerSettings settings = layers[slot].settings;
+    if (doc["animation"].is<int>())
+    {
+      settings.animation = doc["animation"];
+    }
+    if (doc["position"].is<const char *>())
+    {
+      settings.position = strcmp(doc["position"], "foreground") == 0 ? LAYER_FOREGROUND : LAYER_BACKGROUND;
+    }
+    if (doc["blend"].is<const char *>() && parseBlendMode(doc["blend"], mode))
+    {
+      settings.blend = mode;
+    }
+    if (doc["opacity"].is<int>())
+    {
+      settings.opacity = clampByte(doc["opacity"].as<int>());
+    }
+    if (doc["enabled"].is<bool>())
+    {
+      settings.enabled = doc["enabled"];
+    }
+    if (doc["budget"].is<int>())
+    {
+      settings.budgetMicros = doc["budget"].as<int>() > 0 ? doc["budget"].as<int>() : 0;
+    }
+    setLayer(slot, settings);
+  }
+  notifyStateChange();
+}
+
+void AnimationController::prepareCanvas(Animation *animation, bool &dark)
+{
+  // Fade all dots to create trails
+  const float decay = 0.97f;
+  RenderContract contract = animation ? animation->getRenderContract() : RENDER_TRAILS;
+
+  if (!renderPassOptimization)
+  {
+    ledController.fade(decay);
+    if (contract == RENDER_CLEAR)
+    {
+      ledController.clearBuffer();
+    }
+    return;
+  }
+
+  switch (contract)
+  {
+  case RENDER_OVERWRITE:
+    // Every pixel is rewritten by update(), a fade would be discarded
+    break;
+  case RENDER_CLEAR:
+    ledController.clearBuffer();
+    dark = true;
+    break;
+  case RENDER_RIPPLES_ONLY:
+    // Fading a black buffer is a no-op; skip it while nothing is drawing
+    if (dark)
+    {
+      break;
+    }
+    dark = !ledController.fade(decay);
+    break;
+  default:
+    dark = !ledController.fade(decay);
+    break;
+  }
+}
+
 void AnimationController::rollNewBaseColor()
 {
   unsigned int prev = baseColor;
@@ -129,7 +589,7 @@ void AnimationController::rollNewBaseColor()
 
 void AnimationController::getNextAnimation()
 {
-  if (currentAutoPulseType == 255 || (numberOfAutoPulseTypes > 1 && millis() - lastAutoPulseChange >= Constants::RIPPLE_TIMEOUT))
+  if (currentAutoPulseType == 255 || (numberOfAutoPulseTypes > 1 && now() - lastAutoPulseChange >= Constants::RIPPLE_TIMEOUT))
   {
     byte possiblePulse = 255;
     int attempts = 0;
@@ -145,10 +605,11 @@ void AnimationController::getNextAnimation()
         continue;
       }
 
-      if (animations[possiblePulse] != nullptr && animations[possiblePulse]->isEnabled())
+      // Skip animations already showing on another layer
+      if (animations[possiblePulse] != nullptr && animations[possiblePulse]->isEnabled() && !isLayerAnimation(possiblePulse))
       {
         currentAutoPulseType = possiblePulse;
-        lastAutoPulseChange = millis();
+        lastAutoPulseChange = now();
         break;
       }
       attempts++;
@@ -159,6 +620,7 @@ void AnimationController::getNextAnimation()
 void AnimationController::startAnimation(byte animation)
 {
   currentAutoPulseType = animation;
+  canvasDark = false; // run() may draw straight into the buffer
   if (animation < animations.size() && animations[animation])
   {
     animations[animation]->run();
@@ -173,6 +635,29 @@ void AnimationController::changeAnimation(byte animation)
     animations[currentAutoPulseType]->stop();
   }
   rollNewBaseColor();
+  changeCount++;
+  startAnimation(animation);
+}
+
+void AnimationController::startSeeded(byte animation, unsigned long seed)
+{
+  if (currentAutoPulseType < animations.size() && animations[currentAutoPulseType])
+  {
+    animations[currentAutoPulseType]->stop();
+  }
+  for (int j = 0; j < Constants::NUMBER_OF_RIPPLES; j++)
+  {
+    ripples[j].state = STATE_DEAD;
+  }
+  ledController.clearBuffer();
+  memset(primaryBuffer, 0, sizeof(primaryBuffer));
+  Ripple::runnerNode = -1;
+
+  randomSeed(seed);
+  baseColor = random(0xFFFF);
+  lastAutoPulseNode = 255;
+  lastRandomPulse = now();
+  lastAutoPulseChange = now();
   startAnimation(animation);
 }
 
@@ -198,7 +683,8 @@ void AnimationController::startRipple(int node, int direction, uint32_t color, f
           color,
           speed,
           lifespan,
-          behavior);
+          behavior,
+          now());
       break;
     }
   }
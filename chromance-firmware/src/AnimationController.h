@@ -8,9 +8,13 @@
 #include "Configuration.h"
 #include "ripple.h"
 #include "Topology.h"
+#include "CommandQueue.h"
+#include "Clock.h"
+#include "AnimationLayer.h"
 #include <functional>
 
 class Animation;
+class SequenceRecorder;
 
 class AnimationController
 {
@@ -35,34 +39,133 @@ public:
   byte getCurrentAnimation() const { return currentAutoPulseType; }
   void startAnimation(byte animation);
   void changeAnimation(byte animation);
+  unsigned long getChangeCount() const { return changeCount; } // changeAnimation calls so far
+  // Starts animation from a known state: no ripples, a clear buffer and the
+  // random numbers seeded. Controllers given the same seed and the same clock
+  // then draw the same frames (see WallSync).
+  void startSeeded(byte animation, unsigned long seed);
   void setAutoSwitching(bool enabled);
   bool isAutoSwitching() const { return autoSwitching; }
   Ripple &getRipple(int index);
   Animation *getAnimation(int index);
   void setStateChangeCallback(StateChangeCallback callback) { stateChangeCallback = callback; }
   void recalculateAutoPulseTypes();
-  
+
+  // When enabled, update() only runs the fade/clear passes the current
+  // animation's RenderContract needs. Disabling it fades every frame but
+  // keeps the same prepare, draw, ripples, show order, so tests can prove
+  // the skipped passes never change what is shown. It is not the old
+  // pipeline, which showed the faded frame before the animation drew.
+  void setRenderPassOptimization(bool enabled) { renderPassOptimization = enabled; }
+  bool isRenderPassOptimizationEnabled() const { return renderPassOptimization; }
+
   int getAnimationCount() const { return animations.size(); }
 
+  // Layer stack: background layers render below the primary (auto-switched)
+  // animation and its ripples, foreground layers above it. Each slot blends
+  // over the result so far in slot order. Ripple-driven animations share the
+  // controller's ripple pool and so can only be the primary animation.
+  // Must be called on the render core; the web side posts COMMAND_SET_LAYER.
+  static const int MAX_LAYERS = 4;
+  bool setLayer(int slot, const LayerSettings &settings);
+  const AnimationLayer &getLayer(int slot) const { return layers[slot]; }
+  void setPrimaryBlend(BlendMode mode, byte opacity);
+  BlendMode getPrimaryBlend() const { return primaryBlend; }
+  byte getPrimaryOpacity() const { return primaryOpacity; }
+  bool isLayering() const { return layering; }
+
+  // Records what is shown into Sequence::DEFAULT_PATH for PlaybackAnimation.
+  // The recorder's buffers are only allocated while recording.
+  bool startRecording(unsigned long frames, uint16_t frameMillis);
+  bool isRecording() const { return recorder != nullptr; }
+
+  // All animation timing reads this clock. Defaults to the board's millis();
+  // the emulator and tests swap in a VirtualClock or ScaledClock.
+  void setClock(Clock &source) { clock = &source; }
+  Clock &getClock() { return *clock; }
+  unsigned long now() { return clock->now(); }
+
+  // Cross-core control. The web task posts commands (never blocks; returns
+  // false when the queue is full) and update() drains them before rendering,
+  // so animations and configuration are only mutated on the render core.
+  static const size_t COMMAND_QUEUE_SIZE = 32;
+  bool postCommand(const AnimationCommand &command) { return commandQueue.push(command); }
+  size_t getFreeCommandSlots() const { return commandQueue.freeSlots(); }
+  void processCommands();
+  unsigned long getProcessedCommandCount() const { return processedCommands; }
+
+  // What the web side serves, copied by processCommands() at the frame
+  // boundary so GET handlers never read state the render core is changing.
+  // Read them from one task only (the web server's); until the first frame
+  // both are unpublished and empty.
+  struct ConfigSnapshot
+  {
+    bool published = false;
+    String global;                 // Body of GET /api/config/global
+    std::vector<String> animations; // Body of GET /api/config?id=, by index
+  };
+  struct LayerSnapshot
+  {
+    bool published = false;
+    byte primaryAnimation = 255;
+    BlendMode primaryBlend = BLEND_SCREEN;
+    byte primaryOpacity = 255;
+    LayerSettings settings[MAX_LAYERS];
+    unsigned long lastCostMicros[MAX_LAYERS];
+    unsigned long renderedFrames[MAX_LAYERS];
+    unsigned long skippedFrames[MAX_LAYERS];
+  };
+  const ConfigSnapshot &readConfigSnapshot() { return configSnapshot.read(); }
+  const LayerSnapshot &readLayerSnapshot() { return layerSnapshot.read(); }
+
 private:
   LedController &ledController;
   Configuration &configuration;
   Ripple ripples[Constants::NUMBER_OF_RIPPLES];
   std::vector<Animation *> animations;
+  RealTimeClock realTimeClock;
+  Clock *clock = &realTimeClock;
 
   unsigned int baseColor;
   unsigned long lastRandomPulse;
   bool autoSwitching = true;
+  bool renderPassOptimization = true;
+  bool canvasDark = false; // Buffer known to be all black since the last fade
 
   byte currentAutoPulseType = 255;
   unsigned long lastAutoPulseChange;
   byte lastAutoPulseNode = 255;
+  unsigned long changeCount = 0;
 
   // Auto pulse types count
   byte numberOfAutoPulseTypes;
 
   StateChangeCallback stateChangeCallback;
 
+  SpscQueue<AnimationCommand, COMMAND_QUEUE_SIZE> commandQueue;
+  unsigned long processedCommands = 0;
+  SnapshotBuffer<ConfigSnapshot> configSnapshot;
+  SnapshotBuffer<LayerSnapshot> layerSnapshot;
+  bool configPublished = false;
+
+  AnimationLayer layers[MAX_LAYERS];
+  BlendMode primaryBlend = BLEND_SCREEN;
+  byte primaryOpacity = 255;
+  bool layering = false;
+  LayerBuffer primaryBuffer;
+  LayerBuffer composite;
+  SequenceRecorder *recorder = nullptr;
+
+  void prepareCanvas(Animation *animation, bool &dark);
+  void executeCommand(const AnimationCommand &command);
+  void publishConfig();
+  void publishLayers();
+  void applyLayerCommand(const char *json);
+  void renderPrimary();
+  void renderLayers();
+  void renderLayer(AnimationLayer &layer);
+  bool hasActiveLayers() const;
+  bool isLayerAnimation(int animation) const;
   void getNextAnimation();
   void notifyStateChange();
   void rollNewBaseColor();  // Picks a new random baseColor different from the previous
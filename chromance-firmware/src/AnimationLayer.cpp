@@ -0,0 +1,73 @@
+#include "AnimationLayer.h"
+
+static const char *blendModeNames[BLEND_MODE_COUNT] = {"normal", "add", "screen", "multiply", "lighten"};
+
+void blendLayer(LayerBuffer &dst, const LayerBuffer &src, BlendMode mode, byte opacity)
+{
+  byte *d = &dst[0][0][0];
+  const byte *s = &src[0][0][0];
+  const int count = Constants::NUM_OF_PIXELS * 3;
+
+  for (int i = 0; i < count; i++)
+  {
+    int below = d[i];
+    int above = s[i];
+    int result;
+
+    switch (mode)
+    {
+    case BLEND_ADD:
+      result = below + above;
+      break;
+    case BLEND_SCREEN:
+      result = 255 - (((255 - below) * (255 - above)) / 255);
+      break;
+    case BLEND_MULTIPLY:
+      result = (below * above) / 255;
+      break;
+    case BLEND_LIGHTEN:
+      result = below > above ? below : above;
+      break;
+    default:
+      result = above;
+      break;
+    }
+    if (result > 255)
+    {
+      result = 255;
+    }
+
+    // Opacity mixes the blended result back towards what was below
+    if (opacity != 255)
+    {
+      result = below + (((result - below) * opacity) / 255);
+    }
+    d[i] = (byte)result;
+  }
+}
+
+const char *getBlendModeName(BlendMode mode)
+{
+  if (mode < 0 || mode >= BLEND_MODE_COUNT)
+  {
+    return "normal";
+  }
+  return blendModeNames[mode];
+}
+
+bool parseBlendMode(const char *name, BlendMode &mode)
+{
+  if (name == nullptr)
+  {
+    return false;
+  }
+  for (int i = 0; i < BLEND_MODE_COUNT; i++)
+  {
+    if (strcmp(name, blendModeNames[i]) == 0)
+    {
+      mode = (BlendMode)i;
+      return true;
+    }
+  }
+  return false;
+}
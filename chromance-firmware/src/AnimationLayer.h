@@ -0,0 +1,59 @@
+#ifndef ANIMATION_LAYER_H
+#define ANIMATION_LAYER_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+typedef byte LayerBuffer[Constants::NUMBER_OF_SEGMENTS][Constants::LEDS_PER_SEGMENT][3];
+
+// How a layer is combined with everything beneath it
+enum BlendMode
+{
+  BLEND_NORMAL,   // Replace, mixed by opacity
+  BLEND_ADD,      // Saturating add
+  BLEND_SCREEN,   // Brightens like add but never clips
+  BLEND_MULTIPLY, // Darkens; black in the layer masks what is below
+  BLEND_LIGHTEN,  // Per-channel maximum
+  BLEND_MODE_COUNT
+};
+
+// Where an extra layer sits relative to the primary (auto-switched) animation
+enum LayerPosition
+{
+  LAYER_BACKGROUND,
+  LAYER_FOREGROUND
+};
+
+// What the web API or a caller configures for one layer slot
+struct LayerSettings
+{
+  int animation = -1;
+  LayerPosition position = LAYER_BACKGROUND;
+  BlendMode blend = BLEND_NORMAL;
+  byte opacity = 255;
+  bool enabled = false;
+  unsigned long budgetMicros = 0; // Average render cost allowed per frame, 0 = unlimited
+};
+
+struct AnimationLayer
+{
+  LayerSettings settings;
+
+  // Render state, owned by the render core
+  bool needsRun = false;
+  bool canvasDark = false;
+  unsigned long lastRun = 0;
+  unsigned long debtMicros = 0; // Cost over budget still to be paid back by skipping frames
+  unsigned long lastCostMicros = 0;
+  unsigned long renderedFrames = 0;
+  unsigned long skippedFrames = 0;
+  LayerBuffer buffer;
+};
+
+// Blends src over dst in place
+void blendLayer(LayerBuffer &dst, const LayerBuffer &src, BlendMode mode, byte opacity);
+
+const char *getBlendModeName(BlendMode mode);
+bool parseBlendMode(const char *name, BlendMode &mode);
+
+#endif // ANIMATION_LAYER_H
@@ -0,0 +1,160 @@
+#include "Canvas.h"
+#include "SpatialIndex.h"
+#include "LedController.h"
+#include <math.h>
+
+namespace
+{
+  // Squared distance from (px, py) to the segment from (x0, y0) to (x1, y1)
+  inline float distanceSquared(float px, float py, float x0, float y0, float x1, float y1)
+  {
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float lengthSquared = dx * dx + dy * dy;
+    float t = lengthSquared > 0 ? ((px - x0) * dx + (py - y0) * dy) / lengthSquared : 0;
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    float ex = px - (x0 + t * dx);
+    float ey = py - (y0 + t * dy);
+    return ex * ex + ey * ey;
+  }
+}
+
+Canvas::Canvas(byte *pixels)
+    : pixels(pixels), blend(BLEND_NORMAL), opacity(255), softness(DEFAULT_SOFTNESS), covered(0), tested(0)
+{
+}
+
+template <typename Edge>
+void Canvas::fill(int count, Edge edge, uint32_t color)
+{
+  // edge gives how far inside the shape an LED is, negative outside
+  covered = 0;
+  tested = 0;
+  const float scale = 1.0f / softness;
+  for (int k = 0; k < count; k++)
+  {
+    const LedSpan &span = spans[k];
+    for (int led = span.first; led < span.first + span.count; led++)
+    {
+      float coverage = edge(Topology::getLedPosition(span.segment, led)) * scale + 0.5f;
+      tested++;
+      if (coverage > 0)
+      {
+        plot(span.segment, led, coverage < 1 ? coverage : 1, color);
+      }
+    }
+  }
+}
+
+void Canvas::plot(int segment, int led, float coverage, uint32_t color)
+{
+  int alpha = (int)(coverage * opacity + 0.5f);
+  if (alpha == 0)
+  {
+    return;
+  }
+  covered++;
+
+  byte *pixel = pixels + LedController::pixelIndex(segment, led) * 3;
+  for (int c = 0; c < 3; c++)
+  {
+    int below = pixel[c];
+    int above = (color >> (16 - 8 * c)) & 0xFF;
+    int result;
+    switch (blend)
+    {
+    case BLEND_ADD:
+      result = below + above;
+      break;
+    case BLEND_SCREEN:
+      result = 255 - (((255 - below) * (255 - above)) / 255);
+      break;
+    case BLEND_MULTIPLY:
+      result = (below * above) / 255;
+      break;
+    case BLEND_LIGHTEN:
+      result = below > above ? below : above;
+      break;
+    default:
+      result = above;
+      break;
+    }
+    if (result > 255)
+    {
+      result = 255;
+    }
+    pixel[c] = (byte)(below + (((result - below) * alpha) / 255));
+  }
+}
+
+void Canvas::line(float x0, float y0, float x1, float y1, float width, uint32_t color)
+{
+  const float half = width / 2;
+  const float reach = half + softness / 2;
+  int count = Topology::getSpatialIndex().queryRect(fminf(x0, x1) - reach, fminf(y0, y1) - reach,
+                                                    fmaxf(x0, x1) + reach, fmaxf(y0, y1) + reach, spans, MAX_SPANS);
+  fill(
+      count, [&](const LedPosition &p)
+      { return half - sqrtf(distanceSquared(p.x, p.y, x0, y0, x1, y1)); },
+      color);
+}
+
+void Canvas::disc(float x, float y, float radius, uint32_t color)
+{
+  int count = Topology::getSpatialIndex().queryRadius(x, y, radius + softness / 2, spans, MAX_SPANS);
+  fill(
+      count, [&](const LedPosition &p)
+      { return radius - sqrtf((p.x - x) * (p.x - x) + (p.y - y) * (p.y - y)); },
+      color);
+}
+
+void Canvas::ring(float x, float y, float radius, float width, uint32_t color)
+{
+  const float half = width / 2;
+  const float reach = half + softness / 2;
+  int count = Topology::getSpatialIndex().queryRing(x, y, radius - reach, radius + reach, spans, MAX_SPANS);
+  fill(
+      count, [&](const LedPosition &p)
+      { return half - fabsf(sqrtf((p.x - x) * (p.x - x) + (p.y - y) * (p.y - y)) - radius); },
+      color);
+}
+
+void Canvas::polygon(const LedPosition *points, int count, uint32_t color)
+{
+  count = count < MAX_POINTS ? count : MAX_POINTS;
+  if (count < 3)
+  {
+    covered = tested = 0;
+    return;
+  }
+  float left = points[0].x, right = points[0].x, top = points[0].y, bottom = points[0].y;
+  for (int i = 1; i < count; i++)
+  {
+    left = fminf(left, points[i].x);
+    right = fmaxf(right, points[i].x);
+    top = fminf(top, points[i].y);
+    bottom = fmaxf(bottom, points[i].y);
+  }
+  const float reach = softness / 2;
+  int spanCount = Topology::getSpatialIndex().queryRect(left - reach, top - reach, right + reach, bottom + reach,
+                                                        spans, MAX_SPANS);
+  fill(
+      spanCount, [&](const LedPosition &p)
+      {
+        // Nearest edge for the distance, crossings to the right for inside
+        float nearest = SpatialIndex::ANY_DISTANCE;
+        bool inside = false;
+        for (int i = 0, j = count - 1; i < count; j = i++)
+        {
+          const LedPosition &a = points[i];
+          const LedPosition &b = points[j];
+          nearest = fminf(nearest, distanceSquared(p.x, p.y, a.x, a.y, b.x, b.y));
+          if ((a.y > p.y) != (b.y > p.y) && p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y))
+          {
+            inside = !inside;
+          }
+        }
+        float distance = sqrtf(nearest);
+        return inside ? distance : -distance; },
+      color);
+}
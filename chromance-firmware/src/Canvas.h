@@ -0,0 +1,64 @@
+#ifndef CANVAS_H
+#define CANVAS_H
+
+#include <Arduino.h>
+#include "Constants.h"
+#include "Topology.h"
+#include "AnimationLayer.h"
+
+/*
+Vector drawing onto the LEDs: lines, discs, rings and filled polygons in wall
+coordinates (nodePositions units, y down, as Topology::getLedPosition).
+
+Each shape asks the spatial index (Topology::getSpatialIndex) for the LEDs
+near it, so only those are visited, and works out how far each one is from
+the shape's edge. A ring asks for its band only, skipping the cells in its
+hole. LEDs within half the softness of the edge are partly
+covered, which gives anti-aliased edges that move smoothly between LEDs
+instead of stepping from one to the next.
+
+A colour is blended in by coverage times the canvas opacity, with the same
+modes and sums as layers (see blendLayer). Draws into a frame buffer laid
+out like LedController::ledColors.
+*/
+
+class Canvas
+{
+public:
+  static const int MAX_POINTS = 16; // Polygon corners
+  static constexpr float DEFAULT_SOFTNESS = 1.0f; // About two LEDs along a stock segment
+
+  Canvas(byte *pixels);
+
+  void setBlend(BlendMode mode) { blend = mode; }
+  void setOpacity(byte value) { opacity = value; }
+  void setSoftness(float units) { softness = units > 0.01f ? units : 0.01f; } // Width of the edge ramp
+
+  // uint32_t colours are 0xRRGGBB, as LedController::ColorHSV gives them
+  void line(float x0, float y0, float x1, float y1, float width, uint32_t color); // Round ends
+  void disc(float x, float y, float radius, uint32_t color);
+  void ring(float x, float y, float radius, float width, uint32_t color);
+  // Filled, even-odd; points past MAX_POINTS are ignored
+  void polygon(const LedPosition *points, int count, uint32_t color);
+
+  // LEDs the last shape changed, and the LEDs it looked at to find them
+  int getLastCovered() const { return covered; }
+  int getLastTested() const { return tested; }
+
+private:
+  static const int MAX_SPANS = Constants::NUMBER_OF_SEGMENTS * 2;
+
+  byte *pixels;
+  BlendMode blend;
+  byte opacity;
+  float softness;
+  int covered;
+  int tested;
+  LedSpan spans[MAX_SPANS];
+
+  template <typename Edge>
+  void fill(int count, Edge edge, uint32_t color);
+  void plot(int segment, int led, float coverage, uint32_t color);
+};
+
+#endif // CANVAS_H
@@ -3,6 +3,9 @@
 #include "animations/Animation.h"
 #include "WebAssets.h"
 #include "Topology.h"
+#include "Palette.h"
+#include "animations/ShaderAnimation.h"
+#include <SPIFFS.h>
 
 ChromanceWebServer::ChromanceWebServer(AnimationController &animationController, Configuration &configuration)
     : server(80), ws("/ws"), animationController(animationController), configuration(configuration)
@@ -47,14 +50,13 @@ void ChromanceWebServer::setupRoutes()
     server.on("/api/animation", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
               {
         JsonDocument doc;
-        deserializeJson(doc, data);
+        deserializeJson(doc, data, len);
 
         if (doc["id"].is<int>()) {
-            int id = doc["id"];
-            // Disable auto switching if manually selecting
-            animationController.setAutoSwitching(false);
-            animationController.changeAnimation(id);
-            request->send(200, "application/json", "{\"status\":\"ok\"}");
+            AnimationCommand command = {};
+            command.type = COMMAND_CHANGE_ANIMATION;
+            command.animation = doc["id"];
+            postCommand(request, command);
         } else {
             request->send(400, "application/json", "{\"status\":\"error\", \"message\":\"Missing id\"}");
         } });
@@ -63,13 +65,13 @@ void ChromanceWebServer::setupRoutes()
     server.on("/api/autoswitch", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
               {
         JsonDocument doc;
-        deserializeJson(doc, data);
+        deserializeJson(doc, data, len);
 
         if (doc["enabled"].is<bool>()) {
-            bool enabled = doc["enabled"];
-            animationController.setAutoSwitching(enabled);
-            request->send(200, "application/json", "{\"status\":\"ok\"}");
-            this->broadcastStatus();
+            AnimationCommand command = {};
+            command.type = COMMAND_SET_AUTO_SWITCHING;
+            command.enabled = doc["enabled"];
+            postCommand(request, command);
         } else {
             request->send(400, "application/json", "{\"status\":\"error\", \"message\":\"Missing enabled\"}");
         } });
@@ -78,83 +80,226 @@ void ChromanceWebServer::setupRoutes()
     server.on("/api/sleep", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
               {
         JsonDocument doc;
-        deserializeJson(doc, data);
+        deserializeJson(doc, data, len);
 
         if (doc["enabled"].is<bool>()) {
-            bool enabled = doc["enabled"];
-            configuration.setSleepEnabled(enabled);
-            request->send(200, "application/json", "{\"status\":\"ok\"}");
-            this->broadcastStatus();
+            JsonDocument global;
+            global["sleepEnabled"] = doc["enabled"].as<bool>();
+
+            AnimationCommand command = {};
+            command.type = COMMAND_SET_GLOBAL_CONFIG;
+            serializeJson(global, command.payload, sizeof(command.payload));
+            postCommand(request, command);
         } else {
             request->send(400, "application/json", "{\"status\":\"error\", \"message\":\"Missing enabled\"}");
         } });
 
-    // API Get Global Config
+    // API Get Global Config, as the render core last published it
     server.on("/api/config/global", HTTP_GET, [this](AsyncWebServerRequest *request)
               {
-        AsyncResponseStream *response = request->beginResponseStream("application/json");
-        JsonDocument doc;
-        JsonObject obj = doc.to<JsonObject>();
-        configuration.serialize(obj);
-        
-        JsonArray anims = obj.createNestedArray("animations");
-        int count = animationController.getAnimationCount();
-        for (int i = 0; i < count; i++) {
-            Animation *anim = animationController.getAnimation(i);
-            if (anim != nullptr) {
-                JsonObject animObj = anims.add<JsonObject>();
-                animObj["id"] = i;
-                animObj["name"] = anim->getName();
-                animObj["enabled"] = anim->isEnabled();
-            }
+        const AnimationController::ConfigSnapshot &snapshot = animationController.readConfigSnapshot();
+        if (!snapshot.published) {
+            request->send(503, "application/json", "{\"status\":\"error\", \"message\":\"Busy\"}");
+            return;
         }
-        
-        serializeJson(doc, *response);
-        request->send(response); });
+        request->send(200, "application/json", snapshot.global); });
 
     // API Set Global Config
     server.on("/api/config/global", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
               {
         JsonDocument doc;
-        deserializeJson(doc, data);
-        configuration.deserialize(doc.as<JsonObject>());
+        deserializeJson(doc, data, len);
+
+        // Split into one command for the global scalars and one per animation
+        // so each fits a fixed-size queue slot. The whole request is rejected
+        // up front if the queue cannot take all of it.
+        JsonArray anims = doc["animations"];
+        size_t needed = 2 + (anims.isNull() ? 0 : anims.size());
+        if (animationController.getFreeCommandSlots() < needed) {
+            request->send(503, "application/json", "{\"status\":\"error\", \"message\":\"Busy\"}");
+            return;
+        }
+
+        JsonDocument global;
+        if (doc["sleepEnabled"].is<bool>()) {
+            global["sleepEnabled"] = doc["sleepEnabled"].as<bool>();
+        }
+        if (doc["rainbowBrightness"].is<int>()) {
+            global["rainbowBrightness"] = doc["rainbowBrightness"].as<int>();
+        }
+        if (doc["syncRole"].is<int>()) {
+            global["syncRole"] = doc["syncRole"].as<int>();
+        }
 
-        if (doc["animations"].is<JsonArray>()) {
-            JsonArray anims = doc["animations"];
+        AnimationCommand command = {};
+        command.type = COMMAND_SET_GLOBAL_CONFIG;
+        serializeJson(global, command.payload, sizeof(command.payload));
+        animationController.postCommand(command);
+
+        if (!anims.isNull()) {
             for (JsonObject a : anims) {
                 if (a["id"].is<int>() && a["enabled"].is<bool>()) {
-                    int id = a["id"];
-                    bool enabled = a["enabled"];
-                    Animation* anim = animationController.getAnimation(id);
-                    if (anim) {
-                         // We can hack setConfig to set enabled, 
-                         // or ideally Animation class would have a setEnabled method.
-                         // But for now, let's use the JsonObject approach we have on Animation base class.
-                         // Wait, getConfig sets "enabled". setConfig checks for "enabled".
-                         // So we can just call setConfig with this object.
-                         anim->setConfig(a);
-                    }
+                    JsonDocument animDoc;
+                    animDoc["enabled"] = a["enabled"].as<bool>();
+
+                    AnimationCommand animCommand = {};
+                    animCommand.type = COMMAND_SET_ANIMATION_CONFIG;
+                    animCommand.animation = a["id"];
+                    serializeJson(animDoc, animCommand.payload, sizeof(animCommand.payload));
+                    animationController.postCommand(animCommand);
                 }
             }
-            animationController.recalculateAutoPulseTypes();
         }
 
-        this->broadcastStatus();
+        AnimationCommand save = {};
+        save.type = COMMAND_SAVE_CONFIGURATION;
+        postCommand(request, save); });
+
+    // API Get Layers
+    server.on("/api/layers", HTTP_GET, [this](AsyncWebServerRequest *request)
+              {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        response->print(getLayersJson());
+        request->send(response); });
+
+    // API Set Layer. The body may come in several chunks; it is collected
+    // and queued once it is all here.
+    server.on("/api/layers", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+              {
+        if (total >= AnimationCommand::MAX_PAYLOAD) {
+            if (index == 0) {
+                request->send(413, "application/json", "{\"status\":\"error\", \"message\":\"Layer settings too large\"}");
+            }
+            return;
+        }
+        memcpy(bodyCommand.payload + index, data, len);
+        if (index + len < total) {
+            return;
+        }
+        bodyCommand.payload[total] = 0;
+        bodyCommand.type = COMMAND_SET_LAYER;
+        postCommand(request, bodyCommand); });
+
+    // API Record Sequence
+    server.on("/api/record", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+              {
+        JsonDocument doc;
+        deserializeJson(doc, data, len);
+
+        if (doc["frames"].is<int>()) {
+            AnimationCommand command = {};
+            command.type = COMMAND_RECORD_SEQUENCE;
+            serializeJson(doc, command.payload, sizeof(command.payload));
+            postCommand(request, command);
+        } else {
+            request->send(400, "application/json", "{\"status\":\"error\", \"message\":\"Missing frames\"}");
+        } });
+
+    // API Get Palettes, the names animation configs take for "palette"
+    server.on("/api/palettes", HTTP_GET, [](AsyncWebServerRequest *request)
+              {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        JsonDocument doc;
+        JsonArray names = doc["palettes"].to<JsonArray>();
+        for (int i = 0; i < Palettes::COUNT; i++) {
+            names.add(Palettes::getName(i));
+        }
+        serializeJson(doc, *response);
+        request->send(response); });
+
+    // API Get Realtime: whether external pixels have the wall, and from whom
+    server.on("/api/realtime", HTTP_GET, [this](AsyncWebServerRequest *request)
+              {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        JsonDocument doc;
+        doc["active"] = pixelReceiver && pixelReceiver->isActive();
+        doc["badPackets"] = pixelReceiver ? pixelReceiver->getBadPackets() : 0;
+        JsonArray sources = doc["sources"].to<JsonArray>();
+        unsigned long now = millis();
+        for (int i = 0; pixelReceiver && i < pixelReceiver->getSourceCount(); i++) {
+            const PixelSourceStats &stats = pixelReceiver->getSource(i);
+            // The address is in network order, first octet lowest in memory
+            const uint8_t *octets = (const uint8_t *)&stats.address;
+            char address[16];
+            snprintf(address, sizeof(address), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+            JsonObject source = sources.add<JsonObject>();
+            source["address"] = address;
+            source["protocol"] = PixelReceiver::getProtocolName(stats.protocol);
+            source["packets"] = stats.packets;
+            source["frames"] = stats.frames;
+            source["sequenceErrors"] = stats.sequenceErrors;
+            source["averageLatencyUs"] = stats.averageLatency();
+            source["worstLatencyUs"] = stats.worstLatency;
+            source["ageMs"] = now - stats.lastSeen;
+        }
+        serializeJson(doc, *response);
+        request->send(response); });
+
+    // API Get Shader, the source the Shader animation runs
+    server.on("/api/shader", HTTP_GET, [this](AsyncWebServerRequest *request)
+              {
+        ShaderAnimation::readSource(shaderSource);
+        request->send(200, "text/plain", shaderSource); });
+
+    // API Set Shader: the body is the source, compiled here so mistakes come
+    // back straight away, then kept on SPIFFS and started
+    server.on("/api/shader", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+              {
+        if (total > (size_t)ShaderCompiler::MAX_SOURCE) {
+            if (index == 0) {
+                request->send(413, "application/json", "{\"status\":\"error\", \"message\":\"Shader too long\"}");
+            }
+            return;
+        }
+        memcpy(shaderSource + index, data, len);
+        if (index + len < total) {
+            return;
+        }
+        shaderSource[total] = '\0';
+
+        if (!shaderCompiler.compile(shaderSource, shaderProgram)) {
+            AsyncResponseStream *response = request->beginResponseStream("application/json");
+            response->setCode(400);
+            JsonDocument doc;
+            doc["status"] = "error";
+            doc["message"] = shaderCompiler.getError();
+            doc["position"] = shaderCompiler.getErrorPosition();
+            serializeJson(doc, *response);
+            request->send(response);
+            return;
+        }
+
+        File file = SPIFFS.open(ShaderAnimation::PATH, FILE_WRITE);
+        if (!file) {
+            request->send(500, "application/json", "{\"status\":\"error\", \"message\":\"Cannot save shader\"}");
+            return;
+        }
+        file.write((const uint8_t *)shaderSource, total);
+        file.close();
+
+        // Starting it again reloads the file, if it is already running too
+        for (int i = 0; i < animationController.getAnimationCount(); i++) {
+            Animation *anim = animationController.getAnimation(i);
+            if (anim && strcmp(anim->getName(), "Shader") == 0) {
+                AnimationCommand command = {};
+                command.type = COMMAND_CHANGE_ANIMATION;
+                command.animation = i;
+                postCommand(request, command);
+                return;
+            }
+        }
         request->send(200, "application/json", "{\"status\":\"ok\"}"); });
 
-    // API Get Config
+    // API Get Config, as the render core last published it
     server.on("/api/config", HTTP_GET, [this](AsyncWebServerRequest *request)
               {
         if (request->hasParam("id")) {
             int id = request->getParam("id")->value().toInt();
-            Animation* anim = animationController.getAnimation(id);
-            if (anim) {
-                 AsyncResponseStream *response = request->beginResponseStream("application/json");
-                 JsonDocument doc;
-                 JsonObject obj = doc.to<JsonObject>();
-                 anim->getConfig(obj);
-                 serializeJson(doc, *response);
-                 request->send(response);
+            const AnimationController::ConfigSnapshot &snapshot = animationController.readConfigSnapshot();
+            if (!snapshot.published) {
+                request->send(503, "application/json", "{\"status\":\"error\", \"message\":\"Busy\"}");
+            } else if (id >= 0 && id < (int)snapshot.animations.size() && snapshot.animations[id].length() > 0) {
+                request->send(200, "application/json", snapshot.animations[id]);
             } else {
                 request->send(404, "application/json", "{\"status\":\"error\", \"message\":\"Animation not found\"}");
             }
@@ -162,25 +307,49 @@ void ChromanceWebServer::setupRoutes()
              request->send(400, "application/json", "{\"status\":\"error\", \"message\":\"Missing id\"}");
         } });
 
-    // API Set Config
+    // API Set Config. Collected like /api/layers before it is queued.
     server.on("/api/config", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
               {
-        if (request->hasParam("id")) {
-            int id = request->getParam("id")->value().toInt();
-            Animation* anim = animationController.getAnimation(id);
-            if (anim) {
-                JsonDocument doc;
-                deserializeJson(doc, data);
-                anim->setConfig(doc.as<JsonObject>());
-                animationController.recalculateAutoPulseTypes();
-                this->broadcastStatus();
-                request->send(200, "application/json", "{\"status\":\"ok\"}");
-            } else {
+        if (!request->hasParam("id")) {
+            if (index == 0) {
+                request->send(400, "application/json", "{\"status\":\"error\", \"message\":\"Missing id\"}");
+            }
+            return;
+        }
+        int id = request->getParam("id")->value().toInt();
+        if (!animationController.getAnimation(id)) {
+            if (index == 0) {
                 request->send(404, "application/json", "{\"status\":\"error\", \"message\":\"Animation not found\"}");
             }
-        } else {
-             request->send(400, "application/json", "{\"status\":\"error\", \"message\":\"Missing id\"}");
-        } });
+            return;
+        }
+        if (total >= AnimationCommand::MAX_PAYLOAD) {
+            if (index == 0) {
+                request->send(413, "application/json", "{\"status\":\"error\", \"message\":\"Config too large\"}");
+            }
+            return;
+        }
+        memcpy(bodyCommand.payload + index, data, len);
+        if (index + len < total) {
+            return;
+        }
+        bodyCommand.payload[total] = 0;
+        bodyCommand.type = COMMAND_SET_ANIMATION_CONFIG;
+        bodyCommand.animation = id;
+        postCommand(request, bodyCommand); });
+}
+
+void ChromanceWebServer::postCommand(AsyncWebServerRequest *request, const AnimationCommand &command)
+{
+    // Never wait for the render core; let the client retry instead
+    if (animationController.postCommand(command))
+    {
+        request->send(200, "application/json", "{\"status\":\"ok\"}");
+    }
+    else
+    {
+        request->send(503, "application/json", "{\"status\":\"error\", \"message\":\"Busy\"}");
+    }
 }
 
 void ChromanceWebServer::onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
@@ -273,87 +442,32 @@ void ChromanceWebServer::broadcastLedData()
         return;
     lastUpdate = millis();
 
-    size_t bufferSize = Constants::NUMBER_OF_SEGMENTS * Constants::LEDS_PER_SEGMENT * 3;
     LedController &led = animationController.getLedController();
-    uint8_t *currentData = &led.ledColors[0][0][0];
-
-    // Initialize lastLedData if empty
-    if (lastLedData.empty())
-    {
-        lastLedData.resize(bufferSize, 0);
-    }
-    // Calculate Diff
-    // Format: [Type(1), Count(2), [Index(2), R, G, B]...]
-    std::vector<uint8_t> diffPayload;
-
-    // Reuse diffPayload buffer
-    diffPayload.clear();
-    diffPayload.push_back(1); // Type 1 = Diff
-    diffPayload.push_back(0); // Count High placeholder
-    diffPayload.push_back(0); // Count Low placeholder
-
-    uint16_t changeCount = 0;
-    // Iterate pixels
-    for (size_t i = 0; i < bufferSize / 3; i++)
+    if (frameDiff.getPixelCount() != Constants::NUM_OF_PIXELS)
     {
-        size_t idx = i * 3;
-        if (currentData[idx] != lastLedData[idx] ||
-            currentData[idx + 1] != lastLedData[idx + 1] ||
-            currentData[idx + 2] != lastLedData[idx + 2])
-        {
-            changeCount++;
-            // Index (2 bytes)
-            diffPayload.push_back((i >> 8) & 0xFF);
-            diffPayload.push_back(i & 0xFF);
-            // RGB
-            diffPayload.push_back(currentData[idx]);
-            diffPayload.push_back(currentData[idx + 1]);
-            diffPayload.push_back(currentData[idx + 2]);
-        }
+        frameDiff.begin(Constants::NUM_OF_PIXELS);
     }
 
-    // Update count in payload
-    diffPayload[1] = (changeCount >> 8) & 0xFF;
-    diffPayload[2] = changeCount & 0xFF;
-
-    // Determine if we should send Full or Diff
-    // Full payload size: 1 (Type) + bufferSize
-    // Diff payload size: diffPayload.size()
-    bool preferFull = (diffPayload.size() > (bufferSize + 1));
-
-    // Prepare Full Payload if needed
-    // We construct it on demand to avoid memory usage if not needed,
-    // or we could use a static buffer.
-    // Let's just create a vector for it if we need it.
-    std::vector<uint8_t> fullPayload;
-    if (preferFull || !clientsNeedingFullFrame.empty())
+    // Runs of changed pixels, or the whole frame if that is smaller (see FrameDiff.h)
+    size_t diffLength = frameDiff.encode(led.ledColors);
+    size_t fullLength = 0;
+    if (!clientsNeedingFullFrame.empty())
     {
-        fullPayload.clear();
-        fullPayload.reserve(bufferSize + 1);
-        fullPayload.push_back(0); // Type 0 = Full
-        fullPayload.insert(fullPayload.end(), currentData, currentData + bufferSize);
+        fullLength = frameDiff.encodeFull(led.ledColors);
     }
 
     for (uint32_t id : emulatorClients)
     {
-        bool needsFull = clientsNeedingFullFrame.count(id) > 0;
-
-        if (needsFull || preferFull)
+        if (clientsNeedingFullFrame.count(id) > 0)
         {
-            ws.binary(id, fullPayload.data(), fullPayload.size());
-            if (needsFull)
-            {
-                clientsNeedingFullFrame.erase(id);
-            }
+            ws.binary(id, frameDiff.getFullFrame(), fullLength);
+            clientsNeedingFullFrame.erase(id);
         }
         else
         {
-            ws.binary(id, diffPayload.data(), diffPayload.size());
+            ws.binary(id, frameDiff.getMessage(), diffLength);
         }
     }
-
-    // Update lastLedData
-    memcpy(lastLedData.data(), currentData, bufferSize);
 }
 
 String ChromanceWebServer::getStatusJson()
@@ -384,6 +498,43 @@ String ChromanceWebServer::getStatusJson()
     return jsonString;
 }
 
+String ChromanceWebServer::getLayersJson()
+{
+    // The render core's copy from the last frame boundary
+    const AnimationController::LayerSnapshot &snapshot = animationController.readLayerSnapshot();
+    JsonDocument doc;
+    JsonObject primary = doc["primary"].to<JsonObject>();
+    primary["animation"] = snapshot.primaryAnimation;
+    primary["blend"] = getBlendModeName(snapshot.primaryBlend);
+    primary["opacity"] = snapshot.primaryOpacity;
+
+    JsonArray layers = doc["layers"].to<JsonArray>();
+    for (int i = 0; i < AnimationController::MAX_LAYERS; i++)
+    {
+        const LayerSettings &settings = snapshot.settings[i];
+        JsonObject l = layers.add<JsonObject>();
+        l["slot"] = i;
+        l["animation"] = settings.animation;
+        Animation *anim = animationController.getAnimation(settings.animation);
+        if (anim != nullptr)
+        {
+            l["name"] = anim->getName();
+        }
+        l["position"] = settings.position == LAYER_FOREGROUND ? "foreground" : "background";
+        l["blend"] = getBlendModeName(settings.blend);
+        l["opacity"] = settings.opacity;
+        l["enabled"] = settings.enabled;
+        l["budget"] = settings.budgetMicros;
+        l["cost"] = snapshot.lastCostMicros[i];
+        l["rendered"] = snapshot.renderedFrames[i];
+        l["skipped"] = snapshot.skippedFrames[i];
+    }
+
+    String jsonString;
+    serializeJson(doc, jsonString);
+    return jsonString;
+}
+
 String ChromanceWebServer::getEmulatorConfigJson()
 {
     JsonDocument doc;
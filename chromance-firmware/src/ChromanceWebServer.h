@@ -7,6 +7,9 @@
 #include <set>
 #include "AnimationController.h"
 #include "Configuration.h"
+#include "FrameDiff.h"
+#include "ShaderCompiler.h"
+#include "PixelReceiver.h"
 
 class ChromanceWebServer
 {
@@ -14,6 +17,8 @@ public:
     ChromanceWebServer(AnimationController &animationController, Configuration &configuration);
     void begin();
     void broadcastLedData();
+    // Reported at /api/realtime; optional
+    void setPixelReceiver(PixelReceiver *receiver) { pixelReceiver = receiver; }
 
 private:
     AsyncWebServer server;
@@ -22,13 +27,23 @@ private:
     Configuration &configuration;
     std::vector<uint32_t> emulatorClients;
     std::set<uint32_t> clientsNeedingFullFrame;
-    std::vector<uint8_t> lastLedData;
+    FrameDiffEncoder frameDiff;
+    // Shader uploads are compiled here to check them before they are saved
+    ShaderCompiler shaderCompiler;
+    ShaderProgram shaderProgram;
+    char shaderSource[ShaderCompiler::MAX_SOURCE + 1];
+    // JSON bodies for /api/layers and /api/config are collected here until
+    // the last chunk arrives. Handlers all run on the AsyncTCP task.
+    AnimationCommand bodyCommand = {};
+    PixelReceiver *pixelReceiver = nullptr;
 
     void setupRoutes();
     void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
     void handleWebSocketMessage(AsyncWebSocketClient *client, void *arg, uint8_t *data, size_t len);
     void broadcastStatus();
+    void postCommand(AsyncWebServerRequest *request, const AnimationCommand &command);
     String getStatusJson();
+    String getLayersJson();
     String getEmulatorConfigJson();
 
     // Friend function or access to LedController if needed, but animationController has it.
@@ -0,0 +1,74 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <Arduino.h>
+
+// Time source for everything that animates. The controller, animations and
+// ripples read time through a Clock instead of calling millis() so the
+// emulator and tests can run the engine faster than real time.
+class Clock
+{
+public:
+  virtual ~Clock() {}
+  virtual unsigned long now() = 0; // Milliseconds, monotonic
+};
+
+// Wall clock of the board (millis())
+class RealTimeClock : public Clock
+{
+public:
+  unsigned long now() override { return millis(); }
+};
+
+// Only moves when told to. step() advances by one frame so a render loop can
+// simulate hours of animation in seconds, fully deterministically.
+class VirtualClock : public Clock
+{
+public:
+  VirtualClock(unsigned long frameMillis = 33, unsigned long start = 0) : frameMillis(frameMillis), current(start) {}
+
+  unsigned long now() override { return current; }
+  void step() { current += frameMillis; }
+  void advance(unsigned long ms) { current += ms; }
+  void set(unsigned long ms) { current = ms; }
+
+  unsigned long getFrameMillis() const { return frameMillis; }
+  void setFrameMillis(unsigned long ms) { frameMillis = ms; }
+
+private:
+  unsigned long frameMillis;
+  unsigned long current;
+};
+
+// Runs another clock faster or slower. Changing the scale rebases the
+// clock so time never jumps backwards.
+class ScaledClock : public Clock
+{
+public:
+  ScaledClock(Clock &source, float scale = 1.0f) : source(source), scale(scale), sourceOrigin(source.now()), origin(0) {}
+
+  unsigned long now() override
+  {
+    // In double: a float stops counting single milliseconds after 4.6 hours
+    return origin + (unsigned long)((double)(source.now() - sourceOrigin) * scale);
+  }
+
+  void setScale(float newScale)
+  {
+    origin = now();
+    sourceOrigin = source.now();
+    scale = newScale;
+  }
+  float getScale() const { return scale; }
+
+  // Jump ahead without waiting for the source clock
+  void advance(unsigned long ms) { origin += ms; }
+
+private:
+  Clock &source;
+  float scale;
+  unsigned long sourceOrigin;
+  unsigned long origin;
+};
+
+#endif // CLOCK_H
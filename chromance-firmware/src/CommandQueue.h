@@ -0,0 +1,125 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Single-producer/single-consumer ring buffer.
+// push() must only be called from one task (the web/network side) and pop()
+// only from the render loop. Neither side blocks or takes a lock: the indices
+// are published with release/acquire ordering so a slot is never read before
+// it has been fully written.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  SpscQueue() : head(0), tail(0) {}
+
+  // Returns false (without waiting) when the queue is full
+  bool push(const T &item)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    if (h - t == Capacity)
+    {
+      return false;
+    }
+    slots[h & (Capacity - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false when there is nothing to consume
+  bool pop(T &item)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    if (t == h)
+    {
+      return false;
+    }
+    item = slots[t & (Capacity - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Conservative when called by the producer: the consumer can only free slots
+  size_t freeSlots() const
+  {
+    return Capacity - (head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+  }
+
+  bool empty() const
+  {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+
+private:
+  T slots[Capacity];
+  std::atomic<size_t> head; // Written by the producer only
+  std::atomic<size_t> tail; // Written by the consumer only
+};
+
+// Triple buffer for state one task publishes and another reads.
+// The writer fills writable() and then publish()es it; the reader's read()
+// takes the newest published copy, which stays untouched until its next
+// read(). Neither side blocks, and the reader never sees a half-written copy.
+// writable() holds whatever was published two copies ago, so the writer
+// fills it in full each time.
+template <typename T>
+class SnapshotBuffer
+{
+public:
+  SnapshotBuffer() : back(0), front(1), middle(2) {}
+
+  T &writable() { return slots[back]; }
+
+  void publish()
+  {
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  const T &read()
+  {
+    if (middle.load(std::memory_order_relaxed) & FRESH)
+    {
+      front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+    }
+    return slots[front];
+  }
+
+private:
+  static const uint8_t INDEX = 0x03;
+  static const uint8_t FRESH = 0x04; // Set in middle when the writer has swapped in a new copy
+
+  T slots[3];
+  uint8_t back;                // Writer only
+  uint8_t front;               // Reader only
+  std::atomic<uint8_t> middle; // Handed between them
+};
+
+enum CommandType : uint8_t
+{
+  COMMAND_CHANGE_ANIMATION,     // animation = new animation index
+  COMMAND_SET_AUTO_SWITCHING,   // enabled = new state
+  COMMAND_SET_ANIMATION_CONFIG, // animation = index, payload = JSON object for setConfig()
+  COMMAND_SET_GLOBAL_CONFIG,    // payload = JSON object for Configuration::deserialize()
+  COMMAND_SAVE_CONFIGURATION,   // Persist the current configuration to flash
+  COMMAND_SET_LAYER,            // payload = JSON layer settings (see /api/layers)
+  COMMAND_RECORD_SEQUENCE       // payload = {"frames": n, "interval": ms}
+};
+
+// Commands carry their JSON inline so the queue never touches the heap
+struct AnimationCommand
+{
+  static const size_t MAX_PAYLOAD = 160;
+
+  CommandType type;
+  int16_t animation;
+  bool enabled;
+  char payload[MAX_PAYLOAD];
+};
+
+#endif // COMMAND_QUEUE_H
@@ -3,7 +3,7 @@
 #include "animations/Animation.h"
 #include "Constants.h"
 
-Configuration::Configuration() : sleepEnabled(false), rainbowBrightness(30)
+Configuration::Configuration() : sleepEnabled(false), rainbowBrightness(30), syncRole(SYNC_OFF)
 {
 }
 
@@ -25,10 +25,20 @@ void Configuration::setRainbowBrightness(int brightness)
     }
 }
 
+void Configuration::setSyncRole(SyncRole role)
+{
+    if (syncRole != role && role >= SYNC_OFF && role < SYNC_ROLE_COUNT)
+    {
+        syncRole = role;
+        save();
+    }
+}
+
 void Configuration::serialize(JsonObject &doc)
 {
     doc["sleepEnabled"] = sleepEnabled;
     doc["rainbowBrightness"] = rainbowBrightness;
+    doc["syncRole"] = (int)syncRole;
 
     if (animationController) {
         JsonArray anims = doc.createNestedArray("animations");
@@ -65,6 +75,15 @@ void Configuration::deserialize(const JsonObject &doc)
             changed = true;
         }
     }
+    if (doc["syncRole"].is<int>())
+    {
+        int newRole = doc["syncRole"];
+        if (newRole >= SYNC_OFF && newRole < SYNC_ROLE_COUNT && syncRole != newRole)
+        {
+            syncRole = (SyncRole)newRole;
+            changed = true;
+        }
+    }
 
     if (animationController && doc["animations"].is<JsonArray>()) {
         JsonArray anims = doc["animations"];
@@ -142,6 +161,10 @@ void Configuration::load()
     {
         rainbowBrightness = doc["rainbowBrightness"];
     }
+    if (doc["syncRole"].is<int>() && doc["syncRole"] >= SYNC_OFF && doc["syncRole"] < SYNC_ROLE_COUNT)
+    {
+        syncRole = (SyncRole)doc["syncRole"].as<int>();
+    }
 
     if (animationController && doc["animations"].is<JsonArray>()) {
         JsonArray anims = doc["animations"];
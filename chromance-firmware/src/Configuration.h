@@ -6,6 +6,16 @@
 
 class AnimationController; // Forward declaration
 
+// What this wall does with other walls (see WallSync)
+enum SyncRole
+{
+    SYNC_OFF,
+    SYNC_LEADER,   // Others render the same frames from its seeds and clock
+    SYNC_STREAM,   // Sends its pixels to the others
+    SYNC_FOLLOWER, // Shows what a leader sends, or its own animations without one
+    SYNC_ROLE_COUNT
+};
+
 class Configuration
 {
 public:
@@ -19,6 +29,9 @@ public:
     int getRainbowBrightness() const { return rainbowBrightness; }
     void setRainbowBrightness(int brightness);
 
+    SyncRole getSyncRole() const { return syncRole; }
+    void setSyncRole(SyncRole role);
+
     void serialize(JsonObject &doc);
     void deserialize(const JsonObject &doc);
 
@@ -28,6 +41,7 @@ public:
 private:
     bool sleepEnabled;
     int rainbowBrightness;
+    SyncRole syncRole;
     const char *configFilename = "/config.json";
     AnimationController* animationController = nullptr;
 };
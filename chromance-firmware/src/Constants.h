@@ -20,15 +20,30 @@ namespace Constants
   constexpr int RIPPLE_TIMEOUT = NUMBER_OF_RIPPLES * 1000;
   constexpr int ANIMATION_TIME = 3000;
 
-  constexpr int NUMBER_OF_NODES = 25;
+// Wall dimensions. The defaults are the stock 40-segment wall, whose layout
+// is built in (see Topology). A different wall is built with these overridden
+// (e.g. -D CHROMANCE_SEGMENTS=110) and a matching layout file on SPIFFS.
+#ifndef CHROMANCE_NODES
+#define CHROMANCE_NODES 25
+#endif
+#ifndef CHROMANCE_SEGMENTS
+#define CHROMANCE_SEGMENTS 40
+#endif
+#ifndef CHROMANCE_LEDS_PER_SEGMENT
+#define CHROMANCE_LEDS_PER_SEGMENT 14
+#endif
+
+  constexpr int NUMBER_OF_NODES = CHROMANCE_NODES;
   constexpr int MAX_PATHS_PER_NODE = 6;
 
-  constexpr int NUMBER_OF_SEGMENTS = 40;
+  constexpr int NUMBER_OF_SEGMENTS = CHROMANCE_SEGMENTS;
   constexpr int SIDES_PER_SEGMENT = 2;
-  constexpr int LEDS_PER_SEGMENT = 14;
+  constexpr int LEDS_PER_SEGMENT = CHROMANCE_LEDS_PER_SEGMENT; // Render resolution; see TopologyLayout
   constexpr int NUM_OF_PIXELS = NUMBER_OF_SEGMENTS * LEDS_PER_SEGMENT;
 
-  constexpr int NUMBER_OF_STRIPS = 4;
+  constexpr int NUMBER_OF_STRIPS = 4;  // On the stock wall; a layout file may drive any number
+  constexpr int MAX_STRIPS = 255;      // Strip indices are stored in a byte
+  constexpr int MAX_PIXELS = 65535;    // Frame buffer indices are stored in 16 bits
 
   constexpr int BLUE_LENGTH = 154;
   constexpr int GREEN_LENGTH = 168;
@@ -0,0 +1,58 @@
+#include "FixedMath.h"
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace FixedMath
+{
+  int16_t sineTable[SINE_SIZE];
+
+  namespace
+  {
+    // sqrt(i / 64) in 17.15 for i in [64, 256]: the roots of 1.0 to 4.0
+    const int SQRT_FIRST = 64;
+    const int SQRT_LAST = 256;
+    uint32_t sqrtTable[SQRT_LAST - SQRT_FIRST + 1];
+
+    // Filled before setup() or any animation runs
+    struct TableInit
+    {
+      TableInit()
+      {
+        for (int i = 0; i < SINE_SIZE; i++)
+        {
+          sineTable[i] = (int16_t)lround(sin(2.0 * M_PI * i / SINE_SIZE) * ONE);
+        }
+        for (int i = SQRT_FIRST; i <= SQRT_LAST; i++)
+        {
+          sqrtTable[i - SQRT_FIRST] = (uint32_t)lround(sqrt(i / 64.0) * 32768.0);
+        }
+      }
+    } tableInit;
+  }
+
+  Angle fromRadians(double radians)
+  {
+    double turns = radians / (2.0 * M_PI);
+    turns -= floor(turns);
+    return (Angle)lround(turns * TURN) & (TURN - 1);
+  }
+
+  uint32_t sqrt32(uint32_t value)
+  {
+    if (value == 0)
+    {
+      return 0;
+    }
+    // Shift by an even amount so the top two bits hold the leading one; the
+    // root of that is a table entry and the shift halves on the way back
+    int shift = __builtin_clz(value) & ~1;
+    uint32_t normal = value << shift; // 1.0 to 4.0 in 2.30
+    uint32_t index = (normal >> 24) - SQRT_FIRST;
+    uint32_t fraction = (normal >> 8) & 0xFFFF;
+    uint32_t root = sqrtTable[index] + (((sqrtTable[index + 1] - sqrtTable[index]) * fraction) >> 16);
+    return root >> (shift / 2);
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef FIXED_MATH_H
+#define FIXED_MATH_H
+
+#include <Arduino.h>
+
+/*
+Integer trigonometry for per-LED kernels, so a frame costs table lookups
+instead of float sin/sqrt calls (the ESP32's FPU is slow at both).
+
+Angles are 16.16 fixed point turns: 65536 is a full circle and the integer
+part wraps away, so angles can be added and scaled freely. Sines are Q15
+(32767 is 1.0) from a 1024 entry table, within 0.0031 of the true value.
+Both tables are filled during static initialisation.
+*/
+
+namespace FixedMath
+{
+  typedef int32_t Angle;
+
+  const Angle TURN = 65536;
+  const int32_t ONE = 32767; // 1.0 in Q15
+  const int SINE_BITS = 10;
+  const int SINE_SIZE = 1 << SINE_BITS;
+
+  extern int16_t sineTable[SINE_SIZE]; // sin(2 pi i / SINE_SIZE) in Q15
+
+  inline int16_t sin16(Angle angle)
+  {
+    // Nearest entry: round, then drop the bits between entries and the turns
+    return sineTable[(((uint32_t)angle + (1u << (15 - SINE_BITS))) >> (16 - SINE_BITS)) & (SINE_SIZE - 1)];
+  }
+
+  inline int16_t cos16(Angle angle)
+  {
+    return sin16(angle + TURN / 4);
+  }
+
+  // Whole circles are dropped first, so large arguments keep their precision
+  Angle fromRadians(double radians);
+
+  // Integer square root within one of the exact floor, by table lookup and
+  // interpolation rather than a bit at a time
+  uint32_t sqrt32(uint32_t value);
+}
+
+#endif // FIXED_MATH_H
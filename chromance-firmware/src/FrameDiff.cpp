@@ -0,0 +1,163 @@
+#include "FrameDiff.h"
+
+namespace
+{
+  void writeU24(uint8_t *out, uint32_t value)
+  {
+    out[0] = (value >> 16) & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = value & 0xFF;
+  }
+
+  uint32_t readU24(const uint8_t *in)
+  {
+    return ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+  }
+}
+
+bool FrameDiff::apply(const uint8_t *message, size_t length, uint8_t *rgb, int pixels)
+{
+  if (length < 1)
+  {
+    return false;
+  }
+
+  if (message[0] == TYPE_FULL)
+  {
+    if (length - 1 != (size_t)pixels * 3)
+    {
+      return false;
+    }
+    memcpy(rgb, message + 1, length - 1);
+    return true;
+  }
+
+  if (message[0] != TYPE_RUNS || length < RUNS_HEADER_SIZE)
+  {
+    return false;
+  }
+
+  uint32_t runs = readU24(message + 1);
+  size_t pos = RUNS_HEADER_SIZE;
+  for (uint32_t r = 0; r < runs; r++)
+  {
+    if (pos + RUN_HEADER_SIZE > length)
+    {
+      return false;
+    }
+    uint32_t start = readU24(message + pos);
+    uint32_t count = message[pos + 3];
+    pos += RUN_HEADER_SIZE;
+    if (count == 0 || start + count > (uint32_t)pixels || pos + count * 3 > length)
+    {
+      return false;
+    }
+    memcpy(rgb + start * 3, message + pos, count * 3);
+    pos += count * 3;
+  }
+  return pos == length;
+}
+
+FrameDiffEncoder::FrameDiffEncoder() : pixels(0), previous(nullptr), message(nullptr), full(nullptr)
+{
+}
+
+FrameDiffEncoder::~FrameDiffEncoder()
+{
+  delete[] previous;
+  delete[] message;
+  delete[] full;
+}
+
+void FrameDiffEncoder::begin(int pixelCount)
+{
+  delete[] previous;
+  delete[] message;
+  delete[] full;
+
+  pixels = pixelCount;
+  size_t fullSize = 1 + (size_t)pixels * 3;
+  previous = new uint8_t[pixels * 3 + 1]();
+  message = new uint8_t[fullSize > FrameDiff::RUNS_HEADER_SIZE ? fullSize : FrameDiff::RUNS_HEADER_SIZE];
+  full = new uint8_t[fullSize];
+}
+
+size_t FrameDiffEncoder::encode(const uint8_t *rgb)
+{
+  using namespace FrameDiff;
+
+  const size_t fullSize = 1 + (size_t)pixels * 3;
+  size_t pos = RUNS_HEADER_SIZE;
+  size_t runHeader = 0;
+  uint32_t runs = 0;
+  int runStart = -1; // Open run covers [runStart, runEnd)
+  int runEnd = 0;
+  bool tooBig = false;
+
+  for (int i = 0; i < pixels; i++)
+  {
+    const uint8_t *now = rgb + i * 3;
+    const uint8_t *before = previous + i * 3;
+    if (now[0] == before[0] && now[1] == before[1] && now[2] == before[2])
+    {
+      continue;
+    }
+
+    if (runStart >= 0 && i - runEnd <= 1 && i + 1 - runStart <= MAX_RUN)
+    {
+      // Extend the open run, carrying at most one unchanged pixel
+      size_t bytes = (size_t)(i + 1 - runEnd) * 3;
+      if (pos + bytes > fullSize)
+      {
+        tooBig = true;
+        break;
+      }
+      memcpy(message + pos, rgb + runEnd * 3, bytes);
+      pos += bytes;
+      runEnd = i + 1;
+      continue;
+    }
+
+    if (runStart >= 0)
+    {
+      message[runHeader + 3] = runEnd - runStart;
+    }
+    if (pos + RUN_HEADER_SIZE + 3 > fullSize)
+    {
+      tooBig = true;
+      break;
+    }
+    runHeader = pos;
+    writeU24(message + pos, i);
+    pos += RUN_HEADER_SIZE;
+    memcpy(message + pos, now, 3);
+    pos += 3;
+    runStart = i;
+    runEnd = i + 1;
+    runs++;
+  }
+
+  memcpy(previous, rgb, (size_t)pixels * 3);
+
+  if (tooBig)
+  {
+    message[0] = TYPE_FULL;
+    memcpy(message + 1, rgb, (size_t)pixels * 3);
+    return fullSize;
+  }
+
+  if (runStart >= 0)
+  {
+    message[runHeader + 3] = runEnd - runStart;
+  }
+  message[0] = TYPE_RUNS;
+  writeU24(message + 1, runs);
+  return pos;
+}
+
+size_t FrameDiffEncoder::encodeFull(const uint8_t *rgb)
+{
+  full[0] = FrameDiff::TYPE_FULL;
+  memcpy(full + 1, rgb, (size_t)pixels * 3);
+  return 1 + (size_t)pixels * 3;
+}
@@ -0,0 +1,64 @@
+#ifndef FRAME_DIFF_H
+#define FRAME_DIFF_H
+
+#include <Arduino.h>
+
+/*
+Binary frames sent to the web emulator over the WebSocket, big endian:
+
+  Full (type 0): 0, then RGB for every pixel
+  Runs (type 2): 2, runCount (u24), then for each run:
+                 start (u24), length (u8, 1-255), length RGB triplets
+
+A run covers pixels that changed since the previous frame; one unchanged
+pixel between two changes is sent inside the run, which is cheaper than a
+new run header. Indices are 24 bits, so a frame can hold 16M pixels, and a
+run costs 4 bytes however many pixels it carries. When the runs would be
+bigger than the whole frame, the full frame is sent instead.
+
+(Type 1, the old 16-bit per-pixel diff, is no longer produced.)
+*/
+
+namespace FrameDiff
+{
+  constexpr uint8_t TYPE_FULL = 0;
+  constexpr uint8_t TYPE_RUNS = 2;
+  constexpr int MAX_RUN = 255;
+  constexpr size_t RUNS_HEADER_SIZE = 4;
+  constexpr size_t RUN_HEADER_SIZE = 4;
+
+  // Applies a full or runs message to rgb (pixels triplets). Returns false,
+  // leaving any runs before the fault applied, if the message is malformed.
+  bool apply(const uint8_t *message, size_t length, uint8_t *rgb, int pixels);
+}
+
+class FrameDiffEncoder
+{
+public:
+  FrameDiffEncoder();
+  ~FrameDiffEncoder();
+
+  // Sizes the buffers for frames of this many pixels; the previous frame starts black
+  void begin(int pixels);
+  int getPixelCount() const { return pixels; }
+
+  // Encodes rgb against the previous frame, which it then replaces. The
+  // message is runs, or a full frame when that is smaller.
+  size_t encode(const uint8_t *rgb);
+  const uint8_t *getMessage() const { return message; }
+
+  // A full frame of rgb, for clients that do not have the previous one
+  size_t encodeFull(const uint8_t *rgb);
+  const uint8_t *getFullFrame() const { return full; }
+
+private:
+  int pixels;
+  uint8_t *previous;
+  uint8_t *message; // Never longer than a full frame
+  uint8_t *full;
+
+  FrameDiffEncoder(const FrameDiffEncoder &);
+  FrameDiffEncoder &operator=(const FrameDiffEncoder &);
+};
+
+#endif // FRAME_DIFF_H
@@ -0,0 +1,322 @@
+#include "GraphAutomaton.h"
+#include "Topology.h"
+#include "LedGraph.h"
+#include <Arduino.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+  // Bit planes needed to hold states below this
+  int planesFor(int states)
+  {
+    int planes = 1;
+    while ((1 << planes) < states)
+    {
+      planes++;
+    }
+    return planes;
+  }
+}
+
+GraphAutomaton::GraphAutomaton() : cells(0), words(0), front(0), maskWord(nullptr), mask(nullptr)
+{
+  memset(planes, 0, sizeof(planes));
+  maskStart[0] = 0;
+}
+
+GraphAutomaton::~GraphAutomaton()
+{
+  delete[] maskWord;
+  delete[] mask;
+}
+
+void GraphAutomaton::useLeds(int reach)
+{
+  const LedGraph &graph = Topology::getLedGraph();
+  const int pixels = Constants::NUM_OF_PIXELS;
+
+  // Everything within reach steps, found by a breadth-first walk from each
+  // LED; distance doubles as the visited mark
+  std::vector<int> rowStart(pixels + 1);
+  std::vector<uint16_t> neighbors;
+  std::vector<int> distance(pixels, -1);
+  std::vector<int> queue;
+  for (int p = 0; p < pixels; p++)
+  {
+    rowStart[p] = neighbors.size();
+    queue.assign(1, p);
+    distance[p] = 0;
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+      int at = queue[head];
+      if (distance[at] == reach)
+      {
+        continue;
+      }
+      for (int k = 0; k < graph.getDegree(at); k++)
+      {
+        int next = graph.getNeighbors(at)[k];
+        if (distance[next] < 0)
+        {
+          distance[next] = distance[at] + 1;
+          queue.push_back(next);
+          neighbors.push_back(next);
+        }
+      }
+    }
+    for (size_t k = 0; k < queue.size(); k++)
+    {
+      distance[queue[k]] = -1;
+    }
+  }
+  rowStart[pixels] = neighbors.size();
+  setNeighborhoods(pixels, rowStart.data(), neighbors.data());
+}
+
+void GraphAutomaton::useSegments()
+{
+  const int segments = Constants::NUMBER_OF_SEGMENTS;
+  std::vector<int> rowStart(segments + 1);
+  std::vector<uint16_t> neighbors;
+  for (int s = 0; s < segments; s++)
+  {
+    rowStart[s] = neighbors.size();
+    for (int t = 0; t < segments; t++)
+    {
+      bool touching = false;
+      for (int a = 0; a < Constants::SIDES_PER_SEGMENT; a++)
+      {
+        for (int b = 0; b < Constants::SIDES_PER_SEGMENT; b++)
+        {
+          touching = touching || Topology::segmentConnections[s][a] == Topology::segmentConnections[t][b];
+        }
+      }
+      if (t != s && touching)
+      {
+        neighbors.push_back(t);
+      }
+    }
+  }
+  rowStart[segments] = neighbors.size();
+  setNeighborhoods(segments, rowStart.data(), neighbors.data());
+}
+
+void GraphAutomaton::setNeighborhoods(int cells, const int *rowStart, const uint16_t *neighbors)
+{
+  // One mask per word a cell has neighbours in, words in order
+  std::vector<uint16_t> wordsUsed;
+  std::vector<uint32_t> masks;
+  for (int c = 0; c < cells; c++)
+  {
+    maskStart[c] = masks.size();
+    for (int w = 0; w < (cells + 31) / 32; w++)
+    {
+      uint32_t bits = 0;
+      for (int k = rowStart[c]; k < rowStart[c + 1]; k++)
+      {
+        if (neighbors[k] / 32 == w)
+        {
+          bits |= 1u << (neighbors[k] % 32);
+        }
+      }
+      if (bits)
+      {
+        wordsUsed.push_back(w);
+        masks.push_back(bits);
+      }
+    }
+  }
+  maskStart[cells] = masks.size();
+
+  delete[] maskWord;
+  delete[] mask;
+  maskWord = new uint16_t[masks.size() > 0 ? masks.size() : 1];
+  mask = new uint32_t[masks.size() > 0 ? masks.size() : 1];
+  for (size_t e = 0; e < masks.size(); e++)
+  {
+    maskWord[e] = wordsUsed[e];
+    mask[e] = masks[e];
+  }
+
+  this->cells = cells;
+  words = (cells + 31) / 32;
+  clear();
+}
+
+int GraphAutomaton::getNeighborCount(int cell) const
+{
+  int count = 0;
+  for (int e = maskStart[cell]; e < maskStart[cell + 1]; e++)
+  {
+    count += __builtin_popcount(mask[e]);
+  }
+  return count;
+}
+
+inline int GraphAutomaton::countIn(const uint32_t *set, int cell) const
+{
+  int count = 0;
+  for (int e = maskStart[cell]; e < maskStart[cell + 1]; e++)
+  {
+    count += __builtin_popcount(set[maskWord[e]] & mask[e]);
+  }
+  return count;
+}
+
+void GraphAutomaton::clear()
+{
+  memset(planes, 0, sizeof(planes));
+}
+
+int GraphAutomaton::get(int cell) const
+{
+  int state = 0;
+  for (int p = 0; p < MAX_PLANES; p++)
+  {
+    state |= ((planes[front][p][cell / 32] >> (cell % 32)) & 1) << p;
+  }
+  return state;
+}
+
+void GraphAutomaton::set(int cell, int state)
+{
+  uint32_t bit = 1u << (cell % 32);
+  for (int p = 0; p < MAX_PLANES; p++)
+  {
+    uint32_t &word = planes[front][p][cell / 32];
+    word = (state >> p) & 1 ? word | bit : word & ~bit;
+  }
+}
+
+void GraphAutomaton::randomize(int states, int percent)
+{
+  for (int c = 0; c < cells; c++)
+  {
+    set(c, states > 1 && random(100) < percent ? random(1, states) : 0);
+  }
+}
+
+int GraphAutomaton::countLive() const
+{
+  int live = 0;
+  for (int w = 0; w < words; w++)
+  {
+    uint32_t any = 0;
+    for (int p = 0; p < MAX_PLANES; p++)
+    {
+      any |= planes[front][p][w];
+    }
+    live += __builtin_popcount(any);
+  }
+  return live;
+}
+
+void GraphAutomaton::stepLife(uint16_t birth, uint16_t survive, int generations)
+{
+  for (int g = 0; g < generations; g++)
+  {
+    const uint32_t *live = planes[front][0];
+    uint32_t *next = planes[front ^ 1][0];
+    for (int w = 0; w < words; w++)
+    {
+      const int base = w * 32;
+      const int last = cells - base < 32 ? cells - base : 32;
+      const uint32_t here = live[w];
+      uint32_t out = 0;
+      for (int b = 0; b < last; b++)
+      {
+        int count = countIn(live, base + b);
+        uint16_t rule = (here >> b) & 1 ? survive : birth;
+        out |= (uint32_t)((rule >> (count < 15 ? count : 15)) & 1) << b;
+      }
+      next[w] = out;
+    }
+    memset(planes[front ^ 1][1], 0, sizeof(planes[0][0]) * (MAX_PLANES - 1));
+    flip();
+  }
+}
+
+void GraphAutomaton::stepBriansBrain(uint16_t birth, int generations)
+{
+  for (int g = 0; g < generations; g++)
+  {
+    const uint32_t *firing = planes[front][0];
+    const uint32_t *resting = planes[front][1];
+    uint32_t *nextFiring = planes[front ^ 1][0];
+    uint32_t *nextResting = planes[front ^ 1][1];
+    for (int w = 0; w < words; w++)
+    {
+      const int base = w * 32;
+      const int last = cells - base < 32 ? cells - base : 32;
+      // Only cells that are neither firing nor refractory can fire
+      const uint32_t ready = ~(firing[w] | resting[w]);
+      uint32_t out = 0;
+      for (int b = 0; b < last; b++)
+      {
+        if ((ready >> b) & 1)
+        {
+          int count = countIn(firing, base + b);
+          out |= (uint32_t)((birth >> (count < 15 ? count : 15)) & 1) << b;
+        }
+      }
+      nextFiring[w] = out;
+      nextResting[w] = firing[w];
+    }
+    memset(planes[front ^ 1][2], 0, sizeof(planes[0][0]) * (MAX_PLANES - 2));
+    flip();
+  }
+}
+
+void GraphAutomaton::stepCyclic(int states, int threshold, int generations)
+{
+  const int used = planesFor(states);
+  for (int g = 0; g < generations; g++)
+  {
+    const uint32_t(&from)[MAX_PLANES][WORDS] = planes[front];
+    uint32_t(&to)[MAX_PLANES][WORDS] = planes[front ^ 1];
+
+    // Which cells are in each state, a word at a time
+    for (int s = 0; s < states; s++)
+    {
+      for (int w = 0; w < words; w++)
+      {
+        uint32_t in = ~0u;
+        for (int p = 0; p < used; p++)
+        {
+          in &= (s >> p) & 1 ? from[p][w] : ~from[p][w];
+        }
+        members[s][w] = in;
+      }
+    }
+
+    for (int w = 0; w < words; w++)
+    {
+      const int base = w * 32;
+      const int last = cells - base < 32 ? cells - base : 32;
+      uint32_t out[MAX_PLANES] = {};
+      for (int b = 0; b < last; b++)
+      {
+        int state = 0;
+        for (int p = 0; p < used; p++)
+        {
+          state |= ((from[p][w] >> b) & 1) << p;
+        }
+        int next = state + 1 == states ? 0 : state + 1;
+        if (countIn(members[next], base + b) >= threshold)
+        {
+          state = next;
+        }
+        for (int p = 0; p < used; p++)
+        {
+          out[p] |= (uint32_t)((state >> p) & 1) << b;
+        }
+      }
+      for (int p = 0; p < MAX_PLANES; p++)
+      {
+        to[p][w] = out[p];
+      }
+    }
+    flip();
+  }
+}
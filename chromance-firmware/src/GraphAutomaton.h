@@ -0,0 +1,86 @@
+#ifndef GRAPH_AUTOMATON_H
+#define GRAPH_AUTOMATON_H
+
+#include "Constants.h"
+
+/*
+Cellular automata on the wall. The cells are either the LEDs, each
+neighbouring the LEDs a few steps away along Topology::getLedGraph(), or the
+segments, each neighbouring the segments it shares a node with.
+
+A cell's state is split into bit planes of one bit per cell, 32 cells to a
+word, so a generation of the whole wall fits in 70 bytes a plane. Each
+cell's neighbourhood is kept as a list of (word, mask) pairs, and counting
+the neighbours in some state is a popcount of each masked word - usually one
+or two, since neighbouring LEDs are mostly next to each other in the frame
+buffer.
+
+The planes are double-buffered: a generation reads one set and writes the
+other. Nothing is allocated except by useLeds() and useSegments().
+*/
+
+class GraphAutomaton
+{
+public:
+  static const int MAX_CELLS = Constants::NUM_OF_PIXELS > Constants::NUMBER_OF_SEGMENTS
+                                   ? Constants::NUM_OF_PIXELS
+                                   : Constants::NUMBER_OF_SEGMENTS;
+  static const int WORDS = (MAX_CELLS + 31) / 32;
+  static const int MAX_PLANES = 4; // Up to 16 states
+
+  GraphAutomaton();
+  ~GraphAutomaton();
+
+  // Cells are frame buffer pixels, neighbouring every LED at most reach
+  // steps away. Call again after a layout change.
+  void useLeds(int reach);
+  // Cells are segments, neighbouring every segment that meets them at a node
+  void useSegments();
+
+  int getCellCount() const { return cells; }
+  int getNeighborCount(int cell) const;
+
+  // Every cell to state 0
+  void clear();
+  int get(int cell) const;
+  void set(int cell, int state);
+  // Each cell set to a random state below states, or left at 0, so that
+  // about percent of them are not 0
+  void randomize(int states, int percent);
+  // Cells in a state other than 0
+  int countLive() const;
+
+  // Outer totalistic rules, Conway's Life among them: bit n of birth (of
+  // survive) set means a dead (live) cell with n live neighbours is live
+  // next generation. Counts above 15 are taken as 15
+  void stepLife(uint16_t birth, uint16_t survive, int generations = 1);
+  // Brian's Brain: a resting cell (state 0) fires (state 1) with a count of
+  // firing neighbours whose bit is set in birth, exactly two as first
+  // described; firing cells become refractory (state 2) and refractory ones
+  // rest
+  void stepBriansBrain(uint16_t birth = 1 << 2, int generations = 1);
+  // Cyclic: a cell in state s moves on to s + 1 (wrapping at states) when
+  // at least threshold of its neighbours already have
+  void stepCyclic(int states, int threshold, int generations = 1);
+
+private:
+  int cells;
+  int words;
+  int front;
+  uint32_t planes[2][MAX_PLANES][WORDS];
+
+  int maskStart[MAX_CELLS + 1]; // Cell c's masks are maskStart[c] .. maskStart[c + 1)
+  uint16_t *maskWord;
+  uint32_t *mask;
+
+  uint32_t members[1 << MAX_PLANES][WORDS]; // stepCyclic(): the cells in each state
+
+  GraphAutomaton(const GraphAutomaton &);
+  GraphAutomaton &operator=(const GraphAutomaton &);
+
+  void setNeighborhoods(int cells, const int *rowStart, const uint16_t *neighbors);
+  int countIn(const uint32_t *set, int cell) const;
+  void flip() { front ^= 1; }
+};
+
+#endif // GRAPH_AUTOMATON_H
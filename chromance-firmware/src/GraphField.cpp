@@ -0,0 +1,217 @@
+#include "GraphField.h"
+#include "Topology.h"
+#include <cmath>
+
+namespace
+{
+  const int SHARE_ONE = 1 << 15; // Whole of a pixel's outflow in outShare
+
+  inline uint16_t clampValue(int32_t value)
+  {
+    return value < 0 ? 0 : (value > GraphField::ONE ? GraphField::ONE : value);
+  }
+}
+
+const uint16_t GraphField::ONE;
+
+GraphField::GraphField(int species)
+    : species(species), outShare(nullptr), inShare(nullptr), flowEdges(0)
+{
+  values = new uint16_t[species * 2 * Constants::NUM_OF_PIXELS];
+  front = new uint8_t[species];
+  for (int s = 0; s < species; s++)
+  {
+    front[s] = 0;
+    fill(s, 0);
+  }
+}
+
+GraphField::~GraphField()
+{
+  delete[] values;
+  delete[] front;
+  delete[] outShare;
+  delete[] inShare;
+}
+
+void GraphField::fill(int species, uint16_t value)
+{
+  uint16_t *current = get(species);
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    current[p] = value;
+  }
+}
+
+void GraphField::diffuse(int species, uint32_t rate)
+{
+  const LedGraph &graph = Topology::getLedGraph();
+  const uint16_t *from = get(species);
+  uint16_t *to = back(species);
+  // Coupling is Q8 and the Laplacian is kept in 32 bits, so the rate drops
+  // to Q8 as well
+  const int32_t rate8 = rate >> 8;
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const uint16_t *neighbors = graph.getNeighbors(p);
+    const uint8_t *couplings = graph.getCouplings(p);
+    const int degree = graph.getDegree(p);
+    const int32_t here = from[p];
+    int32_t laplacian = 0;
+    for (int k = 0; k < degree; k++)
+    {
+      laplacian += couplings[k] * (from[neighbors[k]] - here);
+    }
+    to[p] = clampValue(here + (((laplacian >> 8) * rate8) >> 8));
+  }
+  flip(species);
+}
+
+void GraphField::setFlow(float dx, float dy)
+{
+  const LedGraph &graph = Topology::getLedGraph();
+  const int edges = graph.getEdgeCount();
+  if (edges > flowEdges)
+  {
+    delete[] outShare;
+    delete[] inShare;
+    outShare = new uint16_t[edges];
+    inShare = new uint16_t[edges];
+    flowEdges = edges;
+  }
+
+  float length = std::sqrt(dx * dx + dy * dy);
+  if (length > 0.0f)
+  {
+    dx /= length;
+    dy /= length;
+  }
+
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  float alignment[Constants::MAX_PATHS_PER_NODE];
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const LedPosition &here = Topology::getLedPosition(p / leds, p % leds);
+    const uint16_t *neighbors = graph.getNeighbors(p);
+    const int degree = graph.getDegree(p);
+    const int edge = graph.getEdge(p);
+    float total = 0.0f;
+    for (int k = 0; k < degree; k++)
+    {
+      const LedPosition &there = Topology::getLedPosition(neighbors[k] / leds, neighbors[k] % leds);
+      float ex = there.x - here.x;
+      float ey = there.y - here.y;
+      float distance = std::sqrt(ex * ex + ey * ey);
+      float along = distance > 0.0f ? (ex * dx + ey * dy) / distance : 0.0f;
+      alignment[k] = along > 0.0f ? along : 0.0f;
+      total += alignment[k];
+    }
+
+    // Shares add up to exactly SHARE_ONE, the rounding landing on the last
+    int given = 0;
+    int last = -1;
+    for (int k = 0; k < degree; k++)
+    {
+      int share = total > 0.0f ? (int)(alignment[k] / total * SHARE_ONE) : 0;
+      outShare[edge + k] = share;
+      given += share;
+      if (share > 0)
+      {
+        last = k;
+      }
+    }
+    if (last >= 0)
+    {
+      outShare[edge + last] += SHARE_ONE - given;
+    }
+  }
+
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const uint16_t *neighbors = graph.getNeighbors(p);
+    const int degree = graph.getDegree(p);
+    const int edge = graph.getEdge(p);
+    for (int k = 0; k < degree; k++)
+    {
+      int q = neighbors[k];
+      const uint16_t *reverse = graph.getNeighbors(q);
+      inShare[edge + k] = 0;
+      for (int j = 0; j < graph.getDegree(q); j++)
+      {
+        if (reverse[j] == p)
+        {
+          inShare[edge + k] = outShare[graph.getEdge(q) + j];
+          break;
+        }
+      }
+    }
+  }
+}
+
+void GraphField::advect(int species, uint32_t rate)
+{
+  if (!outShare)
+  {
+    return;
+  }
+  const LedGraph &graph = Topology::getLedGraph();
+  const uint16_t *from = get(species);
+  uint16_t *to = back(species);
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const uint16_t *neighbors = graph.getNeighbors(p);
+    const int degree = graph.getDegree(p);
+    const uint16_t *outs = outShare + graph.getEdge(p);
+    const uint16_t *ins = inShare + graph.getEdge(p);
+    // Sender and receiver round each edge's amount the same way, so what
+    // leaves one pixel arrives at the other exactly
+    const uint32_t out = (from[p] * rate) >> 16;
+    int32_t value = from[p];
+    for (int k = 0; k < degree; k++)
+    {
+      value -= (out * outs[k]) >> 15;
+      value += (((from[neighbors[k]] * rate) >> 16) * ins[k]) >> 15;
+    }
+    to[p] = clampValue(value);
+  }
+  flip(species);
+}
+
+void GraphField::grayScott(const GrayScott &params, int u, int v, int steps)
+{
+  const LedGraph &graph = Topology::getLedGraph();
+  const int32_t du = params.du >> 8;
+  const int32_t dv = params.dv >> 8;
+  const uint32_t feed = params.feed;
+  const uint32_t loss = params.feed + params.kill;
+  for (int step = 0; step < steps; step++)
+  {
+    const uint16_t *uFrom = get(u);
+    const uint16_t *vFrom = get(v);
+    uint16_t *uTo = back(u);
+    uint16_t *vTo = back(v);
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+    {
+      const uint16_t *neighbors = graph.getNeighbors(p);
+      const uint8_t *couplings = graph.getCouplings(p);
+      const int degree = graph.getDegree(p);
+      const int32_t uHere = uFrom[p];
+      const int32_t vHere = vFrom[p];
+      int32_t uLaplacian = 0;
+      int32_t vLaplacian = 0;
+      for (int k = 0; k < degree; k++)
+      {
+        uLaplacian += couplings[k] * (uFrom[neighbors[k]] - uHere);
+        vLaplacian += couplings[k] * (vFrom[neighbors[k]] - vHere);
+      }
+      // u v^2 in Q16; u * v only just fits 32 bits unsigned
+      const int32_t uvv = (((uint32_t)uHere * vHere >> 16) * vHere) >> 16;
+      const int32_t replenished = (feed * (ONE - uHere)) >> 16;
+      const int32_t removed = (loss * vHere) >> 16;
+      uTo[p] = clampValue(uHere + (((uLaplacian >> 8) * du) >> 8) - uvv + replenished);
+      vTo[p] = clampValue(vHere + (((vLaplacian >> 8) * dv) >> 8) + uvv - removed);
+    }
+    flip(u);
+    flip(v);
+  }
+}
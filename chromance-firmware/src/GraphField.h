@@ -0,0 +1,86 @@
+#ifndef GRAPH_FIELD_H
+#define GRAPH_FIELD_H
+
+#include "Constants.h"
+#include "LedGraph.h"
+
+/*
+Quantities that live on every LED and spread along the wiring: heat, dye,
+chemicals. A field holds one or more species, each a value per frame buffer
+pixel from 0 to ONE (unsigned 16 bit fixed point), and moves them between
+neighbouring LEDs of Topology::getLedGraph() - along segments and across
+nodes alike.
+
+Each species has two buffers. An operation reads the front one, writes every
+pixel of the back one and then swaps them, so updates never see half-updated
+neighbours and nothing is allocated after the field is built (setFlow() sizes
+its tables the first time it is called).
+
+Rates are Q16: 65536 is 1.0.
+*/
+
+class GraphField
+{
+public:
+  static const uint16_t ONE = 0xFFFF;
+
+  // Per step rates of the Gray-Scott model (Q16):
+  //   u' = u + du * lap(u) - u v^2 + feed (1 - u)
+  //   v' = v + dv * lap(v) + u v^2 - (feed + kill) v
+  struct GrayScott
+  {
+    uint32_t du;
+    uint32_t dv;
+    uint32_t feed;
+    uint32_t kill;
+  };
+
+  explicit GraphField(int species);
+  ~GraphField();
+
+  int getSpecies() const { return species; }
+
+  // The current values; writes through the non-const one are seen by the
+  // next operation
+  const uint16_t *get(int species) const { return buffer(species, front[species]); }
+  uint16_t *get(int species) { return buffer(species, front[species]); }
+  void fill(int species, uint16_t value);
+
+  // Each pixel exchanges rate of the difference with its neighbours,
+  // weighted by LedGraph coupling. Conserves the total, up to rounding.
+  // Rates above 32768 overshoot, leaving neighbouring LEDs see-sawing
+  void diffuse(int species, uint32_t rate);
+
+  // Sets the direction advect() carries things in, in LedPosition units
+  // (y grows downwards). Each pixel sends to the neighbours that lie that
+  // way, in proportion to how squarely they do; pixels with none downstream
+  // keep what they have. Call again after a layout change.
+  void setFlow(float dx, float dy);
+  // Each pixel passes rate of its value downstream. Conserves the total
+  // unless a pixel fills past ONE
+  void advect(int species, uint32_t rate);
+
+  // steps of the Gray-Scott reaction between species u (the feed) and v;
+  // du and dv are diffusion rates, so keep them to 32768
+  void grayScott(const GrayScott &params, int u, int v, int steps = 1);
+
+private:
+  int species;
+  uint16_t *values;   // [species][2][NUM_OF_PIXELS]
+  uint8_t *front;     // Which of each species' buffers is current
+  uint16_t *outShare; // Per LedGraph edge: fraction of the pixel's outflow sent along it (Q15)
+  uint16_t *inShare;  // Per edge: fraction of the neighbour's outflow sent back along it
+  int flowEdges;
+
+  GraphField(const GraphField &);
+  GraphField &operator=(const GraphField &);
+
+  uint16_t *buffer(int species, int which) const
+  {
+    return values + (species * 2 + which) * Constants::NUM_OF_PIXELS;
+  }
+  uint16_t *back(int species) const { return buffer(species, front[species] ^ 1); }
+  void flip(int species) { front[species] ^= 1; }
+};
+
+#endif // GRAPH_FIELD_H
@@ -0,0 +1,415 @@
+#include "GraphParticles.h"
+#include <cmath>
+
+namespace
+{
+  // Junctions one particle may pass in a frame; a particle faster than a
+  // segment a frame stops at the last one
+  const int MAX_HOPS = 4;
+  // Longest trail draw() lights
+  const int MAX_DRAWN_TRAIL = 16;
+
+  inline int ledAt(float position)
+  {
+    const int leds = Constants::LEDS_PER_SEGMENT;
+    int led = (int)((1.0f - position) * (leds - 1) + 0.5f);
+    return led < 0 ? 0 : (led >= leds ? leds - 1 : led);
+  }
+
+  inline void addColor(byte *pixel, int r, int g, int b)
+  {
+    int newR = pixel[0] + r;
+    int newG = pixel[1] + g;
+    int newB = pixel[2] + b;
+    pixel[0] = newR > 255 ? 255 : newR;
+    pixel[1] = newG > 255 ? 255 : newG;
+    pixel[2] = newB > 255 ? 255 : newB;
+  }
+}
+
+int RandomOnward::waysOn(int node, bool down, int *ways)
+{
+  const PathList &paths = down ? Topology::getDownPaths(node) : Topology::getUpPaths(node);
+  int found = 0;
+  for (int k = 0; k < paths.count; k++)
+  {
+    if (accept(paths.segments[k]))
+    {
+      ways[found++] = paths.segments[k];
+    }
+  }
+  return found;
+}
+
+bool RandomOnward::arrive(GraphParticles &particles, int i, int node, bool down)
+{
+  int ways[Constants::MAX_PATHS_PER_NODE];
+  int found = waysOn(node, down, ways);
+  if (found == 0)
+  {
+    return deadEnd ? deadEnd->arrive(particles, i, node, down) : false;
+  }
+  particles.enter(i, ways[random(found)], node);
+  return true;
+}
+
+bool SplitOnward::arrive(GraphParticles &particles, int i, int node, bool down)
+{
+  int ways[Constants::MAX_PATHS_PER_NODE];
+  int found = waysOn(node, down, ways);
+  if (found == 0)
+  {
+    return deadEnd ? deadEnd->arrive(particles, i, node, down) : false;
+  }
+
+  int split = random(1, found + 1);
+  for (int k = found - 1; k > 0; k--)
+  {
+    int r = random(k + 1);
+    int held = ways[k];
+    ways[k] = ways[r];
+    ways[r] = held;
+  }
+
+  float share = particles.getWeight(i) / split;
+  particles.setWeight(i, share);
+  for (int k = 1; k < split; k++)
+  {
+    int copy = particles.copy(i);
+    if (copy < 0)
+    {
+      // No room for the rest: the original carries their share
+      particles.setWeight(i, share * (split - k + 1));
+      break;
+    }
+    particles.enter(copy, ways[k], node);
+  }
+  particles.enter(i, ways[0], node);
+  return true;
+}
+
+bool Bounce::arrive(GraphParticles &particles, int i, int node, bool down)
+{
+  particles.bounce(i, restitution);
+  return std::fabs(particles.getVelocity(i)) >= minSpeed;
+}
+
+GraphParticles::GraphParticles(int capacity)
+    : capacity(capacity), count(0), gravity(0.0f), drag(0.0f), downPolicy(nullptr), upPolicy(nullptr),
+      overshoot(0.0f)
+{
+  segment = new int16_t[capacity];
+  from = new int16_t[capacity];
+  position = new float[capacity];
+  velocity = new float[capacity];
+  weight = new float[capacity];
+  color = new uint32_t[capacity];
+  age = new uint16_t[capacity];
+  lifetime = new uint16_t[capacity];
+  retired = new bool[capacity];
+}
+
+GraphParticles::~GraphParticles()
+{
+  delete[] segment;
+  delete[] from;
+  delete[] position;
+  delete[] velocity;
+  delete[] weight;
+  delete[] color;
+  delete[] age;
+  delete[] lifetime;
+  delete[] retired;
+}
+
+void GraphParticles::setPhysics(float gravity, float drag)
+{
+  this->gravity = gravity;
+  this->drag = drag;
+}
+
+void GraphParticles::setJunctions(JunctionPolicy *down, JunctionPolicy *up)
+{
+  downPolicy = down;
+  upPolicy = up;
+}
+
+void GraphParticles::clear()
+{
+  count = 0;
+}
+
+int GraphParticles::spawn(int segment, float position, float velocity)
+{
+  if (count == capacity)
+  {
+    return -1;
+  }
+  int i = count++;
+  this->segment[i] = segment;
+  from[i] = -1;
+  this->position[i] = position;
+  this->velocity[i] = velocity;
+  weight[i] = 1.0f;
+  color[i] = 0xFFFFFF;
+  age[i] = 0;
+  lifetime[i] = 0;
+  retired[i] = false;
+  return i;
+}
+
+int GraphParticles::copy(int i)
+{
+  if (count == capacity)
+  {
+    return -1;
+  }
+  int j = count++;
+  moveParticle(j, i);
+  return j;
+}
+
+void GraphParticles::moveParticle(int to, int i)
+{
+  segment[to] = segment[i];
+  from[to] = from[i];
+  position[to] = position[i];
+  velocity[to] = velocity[i];
+  weight[to] = weight[i];
+  color[to] = color[i];
+  age[to] = age[i];
+  lifetime[to] = lifetime[i];
+  retired[to] = retired[i];
+}
+
+void GraphParticles::step()
+{
+  // One pass: move each particle, then retire it or send it over a junction
+  // while it is at hand. Copies made at junctions land after the particles
+  // that were here at the start, and are closed up behind the survivors.
+  // The arrays are read through locals, as in draw()
+  const int start = count;
+  const float fall = gravity;
+  const float keep = 1.0f - drag;
+  const bool *retireds = retired;
+  uint16_t *ages = age;
+  const uint16_t *lifetimes = lifetime;
+  float *positions = position;
+  float *velocities = velocity;
+  int kept = 0;
+  for (int i = 0; i < start; i++)
+  {
+    if (retireds[i])
+    {
+      continue;
+    }
+    uint16_t older = ages[i] + (ages[i] < 0xFFFF);
+    ages[i] = older;
+    if (lifetimes[i] > 0 && older >= lifetimes[i])
+    {
+      continue;
+    }
+    float speed = (velocities[i] + fall) * keep;
+    float at = positions[i] + speed;
+    velocities[i] = speed;
+    positions[i] = at;
+    if ((at > 1.0f || at < 0.0f) && !cross(i))
+    {
+      continue;
+    }
+    if (kept != i)
+    {
+      moveParticle(kept, i);
+    }
+    kept++;
+  }
+  for (int i = start; i < count; i++)
+  {
+    if (!retired[i])
+    {
+      moveParticle(kept++, i);
+    }
+  }
+  count = kept;
+}
+
+bool GraphParticles::cross(int i)
+{
+  for (int hop = 0; hop < MAX_HOPS; hop++)
+  {
+    float at = position[i];
+    bool down = at > 1.0f;
+    if (!down && at >= 0.0f)
+    {
+      return true;
+    }
+    overshoot = down ? at - 1.0f : -at;
+    JunctionPolicy *policy = down ? downPolicy : upPolicy;
+    if (!policy || !policy->arrive(*this, i, Topology::segmentConnections[segment[i]][down], down))
+    {
+      return false;
+    }
+  }
+  if (position[i] > 1.0f)
+  {
+    position[i] = 1.0f;
+  }
+  else if (position[i] < 0.0f)
+  {
+    position[i] = 0.0f;
+  }
+  return true;
+}
+
+void GraphParticles::enter(int i, int segment, int node)
+{
+  float speed = std::fabs(velocity[i]);
+  from[i] = this->segment[i];
+  this->segment[i] = segment;
+  if (Topology::segmentConnections[segment][0] == node)
+  {
+    position[i] = overshoot;
+    velocity[i] = speed;
+  }
+  else
+  {
+    position[i] = 1.0f - overshoot;
+    velocity[i] = -speed;
+  }
+}
+
+void GraphParticles::bounce(int i, float restitution)
+{
+  velocity[i] = -velocity[i] * restitution;
+  position[i] = position[i] > 1.0f ? 1.0f - overshoot * restitution : overshoot * restitution;
+}
+
+int GraphParticles::getLed(int i) const
+{
+  return ledAt(position[i]);
+}
+
+int GraphParticles::getTrail(int i, uint16_t *pixels, int length) const
+{
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  if (length < 1)
+  {
+    return 0;
+  }
+  int on = segment[i];
+  int led = getLed(i);
+  int written = 0;
+  pixels[written++] = on * leds + led;
+  if (velocity[i] == 0.0f)
+  {
+    return written;
+  }
+
+  // Falling moves towards LED 0, so the trail runs up the LED numbers. Most
+  // trails stay on the particle's own segment
+  int step = velocity[i] > 0.0f ? 1 : -1;
+  int last = led + step * (length - 1);
+  if (last >= 0 && last < leds)
+  {
+    for (int k = 1; k < length; k++)
+    {
+      pixels[k] = pixels[0] + k * step;
+    }
+    return length;
+  }
+  bool crossed = false;
+  while (written < length)
+  {
+    led += step;
+    if (led < 0 || led >= leds)
+    {
+      int previous = from[i];
+      if (crossed || previous < 0)
+      {
+        break;
+      }
+      int joint = Topology::segmentConnections[on][led < 0 ? 1 : 0];
+      if (Topology::segmentConnections[previous][1] == joint)
+      {
+        led = 0;
+        step = 1;
+      }
+      else if (Topology::segmentConnections[previous][0] == joint)
+      {
+        led = leds - 1;
+        step = -1;
+      }
+      else
+      {
+        break; // Bounced off the other end
+      }
+      on = previous;
+      crossed = true;
+    }
+    pixels[written++] = on * leds + led;
+  }
+  return written;
+}
+
+void GraphParticles::draw(LedController &leds, int length, uint8_t fade, float minTrailSpeed) const
+{
+  const int segmentLeds = Constants::LEDS_PER_SEGMENT;
+  if (length > MAX_DRAWN_TRAIL)
+  {
+    length = MAX_DRAWN_TRAIL;
+  }
+  // Writing a byte could change any field as far as the compiler knows, so
+  // everything the loop reads is copied to locals first
+  const int drawn = count;
+  const bool *retireds = retired;
+  const uint32_t *colors = color;
+  const int16_t *segments = segment;
+  const float *positions = position;
+  const float *velocities = velocity;
+  byte *buffer = leds.ledColors;
+  uint16_t trail[MAX_DRAWN_TRAIL];
+  for (int i = 0; i < drawn; i++)
+  {
+    if (retireds[i])
+    {
+      continue;
+    }
+    uint32_t rgb = colors[i];
+    int r = (rgb >> 16) & 0xFF;
+    int g = (rgb >> 8) & 0xFF;
+    int b = rgb & 0xFF;
+    int led = ledAt(positions[i]);
+    int head = segments[i] * segmentLeds + led;
+    addColor(buffer + head * 3, r, g, b);
+
+    float speed = velocities[i];
+    if (length < 2 || speed == 0.0f || std::fabs(speed) < minTrailSpeed)
+    {
+      continue;
+    }
+    int step = speed > 0.0f ? 1 : -1;
+    int last = led + step * (length - 1);
+    if (last >= 0 && last < segmentLeds)
+    {
+      // Most trails stay on the particle's own segment
+      byte *pixel = buffer + head * 3;
+      for (int k = 1; k < length; k++)
+      {
+        pixel += step * 3;
+        r = r * fade >> 8;
+        g = g * fade >> 8;
+        b = b * fade >> 8;
+        addColor(pixel, r, g, b);
+      }
+      continue;
+    }
+    int lit = getTrail(i, trail, length);
+    for (int k = 1; k < lit; k++)
+    {
+      r = r * fade >> 8;
+      g = g * fade >> 8;
+      b = b * fade >> 8;
+      addColor(buffer + trail[k] * 3, r, g, b);
+    }
+  }
+}
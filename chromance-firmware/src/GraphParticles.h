@@ -0,0 +1,171 @@
+#ifndef GRAPH_PARTICLES_H
+#define GRAPH_PARTICLES_H
+
+#include "Constants.h"
+#include "Topology.h"
+#include "LedController.h"
+
+class GraphParticles;
+
+/*
+What a particle does when it runs off the end of its segment onto a node.
+GraphParticles asks one policy for particles arriving downwards (at a
+segment's floor end) and another for those arriving upwards. The stock
+policies below cover falling, splitting and bouncing; an effect with its own
+rules subclasses one of them or JunctionPolicy itself.
+*/
+class JunctionPolicy
+{
+public:
+  virtual ~JunctionPolicy() {}
+
+  // Particle i has reached node heading down (towards the floor) or up.
+  // Send it on with GraphParticles::enter() or bounce(), or return false to
+  // retire it
+  virtual bool arrive(GraphParticles &particles, int i, int node, bool down) = 0;
+};
+
+// Onto one of the segments leading on the same way, picked at random. At a
+// node with no way on the particle is handed to deadEnd, or retired without
+// one
+class RandomOnward : public JunctionPolicy
+{
+public:
+  explicit RandomOnward(JunctionPolicy *deadEnd = nullptr) : deadEnd(deadEnd) {}
+
+  bool arrive(GraphParticles &particles, int i, int node, bool down) override;
+
+protected:
+  JunctionPolicy *deadEnd;
+
+  // Whether a particle may go onto segment; every segment by default
+  virtual bool accept(int segment) { return true; }
+  // The accepted segments leading on from node; returns how many
+  int waysOn(int node, bool down, int *ways);
+};
+
+// Onto between one and all of the ways on, each copy taking an equal share
+// of the particle's weight
+class SplitOnward : public RandomOnward
+{
+public:
+  explicit SplitOnward(JunctionPolicy *deadEnd = nullptr) : RandomOnward(deadEnd) {}
+
+  bool arrive(GraphParticles &particles, int i, int node, bool down) override;
+};
+
+// Back along the same segment, keeping restitution of the speed; retired
+// once slower than minSpeed
+class Bounce : public JunctionPolicy
+{
+public:
+  Bounce(float restitution, float minSpeed = 0.0f) : restitution(restitution), minSpeed(minSpeed) {}
+
+  bool arrive(GraphParticles &particles, int i, int node, bool down) override;
+
+private:
+  float restitution;
+  float minSpeed;
+};
+
+/*
+Particles that travel along the wiring: a fixed-capacity pool with each
+field in its own array, moved together once a frame by step().
+
+A particle sits on a segment at a position from 0 (ceiling end) to 1 (floor
+end) and moves by its velocity each frame, positive towards the floor.
+Gravity adds to the velocity and drag takes a fraction of it away. Running
+off either end hands the particle to that direction's JunctionPolicy with
+the rest of the frame's movement still to go, so speed does not depend on
+where the segments join. A particle also retires when its age reaches its
+lifetime, if it has one.
+
+Storage is allocated once by the constructor; spawning and retiring never
+touch the heap.
+*/
+class GraphParticles
+{
+public:
+  explicit GraphParticles(int capacity);
+  ~GraphParticles();
+
+  // gravity in segments per frame per frame; drag is the fraction of
+  // velocity lost each frame
+  void setPhysics(float gravity, float drag);
+  void setJunctions(JunctionPolicy *down, JunctionPolicy *up);
+
+  void clear();
+  // A new particle with weight 1, white, no lifetime; -1 when full
+  int spawn(int segment, float position, float velocity);
+  // Moves every particle one frame, then closes up the ones retired
+  void step();
+  // Takes particle i out at the next step(); it is still counted until then
+  void retire(int i) { retired[i] = true; }
+
+  int size() const { return count; }
+  int getCapacity() const { return capacity; }
+
+  int getSegment(int i) const { return segment[i]; }
+  float getPosition(int i) const { return position[i]; }
+  float getVelocity(int i) const { return velocity[i]; }
+  float getWeight(int i) const { return weight[i]; }
+  uint32_t getColor(int i) const { return color[i]; }
+  int getAge(int i) const { return age[i]; }
+  int getLifetime(int i) const { return lifetime[i]; }
+  // Nearest LED to the particle; LED 0 is at the floor end
+  int getLed(int i) const;
+
+  void setVelocity(int i, float value) { velocity[i] = value; }
+  // Whatever a split shares out: Water Pour keeps a drop's volume here
+  void setWeight(int i, float value) { weight[i] = value; }
+  void setColor(int i, uint32_t value) { color[i] = value; }
+  // Frames until the particle retires; 0 for never
+  void setLifetime(int i, int frames) { lifetime[i] = frames; }
+
+  // The particle's LED and up to length - 1 more back the way it came,
+  // following it onto the segment it arrived from; returns how many were
+  // written to pixels (frame buffer indices)
+  int getTrail(int i, uint16_t *pixels, int length) const;
+  // Adds each particle's colour at its LED and a trail of length LEDs in
+  // all, each LED fade / 256 as bright as the one before; particles slower
+  // than minTrailSpeed get no trail
+  void draw(LedController &leds, int length, uint8_t fade, float minTrailSpeed = 0.0f) const;
+
+  // For junction policies, during step()
+  //
+  // Puts particle i on segment, leaving node with the rest of its movement
+  void enter(int i, int segment, int node);
+  // A copy of particle i, left where it is for the policy to enter(); -1
+  // when full
+  int copy(int i);
+  // Reverses particle i off the end it reached, keeping restitution of its
+  // speed and movement
+  void bounce(int i, float restitution);
+
+private:
+  int capacity;
+  int count;
+  float gravity;
+  float drag;
+  JunctionPolicy *downPolicy;
+  JunctionPolicy *upPolicy;
+  float overshoot; // Movement left after the particle at a junction reached it
+
+  int16_t *segment;
+  int16_t *from; // Segment the particle was on before this one, or -1
+  float *position;
+  float *velocity;
+  float *weight;
+  uint32_t *color;
+  uint16_t *age;
+  uint16_t *lifetime;
+  bool *retired;
+
+  GraphParticles(const GraphParticles &);
+  GraphParticles &operator=(const GraphParticles &);
+
+  bool cross(int i);
+  void moveParticle(int to, int i);
+};
+
+#endif // GRAPH_PARTICLES_H
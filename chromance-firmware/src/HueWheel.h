@@ -0,0 +1,43 @@
+#ifndef HUE_WHEEL_H
+#define HUE_WHEEL_H
+
+#include <Arduino.h>
+#include "LedController.h"
+
+// ColorHSV(hue, 255, brightness) for HUE_STEPS evenly spaced hues, so a
+// rainbow effect colours a pixel with one lookup. Each entry is taken at
+// the middle of the hues it stands for; ColorHSV itself only has 1530
+// distinct hues. The table is rebuilt when the brightness changes.
+class HueWheel
+{
+public:
+  static const int HUE_BITS = 10;
+  static const int HUE_STEPS = 1 << HUE_BITS;
+
+  HueWheel() : brightness(-1) {}
+
+  void setBrightness(LedController &leds, int value)
+  {
+    if (value == brightness)
+    {
+      return;
+    }
+    brightness = value;
+    for (int i = 0; i < HUE_STEPS; i++)
+    {
+      uint16_t hue = (i << (16 - HUE_BITS)) + (1 << (15 - HUE_BITS));
+      uint32_t color = leds.ColorHSV(hue, 255, brightness);
+      colors[i * 3] = (byte)(color >> 16);
+      colors[i * 3 + 1] = (byte)(color >> 8);
+      colors[i * 3 + 2] = (byte)color;
+    }
+  }
+
+  const byte *lookup(uint16_t hue) const { return colors + (hue >> (16 - HUE_BITS)) * 3; }
+
+private:
+  int brightness;
+  byte colors[HUE_STEPS * 3];
+};
+
+#endif // HUE_WHEEL_H
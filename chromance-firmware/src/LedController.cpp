@@ -1,51 +1,86 @@
 #include "LedController.h"
 #include "Utils.h"
 
-LedController::LedController()
+static_assert(Constants::NUM_OF_PIXELS <= Constants::MAX_PIXELS, "PixelRoute::pixel is 16 bits");
+
+LedController::LedController() : strips(nullptr), stripCount(0), pixelRoutes(nullptr), pixelRouteCount(0)
 {
-  for (int i = 0; i < Constants::NUMBER_OF_STRIPS; i++)
-  {
-    strips[i] = nullptr;
-  }
 }
 
 LedController::~LedController()
 {
-  for (int i = 0; i < Constants::NUMBER_OF_STRIPS; i++)
+  for (int i = 0; i < stripCount; i++)
   {
-    if (strips[i] != nullptr)
-    {
-      delete strips[i];
-      strips[i] = nullptr;
-    }
+    delete strips[i];
   }
+  delete[] strips;
+  delete[] pixelRoutes;
 }
 
 void LedController::initStrips()
 {
   // check if already initialized to prevent double allocation
-  if (strips[0] != nullptr)
+  if (stripCount > 0)
     return;
 
+  stripCount = Topology::getStripCount();
+  strips = new Strip *[stripCount > 0 ? stripCount : 1];
+  for (int i = 0; i < stripCount; i++)
+  {
+    const StripConfig &config = Topology::getStrip(i);
 #ifdef USING_DOTSTAR
-  strips[Constants::BLUE_INDEX] = new Adafruit_DotStar(Constants::BLUE_LENGTH, Constants::BLUE_STRIP_DATA_PIN, Constants::BLUE_STRIP_CLOCK_PIN, DOTSTAR_BRG);
-  strips[Constants::GREEN_INDEX] = new Adafruit_DotStar(Constants::GREEN_LENGTH, Constants::GREEN_STRIP_DATA_PIN, Constants::GREEN_STRIP_CLOCK_PIN, DOTSTAR_BRG);
-  strips[Constants::RED_INDEX] = new Adafruit_DotStar(Constants::RED_LENGTH, Constants::RED_STRIP_DATA_PIN, Constants::RED_STRIP_CLOCK_PIN, DOTSTAR_BRG);
-  strips[Constants::BLACK_INDEX] = new Adafruit_DotStar(Constants::BLACK_LENGTH, Constants::BLACK_STRIP_DATA_PIN, Constants::BLACK_STRIP_CLOCK_PIN, DOTSTAR_BRG);
+    strips[i] = new Adafruit_DotStar(config.length, config.dataPin, config.clockPin, DOTSTAR_BRG);
 #else
-  strips[Constants::BLUE_INDEX] = new Adafruit_NeoPixel(Constants::BLUE_LENGTH, Constants::BLUE_STRIP_DATA_PIN, NEO_GRB + NEO_KHZ800);
-  strips[Constants::GREEN_INDEX] = new Adafruit_NeoPixel(Constants::GREEN_LENGTH, Constants::GREEN_STRIP_DATA_PIN, NEO_GRB + NEO_KHZ800);
-  strips[Constants::RED_INDEX] = new Adafruit_NeoPixel(Constants::RED_LENGTH, Constants::RED_STRIP_DATA_PIN, NEO_GRB + NEO_KHZ800);
-  strips[Constants::BLACK_INDEX] = new Adafruit_NeoPixel(Constants::BLACK_LENGTH, Constants::BLACK_STRIP_DATA_PIN, NEO_GRB + NEO_KHZ800);
+    strips[i] = new Adafruit_NeoPixel(config.length, config.dataPin, NEO_GRB + NEO_KHZ800);
 #endif
+  }
+}
+
+void LedController::buildPixelRoutes()
+{
+  int count = 0;
+  for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
+  {
+    if (Topology::ledAssignments[segment][0] < stripCount)
+    {
+      count += Topology::getSegmentLedCount(segment);
+    }
+  }
+
+  delete[] pixelRoutes;
+  pixelRoutes = new PixelRoute[count > 0 ? count : 1];
+  pixelRouteCount = 0;
+
+  for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
+  {
+    int stripIdx = Topology::ledAssignments[segment][0];
+    int ceilingIndex = Topology::ledAssignments[segment][1];
+    int floorIndex = Topology::ledAssignments[segment][2];
+    int leds = Topology::getSegmentLedCount(segment);
+    if (stripIdx >= stripCount)
+    {
+      continue;
+    }
+
+    // Physical LED j from the floor samples the nearest frame buffer LED
+    for (int j = 0; j < leds; j++)
+    {
+      int fromBottom = leds > 1 ? (int)round(fmap(j, 0, leds - 1, 0, Constants::LEDS_PER_SEGMENT - 1)) : 0;
+      PixelRoute &route = pixelRoutes[pixelRouteCount++];
+      route.pixel = pixelIndex(segment, fromBottom);
+      route.stripLed = floorIndex + (ceilingIndex > floorIndex ? j : -j);
+      route.strip = stripIdx;
+    }
+  }
 }
 
 void LedController::begin()
 {
   initStrips();
+  buildPixelRoutes();
   clear();
 
-  for (int i = 0; i < Constants::NUMBER_OF_STRIPS; i++)
+  for (int i = 0; i < stripCount; i++)
   {
     strips[i]->begin();
     strips[i]->setBrightness(255);
@@ -55,34 +90,37 @@ void LedController::begin()
 
 void LedController::clear()
 {
-  memset(ledColors, 0, sizeof(ledColors));
-  for (int i = 0; i < Constants::NUMBER_OF_STRIPS; i++)
+  clearBuffer();
+  for (int i = 0; i < stripCount; i++)
   {
     strips[i]->clear();
   }
 }
 
-void LedController::fade(float decay)
+void LedController::clearBuffer()
 {
-  for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
+  memset(ledColors, 0, sizeof(ledColors));
+}
+
+bool LedController::fade(float decay)
+{
+  byte lit = 0;
+  for (int i = 0; i < Constants::NUM_OF_PIXELS * 3; i++)
   {
-    for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
-    {
-      for (int k = 0; k < 3; k++)
-      {
-        ledColors[segment][led][k] = (byte)(ledColors[segment][led][k] * decay);
-      }
-    }
+    ledColors[i] = (byte)(ledColors[i] * decay);
+    lit |= ledColors[i];
   }
+  return lit != 0;
 }
 
 void LedController::setPixelColor(int segment, int led, byte r, byte g, byte b)
 {
   if (segment < 0 || segment >= Constants::NUMBER_OF_SEGMENTS || led < 0 || led >= Constants::LEDS_PER_SEGMENT)
     return;
-  ledColors[segment][led][0] = r;
-  ledColors[segment][led][1] = g;
-  ledColors[segment][led][2] = b;
+  byte *color = getPixel(segment, led);
+  color[0] = r;
+  color[1] = g;
+  color[2] = b;
 }
 
 void LedController::addPixelColor(int segment, int led, byte r, byte g, byte b)
@@ -90,28 +128,29 @@ void LedController::addPixelColor(int segment, int led, byte r, byte g, byte b)
   if (segment < 0 || segment >= Constants::NUMBER_OF_SEGMENTS || led < 0 || led >= Constants::LEDS_PER_SEGMENT)
     return;
 
-  int newR = ledColors[segment][led][0] + r;
-  int newG = ledColors[segment][led][1] + g;
-  int newB = ledColors[segment][led][2] + b;
+  byte *color = getPixel(segment, led);
+  int newR = color[0] + r;
+  int newG = color[1] + g;
+  int newB = color[2] + b;
 
-  ledColors[segment][led][0] = (newR > 255) ? 255 : newR;
-  ledColors[segment][led][1] = (newG > 255) ? 255 : newG;
-  ledColors[segment][led][2] = (newB > 255) ? 255 : newB;
+  color[0] = (newR > 255) ? 255 : newR;
+  color[1] = (newG > 255) ? 255 : newG;
+  color[2] = (newB > 255) ? 255 : newB;
 }
 
 void LedController::show()
 {
+  const byte *colors = ledColors;
+
   // Power limiting logic
   unsigned long totalCurrent = 200; // Base current for ESP32 in mA
-  for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
+  for (int i = 0; i < pixelRouteCount; i++)
   {
-    for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
-    {
-      // Approximate current: 20mA per channel at full brightness
-      totalCurrent += (ledColors[segment][led][0] * 20) / 255;
-      totalCurrent += (ledColors[segment][led][1] * 20) / 255;
-      totalCurrent += (ledColors[segment][led][2] * 20) / 255;
-    }
+    // Approximate current: 20mA per channel at full brightness
+    const byte *color = colors + pixelRoutes[i].pixel * 3;
+    totalCurrent += (color[0] * 20) / 255;
+    totalCurrent += (color[1] * 20) / 255;
+    totalCurrent += (color[2] * 20) / 255;
   }
 
   float scale = 1.0f;
@@ -120,39 +159,25 @@ void LedController::show()
     scale = (float)Constants::MAX_CURRENT_MA / (float)totalCurrent;
   }
 
-  for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
+  for (int i = 0; i < pixelRouteCount; i++)
   {
-    for (int fromBottom = 0; fromBottom < Constants::LEDS_PER_SEGMENT; fromBottom++)
+    const PixelRoute &route = pixelRoutes[i];
+    const byte *color = colors + route.pixel * 3;
+    byte r = color[0];
+    byte g = color[1];
+    byte b = color[2];
+
+    if (scale < 1.0f)
     {
-      int stripIdx = Topology::ledAssignments[segment][0];
-      int floorIndex = Topology::ledAssignments[segment][2];
-      int ceilingIndex = Topology::ledAssignments[segment][1];
-
-      int ledIndex = round(fmap(
-          fromBottom,
-          0, (Constants::LEDS_PER_SEGMENT - 1),
-          floorIndex, ceilingIndex));
-
-      byte r = ledColors[segment][fromBottom][0];
-      byte g = ledColors[segment][fromBottom][1];
-      byte b = ledColors[segment][fromBottom][2];
-
-      if (scale < 1.0f)
-      {
-        r = (byte)(r * scale);
-        g = (byte)(g * scale);
-        b = (byte)(b * scale);
-      }
-
-      strips[stripIdx]->setPixelColor(
-          ledIndex,
-          r,
-          g,
-          b);
+      r = (byte)(r * scale);
+      g = (byte)(g * scale);
+      b = (byte)(b * scale);
     }
+
+    strips[route.strip]->setPixelColor(route.stripLed, r, g, b);
   }
 
-  for (int i = 0; i < Constants::NUMBER_OF_STRIPS; i++)
+  for (int i = 0; i < stripCount; i++)
   {
     strips[i]->show();
   }
@@ -162,13 +187,14 @@ void LedController::rainbow(uint16_t first_hue, uint8_t brightness)
 {
   for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
   {
+    int hue = first_hue + (segment * 65536L / Constants::NUMBER_OF_SEGMENTS);
+    uint32_t color = ColorHSV(hue, 255, brightness);
     for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
     {
-      int hue = first_hue + (segment * 65536L / Constants::NUMBER_OF_SEGMENTS);
-      uint32_t color = ColorHSV(hue, 255, brightness);
-      ledColors[segment][led][0] = (uint8_t)(color >> 16);
-      ledColors[segment][led][1] = (uint8_t)(color >> 8);
-      ledColors[segment][led][2] = (uint8_t)(color);
+      byte *out = getPixel(segment, led);
+      out[0] = (uint8_t)(color >> 16);
+      out[1] = (uint8_t)(color >> 8);
+      out[2] = (uint8_t)(color);
     }
   }
 }
@@ -18,12 +18,19 @@
 class LedController
 {
 public:
+#ifdef USING_DOTSTAR
+  typedef Adafruit_DotStar Strip;
+#else
+  typedef Adafruit_NeoPixel Strip;
+#endif
+
   LedController();
   ~LedController(); // Clean up if we use new
   void begin();
   void show();
   void clear();
-  void fade(float decay);
+  void clearBuffer(); // Zeroes ledColors only; the strips keep their last frame
+  bool fade(float decay); // Returns true while any pixel is still lit
 
   // Accessors for ripple logic
   void setPixelColor(int segment, int led, byte r, byte g, byte b);
@@ -32,25 +39,36 @@ public:
   uint32_t ColorHSV(uint16_t hue, uint8_t sat, uint8_t val);
 
   // Raw access if needed (prefer methods above)
-  // [Segment][LED][RGB]
-  byte ledColors[Constants::NUMBER_OF_SEGMENTS][Constants::LEDS_PER_SEGMENT][3];
+  // Flat frame buffer: RGB for pixel (segment * LEDS_PER_SEGMENT + led)
+  byte ledColors[Constants::NUM_OF_PIXELS * 3];
+
+  static int pixelIndex(int segment, int led) { return segment * Constants::LEDS_PER_SEGMENT + led; }
+  byte *getPixel(int segment, int led) { return ledColors + pixelIndex(segment, led) * 3; }
 
   void rainbow(uint16_t first_hue = 0, uint8_t brightness = 255);
 
-#ifdef USING_DOTSTAR
-  Adafruit_DotStar *getStrip(int index) { return strips[index]; }
-#else
-  Adafruit_NeoPixel *getStrip(int index) { return strips[index]; }
-#endif
+  // Where each physical LED of the active topology takes its colour from.
+  // Built by begin(); call it again after changing the topology.
+  struct PixelRoute
+  {
+    uint16_t pixel; // Index into ledColors (pixelIndex)
+    uint16_t stripLed;
+    uint8_t strip;
+  };
+  int getPixelRouteCount() const { return pixelRouteCount; }
+  const PixelRoute *getPixelRoutes() const { return pixelRoutes; }
+
+  int getStripCount() const { return stripCount; }
+  Strip *getStrip(int index) { return strips[index]; }
 
 private:
-#ifdef USING_DOTSTAR
-  Adafruit_DotStar *strips[Constants::NUMBER_OF_STRIPS];
-#else
-  Adafruit_NeoPixel *strips[Constants::NUMBER_OF_STRIPS];
-#endif
+  Strip **strips; // One per Topology strip, sized by begin()
+  int stripCount;
+  PixelRoute *pixelRoutes;
+  int pixelRouteCount;
 
   void initStrips();
+  void buildPixelRoutes();
 };
 
 #endif // LEDCONTROLLER_H
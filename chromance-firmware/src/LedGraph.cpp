@@ -0,0 +1,92 @@
+#include "LedGraph.h"
+#include <vector>
+
+LedGraph::LedGraph() : neighbors(nullptr), couplings(nullptr), maxDegree(0)
+{
+  for (int p = 0; p <= Constants::NUM_OF_PIXELS; p++)
+  {
+    rowStart[p] = 0;
+  }
+}
+
+LedGraph::~LedGraph()
+{
+  release();
+}
+
+void LedGraph::release()
+{
+  delete[] neighbors;
+  delete[] couplings;
+  neighbors = nullptr;
+  couplings = nullptr;
+  maxDegree = 0;
+}
+
+void LedGraph::build()
+{
+  release();
+
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  const int pixels = Constants::NUM_OF_PIXELS;
+
+  // The LED at each end of a segment that faces the node there: LED 0 is
+  // at the floor end (side 1)
+  std::vector<std::vector<uint16_t> > atNode(Constants::NUMBER_OF_NODES);
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+  {
+    atNode[Topology::segmentConnections[s][0]].push_back(s * leds + leds - 1);
+    atNode[Topology::segmentConnections[s][1]].push_back(s * leds);
+  }
+
+  std::vector<std::vector<uint16_t> > rows(pixels);
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+  {
+    for (int led = 0; led + 1 < leds; led++)
+    {
+      int p = s * leds + led;
+      rows[p].push_back(p + 1);
+      rows[p + 1].push_back(p);
+    }
+  }
+  for (int n = 0; n < Constants::NUMBER_OF_NODES; n++)
+  {
+    const std::vector<uint16_t> &ends = atNode[n];
+    for (size_t a = 0; a < ends.size(); a++)
+    {
+      for (size_t b = 0; b < ends.size(); b++)
+      {
+        if (a != b)
+        {
+          rows[ends[a]].push_back(ends[b]);
+        }
+      }
+    }
+  }
+
+  int edges = 0;
+  for (int p = 0; p < pixels; p++)
+  {
+    rowStart[p] = edges;
+    edges += rows[p].size();
+  }
+  rowStart[pixels] = edges;
+
+  neighbors = new uint16_t[edges > 0 ? edges : 1];
+  couplings = new uint8_t[edges > 0 ? edges : 1];
+  for (int p = 0; p < pixels; p++)
+  {
+    int degree = rows[p].size();
+    for (int k = 0; k < degree; k++)
+    {
+      int q = rows[p][k];
+      int larger = degree > (int)rows[q].size() ? degree : rows[q].size();
+      neighbors[rowStart[p] + k] = q;
+      couplings[rowStart[p] + k] = 256 / (larger > 1 ? larger : 2);
+    }
+    if (degree > maxDegree)
+    {
+      maxDegree = degree;
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef LED_GRAPH_H
+#define LED_GRAPH_H
+
+#include "Constants.h"
+#include "Topology.h"
+
+/*
+Which frame buffer pixels (LedController::pixelIndex) touch which, for
+simulations that spread something from LED to LED along the wiring. Each
+LED neighbours the ones either side of it on its segment; at a node, the
+LEDs next to it on every segment that meets there all neighbour each other,
+so no LED has more than Constants::MAX_PATHS_PER_NODE neighbours.
+
+Stored as compressed sparse rows: pixel p's neighbours are
+getNeighbors(p)[0 .. getDegree(p)), and getEdge(p) is where its row starts,
+so per-edge data can be kept in a parallel array of getEdgeCount() entries.
+Each edge also has a coupling, 256 / the larger of its two ends' degrees:
+the same both ways, and no pixel's couplings add up to more than 256, so
+exchanging amount * coupling / 256 along every edge conserves the total and
+never takes more from a pixel than it has. Built for the active layout by
+Topology::getLedGraph().
+*/
+
+class LedGraph
+{
+public:
+  LedGraph();
+  ~LedGraph();
+
+  void build();
+
+  int getDegree(int pixel) const { return rowStart[pixel + 1] - rowStart[pixel]; }
+  const uint16_t *getNeighbors(int pixel) const { return neighbors + rowStart[pixel]; }
+  const uint8_t *getCouplings(int pixel) const { return couplings + rowStart[pixel]; }
+  int getEdge(int pixel) const { return rowStart[pixel]; }
+  int getEdgeCount() const { return rowStart[Constants::NUM_OF_PIXELS]; }
+  int getMaxDegree() const { return maxDegree; }
+
+private:
+  int rowStart[Constants::NUM_OF_PIXELS + 1];
+  uint16_t *neighbors;
+  uint8_t *couplings;
+  int maxDegree;
+
+  LedGraph(const LedGraph &);
+  LedGraph &operator=(const LedGraph &);
+
+  void release();
+};
+
+#endif // LED_GRAPH_H
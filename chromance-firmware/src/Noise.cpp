@@ -0,0 +1,180 @@
+#include "Noise.h"
+#include "Topology.h"
+
+namespace
+{
+  // Ken Perlin's reference permutation
+  const uint8_t PERMUTATION[256] = {
+      151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225,
+      140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148,
+      247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32,
+      57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175,
+      74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122,
+      60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54,
+      65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169,
+      200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64,
+      52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212,
+      207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213,
+      119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9,
+      129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104,
+      218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241,
+      81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181, 199, 106, 157,
+      184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93,
+      222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180};
+
+  const int FRACTION_BITS = 12;                // Distances to the lattice corners
+  const int32_t UNIT = 1 << FRACTION_BITS;
+  const int OUTPUT_GAIN = 8;                   // +-4096 (Q12 1.0) to +-32768
+
+  inline uint8_t hash(int i) { return PERMUTATION[i & 255]; }
+
+  // 3t^2 - 2t^3 for t in [0, 65535], in 16 bits
+  inline int32_t fade(uint32_t t)
+  {
+    uint32_t t2 = (t * t) >> 16;
+    uint32_t t3 = (t2 * t) >> 16;
+    return 3 * t2 - 2 * t3;
+  }
+
+  inline int32_t lerp(int32_t a, int32_t b, int32_t t)
+  {
+    return a + (((b - a) * t) >> 16);
+  }
+
+  // The twelve edge gradients of the improved noise, from hash
+  inline int32_t grad(uint8_t h, int32_t x, int32_t y, int32_t z)
+  {
+    h &= 15;
+    int32_t u = h < 8 ? x : y;
+    int32_t v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+    return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+  }
+
+  // Eight directions round the square
+  inline int32_t grad(uint8_t h, int32_t x, int32_t y)
+  {
+    switch (h & 7)
+    {
+    case 0:
+      return x + y;
+    case 1:
+      return -x + y;
+    case 2:
+      return x - y;
+    case 3:
+      return -x - y;
+    case 4:
+      return x;
+    case 5:
+      return -x;
+    case 6:
+      return y;
+    default:
+      return -y;
+    }
+  }
+
+  inline uint16_t toOutput(int32_t value)
+  {
+    int32_t out = 32768 + value * OUTPUT_GAIN;
+    return out < 0 ? 0 : (out > 65535 ? 65535 : out);
+  }
+
+  // The parts of one z coordinate every sample in a slice shares
+  struct Slice
+  {
+    int cell;
+    int32_t near;  // Distance past the lower lattice plane, Q12
+    int32_t eased; // fade() of the fraction
+
+    explicit Slice(uint32_t z)
+        : cell((z >> 16) & 255), near((z & 0xFFFF) >> (16 - FRACTION_BITS)), eased(fade(z & 0xFFFF)) {}
+  };
+
+  inline int32_t sample3(uint32_t x, uint32_t y, const Slice &z)
+  {
+    int xi = (x >> 16) & 255;
+    int yi = (y >> 16) & 255;
+    int32_t fx = (x & 0xFFFF) >> (16 - FRACTION_BITS);
+    int32_t fy = (y & 0xFFFF) >> (16 - FRACTION_BITS);
+    int32_t u = fade(x & 0xFFFF);
+    int32_t v = fade(y & 0xFFFF);
+    int32_t fz = z.near;
+
+    int a = hash(xi) + yi;
+    int aa = hash(a) + z.cell;
+    int ab = hash(a + 1) + z.cell;
+    int b = hash(xi + 1) + yi;
+    int ba = hash(b) + z.cell;
+    int bb = hash(b + 1) + z.cell;
+
+    int32_t x1 = lerp(grad(hash(aa), fx, fy, fz), grad(hash(ba), fx - UNIT, fy, fz), u);
+    int32_t x2 = lerp(grad(hash(ab), fx, fy - UNIT, fz), grad(hash(bb), fx - UNIT, fy - UNIT, fz), u);
+    int32_t y1 = lerp(x1, x2, v);
+    x1 = lerp(grad(hash(aa + 1), fx, fy, fz - UNIT), grad(hash(ba + 1), fx - UNIT, fy, fz - UNIT), u);
+    x2 = lerp(grad(hash(ab + 1), fx, fy - UNIT, fz - UNIT), grad(hash(bb + 1), fx - UNIT, fy - UNIT, fz - UNIT), u);
+    int32_t y2 = lerp(x1, x2, v);
+    return lerp(y1, y2, z.eased);
+  }
+
+  inline int32_t sample2(uint32_t x, uint32_t y)
+  {
+    int xi = (x >> 16) & 255;
+    int yi = (y >> 16) & 255;
+    int32_t fx = (x & 0xFFFF) >> (16 - FRACTION_BITS);
+    int32_t fy = (y & 0xFFFF) >> (16 - FRACTION_BITS);
+    int32_t u = fade(x & 0xFFFF);
+    int32_t v = fade(y & 0xFFFF);
+
+    int a = hash(xi) + yi;
+    int b = hash(xi + 1) + yi;
+    int32_t x1 = lerp(grad(hash(a), fx, fy), grad(hash(b), fx - UNIT, fy), u);
+    int32_t x2 = lerp(grad(hash(a + 1), fx, fy - UNIT), grad(hash(b + 1), fx - UNIT, fy - UNIT), u);
+    return lerp(x1, x2, v);
+  }
+}
+
+namespace Noise
+{
+  uint16_t noise2(uint32_t x, uint32_t y)
+  {
+    return toOutput(sample2(x, y));
+  }
+
+  uint16_t noise3(uint32_t x, uint32_t y, uint32_t z)
+  {
+    return toOutput(sample3(x, y, Slice(z)));
+  }
+}
+
+void NoiseMap::prepare(float cellsPerUnit)
+{
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+  {
+    for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
+    {
+      const LedPosition &position = Topology::getLedPosition(s, led);
+      int p = s * Constants::LEDS_PER_SEGMENT + led;
+      x[p] = (uint32_t)(int32_t)(position.x * cellsPerUnit * 65536.0f);
+      y[p] = (uint32_t)(int32_t)(position.y * cellsPerUnit * 65536.0f);
+    }
+  }
+  prepared = true;
+}
+
+void NoiseMap::fill(uint32_t dx, uint32_t dy, uint8_t *out) const
+{
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    out[p] = toOutput(sample2(x[p] + dx, y[p] + dy)) >> 8;
+  }
+}
+
+void NoiseMap::fill(uint32_t dx, uint32_t dy, uint32_t z, uint8_t *out) const
+{
+  const Slice slice(z);
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    out[p] = toOutput(sample3(x[p] + dx, y[p] + dy, slice)) >> 8;
+  }
+}
@@ -0,0 +1,50 @@
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+/*
+Perlin gradient noise in integer arithmetic, for effects that want smooth
+organic variation instead of stacked sine waves.
+
+Coordinates are 16.16 fixed point lattice units: the noise changes over
+about one unit, and its pattern repeats every 256. Results span 0 to 65535
+around a middle of 32768, the far ends being rare. Fractions are smoothed
+with 3t^2 - 2t^3 and gradients kept in 12 bits, so a sample is a handful
+of table lookups and 32 bit multiplies.
+*/
+
+namespace Noise
+{
+  uint16_t noise2(uint32_t x, uint32_t y);
+  uint16_t noise3(uint32_t x, uint32_t y, uint32_t z);
+
+  inline uint8_t noise8(uint32_t x, uint32_t y) { return noise2(x, y) >> 8; }
+  inline uint8_t noise8(uint32_t x, uint32_t y, uint32_t z) { return noise3(x, y, z) >> 8; }
+}
+
+// Noise sampled at every LED. The positions (Topology::getLedPosition) are
+// scaled into lattice units once by prepare(); each fill() then offsets them
+// and samples the whole frame buffer, working out the z slice only once.
+class NoiseMap
+{
+public:
+  NoiseMap() : prepared(false) {}
+
+  // cellsPerUnit lattice units per LedPosition unit. Call again after a
+  // layout change
+  void prepare(float cellsPerUnit);
+  bool isPrepared() const { return prepared; }
+
+  // out[pixel] = noise8() at each LED moved by (dx, dy), in lattice units
+  void fill(uint32_t dx, uint32_t dy, uint8_t *out) const;
+  void fill(uint32_t dx, uint32_t dy, uint32_t z, uint8_t *out) const;
+
+private:
+  uint32_t x[Constants::NUM_OF_PIXELS];
+  uint32_t y[Constants::NUM_OF_PIXELS];
+  bool prepared;
+};
+
+#endif // NOISE_H
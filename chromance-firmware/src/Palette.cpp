@@ -0,0 +1,181 @@
+#include "Palette.h"
+#include <string.h>
+
+namespace
+{
+  // Every built in palette starts from black, so 0 is off in any of them
+
+  // Inferno's fire: deepening quadratically to red by 0.4, then through
+  // orange to yellow
+  const GradientStop HEAT_STOPS[] = {
+      {0, 0, 0, 0}, {26, 17, 0, 0}, {51, 64, 0, 0}, {77, 145, 0, 0}, {102, 255, 0, 0}, {179, 255, 128, 0}, {255, 255, 255, 0}};
+  // Lightning's flash: white hot, fading through purple
+  const GradientStop STORM_STOPS[] = {{0, 0, 0, 0}, {128, 150, 0, 255}, {255, 255, 255, 255}};
+  // Water: deep blue, the trail behind a drop, surface foam, the drop itself
+  const GradientStop OCEAN_STOPS[] = {
+      {0, 0, 0, 0}, {64, 0, 0, 150}, {128, 0, 100, 180}, {192, 100, 100, 180}, {255, 150, 220, 255}};
+  const GradientStop RAINBOW_STOPS[] = {
+      {0, 0, 0, 0}, {36, 255, 0, 0}, {72, 255, 255, 0}, {108, 0, 255, 0}, {144, 0, 255, 255}, {180, 0, 0, 255}, {216, 255, 0, 255}, {255, 255, 0, 80}};
+  const GradientStop SUNSET_STOPS[] = {
+      {0, 0, 0, 0}, {80, 120, 0, 90}, {160, 255, 40, 0}, {220, 255, 140, 0}, {255, 255, 230, 120}};
+  const GradientStop FOREST_STOPS[] = {{0, 0, 0, 0}, {96, 0, 80, 10}, {176, 60, 160, 0}, {255, 200, 255, 80}};
+
+  struct BuiltIn
+  {
+    const char *name;
+    const GradientStop *stops;
+    int count;
+  };
+
+#define STOPS(array) array, (int)(sizeof(array) / sizeof(array[0]))
+  const BuiltIn BUILT_IN[Palettes::COUNT] = {
+      {"Heat", STOPS(HEAT_STOPS)},
+      {"Storm", STOPS(STORM_STOPS)},
+      {"Ocean", STOPS(OCEAN_STOPS)},
+      {"Rainbow", STOPS(RAINBOW_STOPS)},
+      {"Sunset", STOPS(SUNSET_STOPS)},
+      {"Forest", STOPS(FOREST_STOPS)},
+  };
+#undef STOPS
+
+  Palette compiled[Palettes::COUNT];
+
+  struct Compiler
+  {
+    Compiler()
+    {
+      for (int i = 0; i < Palettes::COUNT; i++)
+      {
+        compiled[i].compile(BUILT_IN[i].stops, BUILT_IN[i].count);
+      }
+    }
+  } compiler;
+}
+
+Palette::Palette()
+{
+  memset(colors, 0, sizeof(colors));
+}
+
+void Palette::compile(const GradientStop *stops, int count)
+{
+  if (count <= 0)
+  {
+    memset(colors, 0, sizeof(colors));
+    return;
+  }
+
+  int k = 0; // Last stop at or before i
+  for (int i = 0; i < SIZE; i++)
+  {
+    while (k + 1 < count && stops[k + 1].position <= i)
+    {
+      k++;
+    }
+    const GradientStop &a = stops[k];
+    if (i <= a.position || k + 1 == count)
+    {
+      colors[i * 3] = a.r;
+      colors[i * 3 + 1] = a.g;
+      colors[i * 3 + 2] = a.b;
+      continue;
+    }
+    const GradientStop &b = stops[k + 1];
+    int span = b.position - a.position;
+    int t = i - a.position;
+    colors[i * 3] = (a.r * (span - t) + b.r * t + span / 2) / span;
+    colors[i * 3 + 1] = (a.g * (span - t) + b.g * t + span / 2) / span;
+    colors[i * 3 + 2] = (a.b * (span - t) + b.b * t + span / 2) / span;
+  }
+}
+
+void Palette::blend(const Palette &from, const Palette &to, int amount)
+{
+  for (int k = 0; k < SIZE * 3; k++)
+  {
+    colors[k] = from.colors[k] + (((to.colors[k] - from.colors[k]) * amount) >> 8);
+  }
+}
+
+namespace Palettes
+{
+  const Palette &get(int id)
+  {
+    return compiled[id >= 0 && id < COUNT ? id : 0];
+  }
+
+  const char *getName(int id)
+  {
+    return BUILT_IN[id >= 0 && id < COUNT ? id : 0].name;
+  }
+
+  int find(const char *name)
+  {
+    for (int i = 0; name != nullptr && i < COUNT; i++)
+    {
+      if (strcmp(name, BUILT_IN[i].name) == 0)
+      {
+        return i;
+      }
+    }
+    return -1;
+  }
+}
+
+const unsigned long PaletteSelection::BLEND_TIME;
+
+PaletteSelection::PaletteSelection(int palette)
+    : selected(palette), shown(&Palettes::get(palette)), blending(false), starting(false), blendStart(0) {}
+
+void PaletteSelection::select(int palette)
+{
+  if (palette == selected || palette < 0 || palette >= Palettes::COUNT)
+  {
+    return;
+  }
+  from = *shown;
+  selected = palette;
+  blending = true;
+  starting = true;
+}
+
+void PaletteSelection::snap()
+{
+  blending = false;
+  starting = false;
+  shown = &Palettes::get(selected);
+}
+
+void PaletteSelection::update(unsigned long now)
+{
+  if (!blending)
+  {
+    return;
+  }
+  if (starting)
+  {
+    blendStart = now;
+    starting = false;
+  }
+  unsigned long elapsed = now - blendStart;
+  if (elapsed >= BLEND_TIME)
+  {
+    snap();
+    return;
+  }
+  mixed.blend(from, Palettes::get(selected), (int)(elapsed * 256 / BLEND_TIME));
+  shown = &mixed;
+}
+
+void PaletteSelection::getConfig(JsonObject &doc) const
+{
+  doc["palette"] = Palettes::getName(selected);
+}
+
+void PaletteSelection::setConfig(const JsonObject &doc)
+{
+  if (doc["palette"].is<const char *>())
+  {
+    select(Palettes::find(doc["palette"].as<const char *>()));
+  }
+}
@@ -0,0 +1,102 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+/*
+Colour gradients compiled to lookup tables, so an effect that maps heat,
+depth or intensity to a colour reads one table entry instead of working the
+colour out per pixel.
+
+A gradient is a list of stops, each a colour at a position from 0 to 255;
+compile() fills the 256 entries in between by straight interpolation. The
+built in palettes (Palettes::get()) are compiled during static
+initialisation and selected by name, which is how animations offer them in
+their web config.
+*/
+
+struct GradientStop
+{
+  uint8_t position;
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+};
+
+class Palette
+{
+public:
+  static const int SIZE = 256;
+
+  Palette();
+
+  // stops in increasing position; entries before the first stop and after
+  // the last take their colour
+  void compile(const GradientStop *stops, int count);
+  // Every entry amount / 256 of the way from from's to to's
+  void blend(const Palette &from, const Palette &to, int amount);
+
+  const byte *lookup(uint8_t index) const { return colors + index * 3; }
+
+private:
+  byte colors[SIZE * 3];
+};
+
+namespace Palettes
+{
+  // Indices of the built in palettes, which get() and getName() take
+  enum Id
+  {
+    HEAT,
+    STORM,
+    OCEAN,
+    RAINBOW,
+    SUNSET,
+    FOREST,
+    COUNT
+  };
+
+  const Palette &get(int id);
+  const char *getName(int id);
+  // -1 for a name that is not a palette
+  int find(const char *name);
+}
+
+// The palette an animation draws with, chosen in its config. A new choice
+// fades in from what was showing over BLEND_TIME, rebuilding the table as
+// it goes; otherwise lookups read the built in table directly.
+class PaletteSelection
+{
+public:
+  static const unsigned long BLEND_TIME = 1000;
+
+  explicit PaletteSelection(int palette);
+
+  int getSelected() const { return selected; }
+  void select(int palette);
+  // Skips any blend under way, for an animation that is starting afresh
+  void snap();
+  // Moves the blend on; call once a frame before the lookups
+  void update(unsigned long now);
+
+  const byte *lookup(uint8_t index) const { return shown->lookup(index); }
+
+  // The "palette" key, holding the palette's name
+  void getConfig(JsonObject &doc) const;
+  void setConfig(const JsonObject &doc);
+
+private:
+  int selected;
+  const Palette *shown; // The selected built in palette, or mixed while blending
+  Palette from;
+  Palette mixed;
+  bool blending;
+  bool starting; // Blend chosen, its start time taken at the next update()
+  unsigned long blendStart;
+
+  PaletteSelection(const PaletteSelection &);
+  PaletteSelection &operator=(const PaletteSelection &);
+};
+
+#endif // PALETTE_H
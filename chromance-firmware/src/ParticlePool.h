@@ -0,0 +1,82 @@
+#ifndef PARTICLE_POOL_H
+#define PARTICLE_POOL_H
+
+#include <stddef.h>
+
+// Fixed-capacity storage for the particles an animation spawns and retires
+// every frame. The slots live inside the pool, so once the animation exists
+// adding and removing particles never touches the heap.
+//
+// Particles stay in the order they were added. An update either walks the
+// pool and retain()s the survivors in place, or, when one particle can turn
+// into several, keeps two pools and fills one from the other each frame.
+template <typename T, size_t Capacity>
+class ParticlePool
+{
+public:
+  ParticlePool() : count(0) {}
+
+  static size_t capacity() { return Capacity; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  bool full() const { return count == Capacity; }
+  void clear() { count = 0; }
+
+  // The new last slot for the caller to fill in, or nullptr when full
+  T *add()
+  {
+    return count < Capacity ? &slots[count++] : nullptr;
+  }
+
+  // Returns false (dropping the particle) when full
+  bool push(const T &particle)
+  {
+    T *slot = add();
+    if (!slot)
+    {
+      return false;
+    }
+    *slot = particle;
+    return true;
+  }
+
+  // Removes particle i by moving the last one into its place; does not
+  // keep the order
+  void removeSwap(size_t i)
+  {
+    slots[i] = slots[--count];
+  }
+
+  // Calls keep(particle) on each particle in order, which may change it,
+  // and closes up the ones it returns false for
+  template <typename Keep>
+  void retain(Keep keep)
+  {
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+      if (keep(slots[i]))
+      {
+        if (kept != i)
+        {
+          slots[kept] = slots[i];
+        }
+        kept++;
+      }
+    }
+    count = kept;
+  }
+
+  T &operator[](size_t i) { return slots[i]; }
+  const T &operator[](size_t i) const { return slots[i]; }
+  T *begin() { return slots; }
+  T *end() { return slots + count; }
+  const T *begin() const { return slots; }
+  const T *end() const { return slots + count; }
+
+private:
+  T slots[Capacity];
+  size_t count;
+};
+
+#endif // PARTICLE_POOL_H
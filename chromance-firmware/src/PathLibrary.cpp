@@ -0,0 +1,322 @@
+#include "PathLibrary.h"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+  struct Step
+  {
+    int segment;
+    int from; // Node the step leaves
+  };
+
+  int portOf(int node, int segment)
+  {
+    for (int port = 0; port < Constants::MAX_PATHS_PER_NODE; port++)
+    {
+      if (Topology::nodeConnections[node][port] == segment)
+      {
+        return port;
+      }
+    }
+    return -1;
+  }
+
+  int edgeOf(int segment, int from)
+  {
+    return segment * 2 + (Topology::segmentConnections[segment][0] == from ? 0 : 1);
+  }
+
+  // Walks one face of the wall as drawn: leave node by port, then at each
+  // node take the next port clockwise from the one arrived by, until the
+  // first step comes round again
+  void traceFace(int node, int port, std::vector<Step> &steps)
+  {
+    steps.clear();
+    int at = node;
+    do
+    {
+      int segment = Topology::nodeConnections[at][port];
+      Step step = {segment, at};
+      steps.push_back(step);
+      int next = Topology::getOtherEnd(segment, at);
+      int arrived = portOf(next, segment);
+      for (int turn = 1; turn <= Constants::MAX_PATHS_PER_NODE; turn++)
+      {
+        port = (arrived + turn) % Constants::MAX_PATHS_PER_NODE;
+        if (Topology::nodeConnections[next][port] >= 0)
+        {
+          break;
+        }
+      }
+      at = next;
+    } while ((at != node || Topology::nodeConnections[at][port] != steps[0].segment) &&
+             (int)steps.size() <= 2 * Constants::NUMBER_OF_SEGMENTS);
+  }
+
+  // Twice the area the face encloses; ports run clockwise on screen (y
+  // down), so faces inside the wall come out negative and the one around
+  // its outside positive
+  long faceArea(const std::vector<Step> &steps)
+  {
+    long area = 0;
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+      const NodePosition &a = Topology::nodePositions[steps[i].from];
+      const NodePosition &b = Topology::nodePositions[steps[(i + 1) % steps.size()].from];
+      area += (long)a.x * b.y - (long)b.x * a.y;
+    }
+    return area;
+  }
+
+  class Builder
+  {
+  public:
+    std::vector<int> pathStart;
+    std::vector<int> pathNode;
+    std::vector<uint16_t> pixels;
+
+    void begin(int node)
+    {
+      pathStart.push_back(pixels.size());
+      pathNode.push_back(node);
+    }
+
+    // Every LED of the segment, in the order met leaving `from`
+    void addSegment(int segment, int from)
+    {
+      const int leds = Constants::LEDS_PER_SEGMENT;
+      bool up = Topology::segmentConnections[segment][1] == from; // LED 0 is at the floor end
+      for (int i = 0; i < leds; i++)
+      {
+        int led = up ? i : leds - 1 - i;
+        pixels.push_back(segment * leds + led);
+      }
+    }
+
+    void addGap()
+    {
+      pixels.insert(pixels.end(), Constants::LEDS_PER_SEGMENT, PathLibrary::GAP);
+    }
+
+    void addSteps(const std::vector<Step> &steps, size_t first, size_t end)
+    {
+      for (size_t i = first; i < end; i++)
+      {
+        addSegment(steps[i].segment, steps[i].from);
+      }
+    }
+
+    // Depth first along segments that keep to a longest way down
+    void descend(int start, int node, const std::vector<int> &height, std::vector<int> &route, int &kept)
+    {
+      if (kept >= PathLibrary::MAX_DESCENTS_PER_NODE)
+      {
+        return;
+      }
+      if (height[node] == 0)
+      {
+        begin(start);
+        for (size_t i = 0; i < route.size(); i++)
+        {
+          addSegment(route[i], Topology::segmentConnections[route[i]][0]);
+        }
+        kept++;
+        return;
+      }
+      const PathList &down = Topology::getDownPaths(node);
+      for (int i = 0; i < down.count; i++)
+      {
+        int next = Topology::segmentConnections[down.segments[i]][1];
+        if (height[next] == height[node] - 1)
+        {
+          route.push_back(down.segments[i]);
+          descend(start, next, height, route, kept);
+          route.pop_back();
+        }
+      }
+    }
+  };
+}
+
+const uint16_t PathLibrary::GAP;
+const int PathLibrary::MAX_DESCENTS_PER_NODE;
+
+PathLibrary::PathLibrary() : pathStart(nullptr), pathNode(nullptr), pixels(nullptr)
+{
+  for (int k = 0; k < KIND_COUNT; k++)
+  {
+    kindStart[k] = 0;
+    longest[k] = 0;
+  }
+  kindStart[KIND_COUNT] = 0;
+}
+
+PathLibrary::~PathLibrary()
+{
+  release();
+}
+
+void PathLibrary::release()
+{
+  delete[] pathStart;
+  delete[] pathNode;
+  delete[] pixels;
+  pathStart = nullptr;
+  pathNode = nullptr;
+  pixels = nullptr;
+}
+
+void PathLibrary::build()
+{
+  release();
+
+  const int nodes = Constants::NUMBER_OF_NODES;
+  const int segments = Constants::NUMBER_OF_SEGMENTS;
+  const NodePosition *positions = Topology::nodePositions;
+  Builder builder;
+
+  // Columns: vertical segments grouped by x, top to bottom
+  kindStart[COLUMNS] = 0;
+  std::vector<int> vertical;
+  for (int s = 0; s < segments; s++)
+  {
+    if (positions[Topology::segmentConnections[s][0]].x == positions[Topology::segmentConnections[s][1]].x)
+    {
+      vertical.push_back(s);
+    }
+  }
+  std::sort(vertical.begin(), vertical.end(), [positions](int a, int b)
+            {
+              const NodePosition &pa = positions[Topology::segmentConnections[a][0]];
+              const NodePosition &pb = positions[Topology::segmentConnections[b][0]];
+              return pa.x != pb.x ? pa.x < pb.x : pa.y < pb.y; });
+  for (size_t i = 0; i < vertical.size(); i++)
+  {
+    int segment = vertical[i];
+    int ceiling = Topology::segmentConnections[segment][0];
+    if (i == 0 || positions[ceiling].x != positions[Topology::segmentConnections[vertical[i - 1]][0]].x)
+    {
+      builder.begin(ceiling);
+    }
+    else
+    {
+      // Fill the space down from the last segment with gaps its height
+      int above = vertical[i - 1];
+      int top = positions[Topology::segmentConnections[above][0]].y;
+      int bottom = positions[Topology::segmentConnections[above][1]].y;
+      int space = positions[ceiling].y - bottom;
+      int gaps = bottom > top ? (space + (bottom - top) / 2) / (bottom - top) : 0;
+      for (int g = 0; g < gaps; g++)
+      {
+        builder.addGap();
+      }
+    }
+    builder.addSegment(segment, ceiling);
+  }
+
+  // Descents: the longest way down from every node has a height in
+  // segments, found bottom up; keep the routes that never lose any
+  kindStart[DESCENTS] = builder.pathNode.size();
+  std::vector<int> byHeight;
+  for (int n = 0; n < nodes; n++)
+  {
+    byHeight.push_back(n);
+  }
+  std::sort(byHeight.begin(), byHeight.end(), [positions](int a, int b)
+            { return positions[a].y > positions[b].y; });
+  std::vector<int> height(nodes, 0);
+  for (size_t i = 0; i < byHeight.size(); i++)
+  {
+    int n = byHeight[i];
+    const PathList &down = Topology::getDownPaths(n);
+    for (int d = 0; d < down.count; d++)
+    {
+      height[n] = std::max(height[n], 1 + height[Topology::segmentConnections[down.segments[d]][1]]);
+    }
+  }
+  std::vector<int> route;
+  for (int n = 0; n < nodes; n++)
+  {
+    if (Topology::getUpPaths(n).count == 0 && height[n] > 0)
+    {
+      int kept = 0;
+      builder.descend(n, n, height, route, kept);
+    }
+  }
+
+  // Borders: every face of the drawing is traced once; the outside ones
+  // are borders, and their nodes cannot have a ring
+  kindStart[BORDERS] = builder.pathNode.size();
+  std::vector<bool> traced(segments * 2, false);
+  std::vector<bool> onBorder(nodes, false);
+  std::vector<Step> steps;
+  for (int s = 0; s < segments; s++)
+  {
+    for (int side = 0; side < Constants::SIDES_PER_SEGMENT; side++)
+    {
+      int from = Topology::segmentConnections[s][side];
+      if (traced[edgeOf(s, from)])
+      {
+        continue;
+      }
+      traceFace(from, portOf(from, s), steps);
+      for (size_t i = 0; i < steps.size(); i++)
+      {
+        traced[edgeOf(steps[i].segment, steps[i].from)] = true;
+      }
+      if (faceArea(steps) >= 0)
+      {
+        builder.begin(from);
+        builder.addSteps(steps, 0, steps.size());
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+          onBorder[steps[i].from] = true;
+        }
+      }
+    }
+  }
+
+  // Rings: the face after each port of the node, minus the two steps that
+  // touch it, runs from that port's neighbour to the neighbour on the port
+  // before; going round the ports anticlockwise joins them up
+  kindStart[RINGS] = builder.pathNode.size();
+  for (int n = 0; n < nodes; n++)
+  {
+    if (onBorder[n] || Topology::getPaths(n).count == 0)
+    {
+      continue;
+    }
+    builder.begin(n);
+    for (int port = Constants::MAX_PATHS_PER_NODE - 1; port >= 0; port--)
+    {
+      if (Topology::nodeConnections[n][port] >= 0)
+      {
+        traceFace(n, port, steps);
+        if (steps.size() > 2)
+        {
+          builder.addSteps(steps, 1, steps.size() - 1);
+        }
+      }
+    }
+  }
+  kindStart[KIND_COUNT] = builder.pathNode.size();
+  builder.pathStart.push_back(builder.pixels.size());
+
+  int paths = builder.pathNode.size();
+  pathStart = new int[paths + 1];
+  pathNode = new int[paths > 0 ? paths : 1];
+  pixels = new uint16_t[builder.pixels.empty() ? 1 : builder.pixels.size()];
+  std::copy(builder.pathStart.begin(), builder.pathStart.end(), pathStart);
+  std::copy(builder.pathNode.begin(), builder.pathNode.end(), pathNode);
+  std::copy(builder.pixels.begin(), builder.pixels.end(), pixels);
+
+  for (int k = 0; k < KIND_COUNT; k++)
+  {
+    longest[k] = 0;
+    for (int p = 0; p < getCount((Kind)k); p++)
+    {
+      longest[k] = std::max(longest[k], getLength((Kind)k, p));
+    }
+  }
+}
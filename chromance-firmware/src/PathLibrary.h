@@ -0,0 +1,70 @@
+#ifndef PATH_LIBRARY_H
+#define PATH_LIBRARY_H
+
+#include "Constants.h"
+#include "Topology.h"
+
+/*
+Routes across the wall worked out once per layout, so an effect that travels
+along the wiring walks a precomputed array instead of choosing segments
+every frame. Each path is a flat sequence of frame buffer pixels
+(LedController::pixelIndex) in travel order:
+
+  COLUMNS  Vertical segments sharing an x position, top to bottom. Where a
+           column crosses empty wall the path holds GAP entries, one per
+           LED of a segment that would have filled it. Ordered left to right.
+  DESCENTS The longest ways down from each node with nothing above it,
+           always following segments towards the floor.
+  BORDERS  A closed loop around the outside of each connected piece of wall.
+  RINGS    A closed loop through the neighbours of each node not on a
+           border: the hexagon around a cube corner, the ring of six cubes
+           around a six-way node.
+
+Built for the active layout by Topology::getPathLibrary().
+*/
+
+class PathLibrary
+{
+public:
+  enum Kind
+  {
+    COLUMNS,
+    DESCENTS,
+    BORDERS,
+    RINGS,
+    KIND_COUNT
+  };
+
+  static const uint16_t GAP = 0xFFFF; // No LED here; MAX_PIXELS keeps real indices below it
+  static const int MAX_DESCENTS_PER_NODE = 32;
+
+  PathLibrary();
+  ~PathLibrary();
+
+  void build();
+
+  int getCount(Kind kind) const { return kindStart[kind + 1] - kindStart[kind]; }
+  const uint16_t *getPixels(Kind kind, int path) const { return pixels + pathStart[kindStart[kind] + path]; }
+  int getLength(Kind kind, int path) const
+  {
+    int p = kindStart[kind] + path;
+    return pathStart[p + 1] - pathStart[p];
+  }
+  int getLongest(Kind kind) const { return longest[kind]; }
+  // Top node of a column, first node of a descent or border, centre of a ring
+  int getNode(Kind kind, int path) const { return pathNode[kindStart[kind] + path]; }
+
+private:
+  int kindStart[KIND_COUNT + 1]; // Paths of kind k are [kindStart[k], kindStart[k + 1])
+  int longest[KIND_COUNT];
+  int *pathStart;                // Path p is pixels[pathStart[p] .. pathStart[p + 1])
+  int *pathNode;
+  uint16_t *pixels;
+
+  PathLibrary(const PathLibrary &);
+  PathLibrary &operator=(const PathLibrary &);
+
+  void release();
+};
+
+#endif // PATH_LIBRARY_H
@@ -0,0 +1,351 @@
+#include "PixelReceiver.h"
+#include <string.h>
+
+namespace
+{
+  const int DDP_HEADER = 10;
+  const int DDP_TIMECODE = 4;
+  const uint8_t DDP_VERSION_MASK = 0xC0;
+  const uint8_t DDP_VERSION_1 = 0x40;
+  const uint8_t DDP_TIMECODE_FLAG = 0x10;
+  const uint8_t DDP_REPLY_FLAG = 0x04;
+  const uint8_t DDP_QUERY_FLAG = 0x02;
+  const uint8_t DDP_PUSH_FLAG = 0x01;
+  const uint8_t DDP_DISPLAY = 1; // Output ids past this are status and configuration
+
+  const int E131_HEADER = 126;
+  const uint32_t E131_ROOT_DATA = 0x00000004;
+  const uint32_t E131_FRAMING_DATA = 0x00000002;
+  const uint8_t E131_PREVIEW = 0x80;
+  const uint8_t E131_TERMINATED = 0x40;
+  const int E131_STALE_WINDOW = 20; // Sequence numbers this far back are late, not a restart
+
+  const int ARTNET_HEADER = 18;
+  const uint16_t ARTNET_DMX = 0x5000;
+  const uint16_t ARTNET_MIN_VERSION = 14;
+
+  uint16_t bigEndian16(const uint8_t *at)
+  {
+    return (uint16_t)((at[0] << 8) | at[1]);
+  }
+
+  uint32_t bigEndian32(const uint8_t *at)
+  {
+    return ((uint32_t)at[0] << 24) | ((uint32_t)at[1] << 16) | ((uint32_t)at[2] << 8) | at[3];
+  }
+}
+
+const int PixelReceiver::FRAME_BYTES;
+const int PixelReceiver::UNIVERSE_BYTES;
+const int PixelReceiver::FRAME_UNIVERSES;
+
+PixelReceiver::PixelReceiver(LedController &ledController, Clock &clock)
+    : ledController(ledController), clock(clock), inputCount(0), sourceCount(0), active(false), lastPacket(0),
+      badPackets(0)
+{
+}
+
+bool PixelReceiver::addInput(PixelSocket &socket, PixelProtocol protocol)
+{
+  if (inputCount == MAX_INPUTS)
+  {
+    return false;
+  }
+  inputs[inputCount].socket = &socket;
+  inputs[inputCount].protocol = protocol;
+  inputCount++;
+  return true;
+}
+
+const char *PixelReceiver::getProtocolName(PixelProtocol protocol)
+{
+  switch (protocol)
+  {
+  case PIXEL_DDP:
+    return "ddp";
+  case PIXEL_E131:
+    return "e131";
+  case PIXEL_ARTNET:
+    return "artnet";
+  default:
+    return "unknown";
+  }
+}
+
+bool PixelReceiver::update()
+{
+  unsigned long now = clock.now();
+  for (int i = 0; i < inputCount; i++)
+  {
+    for (int k = 0; k < MAX_PACKETS_PER_UPDATE; k++)
+    {
+      uint32_t address = 0;
+      int size = inputs[i].socket->next(address);
+      if (size <= 0)
+      {
+        break;
+      }
+      bool valid;
+      switch (inputs[i].protocol)
+      {
+      case PIXEL_DDP:
+        valid = readDdp(*inputs[i].socket, size, address, now);
+        break;
+      case PIXEL_E131:
+        valid = readE131(*inputs[i].socket, size, address, now);
+        break;
+      default:
+        valid = readArtNet(*inputs[i].socket, size, address, now);
+        break;
+      }
+      if (!valid)
+      {
+        badPackets++;
+      }
+    }
+  }
+
+  if (active && now - lastPacket >= TIMEOUT)
+  {
+    active = false;
+    for (int s = 0; s < sourceCount; s++)
+    {
+      sources[s].inFrame = false;
+    }
+  }
+  return active;
+}
+
+bool PixelReceiver::readDdp(PixelSocket &socket, int size, uint32_t address, unsigned long now)
+{
+  if (size < DDP_HEADER || socket.read(header, DDP_HEADER) != DDP_HEADER ||
+      (header[0] & DDP_VERSION_MASK) != DDP_VERSION_1)
+  {
+    return false;
+  }
+  uint8_t flags = header[0];
+  if ((flags & (DDP_QUERY_FLAG | DDP_REPLY_FLAG)) || header[3] > DDP_DISPLAY)
+  {
+    return true; // Well formed, but nothing to show
+  }
+  int start = DDP_HEADER;
+  if (flags & DDP_TIMECODE_FLAG)
+  {
+    if (socket.read(header + DDP_HEADER, DDP_TIMECODE) != DDP_TIMECODE)
+    {
+      return false;
+    }
+    start += DDP_TIMECODE;
+  }
+  uint32_t offset = bigEndian32(header + 4);
+  int length = bigEndian16(header + 8);
+  if (length > size - start)
+  {
+    return false;
+  }
+
+  Source &source = findSource(address, PIXEL_DDP, now);
+  if (header[1] & 0x0F)
+  {
+    countSequence(source, 0, header[1] & 0x0F, 15);
+  }
+  readPixels(socket, source, offset, length, now);
+  if ((flags & DDP_PUSH_FLAG) || (offset < (uint32_t)FRAME_BYTES && offset + length >= (uint32_t)FRAME_BYTES))
+  {
+    show(source);
+  }
+  return true;
+}
+
+bool PixelReceiver::readE131(PixelSocket &socket, int size, uint32_t address, unsigned long now)
+{
+  static const uint8_t IDENTIFIER[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+  if (size < E131_HEADER || socket.read(header, E131_HEADER) != E131_HEADER || bigEndian16(header) != 0x0010 ||
+      bigEndian16(header + 2) != 0 || memcmp(header + 4, IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+  {
+    return false;
+  }
+  if (bigEndian32(header + 18) != E131_ROOT_DATA || bigEndian32(header + 40) != E131_FRAMING_DATA)
+  {
+    return true; // Sync and universe discovery
+  }
+  if (header[117] != 0x02 || header[118] != 0xA1)
+  {
+    return false;
+  }
+  int length = bigEndian16(header + 123) - 1; // Less the start code
+  if (length < 0 || length > 512 || length > size - E131_HEADER)
+  {
+    return false;
+  }
+
+  Source &source = findSource(address, PIXEL_E131, now);
+  uint8_t options = header[112];
+  if (options & E131_TERMINATED)
+  {
+    // The sender is done; don't wait out the timeout unless another is still
+    // sending
+    source.inFrame = false;
+    source.ended = true;
+    if (!isSending(now))
+    {
+      active = false;
+    }
+    return true;
+  }
+  if ((options & E131_PREVIEW) || header[125] != 0)
+  {
+    return true; // For visualisers, or not level data
+  }
+
+  uint16_t universe = bigEndian16(header + 113);
+  if (universe < FIRST_E131_UNIVERSE)
+  {
+    return true;
+  }
+  int index = universe - FIRST_E131_UNIVERSE;
+  if (index < FRAME_UNIVERSES)
+  {
+    // The standard drops packets that arrive after a later one of the same
+    // universe
+    int8_t step = (int8_t)(header[111] - source.sequences[index]);
+    if (source.hasSequence[index] && step <= 0 && step > -E131_STALE_WINDOW)
+    {
+      source.stats.sequenceErrors++;
+      source.stats.packets++;
+      return true;
+    }
+    countSequence(source, index, header[111], 0);
+  }
+  readUniverse(socket, source, index, length, now);
+  return true;
+}
+
+bool PixelReceiver::readArtNet(PixelSocket &socket, int size, uint32_t address, unsigned long now)
+{
+  static const uint8_t IDENTIFIER[8] = {'A', 'r', 't', '-', 'N', 'e', 't', 0};
+  if (size < ARTNET_HEADER || socket.read(header, ARTNET_HEADER) != ARTNET_HEADER ||
+      memcmp(header, IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+  {
+    return false;
+  }
+  if ((header[8] | (header[9] << 8)) != ARTNET_DMX)
+  {
+    return true; // Polls, syncs and the rest of Art-Net
+  }
+  int length = bigEndian16(header + 16);
+  if (bigEndian16(header + 10) < ARTNET_MIN_VERSION || length > 512 || length > size - ARTNET_HEADER)
+  {
+    return false;
+  }
+
+  Source &source = findSource(address, PIXEL_ARTNET, now);
+  uint16_t universe = header[14] | ((header[15] & 0x7F) << 8); // Net, sub-net and universe
+  if (universe < FIRST_ARTNET_UNIVERSE)
+  {
+    return true;
+  }
+  int index = universe - FIRST_ARTNET_UNIVERSE;
+  if (header[12] && index < FRAME_UNIVERSES)
+  {
+    countSequence(source, index, header[12], 255);
+  }
+  readUniverse(socket, source, index, length, now);
+  return true;
+}
+
+void PixelReceiver::readUniverse(PixelSocket &socket, Source &source, int index, int length, unsigned long now)
+{
+  // Universes hold whole LEDs; channels past UNIVERSE_BYTES are unused
+  uint32_t offset = (uint32_t)index * UNIVERSE_BYTES;
+  readPixels(socket, source, offset, length < UNIVERSE_BYTES ? length : UNIVERSE_BYTES, now);
+  if (offset < (uint32_t)FRAME_BYTES && offset + UNIVERSE_BYTES >= (uint32_t)FRAME_BYTES)
+  {
+    show(source);
+  }
+}
+
+void PixelReceiver::readPixels(PixelSocket &socket, Source &source, uint32_t offset, int length, unsigned long now)
+{
+  source.stats.packets++;
+  source.ended = false;
+  if (!source.inFrame)
+  {
+    source.inFrame = true;
+    source.frameStart = micros();
+  }
+  if (offset < (uint32_t)FRAME_BYTES && length > 0)
+  {
+    int room = FRAME_BYTES - (int)offset;
+    socket.read(ledController.ledColors + offset, length < room ? length : room);
+  }
+  active = true;
+  lastPacket = now;
+}
+
+void PixelReceiver::show(Source &source)
+{
+  ledController.show();
+  unsigned long latency = micros() - source.frameStart;
+  source.inFrame = false;
+  source.stats.frames++;
+  source.stats.lastLatency = latency;
+  source.stats.totalLatency += latency;
+  if (latency > source.stats.worstLatency)
+  {
+    source.stats.worstLatency = latency;
+  }
+}
+
+PixelReceiver::Source &PixelReceiver::findSource(uint32_t address, PixelProtocol protocol, unsigned long now)
+{
+  int oldest = 0;
+  for (int s = 0; s < sourceCount; s++)
+  {
+    if (sources[s].stats.address == address && sources[s].stats.protocol == protocol)
+    {
+      sources[s].stats.lastSeen = now;
+      return sources[s];
+    }
+    if (sources[s].stats.lastSeen < sources[oldest].stats.lastSeen)
+    {
+      oldest = s;
+    }
+  }
+
+  Source &source = sources[sourceCount < MAX_SOURCES ? sourceCount++ : oldest];
+  source = Source();
+  source.stats.address = address;
+  source.stats.protocol = protocol;
+  source.stats.lastSeen = now;
+  return source;
+}
+
+bool PixelReceiver::isSending(unsigned long now) const
+{
+  for (int s = 0; s < sourceCount; s++)
+  {
+    if (!sources[s].ended && now - sources[s].stats.lastSeen < TIMEOUT)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PixelReceiver::countSequence(Source &source, int index, uint8_t sequence, uint8_t highest)
+{
+  // DDP and Art-Net count from 1 to highest and start over at 1; E1.31 uses
+  // every value (highest 0)
+  if (source.hasSequence[index])
+  {
+    uint8_t previous = source.sequences[index];
+    uint8_t expected = highest ? (previous >= highest ? 1 : previous + 1) : (uint8_t)(previous + 1);
+    if (sequence != expected)
+    {
+      source.stats.sequenceErrors++;
+    }
+  }
+  source.sequences[index] = sequence;
+  source.hasSequence[index] = true;
+}
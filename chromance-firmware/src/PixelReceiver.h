@@ -0,0 +1,146 @@
+#ifndef PIXEL_RECEIVER_H
+#define PIXEL_RECEIVER_H
+
+#include <Arduino.h>
+#include "Constants.h"
+#include "Clock.h"
+#include "LedController.h"
+
+/*
+Lets lighting software drive the wall over the network with DDP, E1.31 (sACN)
+or Art-Net, sent by unicast to the wall.
+
+Incoming pixels are RGB in frame buffer order: pixel n is LED
+n % LEDS_PER_SEGMENT of segment n / LEDS_PER_SEGMENT, as in
+LedController::ledColors.
+- DDP gives a byte offset into that buffer.
+- E1.31 and Art-Net give a universe. Each universe carries UNIVERSE_BYTES
+  (170 LEDs), starting at FIRST_E131_UNIVERSE or FIRST_ARTNET_UNIVERSE.
+
+Each datagram's header is read first. The pixels are then read from the
+socket straight into ledColors, with no buffer in between. A frame is shown
+when it is complete:
+- DDP: on a packet with the push flag, or one that reaches the end of the
+  buffer.
+- E1.31 and Art-Net: when the universe holding the end of the buffer
+  arrives.
+
+While anything is sending, update() returns true and the animations should
+not render. When no packet has arrived for TIMEOUT, or an E1.31 sender says
+its stream has ended and no other is sending, the wall goes back to its own
+animations.
+
+Each sender (address and protocol) gets statistics: packets, frames shown,
+sequence gaps, and the time from a frame's first packet to the end of its
+show(). E1.31 and Art-Net number each universe on its own, so sequences are
+followed per universe.
+*/
+
+enum PixelProtocol
+{
+  PIXEL_DDP,
+  PIXEL_E131,
+  PIXEL_ARTNET,
+  PIXEL_PROTOCOL_COUNT
+};
+
+// One UDP port, read a datagram at a time
+class PixelSocket
+{
+public:
+  virtual ~PixelSocket() {}
+  // Moves to the next datagram, dropping what is left of the last one.
+  // Returns its size, 0 when none is waiting, and its sender's IPv4 address
+  // as the network stack holds it.
+  virtual int next(uint32_t &source) = 0;
+  // Copies the next bytes of the datagram to data; returns how many there were
+  virtual int read(uint8_t *data, size_t length) = 0;
+};
+
+struct PixelSourceStats
+{
+  uint32_t address = 0;
+  PixelProtocol protocol = PIXEL_DDP;
+  unsigned long packets = 0;
+  unsigned long frames = 0;         // Shown
+  unsigned long sequenceErrors = 0; // Packets lost or out of order
+  unsigned long lastSeen = 0;
+  unsigned long lastLatency = 0; // us from the frame's first packet until show() returned
+  unsigned long worstLatency = 0;
+  uint64_t totalLatency = 0;
+
+  unsigned long averageLatency() const { return frames ? (unsigned long)(totalLatency / frames) : 0; }
+};
+
+class PixelReceiver
+{
+public:
+  static const uint16_t DDP_PORT = 4048;
+  static const uint16_t E131_PORT = 5568;
+  static const uint16_t ARTNET_PORT = 6454;
+  static const unsigned long TIMEOUT = 2500; // ms
+  static const int MAX_INPUTS = PIXEL_PROTOCOL_COUNT;
+  static const int MAX_SOURCES = 4; // The least recently seen makes room
+  static const int MAX_PACKETS_PER_UPDATE = 32;
+  static const int UNIVERSE_BYTES = 510;
+  static const uint16_t FIRST_E131_UNIVERSE = 1;
+  static const uint16_t FIRST_ARTNET_UNIVERSE = 0;
+  static const int FRAME_BYTES = Constants::NUM_OF_PIXELS * 3;
+  static const int FRAME_UNIVERSES = (FRAME_BYTES + UNIVERSE_BYTES - 1) / UNIVERSE_BYTES;
+
+  PixelReceiver(LedController &ledController, Clock &clock);
+
+  bool addInput(PixelSocket &socket, PixelProtocol protocol);
+
+  // Reads everything that has arrived and shows each completed frame.
+  // Returns true while a sender is active.
+  bool update();
+  bool isActive() const { return active; }
+
+  int getSourceCount() const { return sourceCount; }
+  const PixelSourceStats &getSource(int index) const { return sources[index].stats; }
+  unsigned long getBadPackets() const { return badPackets; }
+  static const char *getProtocolName(PixelProtocol protocol);
+
+private:
+  struct Input
+  {
+    PixelSocket *socket;
+    PixelProtocol protocol;
+  };
+
+  struct Source
+  {
+    PixelSourceStats stats;
+    // Senders number each universe on its own; DDP has one count, the first
+    uint8_t sequences[FRAME_UNIVERSES] = {};
+    bool hasSequence[FRAME_UNIVERSES] = {};
+    bool ended = false; // Its E1.31 stream was terminated
+    bool inFrame = false;
+    unsigned long frameStart = 0; // micros() at the frame's first packet
+  };
+
+  LedController &ledController;
+  Clock &clock;
+  Input inputs[MAX_INPUTS];
+  int inputCount;
+  Source sources[MAX_SOURCES];
+  int sourceCount;
+  bool active;
+  unsigned long lastPacket;
+  unsigned long badPackets;
+  uint8_t header[126]; // The longest header, E1.31's
+
+  // Each reads one datagram and returns false when it is malformed
+  bool readDdp(PixelSocket &socket, int size, uint32_t address, unsigned long now);
+  bool readE131(PixelSocket &socket, int size, uint32_t address, unsigned long now);
+  bool readArtNet(PixelSocket &socket, int size, uint32_t address, unsigned long now);
+  void readUniverse(PixelSocket &socket, Source &source, int index, int length, unsigned long now);
+  void readPixels(PixelSocket &socket, Source &source, uint32_t offset, int length, unsigned long now);
+  void show(Source &source);
+  Source &findSource(uint32_t address, PixelProtocol protocol, unsigned long now);
+  bool isSending(unsigned long now) const;
+  void countSequence(Source &source, int index, uint8_t sequence, uint8_t highest);
+};
+
+#endif // PIXEL_RECEIVER_H
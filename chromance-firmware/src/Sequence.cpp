@@ -0,0 +1,410 @@
+#include "Sequence.h"
+
+static void writeU16(uint8_t *out, uint16_t value)
+{
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+}
+
+static uint16_t readU16(const uint8_t *in)
+{
+  return in[0] | (in[1] << 8);
+}
+
+// ---------------------------------------------------------------------------
+// MemorySequenceSource
+
+size_t MemorySequenceSource::read(uint8_t *out, size_t length)
+{
+  size_t available = size - position;
+  if (length > available)
+  {
+    length = available;
+  }
+  memcpy(out, data + position, length);
+  position += length;
+  return length;
+}
+
+bool MemorySequenceSource::seek(uint32_t target)
+{
+  if (target > size)
+  {
+    return false;
+  }
+  position = target;
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// SequenceEncoder
+
+void SequenceEncoder::setPalette(const byte (*colors)[3], int count)
+{
+  paletteCount = count < Sequence::MAX_PALETTE ? count : Sequence::MAX_PALETTE;
+  memcpy(palette, colors, paletteCount * 3);
+}
+
+bool SequenceEncoder::begin(SequenceSink &output, uint16_t frameMillis)
+{
+  sink = &output;
+  paletteEmitted = 0;
+  frameCount = 0;
+  bytesWritten = 0;
+  memset(hashKeys, 0, sizeof(hashKeys));
+  memset(previous, 0, sizeof(previous));
+
+  uint8_t header[Sequence::HEADER_SIZE] = {'C', 'H', 'S', 'Q', Sequence::VERSION, 0};
+  writeU16(header + 6, Constants::NUM_OF_PIXELS);
+  writeU16(header + 8, frameMillis);
+  return emit(header, sizeof(header));
+}
+
+byte SequenceEncoder::lookup(byte r, byte g, byte b)
+{
+  uint32_t key = ((uint32_t)r << 16 | (uint32_t)g << 8 | b) + 1;
+  uint32_t slot = (key * 2654435761u) >> 22; // Top 10 bits: HASH_SIZE entries
+
+  for (int probe = 0; probe < 8; probe++)
+  {
+    uint32_t i = (slot + probe) & (HASH_SIZE - 1);
+    if (hashKeys[i] == key)
+    {
+      return hashValues[i];
+    }
+    if (hashKeys[i] == 0)
+    {
+      byte index = 0;
+      bool found = false;
+      for (int p = 0; p < paletteCount; p++)
+      {
+        if (palette[p][0] == r && palette[p][1] == g && palette[p][2] == b)
+        {
+          index = p;
+          found = true;
+          break;
+        }
+      }
+
+      if (!found && paletteCount < Sequence::MAX_PALETTE)
+      {
+        index = paletteCount;
+        palette[paletteCount][0] = r;
+        palette[paletteCount][1] = g;
+        palette[paletteCount][2] = b;
+        paletteCount++;
+      }
+      else if (!found)
+      {
+        // Palette is full: fall back to the nearest colour
+        long best = 0x7FFFFFFF;
+        for (int p = 0; p < paletteCount; p++)
+        {
+          long dr = (long)palette[p][0] - r;
+          long dg = (long)palette[p][1] - g;
+          long db = (long)palette[p][2] - b;
+          long distance = dr * dr + dg * dg + db * db;
+          if (distance < best)
+          {
+            best = distance;
+            index = p;
+          }
+        }
+      }
+
+      hashKeys[i] = key;
+      hashValues[i] = index;
+      return index;
+    }
+  }
+
+  // Neighbourhood of the hash table is full; map without caching
+  hashKeys[slot] = 0;
+  return lookup(r, g, b);
+}
+
+bool SequenceEncoder::addFrame(const byte *rgb)
+{
+  if (sink == nullptr)
+  {
+    return false;
+  }
+
+  const int pixels = Constants::NUM_OF_PIXELS;
+  for (int i = 0; i < pixels; i++)
+  {
+    current[i] = lookup(rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2]);
+  }
+
+  uint8_t *out = frame + 2;
+  size_t length = 0;
+
+  // New palette entries first so every index below is defined
+  while (paletteEmitted < paletteCount)
+  {
+    int count = paletteCount - paletteEmitted;
+    if (count > Sequence::MAX_RUN)
+    {
+      count = Sequence::MAX_RUN;
+    }
+    out[length++] = Sequence::OP_PALETTE | (count - 1);
+    memcpy(out + length, palette[paletteEmitted], count * 3);
+    length += count * 3;
+    paletteEmitted += count;
+  }
+
+  int i = 0;
+  while (i < pixels)
+  {
+    if (current[i] == previous[i])
+    {
+      int run = 1;
+      while (i + run < pixels && run < Sequence::MAX_RUN && current[i + run] == previous[i + run])
+      {
+        run++;
+      }
+      // A skip at the very end of the frame carries no information
+      if (i + run < pixels)
+      {
+        out[length++] = Sequence::OP_SKIP | (run - 1);
+      }
+      i += run;
+      continue;
+    }
+
+    int run = 1;
+    while (i + run < pixels && run < Sequence::MAX_RUN && current[i + run] == current[i])
+    {
+      run++;
+    }
+    if (run >= 3)
+    {
+      out[length++] = Sequence::OP_FILL | (run - 1);
+      out[length++] = current[i];
+      i += run;
+      continue;
+    }
+
+    // Literal until the pixels settle into a skip or fill worth encoding
+    int start = i;
+    int count = 0;
+    while (i < pixels && count < Sequence::MAX_RUN)
+    {
+      bool unchanged = i + 1 < pixels && current[i] == previous[i] && current[i + 1] == previous[i + 1];
+      bool repeat = i + 2 < pixels && current[i] == current[i + 1] && current[i] == current[i + 2];
+      if (count > 0 && (unchanged || repeat))
+      {
+        break;
+      }
+      i++;
+      count++;
+    }
+    out[length++] = Sequence::OP_LITERAL | (count - 1);
+    memcpy(out + length, current + start, count);
+    length += count;
+  }
+
+  writeU16(frame, length);
+  memcpy(previous, current, sizeof(previous));
+  frameCount++;
+  return emit(frame, length + 2);
+}
+
+bool SequenceEncoder::finish()
+{
+  if (sink == nullptr)
+  {
+    return false;
+  }
+  uint8_t end[2] = {0, 0};
+  bool ok = emit(end, sizeof(end));
+  sink = nullptr;
+  paletteCount = 0; // The next recording starts from scratch unless setPalette() is called again
+  return ok;
+}
+
+bool SequenceEncoder::emit(const uint8_t *data, size_t length)
+{
+  bytesWritten += length;
+  return sink->write(data, length);
+}
+
+// ---------------------------------------------------------------------------
+// SequenceDecoder
+
+bool SequenceDecoder::begin(SequenceSource &input)
+{
+  source = &input;
+  valid = false;
+
+  uint8_t header[Sequence::HEADER_SIZE];
+  if (source->read(header, sizeof(header)) != sizeof(header) ||
+      memcmp(header, "CHSQ", 4) != 0 || header[4] != Sequence::VERSION)
+  {
+    Serial.println("Not a sequence file");
+    return false;
+  }
+  if (readU16(header + 6) != Constants::NUM_OF_PIXELS)
+  {
+    Serial.println("Sequence was recorded for a different layout");
+    return false;
+  }
+
+  frameMillis = readU16(header + 8);
+  if (frameMillis == 0)
+  {
+    frameMillis = 1;
+  }
+  valid = true;
+  return rewind();
+}
+
+bool SequenceDecoder::rewind()
+{
+  if (!valid || !source->seek(Sequence::HEADER_SIZE))
+  {
+    valid = false;
+    return false;
+  }
+  frameIndex = 0;
+  paletteCount = 0;
+  memset(indices, 0, sizeof(indices));
+  memset(palette, 0, sizeof(palette));
+  return true;
+}
+
+bool SequenceDecoder::nextFrame()
+{
+  if (!valid)
+  {
+    return false;
+  }
+
+  uint8_t lengthBytes[2];
+  if (source->read(lengthBytes, 2) != 2)
+  {
+    valid = false;
+    return false;
+  }
+  uint16_t length = readU16(lengthBytes);
+  if (length == 0)
+  {
+    return false; // End of sequence
+  }
+  if (length > sizeof(frame) || source->read(frame, length) != length || !apply(frame, length))
+  {
+    Serial.println("Corrupt sequence frame");
+    valid = false;
+    return false;
+  }
+  frameIndex++;
+  return true;
+}
+
+bool SequenceDecoder::apply(const uint8_t *ops, size_t length)
+{
+  size_t pos = 0;
+  int pixel = 0;
+  while (pos < length)
+  {
+    uint8_t token = ops[pos++];
+    int count = (token & 0x3F) + 1;
+
+    switch (token & 0xC0)
+    {
+    case Sequence::OP_SKIP:
+      pixel += count;
+      break;
+    case Sequence::OP_FILL:
+      if (pos >= length || pixel + count > Constants::NUM_OF_PIXELS)
+      {
+        return false;
+      }
+      memset(indices + pixel, ops[pos++], count);
+      pixel += count;
+      break;
+    case Sequence::OP_LITERAL:
+      if (pos + count > length || pixel + count > Constants::NUM_OF_PIXELS)
+      {
+        return false;
+      }
+      memcpy(indices + pixel, ops + pos, count);
+      pos += count;
+      pixel += count;
+      break;
+    default:
+      if (pos + count * 3 > length || paletteCount + count > Sequence::MAX_PALETTE)
+      {
+        return false;
+      }
+      memcpy(palette[paletteCount], ops + pos, count * 3);
+      pos += count * 3;
+      paletteCount += count;
+      break;
+    }
+  }
+  return pixel <= Constants::NUM_OF_PIXELS;
+}
+
+void SequenceDecoder::render(byte *rgb) const
+{
+  for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
+  {
+    const byte *color = palette[indices[i]];
+    rgb[i * 3] = color[0];
+    rgb[i * 3 + 1] = color[1];
+    rgb[i * 3 + 2] = color[2];
+  }
+}
+
+// ---------------------------------------------------------------------------
+// SequenceRecorder
+
+bool SequenceRecorder::start(const char *path, uint16_t frameInterval, unsigned long frames, unsigned long now)
+{
+  stop();
+  file = SPIFFS.open(path, FILE_WRITE);
+  if (!file)
+  {
+    Serial.println("Failed to create sequence file");
+    return false;
+  }
+  frameMillis = frameInterval > 0 ? frameInterval : 1;
+  framesLeft = frames;
+  nextCapture = now;
+  recording = encoder.begin(sink, frameMillis);
+  return recording;
+}
+
+void SequenceRecorder::capture(const byte *rgb, unsigned long now)
+{
+  if (!recording || (long)(now - nextCapture) < 0)
+  {
+    return;
+  }
+  nextCapture += frameMillis;
+
+  if (!encoder.addFrame(rgb))
+  {
+    Serial.println("Failed to write sequence frame");
+    stop();
+    return;
+  }
+  if (--framesLeft == 0)
+  {
+    stop();
+  }
+}
+
+void SequenceRecorder::stop()
+{
+  if (!recording)
+  {
+    return;
+  }
+  encoder.finish();
+  file.close();
+  recording = false;
+  Serial.print("Recorded sequence frames: ");
+  Serial.println((long)encoder.getFrameCount());
+}
@@ -0,0 +1,182 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include "Constants.h"
+
+/*
+Pre-rendered LED sequence format (.chsq), little endian:
+
+  Header (10 bytes): 'C' 'H' 'S' 'Q', version, flags, pixelCount (u16),
+                    frameMillis (u16)
+  Frames:           length (u16) followed by that many bytes of ops; a zero
+                    length marks the end of the sequence
+
+Each pixel holds an index into a palette of up to 256 colours. A frame is a
+list of ops applied to the previous frame's indices (all zero before the
+first frame). Each op is one token byte, with the op in the top two bits and
+(count - 1) in the low six:
+
+  00 SKIP n       n pixels keep their index
+  01 FILL n i     n pixels are set to index i
+  10 LITERAL n .. n pixels are set to the n indices that follow
+  11 PALETTE n .. n colours (RGB) are appended to the palette
+
+The palette is built inline, so a recorder can stream frames out with fixed
+RAM, and a player needs nothing but the indices and the palette.
+*/
+
+namespace Sequence
+{
+  constexpr uint8_t VERSION = 1;
+  constexpr size_t HEADER_SIZE = 10;
+  constexpr int MAX_PALETTE = 256;
+  constexpr int MAX_RUN = 64;
+
+  constexpr uint8_t OP_SKIP = 0x00;
+  constexpr uint8_t OP_FILL = 0x40;
+  constexpr uint8_t OP_LITERAL = 0x80;
+  constexpr uint8_t OP_PALETTE = 0xC0;
+
+  // Worst case for one frame: every palette entry defined plus every pixel literal
+  constexpr size_t MAX_FRAME_BYTES = (MAX_PALETTE / MAX_RUN) + MAX_PALETTE * 3 +
+                                     (Constants::NUM_OF_PIXELS + MAX_RUN - 1) / MAX_RUN + Constants::NUM_OF_PIXELS;
+  static_assert(MAX_FRAME_BYTES <= 65535, "Frame lengths are stored in 16 bits");
+
+  constexpr const char *DEFAULT_PATH = "/sequence.chsq";
+}
+
+class SequenceSink
+{
+public:
+  virtual ~SequenceSink() {}
+  virtual bool write(const uint8_t *data, size_t length) = 0;
+};
+
+class SequenceSource
+{
+public:
+  virtual ~SequenceSource() {}
+  virtual size_t read(uint8_t *data, size_t length) = 0;
+  virtual bool seek(uint32_t position) = 0;
+};
+
+class FileSequenceSink : public SequenceSink
+{
+public:
+  FileSequenceSink(File &file) : file(file) {}
+  bool write(const uint8_t *data, size_t length) override { return file.write(data, length) == length; }
+
+private:
+  File &file;
+};
+
+class FileSequenceSource : public SequenceSource
+{
+public:
+  FileSequenceSource(File &file) : file(file) {}
+  size_t read(uint8_t *data, size_t length) override { return file.read(data, length); }
+  bool seek(uint32_t position) override { return file.seek(position); }
+
+private:
+  File &file;
+};
+
+class MemorySequenceSource : public SequenceSource
+{
+public:
+  MemorySequenceSource(const uint8_t *data, size_t size) : data(data), size(size), position(0) {}
+  size_t read(uint8_t *out, size_t length) override;
+  bool seek(uint32_t target) override;
+
+private:
+  const uint8_t *data;
+  size_t size;
+  size_t position;
+};
+
+// Streams RGB frames out as a sequence. All working memory is fixed.
+class SequenceEncoder
+{
+public:
+  // Optional: start from a precomputed palette (e.g. a median cut over the
+  // whole recording). Colours not in the palette are added while there is
+  // room and mapped to the nearest entry after that.
+  void setPalette(const byte (*colors)[3], int count);
+
+  bool begin(SequenceSink &sink, uint16_t frameMillis);
+  bool addFrame(const byte *rgb);
+  bool finish();
+
+  unsigned long getFrameCount() const { return frameCount; }
+  unsigned long getBytesWritten() const { return bytesWritten; }
+
+private:
+  static const int HASH_SIZE = 1024;
+
+  SequenceSink *sink = nullptr;
+  byte palette[Sequence::MAX_PALETTE][3];
+  int paletteCount = 0;
+  int paletteEmitted = 0;
+  uint32_t hashKeys[HASH_SIZE];  // RGB + 1, 0 = empty
+  byte hashValues[HASH_SIZE];
+  byte previous[Constants::NUM_OF_PIXELS];
+  byte current[Constants::NUM_OF_PIXELS];
+  uint8_t frame[2 + Sequence::MAX_FRAME_BYTES];
+  unsigned long frameCount = 0;
+  unsigned long bytesWritten = 0;
+
+  byte lookup(byte r, byte g, byte b);
+  bool emit(const uint8_t *data, size_t length);
+};
+
+// Plays a sequence back with fixed RAM; only the current frame is read
+class SequenceDecoder
+{
+public:
+  bool begin(SequenceSource &source);
+  bool nextFrame(); // Applies the next frame; false at the end or on error
+  bool rewind();
+  void render(byte *rgb) const; // Expands indices into NUM_OF_PIXELS RGB triplets
+
+  uint16_t getFrameMillis() const { return frameMillis; }
+  unsigned long getFrameIndex() const { return frameIndex; }
+  bool isValid() const { return valid; }
+
+private:
+  SequenceSource *source = nullptr;
+  bool valid = false;
+  uint16_t frameMillis = 0;
+  unsigned long frameIndex = 0;
+  int paletteCount = 0;
+  byte palette[Sequence::MAX_PALETTE][3];
+  byte indices[Constants::NUM_OF_PIXELS];
+  uint8_t frame[Sequence::MAX_FRAME_BYTES];
+
+  bool apply(const uint8_t *ops, size_t length);
+};
+
+// Captures what the controller shows into a sequence file on SPIFFS, one
+// frame every frameMillis of controller time.
+class SequenceRecorder
+{
+public:
+  SequenceRecorder() : sink(file) {}
+
+  bool start(const char *path, uint16_t frameMillis, unsigned long frames, unsigned long now);
+  void capture(const byte *rgb, unsigned long now); // Call once per rendered frame
+  void stop();
+  bool isRecording() const { return recording; }
+
+private:
+  File file;
+  FileSequenceSink sink;
+  SequenceEncoder encoder;
+  bool recording = false;
+  uint16_t frameMillis = 0;
+  unsigned long framesLeft = 0;
+  unsigned long nextCapture = 0;
+};
+
+#endif // SEQUENCE_H
@@ -0,0 +1,474 @@
+#include "ShaderCompiler.h"
+#include <string.h>
+
+using namespace Shader;
+
+namespace
+{
+  struct Name
+  {
+    const char *name;
+    uint8_t value;
+  };
+
+  const Name INPUTS[] = {
+      {"t", TIME},
+      {"x", X},
+      {"y", Y},
+      {"r", RADIUS},
+      {"a", ANGLE},
+      {"seg", SEGMENT},
+      {"led", LED},
+      {"i", INDEX},
+  };
+
+  struct Function
+  {
+    const char *name;
+    Op op;
+    int arguments;
+  };
+
+  const Function FUNCTIONS[] = {
+      {"sin", OP_SIN, 1},
+      {"cos", OP_COS, 1},
+      {"abs", OP_ABS, 1},
+      {"floor", OP_FLOOR, 1},
+      {"fract", OP_FRACT, 1},
+      {"sqrt", OP_SQRT, 1},
+      {"min", OP_MIN, 2},
+      {"max", OP_MAX, 2},
+      {"clamp", OP_CLAMP, 3},
+      {"mix", OP_MIX, 3},
+      {"noise", OP_NOISE, 3},
+  };
+
+  const int INPUT_NAMES = sizeof(INPUTS) / sizeof(INPUTS[0]);
+  const int FUNCTION_NAMES = sizeof(FUNCTIONS) / sizeof(FUNCTIONS[0]);
+
+  bool isNameStart(char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+  }
+
+  bool isDigit(char c)
+  {
+    return c >= '0' && c <= '9';
+  }
+}
+
+const int ShaderCompiler::MAX_SOURCE;
+const int ShaderCompiler::MAX_NAME;
+
+ShaderCompiler::ShaderCompiler()
+    : source(nullptr), at(nullptr), length(0), localCount(0), error(nullptr), errorPosition(0)
+{
+}
+
+bool ShaderCompiler::compile(const char *source, ShaderProgram &program)
+{
+  this->source = source;
+  at = source;
+  length = 0;
+  localCount = 0;
+  error = nullptr;
+  errorPosition = 0;
+
+  if (strlen(source) > (size_t)MAX_SOURCE)
+  {
+    return fail("Shader too long");
+  }
+
+  skipSpace();
+  while (accept("let"))
+  {
+    if (!statement())
+    {
+      return false;
+    }
+    skipSpace();
+  }
+
+  Output output;
+  if (accept("rgb"))
+  {
+    output = RGB;
+  }
+  else if (accept("hsv"))
+  {
+    output = HSV;
+  }
+  else
+  {
+    return fail("Expected let, rgb( or hsv(");
+  }
+  if (!expect("(") || !expression() || !expect(",") || !expression() || !expect(",") || !expression() ||
+      !expect(")"))
+  {
+    return false;
+  }
+  accept(";");
+  skipSpace();
+  if (*at)
+  {
+    return fail("Expected the end after the colour");
+  }
+
+  // The compiler only builds well formed programs, so this fails only when
+  // an expression nests too deeply for the stack
+  ShaderProgram checked;
+  if (!checked.load(output, code, length))
+  {
+    at = source;
+    return fail(checked.getError());
+  }
+  program = checked;
+  return true;
+}
+
+bool ShaderCompiler::fail(const char *message)
+{
+  if (!error)
+  {
+    error = message;
+    errorPosition = at - source;
+  }
+  return false;
+}
+
+void ShaderCompiler::skipSpace()
+{
+  for (;;)
+  {
+    while (*at == ' ' || *at == '\t' || *at == '\n' || *at == '\r')
+    {
+      at++;
+    }
+    if (at[0] == '/' && at[1] == '/')
+    {
+      while (*at && *at != '\n')
+      {
+        at++;
+      }
+      continue;
+    }
+    return;
+  }
+}
+
+bool ShaderCompiler::accept(const char *token)
+{
+  // Word tokens must not run on into a longer name
+  skipSpace();
+  size_t n = strlen(token);
+  if (strncmp(at, token, n) != 0 || (isNameStart(token[0]) && (isNameStart(at[n]) || isDigit(at[n]))))
+  {
+    return false;
+  }
+  at += n;
+  return true;
+}
+
+bool ShaderCompiler::expect(const char *token)
+{
+  if (accept(token))
+  {
+    return true;
+  }
+  switch (token[0])
+  {
+  case '(':
+    return fail("Expected (");
+  case ')':
+    return fail("Expected )");
+  case ',':
+    return fail("Expected ,");
+  case '=':
+    return fail("Expected =");
+  default:
+    return fail("Expected ;");
+  }
+}
+
+int ShaderCompiler::readName(char *name)
+{
+  skipSpace();
+  if (!isNameStart(*at))
+  {
+    return 0;
+  }
+  int n = 0;
+  while (isNameStart(at[n]) || isDigit(at[n]))
+  {
+    if (n >= MAX_NAME - 1)
+    {
+      fail("Name too long");
+      return 0;
+    }
+    name[n] = at[n];
+    n++;
+  }
+  name[n] = '\0';
+  return n;
+}
+
+bool ShaderCompiler::emit(uint8_t op)
+{
+  if (length + 1 > MAX_CODE)
+  {
+    return fail("Shader too long");
+  }
+  code[length++] = op;
+  return true;
+}
+
+bool ShaderCompiler::emit(uint8_t op, uint8_t operand)
+{
+  if (length + 2 > MAX_CODE)
+  {
+    return fail("Shader too long");
+  }
+  code[length++] = op;
+  code[length++] = operand;
+  return true;
+}
+
+bool ShaderCompiler::emitConstant(int32_t value)
+{
+  if (length + 5 > MAX_CODE)
+  {
+    return fail("Shader too long");
+  }
+  code[length++] = OP_PUSH;
+  for (int b = 0; b < 4; b++)
+  {
+    code[length++] = (uint8_t)((uint32_t)value >> (8 * b));
+  }
+  return true;
+}
+
+bool ShaderCompiler::statement()
+{
+  // let name = expression;
+  char name[MAX_NAME];
+  int n = readName(name);
+  if (n == 0)
+  {
+    return fail("Expected a name");
+  }
+  for (int k = 0; k < INPUT_NAMES; k++)
+  {
+    if (strcmp(name, INPUTS[k].name) == 0)
+    {
+      return fail("Name is an input");
+    }
+  }
+  for (int k = 0; k < FUNCTION_NAMES; k++)
+  {
+    if (strcmp(name, FUNCTIONS[k].name) == 0)
+    {
+      return fail("Name is a function");
+    }
+  }
+
+  // A let of a name already made reuses its slot
+  int slot = 0;
+  while (slot < localCount && strcmp(locals[slot], name) != 0)
+  {
+    slot++;
+  }
+  if (slot == MAX_LOCALS)
+  {
+    return fail("Too many lets");
+  }
+  at += n;
+  if (!expect("=") || !expression() || !expect(";"))
+  {
+    return false;
+  }
+  if (slot == localCount)
+  {
+    strcpy(locals[localCount++], name);
+  }
+  return emit(OP_STORE, slot);
+}
+
+bool ShaderCompiler::expression()
+{
+  // Comparisons bind loosest and do not chain
+  if (!additive())
+  {
+    return false;
+  }
+  Op op;
+  if (accept("<="))
+    op = OP_LESS_EQUAL;
+  else if (accept(">="))
+    op = OP_GREATER_EQUAL;
+  else if (accept("<"))
+    op = OP_LESS;
+  else if (accept(">"))
+    op = OP_GREATER;
+  else
+    return true;
+  return additive() && emit(op);
+}
+
+bool ShaderCompiler::additive()
+{
+  if (!term())
+  {
+    return false;
+  }
+  for (;;)
+  {
+    if (accept("+"))
+    {
+      if (!term() || !emit(OP_ADD))
+        return false;
+    }
+    else if (accept("-"))
+    {
+      if (!term() || !emit(OP_SUB))
+        return false;
+    }
+    else
+    {
+      return true;
+    }
+  }
+}
+
+bool ShaderCompiler::term()
+{
+  if (!unary())
+  {
+    return false;
+  }
+  for (;;)
+  {
+    Op op;
+    if (accept("*"))
+      op = OP_MUL;
+    else if (accept("/"))
+      op = OP_DIV;
+    else if (accept("%"))
+      op = OP_MOD;
+    else
+      return true;
+    if (!unary() || !emit(op))
+      return false;
+  }
+}
+
+bool ShaderCompiler::unary()
+{
+  if (accept("-"))
+  {
+    return unary() && emit(OP_NEG);
+  }
+  accept("+");
+  return primary();
+}
+
+bool ShaderCompiler::primary()
+{
+  skipSpace();
+  if (isDigit(*at) || (*at == '.' && isDigit(at[1])))
+  {
+    return number();
+  }
+  if (accept("("))
+  {
+    return expression() && expect(")");
+  }
+
+  char name[MAX_NAME];
+  int n = readName(name);
+  if (n == 0)
+  {
+    return fail("Expected a number, name or (");
+  }
+  at += n;
+  skipSpace();
+  if (*at == '(')
+  {
+    at -= n;
+    return call(name);
+  }
+  for (int slot = 0; slot < localCount; slot++)
+  {
+    if (strcmp(locals[slot], name) == 0)
+    {
+      return emit(OP_LOAD, slot);
+    }
+  }
+  for (int k = 0; k < INPUT_NAMES; k++)
+  {
+    if (strcmp(name, INPUTS[k].name) == 0)
+    {
+      return emit(OP_INPUT, INPUTS[k].value);
+    }
+  }
+  at -= n;
+  return fail("Unknown name");
+}
+
+bool ShaderCompiler::number()
+{
+  // Whole part and up to five decimals, rounded to the nearest 1/65536
+  int32_t whole = 0;
+  while (isDigit(*at))
+  {
+    whole = whole * 10 + (*at++ - '0');
+    if (whole >= 32768)
+    {
+      return fail("Number too big");
+    }
+  }
+  uint32_t fraction = 0;
+  uint32_t scale = 1;
+  if (*at == '.')
+  {
+    at++;
+    while (isDigit(*at))
+    {
+      if (scale < 100000)
+      {
+        fraction = fraction * 10 + (*at - '0');
+        scale *= 10;
+      }
+      at++;
+    }
+  }
+  return emitConstant(whole * ONE + (int32_t)(((uint64_t)fraction * ONE + scale / 2) / scale));
+}
+
+bool ShaderCompiler::call(const char *name)
+{
+  const Function *function = nullptr;
+  for (int k = 0; k < FUNCTION_NAMES; k++)
+  {
+    if (strcmp(name, FUNCTIONS[k].name) == 0)
+    {
+      function = &FUNCTIONS[k];
+    }
+  }
+  if (!function)
+  {
+    return fail("Unknown function");
+  }
+  at += strlen(name);
+  if (!expect("("))
+  {
+    return false;
+  }
+  for (int k = 0; k < function->arguments; k++)
+  {
+    if ((k > 0 && !expect(",")) || !expression())
+    {
+      return false;
+    }
+  }
+  return expect(")") && emit(function->op);
+}
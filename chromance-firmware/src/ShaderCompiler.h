@@ -0,0 +1,69 @@
+#ifndef SHADER_COMPILER_H
+#define SHADER_COMPILER_H
+
+#include <Arduino.h>
+#include "ShaderVM.h"
+
+/*
+Turns the text of a shader into ShaderVM bytecode. A shader is some lets
+followed by the colour, with the same operators and precedence as C:
+
+  let d = abs(r - fract(t * 0.25));
+  let glow = clamp(1 - d * 6, 0, 1);
+  hsv(a + t * 0.1, 1, glow * glow)
+
+The colour is rgb(red, green, blue) or hsv(hue, saturation, value).
+Variables are t, x, y, r (radius), a (angle), seg, led and i (see
+Shader::Input); functions are sin, cos, abs, floor, fract, sqrt, min, max,
+clamp, mix and noise. Comparisons give 1 or 0. Numbers are decimals; there
+are no jumps, so no if or loops.
+
+Compiling is a single pass with no allocation, quick enough to run on the
+wall when a shader is uploaded.
+*/
+
+class ShaderCompiler
+{
+public:
+  static const int MAX_SOURCE = 1024;
+  static const int MAX_NAME = 16;
+
+  ShaderCompiler();
+
+  // Compiles source (nul terminated) into program; on failure program is
+  // left as it was and getError() and getErrorPosition() say what and where
+  bool compile(const char *source, ShaderProgram &program);
+
+  const char *getError() const { return error; }
+  int getErrorPosition() const { return errorPosition; } // Characters into the source
+
+private:
+  const char *source;
+  const char *at;
+  uint8_t code[Shader::MAX_CODE];
+  int length;
+  char locals[Shader::MAX_LOCALS][MAX_NAME];
+  int localCount;
+  const char *error;
+  int errorPosition;
+
+  bool fail(const char *message);
+  void skipSpace();
+  bool accept(const char *token);
+  bool expect(const char *token);
+  int readName(char *name);
+  bool emit(uint8_t op);
+  bool emit(uint8_t op, uint8_t operand);
+  bool emitConstant(int32_t value);
+
+  bool statement();
+  bool expression();
+  bool additive();
+  bool term();
+  bool unary();
+  bool primary();
+  bool number();
+  bool call(const char *name);
+};
+
+#endif // SHADER_COMPILER_H
@@ -0,0 +1,361 @@
+#include "ShaderVM.h"
+#include "Topology.h"
+#include "FixedMath.h"
+#include "Noise.h"
+#include <math.h>
+#include <string.h>
+
+using namespace Shader;
+
+namespace
+{
+  // Stack effect of each opcode, and the bytes of operand after it
+  struct OpInfo
+  {
+    uint8_t pops;
+    uint8_t pushes;
+    uint8_t operand;
+  };
+
+  const OpInfo OPS[OP_COUNT] = {
+      {0, 1, 4}, // OP_PUSH
+      {0, 1, 1}, // OP_INPUT
+      {0, 1, 1}, // OP_LOAD
+      {1, 0, 1}, // OP_STORE
+      {2, 1, 0}, // OP_ADD
+      {2, 1, 0}, // OP_SUB
+      {2, 1, 0}, // OP_MUL
+      {2, 1, 0}, // OP_DIV
+      {2, 1, 0}, // OP_MOD
+      {1, 1, 0}, // OP_NEG
+      {2, 1, 0}, // OP_LESS
+      {2, 1, 0}, // OP_GREATER
+      {2, 1, 0}, // OP_LESS_EQUAL
+      {2, 1, 0}, // OP_GREATER_EQUAL
+      {1, 1, 0}, // OP_SIN
+      {1, 1, 0}, // OP_COS
+      {1, 1, 0}, // OP_ABS
+      {1, 1, 0}, // OP_FLOOR
+      {1, 1, 0}, // OP_FRACT
+      {1, 1, 0}, // OP_SQRT
+      {2, 1, 0}, // OP_MIN
+      {2, 1, 0}, // OP_MAX
+      {3, 1, 0}, // OP_CLAMP
+      {3, 1, 0}, // OP_MIX
+      {3, 1, 0}, // OP_NOISE
+  };
+
+  inline int32_t multiply(int32_t a, int32_t b)
+  {
+    return (int32_t)(((int64_t)a * b) >> 16);
+  }
+
+  inline int32_t divide(int32_t a, int32_t b)
+  {
+    if (b == 0)
+    {
+      return 0;
+    }
+    int64_t q = ((int64_t)a << 16) / b;
+    return q > INT32_MAX ? INT32_MAX : (q < INT32_MIN ? INT32_MIN : (int32_t)q);
+  }
+
+  inline int32_t modulo(int32_t a, int32_t b)
+  {
+    if (b == 0)
+    {
+      return 0;
+    }
+    int32_t r = (int32_t)((int64_t)a % b);
+    return r != 0 && ((r < 0) != (b < 0)) ? r + b : r;
+  }
+
+  inline int32_t unit(int32_t value)
+  {
+    return value < 0 ? 0 : (value > ONE ? ONE : value);
+  }
+
+  // Runs code over inputs and returns the top of the stack; load() has
+  // made sure every step is in bounds
+  inline int32_t *execute(const uint8_t *code, int length, const int32_t *inputs, int32_t *stack)
+  {
+    int32_t locals[MAX_LOCALS];
+    int32_t *top = stack - 1;
+    const uint8_t *end = code + length;
+    for (const uint8_t *pc = code; pc < end;)
+    {
+      switch ((Op)*pc++)
+      {
+      case OP_PUSH:
+        *++top = (int32_t)((uint32_t)pc[0] | (uint32_t)pc[1] << 8 | (uint32_t)pc[2] << 16 | (uint32_t)pc[3] << 24);
+        pc += 4;
+        break;
+      case OP_INPUT:
+        *++top = inputs[*pc++];
+        break;
+      case OP_LOAD:
+        *++top = locals[*pc++];
+        break;
+      case OP_STORE:
+        locals[*pc++] = *top--;
+        break;
+      case OP_ADD:
+        top--;
+        top[0] = (int32_t)((uint32_t)top[0] + (uint32_t)top[1]);
+        break;
+      case OP_SUB:
+        top--;
+        top[0] = (int32_t)((uint32_t)top[0] - (uint32_t)top[1]);
+        break;
+      case OP_MUL:
+        top--;
+        top[0] = multiply(top[0], top[1]);
+        break;
+      case OP_DIV:
+        top--;
+        top[0] = divide(top[0], top[1]);
+        break;
+      case OP_MOD:
+        top--;
+        top[0] = modulo(top[0], top[1]);
+        break;
+      case OP_NEG:
+        top[0] = (int32_t)(0u - (uint32_t)top[0]);
+        break;
+      case OP_LESS:
+        top--;
+        top[0] = top[0] < top[1] ? ONE : 0;
+        break;
+      case OP_GREATER:
+        top--;
+        top[0] = top[0] > top[1] ? ONE : 0;
+        break;
+      case OP_LESS_EQUAL:
+        top--;
+        top[0] = top[0] <= top[1] ? ONE : 0;
+        break;
+      case OP_GREATER_EQUAL:
+        top--;
+        top[0] = top[0] >= top[1] ? ONE : 0;
+        break;
+      case OP_SIN:
+        // Turns in 16.16 are FixedMath angles; Q15 to Q16
+        top[0] = FixedMath::sin16(top[0]) * 2;
+        break;
+      case OP_COS:
+        top[0] = FixedMath::cos16(top[0]) * 2;
+        break;
+      case OP_ABS:
+        top[0] = top[0] < 0 ? (int32_t)(0u - (uint32_t)top[0]) : top[0];
+        break;
+      case OP_FLOOR:
+        top[0] = (int32_t)((uint32_t)top[0] & 0xFFFF0000u);
+        break;
+      case OP_FRACT:
+        top[0] &= 0xFFFF;
+        break;
+      case OP_SQRT:
+        // sqrt(v / 65536) * 65536 is sqrt(v) * 256
+        top[0] = top[0] > 0 ? (int32_t)(FixedMath::sqrt32((uint32_t)top[0]) << 8) : 0;
+        break;
+      case OP_MIN:
+        top--;
+        top[0] = top[1] < top[0] ? top[1] : top[0];
+        break;
+      case OP_MAX:
+        top--;
+        top[0] = top[1] > top[0] ? top[1] : top[0];
+        break;
+      case OP_CLAMP:
+        top -= 2;
+        top[0] = top[0] < top[1] ? top[1] : (top[0] > top[2] ? top[2] : top[0]);
+        break;
+      case OP_MIX:
+        top -= 2;
+        top[0] = (int32_t)((uint32_t)top[0] + (uint32_t)multiply((int32_t)((uint32_t)top[1] - (uint32_t)top[0]), top[2]));
+        break;
+      case OP_NOISE:
+        top -= 2;
+        top[0] = Noise::noise3((uint32_t)top[0], (uint32_t)top[1], (uint32_t)top[2]);
+        break;
+      default:
+        break;
+      }
+    }
+    return top;
+  }
+}
+
+ShaderProgram::ShaderProgram() : output(RGB), length(0), instructions(0), error("Empty program")
+{
+}
+
+bool ShaderProgram::load(Output output, const uint8_t *code, int length)
+{
+  this->length = 0;
+  instructions = 0;
+  if (length <= 0 || length > MAX_CODE)
+  {
+    error = length <= 0 ? "Empty program" : "Program too long";
+    return false;
+  }
+  if (output != RGB && output != HSV)
+  {
+    error = "Unknown output";
+    return false;
+  }
+
+  int depth = 0;
+  int count = 0;
+  for (int pc = 0; pc < length; count++)
+  {
+    uint8_t op = code[pc++];
+    if (op >= OP_COUNT)
+    {
+      error = "Unknown instruction";
+      return false;
+    }
+    const OpInfo &info = OPS[op];
+    if (pc + info.operand > length)
+    {
+      error = "Truncated instruction";
+      return false;
+    }
+    if ((op == OP_INPUT && code[pc] >= INPUT_COUNT) || ((op == OP_LOAD || op == OP_STORE) && code[pc] >= MAX_LOCALS))
+    {
+      error = "Operand out of range";
+      return false;
+    }
+    pc += info.operand;
+    if (depth < info.pops)
+    {
+      error = "Stack underflow";
+      return false;
+    }
+    depth += info.pushes - info.pops;
+    if (depth > MAX_STACK)
+    {
+      error = "Stack overflow";
+      return false;
+    }
+  }
+  if (depth != 3)
+  {
+    error = "Program must leave three values";
+    return false;
+  }
+
+  memcpy(this->code, code, length);
+  this->output = output;
+  this->length = length;
+  instructions = count;
+  error = nullptr;
+  return true;
+}
+
+void ShaderVM::prepare()
+{
+  // Bounds of the wall, for x and y from 0 to 1
+  float left = 1e9f, right = -1e9f, top = 1e9f, bottom = -1e9f;
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const LedPosition &position = Topology::getLedPosition(p / Constants::LEDS_PER_SEGMENT, p % Constants::LEDS_PER_SEGMENT);
+    left = position.x < left ? position.x : left;
+    right = position.x > right ? position.x : right;
+    top = position.y < top ? position.y : top;
+    bottom = position.y > bottom ? position.y : bottom;
+  }
+  float width = right > left ? right - left : 1.0f;
+  float height = bottom > top ? bottom - top : 1.0f;
+  float middleX = (left + right) / 2;
+  float middleY = (top + bottom) / 2;
+
+  float furthest = 0;
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const LedPosition &position = Topology::getLedPosition(p / Constants::LEDS_PER_SEGMENT, p % Constants::LEDS_PER_SEGMENT);
+    float distance = hypotf(position.x - middleX, position.y - middleY);
+    furthest = distance > furthest ? distance : furthest;
+  }
+  furthest = furthest > 0 ? furthest : 1.0f;
+
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const LedPosition &position = Topology::getLedPosition(p / Constants::LEDS_PER_SEGMENT, p % Constants::LEDS_PER_SEGMENT);
+    float dx = position.x - middleX;
+    float dy = position.y - middleY;
+    float turns = atan2f(dy, dx) / (2 * (float)M_PI);
+    x[p] = (int32_t)((position.x - left) / width * ONE);
+    y[p] = (int32_t)((position.y - top) / height * ONE);
+    radius[p] = (int32_t)(hypotf(dx, dy) / furthest * ONE);
+    angle[p] = (int32_t)((turns < 0 ? turns + 1 : turns) * ONE) & 0xFFFF;
+  }
+  prepared = true;
+}
+
+inline void ShaderVM::loadInputs(int pixel, int32_t time, int32_t *inputs) const
+{
+  inputs[TIME] = time;
+  inputs[X] = x[pixel];
+  inputs[Y] = y[pixel];
+  inputs[RADIUS] = radius[pixel];
+  inputs[ANGLE] = angle[pixel];
+  inputs[SEGMENT] = (pixel / Constants::LEDS_PER_SEGMENT) << 16;
+  inputs[LED] = (pixel % Constants::LEDS_PER_SEGMENT) << 16;
+  inputs[INDEX] = pixel << 16;
+}
+
+void ShaderVM::evaluate(const ShaderProgram &program, int pixel, unsigned long millis, int32_t *out) const
+{
+  int32_t inputs[INPUT_COUNT];
+  int32_t stack[MAX_STACK];
+  out[0] = out[1] = out[2] = 0;
+  if (!program.isValid())
+  {
+    return;
+  }
+  loadInputs(pixel, (int32_t)(((uint64_t)millis << 16) / 1000), inputs);
+  int32_t *top = execute(program.getCode(), program.getLength(), inputs, stack);
+  out[0] = top[-2];
+  out[1] = top[-1];
+  out[2] = top[0];
+}
+
+void ShaderVM::render(const ShaderProgram &program, unsigned long millis, const HueWheel &wheel, byte *colors) const
+{
+  if (!program.isValid())
+  {
+    memset(colors, 0, Constants::NUM_OF_PIXELS * 3);
+    return;
+  }
+
+  // Seconds in 16.16 wrap after about nine hours
+  const int32_t time = (int32_t)(((uint64_t)millis << 16) / 1000);
+  const uint8_t *code = program.getCode();
+  const int length = program.getLength();
+  const bool hsv = program.getOutput() == HSV;
+  int32_t inputs[INPUT_COUNT];
+  int32_t stack[MAX_STACK];
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++, colors += 3)
+  {
+    loadInputs(p, time, inputs);
+    int32_t *top = execute(code, length, inputs, stack);
+    if (hsv)
+    {
+      // Full colour from the wheel, washed towards white by 1 - s and
+      // scaled by v
+      const byte *rgb = wheel.lookup((uint16_t)top[-2]);
+      int32_t s = unit(top[-1]) >> 8;
+      int32_t v = unit(top[0]) >> 8;
+      colors[0] = (byte)((v * (255 * 256 - s * (255 - rgb[0]))) >> 16);
+      colors[1] = (byte)((v * (255 * 256 - s * (255 - rgb[1]))) >> 16);
+      colors[2] = (byte)((v * (255 * 256 - s * (255 - rgb[2]))) >> 16);
+    }
+    else
+    {
+      colors[0] = (byte)(unit(top[-2]) * 255 >> 16);
+      colors[1] = (byte)(unit(top[-1]) * 255 >> 16);
+      colors[2] = (byte)(unit(top[0]) * 255 >> 16);
+    }
+  }
+}
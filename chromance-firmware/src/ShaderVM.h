@@ -0,0 +1,133 @@
+#ifndef SHADER_VM_H
+#define SHADER_VM_H
+
+#include <Arduino.h>
+#include "Constants.h"
+#include "HueWheel.h"
+
+/*
+A small stack machine for per-pixel colour programs written on the web page
+(see ShaderCompiler.h), so a new effect needs no reflash.
+
+Values are Q16.16 fixed point: 65536 is 1.0. A program reads the pixel's
+inputs and the time, works on them with arithmetic and a few functions, and
+leaves three values: red, green and blue, or hue, saturation and value. Each
+is 0 to 1, except hue, which is in turns and wraps.
+
+There are no jumps, so a program runs straight through once per pixel.
+ShaderProgram::load() checks all of it before it can run: the opcodes are
+known, the operands are whole, the locals are in range, and the stack never
+underflows or overflows and ends three deep. The VM then runs without
+checks. Division by zero gives 0, and results wrap rather than trap.
+*/
+
+namespace Shader
+{
+  // Operands follow the opcode: OP_PUSH a 32 bit constant (little endian),
+  // OP_INPUT, OP_LOAD and OP_STORE a one byte index
+  enum Op : uint8_t
+  {
+    OP_PUSH,
+    OP_INPUT,
+    OP_LOAD,  // Local variable
+    OP_STORE, // Pops into a local variable
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD, // Takes the sign of the divisor, so mod(-0.25, 1) is 0.75
+    OP_NEG,
+    OP_LESS, // Comparisons give 1 or 0
+    OP_GREATER,
+    OP_LESS_EQUAL,
+    OP_GREATER_EQUAL,
+    OP_SIN, // Of turns: sin(0.25) is 1
+    OP_COS,
+    OP_ABS,
+    OP_FLOOR,
+    OP_FRACT,
+    OP_SQRT,
+    OP_MIN,
+    OP_MAX,
+    OP_CLAMP, // value, low, high
+    OP_MIX,   // a, b, t: a + (b - a) * t
+    OP_NOISE, // x, y, z in lattice units, 0 to 1 (see Noise.h)
+    OP_COUNT
+  };
+
+  enum Input : uint8_t
+  {
+    TIME,    // Seconds
+    X,       // 0 at the left of the wall to 1 at the right
+    Y,       // 0 at the top to 1 at the bottom
+    RADIUS,  // From the middle of the wall; 1 at the furthest LED
+    ANGLE,   // Turns round the middle, 0 to 1, clockwise from the right
+    SEGMENT, // Whole numbers
+    LED,     // 0 at the floor end of the segment
+    INDEX,   // Frame buffer pixel
+    INPUT_COUNT
+  };
+
+  enum Output : uint8_t
+  {
+    RGB,
+    HSV
+  };
+
+  const int32_t ONE = 65536;
+  const int MAX_CODE = 512;
+  const int MAX_STACK = 16;
+  const int MAX_LOCALS = 8;
+}
+
+class ShaderProgram
+{
+public:
+  ShaderProgram();
+
+  // Checks code and keeps a copy; a program that fails is left empty, with
+  // getError() saying why
+  bool load(Shader::Output output, const uint8_t *code, int length);
+
+  bool isValid() const { return length > 0; }
+  const char *getError() const { return error; }
+  Shader::Output getOutput() const { return output; }
+  const uint8_t *getCode() const { return code; }
+  int getLength() const { return length; }
+  int getInstructionCount() const { return instructions; }
+
+private:
+  Shader::Output output;
+  uint8_t code[Shader::MAX_CODE];
+  int length;
+  int instructions;
+  const char *error;
+};
+
+class ShaderVM
+{
+public:
+  ShaderVM() : prepared(false) {}
+
+  // Works out every LED's inputs from Topology::getLedPosition(). Call
+  // again after a layout change
+  void prepare();
+  bool isPrepared() const { return prepared; }
+
+  // The three values program leaves for pixel at time millis
+  void evaluate(const ShaderProgram &program, int pixel, unsigned long millis, int32_t *out) const;
+  // Every pixel's colour into colors (RGB triples); HSV programs take their
+  // hues from wheel, which should be at full brightness
+  void render(const ShaderProgram &program, unsigned long millis, const HueWheel &wheel, byte *colors) const;
+
+private:
+  int32_t x[Constants::NUM_OF_PIXELS];
+  int32_t y[Constants::NUM_OF_PIXELS];
+  int32_t radius[Constants::NUM_OF_PIXELS];
+  int32_t angle[Constants::NUM_OF_PIXELS];
+  bool prepared;
+
+  void loadInputs(int pixel, int32_t time, int32_t *inputs) const;
+};
+
+#endif // SHADER_VM_H
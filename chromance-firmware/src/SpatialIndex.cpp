@@ -0,0 +1,261 @@
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+SpatialIndex::SpatialIndex()
+    : originX(0), originY(0), columns(0), rows(0), cellStart(nullptr), cellSpans(nullptr), cellSpanCount(0),
+      scratch(nullptr), scratchCapacity(0)
+{
+}
+
+SpatialIndex::~SpatialIndex()
+{
+  release();
+}
+
+void SpatialIndex::release()
+{
+  delete[] cellStart;
+  delete[] cellSpans;
+  delete[] scratch;
+  cellStart = nullptr;
+  cellSpans = nullptr;
+  scratch = nullptr;
+  columns = rows = cellSpanCount = scratchCapacity = 0;
+}
+
+int SpatialIndex::cellOf(float x, float y) const
+{
+  int column = (int)((x - originX) / CELL_SIZE);
+  int row = (int)((y - originY) / CELL_SIZE);
+  return row * columns + column;
+}
+
+void SpatialIndex::build()
+{
+  release();
+
+  float maxX = -ANY_DISTANCE;
+  float maxY = -ANY_DISTANCE;
+  originX = ANY_DISTANCE;
+  originY = ANY_DISTANCE;
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+  {
+    for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
+    {
+      const LedPosition &p = Topology::getLedPosition(s, led);
+      originX = std::min(originX, p.x);
+      originY = std::min(originY, p.y);
+      maxX = std::max(maxX, p.x);
+      maxY = std::max(maxY, p.y);
+    }
+  }
+  columns = (int)((maxX - originX) / CELL_SIZE) + 1;
+  rows = (int)((maxY - originY) / CELL_SIZE) + 1;
+
+  // Cut every segment where it crosses into another cell
+  std::vector<int> spanCells;
+  std::vector<LedSpan> spans;
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+  {
+    int previous = -1;
+    for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
+    {
+      const LedPosition &p = Topology::getLedPosition(s, led);
+      int cell = cellOf(p.x, p.y);
+      if (cell == previous)
+      {
+        spans.back().count++;
+        continue;
+      }
+      LedSpan span = {s, led, 1};
+      spans.push_back(span);
+      spanCells.push_back(cell);
+      previous = cell;
+    }
+  }
+
+  // Counting sort by cell
+  int cells = columns * rows;
+  cellStart = new int[cells + 1]();
+  for (size_t i = 0; i < spans.size(); i++)
+  {
+    cellStart[spanCells[i] + 1]++;
+  }
+  for (int c = 0; c < cells; c++)
+  {
+    cellStart[c + 1] += cellStart[c];
+  }
+  cellSpanCount = spans.size();
+  cellSpans = new LedSpan[cellSpanCount > 0 ? cellSpanCount : 1];
+  std::vector<int> fill(cellStart, cellStart + cells);
+  for (size_t i = 0; i < spans.size(); i++)
+  {
+    cellSpans[fill[spanCells[i]]++] = spans[i];
+  }
+
+  // A straight segment leaves a convex shape at most once; the far side of a
+  // wide sector and the hole of a ring are the shapes that can split a
+  // cell's span in two
+  scratchCapacity = 2 * cellSpanCount + 1;
+  scratch = new LedSpan[scratchCapacity];
+}
+
+template <typename Test>
+int SpatialIndex::query(float left, float top, float right, float bottom, Test test, LedSpan *out, int capacity) const
+{
+  return query(
+      left, top, right, bottom, [](float, float, float, float)
+      { return true; },
+      test, out, capacity);
+}
+
+template <typename CellTest, typename Test>
+int SpatialIndex::query(float left, float top, float right, float bottom, CellTest cellTest, Test test, LedSpan *out,
+                        int capacity) const
+{
+  if (columns == 0 || right < originX || bottom < originY || left > originX + columns * CELL_SIZE ||
+      top > originY + rows * CELL_SIZE)
+  {
+    return 0;
+  }
+  int column0 = std::max(0, (int)((left - originX) / CELL_SIZE));
+  int column1 = std::min(columns - 1, (int)((right - originX) / CELL_SIZE));
+  int row0 = std::max(0, (int)((top - originY) / CELL_SIZE));
+  int row1 = std::min(rows - 1, (int)((bottom - originY) / CELL_SIZE));
+
+  int found = 0;
+  for (int row = row0; row <= row1; row++)
+  {
+    for (int column = column0; column <= column1; column++)
+    {
+      float cellLeft = originX + column * CELL_SIZE;
+      float cellTop = originY + row * CELL_SIZE;
+      if (!cellTest(cellLeft, cellTop, cellLeft + CELL_SIZE, cellTop + CELL_SIZE))
+      {
+        continue;
+      }
+      int cell = row * columns + column;
+      for (int i = cellStart[cell]; i < cellStart[cell + 1]; i++)
+      {
+        const LedSpan &span = cellSpans[i];
+        bool open = false;
+        for (int led = span.first; led < span.first + span.count; led++)
+        {
+          if (!test(Topology::getLedPosition(span.segment, led)))
+          {
+            open = false;
+            continue;
+          }
+          if (open)
+          {
+            scratch[found - 1].count++;
+          }
+          else if (found < scratchCapacity)
+          {
+            LedSpan run = {span.segment, led, 1};
+            scratch[found++] = run;
+            open = true;
+          }
+        }
+      }
+    }
+  }
+
+  // Sort by segment, then join runs that continue into the next cell
+  std::sort(scratch, scratch + found, [](const LedSpan &a, const LedSpan &b)
+            { return a.segment != b.segment ? a.segment < b.segment : a.first < b.first; });
+  int written = 0;
+  for (int i = 0; i < found; i++)
+  {
+    if (written > 0 && out[written - 1].segment == scratch[i].segment &&
+        out[written - 1].first + out[written - 1].count == scratch[i].first)
+    {
+      out[written - 1].count += scratch[i].count;
+    }
+    else if (written < capacity)
+    {
+      out[written++] = scratch[i];
+    }
+    else
+    {
+      break;
+    }
+  }
+  return written;
+}
+
+int SpatialIndex::queryRadius(float x, float y, float radius, LedSpan *out, int capacity) const
+{
+  float radiusSquared = radius * radius;
+  return query(
+      x - radius, y - radius, x + radius, y + radius, [&](const LedPosition &p)
+      {
+        float dx = p.x - x;
+        float dy = p.y - y;
+        return dx * dx + dy * dy <= radiusSquared; },
+      out, capacity);
+}
+
+int SpatialIndex::queryRing(float x, float y, float inner, float outer, LedSpan *out, int capacity) const
+{
+  float innerSquared = inner > 0 ? inner * inner : 0;
+  float outerSquared = outer * outer;
+  return query(
+      x - outer, y - outer, x + outer, y + outer,
+      [&](float left, float top, float right, float bottom)
+      {
+        // Visit a cell unless it lies wholly in the hole or wholly outside
+        float nearX = std::max(left - x, std::max(0.0f, x - right));
+        float nearY = std::max(top - y, std::max(0.0f, y - bottom));
+        float farX = std::max(x - left, right - x);
+        float farY = std::max(y - top, bottom - y);
+        return nearX * nearX + nearY * nearY <= outerSquared && farX * farX + farY * farY >= innerSquared; },
+      [&](const LedPosition &p)
+      {
+        float dx = p.x - x;
+        float dy = p.y - y;
+        float lengthSquared = dx * dx + dy * dy;
+        return lengthSquared >= innerSquared && lengthSquared <= outerSquared; },
+      out, capacity);
+}
+
+int SpatialIndex::queryRect(float left, float top, float right, float bottom, LedSpan *out, int capacity) const
+{
+  return query(
+      left, top, right, bottom, [&](const LedPosition &p)
+      { return p.x >= left && p.x <= right && p.y >= top && p.y <= bottom; },
+      out, capacity);
+}
+
+int SpatialIndex::querySector(float x, float y, float angle, float halfWidth, float radius, LedSpan *out,
+                              int capacity) const
+{
+  // Inside when the angle to the beam axis is at most halfWidth, compared
+  // through the dot product so no LED needs an atan2
+  float dirX = cos(angle);
+  float dirY = sin(angle);
+  float spread = cos(std::min(halfWidth, (float)M_PI));
+  float spreadSquared = spread * spread;
+  float radiusSquared = radius * radius;
+  return query(
+      x - radius, y - radius, x + radius, y + radius, [&](const LedPosition &p)
+      {
+        float dx = p.x - x;
+        float dy = p.y - y;
+        float lengthSquared = dx * dx + dy * dy;
+        if (lengthSquared > radiusSquared)
+          return false;
+        if (lengthSquared == 0.0f)
+          return true;
+        float dot = dx * dirX + dy * dirY;
+        if (spread >= 0.0f)
+          return dot >= 0.0f && dot * dot >= spreadSquared * lengthSquared;
+        return dot >= 0.0f || dot * dot <= spreadSquared * lengthSquared; },
+      out, capacity);
+}
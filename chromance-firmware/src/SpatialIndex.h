@@ -0,0 +1,65 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include "Constants.h"
+#include "Topology.h"
+
+/*
+A uniform grid over the frame buffer's LED positions (Topology::getLedPosition),
+for effects that light "everything near here" without testing every LED.
+
+Each cell stores the runs of consecutive LEDs of one segment that fall inside
+it. A query tests only the LEDs of cells overlapping the shape and returns
+LedSpans sorted by segment and merged across cells, so a span can be drawn
+with one loop over led. Built for the active layout by
+Topology::getSpatialIndex(); coordinates are nodePositions units.
+*/
+
+class SpatialIndex
+{
+public:
+  static constexpr float CELL_SIZE = 4.0f; // A stock hex edge is about 6 to 10 units
+  static constexpr float ANY_DISTANCE = 1.0e9f;
+
+  SpatialIndex();
+  ~SpatialIndex();
+
+  void build();
+
+  // Each returns how many spans it wrote to out, at most capacity
+  int queryRadius(float x, float y, float radius, LedSpan *out, int capacity) const;
+  int queryRect(float left, float top, float right, float bottom, LedSpan *out, int capacity) const;
+  // LEDs whose bearing from (x, y) is within halfWidth radians of angle
+  // (atan2 convention), no further than radius
+  int querySector(float x, float y, float angle, float halfWidth, float radius, LedSpan *out, int capacity) const;
+  // LEDs from inner to outer away from (x, y); cells inside the hole are skipped
+  int queryRing(float x, float y, float inner, float outer, LedSpan *out, int capacity) const;
+
+  int getColumns() const { return columns; }
+  int getRows() const { return rows; }
+
+private:
+  float originX;
+  float originY;
+  int columns;
+  int rows;
+  int *cellStart; // cellSpans[cellStart[c] .. cellStart[c + 1]) lie in cell c
+  LedSpan *cellSpans;
+  int cellSpanCount;
+  mutable LedSpan *scratch; // Runs found by one query before merging
+  int scratchCapacity;
+
+  SpatialIndex(const SpatialIndex &);
+  SpatialIndex &operator=(const SpatialIndex &);
+
+  void release();
+  int cellOf(float x, float y) const;
+  template <typename Test>
+  int query(float left, float top, float right, float bottom, Test test, LedSpan *out, int capacity) const;
+  // cellTest(left, top, right, bottom) false skips a cell without testing its LEDs
+  template <typename CellTest, typename Test>
+  int query(float left, float top, float right, float bottom, CellTest cellTest, Test test, LedSpan *out,
+            int capacity) const;
+};
+
+#endif // SPATIAL_INDEX_H
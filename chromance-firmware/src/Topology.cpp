@@ -1,10 +1,15 @@
 #include "Topology.h"
+#include "TopologyLayout.h"
+#include "SpatialIndex.h"
+#include "PathLibrary.h"
+#include "LedGraph.h"
+#include <SPIFFS.h>
 
 // Helper macros for internal use to match original data format
 #define headof(S) Topology::headof(S)
 #define tailof(S) Topology::tailof(S)
 
-const int Topology::nodeConnections[Constants::NUMBER_OF_NODES][Constants::MAX_PATHS_PER_NODE] = {
+constexpr int Topology::stockNodeConnections[STOCK_NODES][Constants::MAX_PATHS_PER_NODE] = {
     {-1, -1, 1, -1, 0, -1},
     {-1, -1, 3, -1, 2, -1},
     {-1, -1, 5, -1, 4, -1},
@@ -35,7 +40,7 @@ const int Topology::nodeConnections[Constants::NUMBER_OF_NODES][Constants::MAX_P
     {32, 37, -1, -1, 39, 36},
     {-1, 39, -1, -1, -1, 38}};
 
-const int Topology::segmentConnections[Constants::NUMBER_OF_SEGMENTS][Constants::SIDES_PER_SEGMENT] = {
+constexpr int Topology::stockSegmentConnections[STOCK_SEGMENTS][Constants::SIDES_PER_SEGMENT] = {
     {0, 3},
     {0, 4},
     {1, 4},
@@ -77,10 +82,10 @@ const int Topology::segmentConnections[Constants::NUMBER_OF_SEGMENTS][Constants:
     {22, 24},
     {23, 24}};
 
-const NodePosition Topology::nodePositions[Constants::NUMBER_OF_NODES] = {
+constexpr NodePosition Topology::stockNodePositions[STOCK_NODES] = {
     {20, 1}, {40, 1}, {60, 1}, {10, 4}, {30, 4}, {50, 4}, {70, 4}, {20, 7}, {40, 7}, {60, 7}, {10, 10}, {30, 10}, {50, 10}, {70, 10}, {20, 13}, {40, 13}, {60, 13}, {30, 16}, {50, 16}, {20, 19}, {40, 19}, {60, 19}, {30, 22}, {50, 22}, {40, 25}};
 
-const int Topology::ledAssignments[Constants::NUMBER_OF_SEGMENTS][3] = {
+const int Topology::stockLedAssignments[STOCK_SEGMENTS][3] = {
     {Constants::RED_INDEX, headof(3), tailof(3)},
     {Constants::RED_INDEX, tailof(2), headof(2)},
     {Constants::GREEN_INDEX, headof(10), tailof(10)},
@@ -129,18 +134,413 @@ const int Topology::ledAssignments[Constants::NUMBER_OF_SEGMENTS][3] = {
     {Constants::BLACK_INDEX, tailof(1), headof(1)},
     {Constants::BLUE_INDEX, tailof(1), headof(1)}};
 
-const int Topology::borderNodes[Topology::numberOfBorderNodes] = {0, 1, 2, 3, 6, 10, 13, 19, 21, 24};
 
-const int Topology::cubeNodes[Topology::numberOfCubeNodes] = {7, 8, 9, 11, 12, 17, 18, 20};
+constexpr StripConfig Topology::stockStrips[STOCK_STRIPS] = {
+    {Constants::BLUE_LENGTH, Constants::BLUE_STRIP_DATA_PIN, Constants::BLUE_STRIP_CLOCK_PIN},
+    {Constants::GREEN_LENGTH, Constants::GREEN_STRIP_DATA_PIN, Constants::GREEN_STRIP_CLOCK_PIN},
+    {Constants::RED_LENGTH, Constants::RED_STRIP_DATA_PIN, Constants::RED_STRIP_CLOCK_PIN},
+    {Constants::BLACK_LENGTH, Constants::BLACK_STRIP_DATA_PIN, Constants::BLACK_STRIP_CLOCK_PIN}};
 
-const int Topology::funNodes[Topology::numberOfFunNodes] = {4, 5, 14, 15, 16, 22, 23};
+const int Topology::stockBorderNodes[10] = {0, 1, 2, 3, 6, 10, 13, 19, 21, 24};
+const int Topology::stockCubeNodes[8] = {7, 8, 9, 11, 12, 17, 18, 20};
+const int Topology::stockFunNodes[7] = {4, 5, 14, 15, 16, 22, 23};
 
-int Topology::getNextStep(int startNode, int targetNode)
+// ---------------------------------------------------------------------------
+// Derived tables for the stock layout, built at compile time (C++11
+// constexpr, so every helper is a single expression and loops are recursion)
+
+namespace
 {
-  if (startNode == targetNode)
+  using Constants::MAX_PATHS_PER_NODE;
+  const int NODES = Topology::STOCK_NODES;
+  const int SEGMENTS = Topology::STOCK_SEGMENTS;
+  const int LEDS = Topology::STOCK_LEDS_PER_SEGMENT;
+
+  template <int... I>
+  struct IndexList
   {
-    return -1;
+  };
+  template <int N, int... I>
+  struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...>
+  {
+  };
+  template <int... I>
+  struct MakeIndexList<0, I...>
+  {
+    typedef IndexList<I...> type;
+  };
+
+  typedef MakeIndexList<MAX_PATHS_PER_NODE>::type Ports;
+  typedef MakeIndexList<NODES>::type Nodes;
+  typedef MakeIndexList<SEGMENTS>::type Segments;
+  typedef MakeIndexList<SEGMENTS * LEDS>::type Pixels;
+
+  enum PathFilter
+  {
+    PATHS_ANY,
+    PATHS_DOWN,
+    PATHS_UP,
+    PATHS_FEEDING // Segment hangs from the node by its ceiling end
+  };
+
+  constexpr int segmentAt(int node, int port)
+  {
+    return port < 0 ? -1 : Topology::stockNodeConnections[node][port];
+  }
+
+  constexpr int ceilingOf(int segment) { return Topology::stockSegmentConnections[segment][0]; }
+  constexpr int floorOf(int segment) { return Topology::stockSegmentConnections[segment][1]; }
+
+  constexpr int otherEnd(int segment, int node)
+  {
+    return ceilingOf(segment) == node ? floorOf(segment) : ceilingOf(segment);
+  }
+
+  constexpr int neighborAt(int node, int port)
+  {
+    return segmentAt(node, port) < 0 ? -1 : otherEnd(segmentAt(node, port), node);
+  }
+
+  constexpr int heightOf(int node) { return Topology::stockNodePositions[node].y; }
+
+  constexpr bool matches(int node, int port, PathFilter filter)
+  {
+    return segmentAt(node, port) >= 0 &&
+           (filter == PATHS_ANY ||
+            (filter == PATHS_DOWN && heightOf(neighborAt(node, port)) > heightOf(node)) ||
+            (filter == PATHS_UP && heightOf(neighborAt(node, port)) < heightOf(node)) ||
+            (filter == PATHS_FEEDING && ceilingOf(segmentAt(node, port)) == node));
+  }
+
+  constexpr int countMatches(int node, PathFilter filter, int port = 0)
+  {
+    return port >= MAX_PATHS_PER_NODE ? 0 : (matches(node, port, filter) ? 1 : 0) + countMatches(node, filter, port + 1);
+  }
+
+  // Port of the nth matching path at or after `port`, -1 past the last
+  constexpr int nthMatch(int node, PathFilter filter, int n, int port = 0)
+  {
+    return port >= MAX_PATHS_PER_NODE ? -1
+           : !matches(node, port, filter) ? nthMatch(node, filter, n, port + 1)
+           : n == 0                       ? port
+                                          : nthMatch(node, filter, n - 1, port + 1);
+  }
+
+  template <int... P>
+  constexpr PathList makePaths(int node, PathFilter filter, IndexList<P...>)
+  {
+    return PathList{countMatches(node, filter),
+                    {segmentAt(node, nthMatch(node, filter, P))...},
+                    {nthMatch(node, filter, P)...}};
+  }
+
+  template <int... P>
+  constexpr NodeNeighbors makeNeighbors(int node, IndexList<P...>)
+  {
+    return NodeNeighbors{{neighborAt(node, P)...}};
+  }
+
+  template <int... N>
+  constexpr TopologyTable<NodeNeighbors, sizeof...(N)> makeNeighborTable(IndexList<N...>)
+  {
+    return TopologyTable<NodeNeighbors, sizeof...(N)>{{makeNeighbors(N, Ports())...}};
+  }
+
+  template <int... N>
+  constexpr TopologyTable<PathList, sizeof...(N)> makePathTable(PathFilter filter, IndexList<N...>)
+  {
+    return TopologyTable<PathList, sizeof...(N)>{{makePaths(N, filter, Ports())...}};
+  }
+
+  template <int... S>
+  constexpr TopologyTable<PathList, sizeof...(S)> makeFeederTable(IndexList<S...>)
+  {
+    return TopologyTable<PathList, sizeof...(S)>{{makePaths(floorOf(S), PATHS_FEEDING, Ports())...}};
+  }
+
+  // LED 0 sits at the floor node, the last LED at the ceiling node
+  constexpr LedPosition makeLedPosition(int segment, int led)
+  {
+    return LedPosition{Topology::stockNodePositions[floorOf(segment)].x +
+                           (Topology::stockNodePositions[ceilingOf(segment)].x - Topology::stockNodePositions[floorOf(segment)].x) * ((float)led / (LEDS - 1)),
+                       Topology::stockNodePositions[floorOf(segment)].y +
+                           (Topology::stockNodePositions[ceilingOf(segment)].y - Topology::stockNodePositions[floorOf(segment)].y) * ((float)led / (LEDS - 1))};
+  }
+
+  template <int... I>
+  constexpr TopologyTable<LedPosition, sizeof...(I)> makeLedPositions(IndexList<I...>)
+  {
+    return TopologyTable<LedPosition, sizeof...(I)>{{makeLedPosition(I / LEDS, I % LEDS)...}};
+  }
+
+  // Consistency checks over every (node, port) pair and every segment
+
+  constexpr int countListings(int segment, int node, int port = 0)
+  {
+    return port >= MAX_PATHS_PER_NODE ? 0 : (segmentAt(node, port) == segment ? 1 : 0) + countListings(segment, node, port + 1);
+  }
+
+  constexpr bool portIsValid(int node, int port)
+  {
+    return segmentAt(node, port) == -1 ||
+           (segmentAt(node, port) >= 0 && segmentAt(node, port) < SEGMENTS &&
+            (ceilingOf(segmentAt(node, port)) == node || floorOf(segmentAt(node, port)) == node));
   }
+
+  constexpr bool allPortsValid(int i = 0)
+  {
+    return i >= NODES * MAX_PATHS_PER_NODE ||
+           (portIsValid(i / MAX_PATHS_PER_NODE, i % MAX_PATHS_PER_NODE) && allPortsValid(i + 1));
+  }
+
+  constexpr bool endsAreValid(int segment)
+  {
+    return ceilingOf(segment) >= 0 && ceilingOf(segment) < NODES &&
+           floorOf(segment) >= 0 && floorOf(segment) < NODES && ceilingOf(segment) != floorOf(segment);
+  }
+
+  constexpr bool allSegmentsListedOnce(int segment = 0)
+  {
+    return segment >= SEGMENTS ||
+           (endsAreValid(segment) && countListings(segment, ceilingOf(segment)) == 1 &&
+            countListings(segment, floorOf(segment)) == 1 && allSegmentsListedOnce(segment + 1));
+  }
+
+  constexpr bool allCeilingsAbove(int segment = 0)
+  {
+    return segment >= SEGMENTS ||
+           (heightOf(ceilingOf(segment)) < heightOf(floorOf(segment)) && allCeilingsAbove(segment + 1));
+  }
+
+  // Ports 0, 1 and 5 point up, 2, 3 and 4 point down (ripples rely on it)
+  constexpr bool portPointsRightWay(int node, int port)
+  {
+    return neighborAt(node, port) < 0 ||
+           ((port == 0 || port == 1 || port == 5) == (heightOf(neighborAt(node, port)) < heightOf(node)));
+  }
+
+  constexpr bool allPortsPointRightWay(int i = 0)
+  {
+    return i >= NODES * MAX_PATHS_PER_NODE ||
+           (portPointsRightWay(i / MAX_PATHS_PER_NODE, i % MAX_PATHS_PER_NODE) && allPortsPointRightWay(i + 1));
+  }
+
+  constexpr int totalMatches(PathFilter filter, int node = 0)
+  {
+    return node >= NODES ? 0 : countMatches(node, filter) + totalMatches(filter, node + 1);
+  }
+
+  static_assert(allPortsValid(), "nodeConnections lists a segment that does not end at that node");
+  static_assert(allSegmentsListedOnce(), "Each segment must appear exactly once at both of its end nodes");
+  static_assert(allCeilingsAbove(), "segmentConnections side 0 must be the higher node");
+  static_assert(allPortsPointRightWay(), "Port directions do not match nodePositions");
+  static_assert(totalMatches(PATHS_ANY) == 2 * SEGMENTS, "Port count does not match the segment count");
+  static_assert(totalMatches(PATHS_DOWN) == SEGMENTS, "Every segment must lead down from exactly one node");
+  static_assert(totalMatches(PATHS_UP) == SEGMENTS, "Every segment must lead up from exactly one node");
+  static_assert(totalMatches(PATHS_FEEDING) == SEGMENTS, "Every segment must hang from exactly one node");
+
+  const TopologyTable<NodeNeighbors, NODES> stockNeighbors = makeNeighborTable(Nodes());
+  const TopologyTable<PathList, NODES> stockPaths = makePathTable(PATHS_ANY, Nodes());
+  const TopologyTable<PathList, NODES> stockDownPaths = makePathTable(PATHS_DOWN, Nodes());
+  const TopologyTable<PathList, NODES> stockUpPaths = makePathTable(PATHS_UP, Nodes());
+  const TopologyTable<PathList, SEGMENTS> stockFeeders = makeFeederTable(Segments());
+  const TopologyTable<LedPosition, SEGMENTS * LEDS> stockLedPositions = makeLedPositions(Pixels());
+
+  // Routing has no closed form; it is filled in on first use
+  int8_t stockRoutes[NODES * NODES];
+  bool stockRoutesBuilt = false;
+}
+
+// ---------------------------------------------------------------------------
+// Active layout
+
+const TopologyLayout *Topology::layout = nullptr;
+const NodePorts *Topology::nodeConnections = Topology::stockNodeConnections;
+const SegmentEnds *Topology::segmentConnections = Topology::stockSegmentConnections;
+const NodePosition *Topology::nodePositions = Topology::stockNodePositions;
+const LedAssignment *Topology::ledAssignments = Topology::stockLedAssignments;
+int Topology::numberOfBorderNodes = sizeof(stockBorderNodes) / sizeof(int);
+const int *Topology::borderNodes = stockBorderNodes;
+int Topology::numberOfCubeNodes = sizeof(stockCubeNodes) / sizeof(int);
+const int *Topology::cubeNodes = stockCubeNodes;
+int Topology::numberOfFunNodes = sizeof(stockFunNodes) / sizeof(int);
+const int *Topology::funNodes = stockFunNodes;
+int Topology::starburstNode = STOCK_STARBURST_NODE;
+int Topology::stripCount = STOCK_STRIPS;
+const StripConfig *Topology::strips = Topology::stockStrips;
+const LedPosition *Topology::ledPositions = STOCK_COMPILED ? stockLedPositions.rows : nullptr;
+const NodeNeighbors *Topology::neighborTable = stockNeighbors.rows;
+const PathList *Topology::pathTable = stockPaths.rows;
+const PathList *Topology::downPathTable = stockDownPaths.rows;
+const PathList *Topology::upPathTable = stockUpPaths.rows;
+const PathList *Topology::feederTable = stockFeeders.rows;
+const int8_t *Topology::routeTable = nullptr;
+SpatialIndex *Topology::spatialIndex = nullptr;
+PathLibrary *Topology::pathLibrary = nullptr;
+LedGraph *Topology::ledGraph = nullptr;
+uint8_t *Topology::distanceFields[Constants::NUMBER_OF_NODES] = {};
+uint8_t Topology::maxDistances[Constants::NUMBER_OF_NODES] = {};
+
+void Topology::setLayout(const TopologyLayout *active)
+{
+  layout = active;
+  releaseDistanceFields();
+  delete spatialIndex;
+  spatialIndex = nullptr;
+  delete pathLibrary;
+  pathLibrary = nullptr;
+  delete ledGraph;
+  ledGraph = nullptr;
+  if (layout == nullptr)
+  {
+    nodeConnections = stockNodeConnections;
+    segmentConnections = stockSegmentConnections;
+    nodePositions = stockNodePositions;
+    ledAssignments = stockLedAssignments;
+    numberOfBorderNodes = sizeof(stockBorderNodes) / sizeof(int);
+    borderNodes = stockBorderNodes;
+    numberOfCubeNodes = sizeof(stockCubeNodes) / sizeof(int);
+    cubeNodes = stockCubeNodes;
+    numberOfFunNodes = sizeof(stockFunNodes) / sizeof(int);
+    funNodes = stockFunNodes;
+    starburstNode = STOCK_STARBURST_NODE;
+    stripCount = STOCK_STRIPS;
+    strips = stockStrips;
+    ledPositions = STOCK_COMPILED ? stockLedPositions.rows : nullptr;
+    neighborTable = stockNeighbors.rows;
+    pathTable = stockPaths.rows;
+    downPathTable = stockDownPaths.rows;
+    upPathTable = stockUpPaths.rows;
+    feederTable = stockFeeders.rows;
+    routeTable = stockRoutesBuilt ? stockRoutes : nullptr;
+    return;
+  }
+
+  nodeConnections = layout->ports;
+  segmentConnections = layout->ends;
+  nodePositions = layout->positions;
+  ledAssignments = layout->assignments;
+  numberOfBorderNodes = layout->groupCounts[0];
+  borderNodes = layout->groups[0];
+  numberOfCubeNodes = layout->groupCounts[1];
+  cubeNodes = layout->groups[1];
+  numberOfFunNodes = layout->groupCounts[2];
+  funNodes = layout->groups[2];
+  starburstNode = layout->center;
+  stripCount = layout->stripCount;
+  strips = layout->strips;
+  ledPositions = layout->ledPositions;
+  neighborTable = layout->neighbors;
+  pathTable = layout->paths;
+  downPathTable = layout->downPaths;
+  upPathTable = layout->upPaths;
+  feederTable = layout->feeders;
+  routeTable = layout->routes;
+}
+
+bool Topology::begin()
+{
+  static TopologyLayout *loaded = nullptr;
+
+  const char *path = nullptr;
+  if (SPIFFS.exists(LAYOUT_PATH))
+  {
+    path = LAYOUT_PATH;
+  }
+  else if (SPIFFS.exists(LAYOUT_JSON_PATH))
+  {
+    path = LAYOUT_JSON_PATH;
+  }
+
+  TopologyLayout *next = new TopologyLayout();
+  bool ok = true;
+  if (path != nullptr && !next->loadFile(path))
+  {
+    Serial.print("Topology file rejected: ");
+    Serial.println(next->getError());
+    ok = false;
+  }
+
+  if (!next->isValid())
+  {
+    if (STOCK_COMPILED || (loaded != nullptr && layout == loaded))
+    {
+      delete next; // Keep what is running
+      return ok;
+    }
+    if (!next->loadStock())
+    {
+      Serial.println("This build does not match the stock wall and needs a topology file");
+      next->loadBlank();
+    }
+  }
+  else
+  {
+    Serial.print("Loaded topology from ");
+    Serial.println(path);
+  }
+
+  setLayout(next);
+  delete loaded;
+  loaded = next;
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Routing
+
+void Topology::buildRouteTable(const NodeNeighbors *neighbors, int nodes, int8_t *routes)
+{
+  int *parent = new int[nodes];
+  int *queue = new int[nodes];
+
+  for (int target = 0; target < nodes; target++)
+  {
+    for (int i = 0; i < nodes; i++)
+    {
+      parent[i] = -1;
+    }
+
+    // Breadth-first from the target: a node's parent is its next hop
+    int front = 0;
+    int rear = 0;
+    queue[rear++] = target;
+    parent[target] = target;
+    while (front < rear)
+    {
+      int u = queue[front++];
+      for (int i = 0; i < Constants::MAX_PATHS_PER_NODE; i++)
+      {
+        int v = neighbors[u].nodes[i];
+        if (v >= 0 && parent[v] == -1)
+        {
+          parent[v] = u;
+          queue[rear++] = v;
+        }
+      }
+    }
+
+    for (int start = 0; start < nodes; start++)
+    {
+      int8_t port = -1;
+      for (int i = 0; start != target && parent[start] >= 0 && i < Constants::MAX_PATHS_PER_NODE; i++)
+      {
+        if (neighbors[start].nodes[i] == parent[start])
+        {
+          port = i;
+          break;
+        }
+      }
+      routes[start * nodes + target] = port;
+    }
+  }
+
+  delete[] parent;
+  delete[] queue;
+}
+
+int Topology::getNextStep(int startNode, int targetNode)
+{
   if (startNode < 0 || startNode >= Constants::NUMBER_OF_NODES)
   {
     return -1;
@@ -150,6 +550,26 @@ int Topology::getNextStep(int startNode, int targetNode)
     return -1;
   }
 
+  if (routeTable == nullptr && layout == nullptr)
+  {
+    buildRouteTable(stockNeighbors.rows, STOCK_NODES, stockRoutes);
+    stockRoutesBuilt = true;
+    routeTable = stockRoutes;
+  }
+  if (routeTable != nullptr)
+  {
+    return routeTable[startNode * Constants::NUMBER_OF_NODES + targetNode];
+  }
+  return findNextStep(startNode, targetNode);
+}
+
+int Topology::findNextStep(int startNode, int targetNode)
+{
+  if (startNode == targetNode)
+  {
+    return -1;
+  }
+
   int dist[Constants::NUMBER_OF_NODES];
   int parent[Constants::NUMBER_OF_NODES];
   for (int i = 0; i < Constants::NUMBER_OF_NODES; i++)
@@ -176,17 +596,12 @@ int Topology::getNextStep(int startNode, int targetNode)
 
     for (int i = 0; i < Constants::MAX_PATHS_PER_NODE; i++)
     {
-      int segment = nodeConnections[u][i];
-      if (segment != -1)
+      int v = getNeighborNode(u, i);
+      if (v >= 0 && dist[v] == -1)
       {
-        int v = (segmentConnections[segment][0] == u) ? segmentConnections[segment][1] : segmentConnections[segment][0];
-
-        if (v >= 0 && v < Constants::NUMBER_OF_NODES && dist[v] == -1)
-        {
-          dist[v] = dist[u] + 1;
-          parent[v] = u;
-          queue[rear++] = v;
-        }
+        dist[v] = dist[u] + 1;
+        parent[v] = u;
+        queue[rear++] = v;
       }
     }
   }
@@ -196,17 +611,146 @@ int Topology::getNextStep(int startNode, int targetNode)
   {
     for (int i = 0; i < Constants::MAX_PATHS_PER_NODE; i++)
     {
-      int segment = nodeConnections[startNode][i];
-      if (segment != -1)
+      if (getNeighborNode(startNode, i) == nextNode)
+      {
+        return i;
+      }
+    }
+  }
+
+  return -1;
+}
+
+// ---------------------------------------------------------------------------
+// Spatial index
+
+const SpatialIndex &Topology::getSpatialIndex()
+{
+  if (spatialIndex == nullptr)
+  {
+    spatialIndex = new SpatialIndex();
+    spatialIndex->build();
+  }
+  return *spatialIndex;
+}
+
+// ---------------------------------------------------------------------------
+// Path library
+
+const PathLibrary &Topology::getPathLibrary()
+{
+  if (pathLibrary == nullptr)
+  {
+    pathLibrary = new PathLibrary();
+    pathLibrary->build();
+  }
+  return *pathLibrary;
+}
+
+// ---------------------------------------------------------------------------
+// LED graph
+
+const LedGraph &Topology::getLedGraph()
+{
+  if (ledGraph == nullptr)
+  {
+    ledGraph = new LedGraph();
+    ledGraph->build();
+  }
+  return *ledGraph;
+}
+
+// ---------------------------------------------------------------------------
+// Distance fields
+
+const uint8_t *Topology::getDistanceField(int node)
+{
+  if (node < 0 || node >= Constants::NUMBER_OF_NODES)
+  {
+    return nullptr;
+  }
+  if (distanceFields[node] == nullptr)
+  {
+    distanceFields[node] = new uint8_t[Constants::NUM_OF_PIXELS];
+    buildDistanceField(node, distanceFields[node]);
+
+    uint8_t furthest = 0;
+    for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
+    {
+      uint8_t d = distanceFields[node][i];
+      if (d != DISTANCE_UNREACHABLE && d > furthest)
+      {
+        furthest = d;
+      }
+    }
+    maxDistances[node] = furthest;
+  }
+  return distanceFields[node];
+}
+
+int Topology::getMaxDistance(int node)
+{
+  return getDistanceField(node) != nullptr ? maxDistances[node] : 0;
+}
+
+void Topology::buildDistanceField(int node, uint8_t *field)
+{
+  // Hops to every node, then each LED takes the nearer of its two ends
+  int hops[Constants::NUMBER_OF_NODES];
+  for (int i = 0; i < Constants::NUMBER_OF_NODES; i++)
+  {
+    hops[i] = -1;
+  }
+  int queue[Constants::NUMBER_OF_NODES];
+  int front = 0;
+  int rear = 0;
+  queue[rear++] = node;
+  hops[node] = 0;
+  while (front < rear)
+  {
+    int u = queue[front++];
+    for (int port = 0; port < Constants::MAX_PATHS_PER_NODE; port++)
+    {
+      int v = getNeighborNode(u, port);
+      if (v >= 0 && hops[v] == -1)
+      {
+        hops[v] = hops[u] + 1;
+        queue[rear++] = v;
+      }
+    }
+  }
+
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
+  {
+    int ceilingHops = hops[segmentConnections[segment][0]];
+    int floorHops = hops[segmentConnections[segment][1]];
+    for (int led = 0; led < leds; led++)
+    {
+      int fromFloor = ((led + 1) * DISTANCE_PER_HOP + (leds + 1) / 2) / (leds + 1);
+      int best = -1;
+      if (floorHops >= 0)
+      {
+        best = floorHops * DISTANCE_PER_HOP + fromFloor;
+      }
+      if (ceilingHops >= 0)
       {
-        int v = (segmentConnections[segment][0] == startNode) ? segmentConnections[segment][1] : segmentConnections[segment][0];
-        if (v == nextNode)
+        int viaCeiling = ceilingHops * DISTANCE_PER_HOP + DISTANCE_PER_HOP - fromFloor;
+        if (best < 0 || viaCeiling < best)
         {
-          return i;
+          best = viaCeiling;
         }
       }
+      field[segment * leds + led] = best < 0 ? DISTANCE_UNREACHABLE : (best < DISTANCE_UNREACHABLE ? best : DISTANCE_UNREACHABLE - 1);
     }
   }
+}
 
-  return -1;
+void Topology::releaseDistanceFields()
+{
+  for (int i = 0; i < Constants::NUMBER_OF_NODES; i++)
+  {
+    delete[] distanceFields[i];
+    distanceFields[i] = nullptr;
+  }
 }
@@ -9,45 +9,209 @@ struct NodePosition
   int y;
 };
 
+// Centre of one LED in nodePositions units
+struct LedPosition
+{
+  float x;
+  float y;
+};
+
+// Consecutive frame buffer LEDs of one segment
+struct LedSpan
+{
+  int segment;
+  int first;
+  int count;
+};
+
+struct StripConfig
+{
+  int length;
+  int dataPin;
+  int clockPin; // DotStar only, -1 if unused
+};
+
+// Segments leaving a node (or feeding a segment), in port order
+struct PathList
+{
+  int count;
+  int segments[Constants::MAX_PATHS_PER_NODE];
+  int ports[Constants::MAX_PATHS_PER_NODE]; // Port on the node the list belongs to
+};
+
+struct NodeNeighbors
+{
+  int nodes[Constants::MAX_PATHS_PER_NODE]; // -1 where the port is unused
+};
+
+// Fixed-size table that can be built by a constexpr function
+template <typename T, int N>
+struct TopologyTable
+{
+  T rows[N];
+  const T &operator[](int i) const { return rows[i]; }
+};
+
+typedef int NodePorts[Constants::MAX_PATHS_PER_NODE];
+typedef int SegmentEnds[Constants::SIDES_PER_SEGMENT];
+typedef int LedAssignment[3];
+
+class TopologyLayout;
+class SpatialIndex;
+class PathLibrary;
+class LedGraph;
+
+// The wall the firmware drives. The stock layout is compiled in; a layout
+// file on SPIFFS replaces it at boot (see TopologyLayout). Everything below
+// reads the active layout, so the tables index exactly like fixed arrays.
 class Topology
 {
 public:
+  // Strip LED range of the sth group of LEDs on a stock strip
   static constexpr int headof(int s)
   {
-    return (s - 1) * Constants::LEDS_PER_SEGMENT;
+    return (s - 1) * STOCK_LEDS_PER_SEGMENT;
   }
 
   static constexpr int tailof(int s)
   {
-    return headof(s) + (Constants::LEDS_PER_SEGMENT - 1);
+    return headof(s) + (STOCK_LEDS_PER_SEGMENT - 1);
   }
 
   // Node connections: [Node][PathIndex] -> Connected Segment ID
-  static const int nodeConnections[Constants::NUMBER_OF_NODES][Constants::MAX_PATHS_PER_NODE];
+  static const NodePorts *nodeConnections;
 
   // Segment connections: [Segment][Side] -> Connected Node ID
   // Side 0: Closer to ceiling, Side 1: Closer to floor
-  static const int segmentConnections[Constants::NUMBER_OF_SEGMENTS][Constants::SIDES_PER_SEGMENT];
+  static const SegmentEnds *segmentConnections;
 
   // Node Positions for Emulator/UI
-  static const NodePosition nodePositions[Constants::NUMBER_OF_NODES];
+  static const NodePosition *nodePositions;
 
   // LED Assignments: [Segment][3] -> {StripIndex, CeilingLedIndex, FloorLedIndex}
-  static const int ledAssignments[Constants::NUMBER_OF_SEGMENTS][3];
+  static const LedAssignment *ledAssignments;
 
-  static const int numberOfBorderNodes = 10;
-  static const int borderNodes[numberOfBorderNodes];
+  static int numberOfBorderNodes;
+  static const int *borderNodes;
 
-  static const int numberOfCubeNodes = 8;
-  static const int cubeNodes[numberOfCubeNodes];
+  static int numberOfCubeNodes;
+  static const int *cubeNodes;
 
-  static const int numberOfFunNodes = 7;
-  static const int funNodes[numberOfFunNodes];
+  static int numberOfFunNodes;
+  static const int *funNodes;
 
-  static const int starburstNode = 15;
+  static int starburstNode;
 
-  // Pathfinding
+  static int getStripCount() { return stripCount; }
+  static const StripConfig &getStrip(int strip) { return strips[strip]; }
+
+  // Physical LEDs on a segment; the frame buffer is resampled onto them
+  static int getSegmentLedCount(int segment)
+  {
+    int span = ledAssignments[segment][1] - ledAssignments[segment][2];
+    return (span < 0 ? -span : span) + 1;
+  }
+
+  // led counts from the floor end like the frame buffer
+  static const LedPosition &getLedPosition(int segment, int led)
+  {
+    return ledPositions[segment * Constants::LEDS_PER_SEGMENT + led];
+  }
+
+  // Pathfinding: port on startNode of a shortest path to targetNode, -1 if
+  // none. A table lookup for layouts up to ROUTE_TABLE_MAX_NODES.
   static int getNextStep(int startNode, int targetNode);
+
+  static const int ROUTE_TABLE_MAX_NODES = 128;
+  // Fills routes[start * nodes + target] with getNextStep() for every pair
+  static void buildRouteTable(const NodeNeighbors *neighbors, int nodes, int8_t *routes);
+
+  // Derived adjacency, built from the tables above when a layout is made
+  // active (at compile time for the stock one; see Topology.cpp)
+  static int getNeighborNode(int node, int port) { return neighborTable[node].nodes[port]; }
+  static int getOtherEnd(int segment, int node)
+  {
+    return segmentConnections[segment][0] == node ? segmentConnections[segment][1] : segmentConnections[segment][0];
+  }
+  static const PathList &getPaths(int node) { return pathTable[node]; }
+  static const PathList &getDownPaths(int node) { return downPathTable[node]; } // Towards the floor
+  static const PathList &getUpPaths(int node) { return upPathTable[node]; }     // Towards the ceiling
+  // Segments whose ceiling end is this segment's floor end; ports are on that node
+  static const PathList &getFeeders(int segment) { return feederTable[segment]; }
+
+  // Grid over the LED positions for radius, rectangle and sector queries
+  // (see SpatialIndex). Built on first use and again after a layout change.
+  static const SpatialIndex &getSpatialIndex();
+  // Columns, descents, borders and rings as flat pixel sequences (see
+  // PathLibrary). Built on first use and again after a layout change.
+  static const PathLibrary &getPathLibrary();
+  // Which LEDs neighbour which, across nodes too, as a sparse graph (see
+  // LedGraph). Built on first use and again after a layout change.
+  static const LedGraph &getLedGraph();
+
+  // Layout management
+  static constexpr const char *LAYOUT_PATH = "/topology.bin";
+  static constexpr const char *LAYOUT_JSON_PATH = "/topology.json";
+
+  // Activates a layout file from SPIFFS if there is one; returns false when
+  // a file exists but is rejected (the previous layout stays active)
+  static bool begin();
+  static void setLayout(const TopologyLayout *layout); // nullptr restores the stock layout
+  static const TopologyLayout *getLayout() { return layout; }
+  static bool isStockLayout() { return layout == nullptr; }
+
+  // The compiled-in wall. Checked against itself with static_asserts.
+  static const int STOCK_NODES = 25;
+  static const int STOCK_SEGMENTS = 40;
+  static const int STOCK_LEDS_PER_SEGMENT = 14;
+  static const int STOCK_STRIPS = 4;
+  // The stock wall can be loaded into a build with the same shape...
+  static const bool STOCK_FITS = Constants::NUMBER_OF_NODES == STOCK_NODES &&
+                                 Constants::NUMBER_OF_SEGMENTS == STOCK_SEGMENTS;
+  // ...and its compiled tables used directly if it also renders at stock resolution
+  static const bool STOCK_COMPILED = STOCK_FITS && Constants::LEDS_PER_SEGMENT == STOCK_LEDS_PER_SEGMENT;
+
+  static const int stockNodeConnections[STOCK_NODES][Constants::MAX_PATHS_PER_NODE];
+  static const int stockSegmentConnections[STOCK_SEGMENTS][Constants::SIDES_PER_SEGMENT];
+  static const NodePosition stockNodePositions[STOCK_NODES];
+  static const int stockLedAssignments[STOCK_SEGMENTS][3];
+  static const StripConfig stockStrips[STOCK_STRIPS];
+  static const int stockBorderNodes[10];
+  static const int stockCubeNodes[8];
+  static const int stockFunNodes[7];
+  static const int STOCK_STARBURST_NODE = 15;
+
+  // Distance along the wiring from a node to every frame buffer pixel, in LED
+  // steps of the stock wall: DISTANCE_PER_HOP per segment, and LED i of a
+  // segment i + 1 steps from its floor end. Reachable pixels saturate at
+  // 254, unreachable ones are DISTANCE_UNREACHABLE. Each node's field is
+  // built on first use (NUM_OF_PIXELS bytes) and kept until the layout changes.
+  static const int DISTANCE_PER_HOP = STOCK_LEDS_PER_SEGMENT + 1;
+  static const uint8_t DISTANCE_UNREACHABLE = 255;
+  static const uint8_t *getDistanceField(int node);
+  static int getMaxDistance(int node); // Furthest reachable pixel in the field
+
+private:
+  static const TopologyLayout *layout;
+  static int stripCount;
+  static const StripConfig *strips;
+  static const LedPosition *ledPositions;
+  static const NodeNeighbors *neighborTable;
+  static const PathList *pathTable;
+  static const PathList *downPathTable;
+  static const PathList *upPathTable;
+  static const PathList *feederTable;
+  static const int8_t *routeTable; // [start * nodes + target] -> port
+
+  static SpatialIndex *spatialIndex;
+  static PathLibrary *pathLibrary;
+  static LedGraph *ledGraph;
+  static uint8_t *distanceFields[Constants::NUMBER_OF_NODES];
+  static uint8_t maxDistances[Constants::NUMBER_OF_NODES];
+
+  static int findNextStep(int startNode, int targetNode); // Breadth-first search
+  static void buildDistanceField(int node, uint8_t *field);
+  static void releaseDistanceFields();
 };
 
 #endif // TOPOLOGY_H
@@ -0,0 +1,745 @@
+#include "TopologyLayout.h"
+#include <SPIFFS.h>
+
+static const int GROUP_BORDER = 0;
+static const int GROUP_CUBE = 1;
+static const int GROUP_FUN = 2;
+static const char *groupNames[3] = {"border", "cube", "fun"};
+
+static void writeU16(uint8_t *out, int value)
+{
+  out[0] = value & 0xFF;
+  out[1] = (value >> 8) & 0xFF;
+}
+
+static int readU16(const uint8_t *in)
+{
+  return in[0] | (in[1] << 8);
+}
+
+static int readI16(const uint8_t *in)
+{
+  return (int16_t)readU16(in);
+}
+
+TopologyLayout::TopologyLayout()
+    : valid(false), error(nullptr), nodeCount(0), segmentCount(0), stripCount(0),
+      ports(nullptr), ends(nullptr), positions(nullptr), assignments(nullptr), strips(nullptr), center(-1),
+      neighbors(nullptr), paths(nullptr), downPaths(nullptr), upPaths(nullptr), feeders(nullptr),
+      routes(nullptr), ledPositions(nullptr)
+{
+  for (int g = 0; g < 3; g++)
+  {
+    groupCounts[g] = 0;
+    groups[g] = nullptr;
+  }
+}
+
+TopologyLayout::~TopologyLayout()
+{
+  release();
+}
+
+bool TopologyLayout::allocate(int nodes, int segments, int stripTotal)
+{
+  release();
+  error = nullptr;
+
+  if (nodes != Constants::NUMBER_OF_NODES || segments != Constants::NUMBER_OF_SEGMENTS)
+  {
+    return fail("Node or segment count does not match this build");
+  }
+  if (stripTotal < 0 || stripTotal > Constants::MAX_STRIPS)
+  {
+    return fail("Too many strips");
+  }
+
+  nodeCount = nodes;
+  segmentCount = segments;
+  stripCount = stripTotal;
+
+  ports = new NodePorts[nodes];
+  ends = new SegmentEnds[segments];
+  positions = new NodePosition[nodes];
+  assignments = new LedAssignment[segments];
+  strips = new StripConfig[stripTotal > 0 ? stripTotal : 1];
+  center = -1;
+
+  neighbors = new NodeNeighbors[nodes];
+  paths = new PathList[nodes];
+  downPaths = new PathList[nodes];
+  upPaths = new PathList[nodes];
+  feeders = new PathList[segments];
+  routes = nodes <= Topology::ROUTE_TABLE_MAX_NODES ? new int8_t[nodes * nodes] : nullptr;
+  ledPositions = new LedPosition[segments * Constants::LEDS_PER_SEGMENT];
+  return true;
+}
+
+void TopologyLayout::release()
+{
+  delete[] ports;
+  delete[] ends;
+  delete[] positions;
+  delete[] assignments;
+  delete[] strips;
+  delete[] neighbors;
+  delete[] paths;
+  delete[] downPaths;
+  delete[] upPaths;
+  delete[] feeders;
+  delete[] routes;
+  delete[] ledPositions;
+  ports = nullptr;
+  ends = nullptr;
+  positions = nullptr;
+  assignments = nullptr;
+  strips = nullptr;
+  neighbors = nullptr;
+  paths = nullptr;
+  downPaths = nullptr;
+  upPaths = nullptr;
+  feeders = nullptr;
+  routes = nullptr;
+  ledPositions = nullptr;
+
+  for (int g = 0; g < 3; g++)
+  {
+    delete[] groups[g];
+    groups[g] = nullptr;
+    groupCounts[g] = 0;
+  }
+  nodeCount = 0;
+  segmentCount = 0;
+  stripCount = 0;
+  valid = false;
+}
+
+bool TopologyLayout::fail(const char *message)
+{
+  release();
+  error = message;
+  return false;
+}
+
+// ---------------------------------------------------------------------------
+// Loading
+
+bool TopologyLayout::loadStock()
+{
+  if (!Topology::STOCK_FITS)
+  {
+    return fail("The stock layout does not match this build");
+  }
+  if (!allocate(Topology::STOCK_NODES, Topology::STOCK_SEGMENTS, Topology::STOCK_STRIPS))
+  {
+    return false;
+  }
+
+  memcpy(ports, Topology::stockNodeConnections, sizeof(NodePorts) * nodeCount);
+  memcpy(ends, Topology::stockSegmentConnections, sizeof(SegmentEnds) * segmentCount);
+  memcpy(positions, Topology::stockNodePositions, sizeof(NodePosition) * nodeCount);
+  memcpy(assignments, Topology::stockLedAssignments, sizeof(LedAssignment) * segmentCount);
+  memcpy(strips, Topology::stockStrips, sizeof(StripConfig) * stripCount);
+
+  const int *stockGroups[3] = {Topology::stockBorderNodes, Topology::stockCubeNodes, Topology::stockFunNodes};
+  const int stockCounts[3] = {sizeof(Topology::stockBorderNodes) / sizeof(int), sizeof(Topology::stockCubeNodes) / sizeof(int),
+                              sizeof(Topology::stockFunNodes) / sizeof(int)};
+  center = Topology::STOCK_STARBURST_NODE;
+  for (int g = 0; g < 3; g++)
+  {
+    groupCounts[g] = stockCounts[g];
+    groups[g] = new int[stockCounts[g]];
+    memcpy(groups[g], stockGroups[g], sizeof(int) * stockCounts[g]);
+  }
+  return finish();
+}
+
+bool TopologyLayout::loadBlank()
+{
+  if (!allocate(Constants::NUMBER_OF_NODES, Constants::NUMBER_OF_SEGMENTS, 0))
+  {
+    return false;
+  }
+  for (int n = 0; n < nodeCount; n++)
+  {
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      ports[n][p] = -1;
+    }
+    positions[n].x = 0;
+    positions[n].y = n;
+  }
+  for (int s = 0; s < segmentCount; s++)
+  {
+    ends[s][0] = 0;
+    ends[s][1] = 1;
+    assignments[s][0] = 0; // No strip 0 exists, so nothing is routed
+    assignments[s][1] = 0;
+    assignments[s][2] = 0;
+  }
+  deriveGroups();
+  buildCaches();
+  valid = false; // Usable, but not a real wall
+  return true;
+}
+
+bool TopologyLayout::loadJson(const char *json, size_t length)
+{
+  JsonDocument doc;
+  DeserializationError result = deserializeJson(doc, json, length);
+  if (result)
+  {
+    return fail("Topology JSON does not parse");
+  }
+
+  JsonArray nodeList = doc["nodes"];
+  JsonArray segmentList = doc["segments"];
+  JsonArray stripList = doc["strips"];
+  if (!doc["nodes"].is<JsonArray>() || !doc["segments"].is<JsonArray>() || !doc["strips"].is<JsonArray>())
+  {
+    return fail("Topology JSON needs nodes, segments and strips arrays");
+  }
+  if (!allocate(nodeList.size(), segmentList.size(), stripList.size()))
+  {
+    return false;
+  }
+
+  int n = 0;
+  for (JsonObject node : nodeList)
+  {
+    JsonArray nodePorts = node["ports"];
+    if (!node["x"].is<int>() || !node["y"].is<int>() || !node["ports"].is<JsonArray>() ||
+        nodePorts.size() != Constants::MAX_PATHS_PER_NODE)
+    {
+      return fail("Each node needs x, y and six ports");
+    }
+    positions[n].x = node["x"].as<int>();
+    positions[n].y = node["y"].as<int>();
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      ports[n][p] = nodePorts[p].is<int>() ? nodePorts[p].as<int>() : -2;
+    }
+    n++;
+  }
+
+  int s = 0;
+  for (JsonObject segment : segmentList)
+  {
+    if (!segment["ceiling"].is<int>() || !segment["floor"].is<int>() || !segment["strip"].is<int>() ||
+        !segment["ceilingLed"].is<int>() || !segment["floorLed"].is<int>())
+    {
+      return fail("Each segment needs ceiling, floor, strip, ceilingLed and floorLed");
+    }
+    ends[s][0] = segment["ceiling"].as<int>();
+    ends[s][1] = segment["floor"].as<int>();
+    assignments[s][0] = segment["strip"].as<int>();
+    assignments[s][1] = segment["ceilingLed"].as<int>();
+    assignments[s][2] = segment["floorLed"].as<int>();
+    s++;
+  }
+
+  int i = 0;
+  for (JsonObject strip : stripList)
+  {
+    if (!strip["length"].is<int>() || !strip["pin"].is<int>())
+    {
+      return fail("Each strip needs length and pin");
+    }
+    strips[i].length = strip["length"].as<int>();
+    strips[i].dataPin = strip["pin"].as<int>();
+    strips[i].clockPin = strip["clockPin"].is<int>() ? strip["clockPin"].as<int>() : -1;
+    i++;
+  }
+
+  if (doc["groups"].is<JsonObject>())
+  {
+    JsonObject groupObject = doc["groups"];
+    center = groupObject["center"].is<int>() ? groupObject["center"].as<int>() : -1;
+    for (int g = 0; g < 3; g++)
+    {
+      if (!groupObject[groupNames[g]].is<JsonArray>())
+      {
+        continue;
+      }
+      JsonArray list = groupObject[groupNames[g]];
+      groupCounts[g] = list.size();
+      groups[g] = new int[groupCounts[g] > 0 ? groupCounts[g] : 1];
+      for (int k = 0; k < groupCounts[g]; k++)
+      {
+        groups[g][k] = list[k].is<int>() ? list[k].as<int>() : -1;
+      }
+    }
+  }
+  return finish();
+}
+
+bool TopologyLayout::loadBinary(const uint8_t *data, size_t length)
+{
+  if (length < BINARY_HEADER_SIZE || memcmp(data, "CHTP", 4) != 0 || data[4] != BINARY_VERSION)
+  {
+    return fail("Not a topology file");
+  }
+  if (!allocate(readU16(data + 6), readU16(data + 8), data[5]))
+  {
+    return false;
+  }
+
+  size_t needed = BINARY_HEADER_SIZE + nodeCount * 16 + segmentCount * 9 + stripCount * 4 + 2 + 3 * 2;
+  if (length < needed)
+  {
+    return fail("Topology file is truncated");
+  }
+
+  const uint8_t *in = data + BINARY_HEADER_SIZE;
+  for (int n = 0; n < nodeCount; n++, in += 16)
+  {
+    positions[n].x = readI16(in);
+    positions[n].y = readI16(in + 2);
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      ports[n][p] = readI16(in + 4 + p * 2);
+    }
+  }
+  for (int s = 0; s < segmentCount; s++, in += 9)
+  {
+    ends[s][0] = readU16(in);
+    ends[s][1] = readU16(in + 2);
+    assignments[s][0] = in[4];
+    assignments[s][1] = readU16(in + 5);
+    assignments[s][2] = readU16(in + 7);
+  }
+  for (int i = 0; i < stripCount; i++, in += 4)
+  {
+    strips[i].length = readU16(in);
+    strips[i].dataPin = in[2];
+    strips[i].clockPin = in[3] == 255 ? -1 : in[3];
+  }
+
+  center = readU16(in);
+  in += 2;
+  const uint8_t *end = data + length;
+  for (int g = 0; g < 3; g++)
+  {
+    if (end - in < 2 || end - in < 2 + 2 * readU16(in))
+    {
+      return fail("Topology file is truncated");
+    }
+    groupCounts[g] = readU16(in);
+    groups[g] = new int[groupCounts[g] > 0 ? groupCounts[g] : 1];
+    for (int k = 0; k < groupCounts[g]; k++)
+    {
+      groups[g][k] = readU16(in + 2 + k * 2);
+    }
+    in += 2 + groupCounts[g] * 2;
+  }
+  return finish();
+}
+
+bool TopologyLayout::loadFile(const char *path)
+{
+  File file = SPIFFS.open(path, FILE_READ);
+  if (!file)
+  {
+    return fail("Topology file does not open");
+  }
+
+  size_t length = file.available();
+  uint8_t *data = new uint8_t[length + 1];
+  size_t got = file.read(data, length);
+  file.close();
+  data[got] = 0;
+
+  bool ok = got >= 4 && memcmp(data, "CHTP", 4) == 0 ? loadBinary(data, got) : loadJson((const char *)data, got);
+  delete[] data;
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Writing
+
+size_t TopologyLayout::getBinarySize() const
+{
+  size_t size = BINARY_HEADER_SIZE + nodeCount * 16 + segmentCount * 9 + stripCount * 4 + 2;
+  for (int g = 0; g < 3; g++)
+  {
+    size += 2 + groupCounts[g] * 2;
+  }
+  return size;
+}
+
+size_t TopologyLayout::writeBinary(uint8_t *out, size_t capacity) const
+{
+  size_t size = getBinarySize();
+  if (nodeCount == 0 || capacity < size)
+  {
+    return 0;
+  }
+
+  memcpy(out, "CHTP", 4);
+  out[4] = BINARY_VERSION;
+  out[5] = stripCount;
+  writeU16(out + 6, nodeCount);
+  writeU16(out + 8, segmentCount);
+
+  uint8_t *o = out + BINARY_HEADER_SIZE;
+  for (int n = 0; n < nodeCount; n++, o += 16)
+  {
+    writeU16(o, positions[n].x);
+    writeU16(o + 2, positions[n].y);
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      writeU16(o + 4 + p * 2, ports[n][p]);
+    }
+  }
+  for (int s = 0; s < segmentCount; s++, o += 9)
+  {
+    writeU16(o, ends[s][0]);
+    writeU16(o + 2, ends[s][1]);
+    o[4] = assignments[s][0];
+    writeU16(o + 5, assignments[s][1]);
+    writeU16(o + 7, assignments[s][2]);
+  }
+  for (int i = 0; i < stripCount; i++, o += 4)
+  {
+    writeU16(o, strips[i].length);
+    o[2] = strips[i].dataPin;
+    o[3] = strips[i].clockPin < 0 ? 255 : strips[i].clockPin;
+  }
+
+  writeU16(o, center);
+  o += 2;
+  for (int g = 0; g < 3; g++)
+  {
+    writeU16(o, groupCounts[g]);
+    for (int k = 0; k < groupCounts[g]; k++)
+    {
+      writeU16(o + 2 + k * 2, groups[g][k]);
+    }
+    o += 2 + groupCounts[g] * 2;
+  }
+  return size;
+}
+
+void TopologyLayout::writeJson(JsonObject &doc) const
+{
+  JsonArray nodeList = doc["nodes"].to<JsonArray>();
+  for (int n = 0; n < nodeCount; n++)
+  {
+    JsonObject node = nodeList.add<JsonObject>();
+    node["x"] = positions[n].x;
+    node["y"] = positions[n].y;
+    JsonArray nodePorts = node["ports"].to<JsonArray>();
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      nodePorts.add(ports[n][p]);
+    }
+  }
+
+  JsonArray segmentList = doc["segments"].to<JsonArray>();
+  for (int s = 0; s < segmentCount; s++)
+  {
+    JsonObject segment = segmentList.add<JsonObject>();
+    segment["ceiling"] = ends[s][0];
+    segment["floor"] = ends[s][1];
+    segment["strip"] = assignments[s][0];
+    segment["ceilingLed"] = assignments[s][1];
+    segment["floorLed"] = assignments[s][2];
+  }
+
+  JsonArray stripList = doc["strips"].to<JsonArray>();
+  for (int i = 0; i < stripCount; i++)
+  {
+    JsonObject strip = stripList.add<JsonObject>();
+    strip["length"] = strips[i].length;
+    strip["pin"] = strips[i].dataPin;
+    strip["clockPin"] = strips[i].clockPin;
+  }
+
+  JsonObject groupObject = doc["groups"].to<JsonObject>();
+  groupObject["center"] = center;
+  for (int g = 0; g < 3; g++)
+  {
+    JsonArray list = groupObject[groupNames[g]].to<JsonArray>();
+    for (int k = 0; k < groupCounts[g]; k++)
+    {
+      list.add(groups[g][k]);
+    }
+  }
+}
+
+int TopologyLayout::getLedCount() const
+{
+  int total = 0;
+  for (int s = 0; s < segmentCount; s++)
+  {
+    int span = assignments[s][1] - assignments[s][2];
+    total += (span < 0 ? -span : span) + 1;
+  }
+  return total;
+}
+
+// ---------------------------------------------------------------------------
+// Validation and derived tables
+
+bool TopologyLayout::finish()
+{
+  if (!validate())
+  {
+    return false;
+  }
+  deriveGroups();
+  buildCaches();
+  valid = true;
+  return true;
+}
+
+bool TopologyLayout::validate()
+{
+  for (int n = 0; n < nodeCount; n++)
+  {
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      int seg = ports[n][p];
+      if (seg < -1 || seg >= segmentCount)
+      {
+        return fail("A port names a segment that does not exist");
+      }
+      if (seg >= 0 && ends[seg][0] != n && ends[seg][1] != n)
+      {
+        return fail("A port lists a segment that does not end at that node");
+      }
+    }
+  }
+
+  for (int s = 0; s < segmentCount; s++)
+  {
+    int top = ends[s][0];
+    int bottom = ends[s][1];
+    if (top < 0 || top >= nodeCount || bottom < 0 || bottom >= nodeCount || top == bottom)
+    {
+      return fail("A segment has an invalid end node");
+    }
+    if (positions[top].y >= positions[bottom].y)
+    {
+      return fail("A segment's ceiling node must be above its floor node");
+    }
+    for (int side = 0; side < Constants::SIDES_PER_SEGMENT; side++)
+    {
+      int listed = 0;
+      for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+      {
+        listed += ports[ends[s][side]][p] == s ? 1 : 0;
+      }
+      if (listed != 1)
+      {
+        return fail("Each segment must appear exactly once at both of its end nodes");
+      }
+    }
+
+    int strip = assignments[s][0];
+    if (strip < 0 || strip >= stripCount)
+    {
+      return fail("A segment is routed to a strip that does not exist");
+    }
+    for (int k = 1; k <= 2; k++)
+    {
+      if (assignments[s][k] < 0 || assignments[s][k] >= strips[strip].length)
+      {
+        return fail("A segment's LEDs run past the end of its strip");
+      }
+    }
+  }
+
+  // Ports 0, 1 and 5 point up, 2, 3 and 4 point down (ripples rely on it)
+  for (int n = 0; n < nodeCount; n++)
+  {
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      int seg = ports[n][p];
+      if (seg < 0)
+      {
+        continue;
+      }
+      int other = ends[seg][0] == n ? ends[seg][1] : ends[seg][0];
+      bool upPort = p == 0 || p == 1 || p == 5;
+      if (upPort != (positions[other].y < positions[n].y))
+      {
+        return fail("Port directions do not match the node positions");
+      }
+    }
+  }
+
+  // No strip LED may be claimed twice
+  for (int i = 0; i < stripCount; i++)
+  {
+    if (strips[i].length <= 0 || strips[i].dataPin < 0)
+    {
+      return fail("A strip needs a length and a data pin");
+    }
+    if (strips[i].length > 65535)
+    {
+      return fail("A strip can have at most 65535 LEDs");
+    }
+    uint8_t *claimed = new uint8_t[strips[i].length]();
+    bool overlap = false;
+    for (int s = 0; s < segmentCount && !overlap; s++)
+    {
+      if (assignments[s][0] != i)
+      {
+        continue;
+      }
+      int lo = assignments[s][1] < assignments[s][2] ? assignments[s][1] : assignments[s][2];
+      int hi = assignments[s][1] < assignments[s][2] ? assignments[s][2] : assignments[s][1];
+      for (int led = lo; led <= hi && !overlap; led++)
+      {
+        overlap = claimed[led] != 0;
+        claimed[led] = 1;
+      }
+    }
+    delete[] claimed;
+    if (overlap)
+    {
+      return fail("Two segments share a strip LED");
+    }
+  }
+
+  if (center >= nodeCount)
+  {
+    return fail("The center node does not exist");
+  }
+  for (int g = 0; g < 3; g++)
+  {
+    for (int k = 0; k < groupCounts[g]; k++)
+    {
+      if (groups[g][k] < 0 || groups[g][k] >= nodeCount)
+      {
+        return fail("A node group names a node that does not exist");
+      }
+    }
+  }
+  return true;
+}
+
+void TopologyLayout::deriveGroups()
+{
+  int *degree = new int[nodeCount];
+  for (int n = 0; n < nodeCount; n++)
+  {
+    degree[n] = 0;
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      degree[n] += ports[n][p] >= 0 ? 1 : 0;
+    }
+  }
+
+  for (int g = 0; g < 3; g++)
+  {
+    if (groupCounts[g] > 0)
+    {
+      continue;
+    }
+    delete[] groups[g];
+    groups[g] = new int[nodeCount];
+    for (int n = 0; n < nodeCount; n++)
+    {
+      bool member = g == GROUP_BORDER ? degree[n] <= 2 : g == GROUP_CUBE ? degree[n] == 3
+                                                                         : degree[n] >= 4;
+      if (member)
+      {
+        groups[g][groupCounts[g]++] = n;
+      }
+    }
+    // Animations pick from these at random, so never leave one empty
+    if (groupCounts[g] == 0)
+    {
+      for (int n = 0; n < nodeCount; n++)
+      {
+        groups[g][groupCounts[g]++] = n;
+      }
+    }
+  }
+  delete[] degree;
+
+  if (center < 0)
+  {
+    long sumX = 0, sumY = 0;
+    for (int n = 0; n < nodeCount; n++)
+    {
+      sumX += positions[n].x;
+      sumY += positions[n].y;
+    }
+    long best = -1;
+    for (int n = 0; n < nodeCount; n++)
+    {
+      long dx = positions[n].x * (long)nodeCount - sumX;
+      long dy = positions[n].y * (long)nodeCount - sumY;
+      long distance = dx * dx + dy * dy;
+      if (best < 0 || distance < best)
+      {
+        best = distance;
+        center = n;
+      }
+    }
+  }
+}
+
+void TopologyLayout::buildCaches()
+{
+  for (int n = 0; n < nodeCount; n++)
+  {
+    paths[n].count = 0;
+    downPaths[n].count = 0;
+    upPaths[n].count = 0;
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      paths[n].segments[p] = downPaths[n].segments[p] = upPaths[n].segments[p] = -1;
+      paths[n].ports[p] = downPaths[n].ports[p] = upPaths[n].ports[p] = -1;
+    }
+  }
+
+  for (int n = 0; n < nodeCount; n++)
+  {
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      int seg = ports[n][p];
+      if (seg < 0)
+      {
+        neighbors[n].nodes[p] = -1;
+        continue;
+      }
+      int other = ends[seg][0] == n ? ends[seg][1] : ends[seg][0];
+      neighbors[n].nodes[p] = other;
+
+      PathList &direction = positions[other].y > positions[n].y ? downPaths[n] : upPaths[n];
+      paths[n].segments[paths[n].count] = seg;
+      paths[n].ports[paths[n].count++] = p;
+      direction.segments[direction.count] = seg;
+      direction.ports[direction.count++] = p;
+    }
+  }
+
+  // Segments hang from their ceiling node, so the feeders of a segment are
+  // the downward paths from its floor node
+  for (int s = 0; s < segmentCount; s++)
+  {
+    feeders[s] = downPaths[ends[s][1]];
+  }
+
+  if (routes != nullptr)
+  {
+    Topology::buildRouteTable(neighbors, nodeCount, routes);
+  }
+
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  for (int s = 0; s < segmentCount; s++)
+  {
+    const NodePosition &top = positions[ends[s][0]];
+    const NodePosition &bottom = positions[ends[s][1]];
+    for (int i = 0; i < leds; i++)
+    {
+      float t = leds > 1 ? (float)i / (leds - 1) : 0.0f;
+      ledPositions[s * leds + i].x = bottom.x + (top.x - bottom.x) * t;
+      ledPositions[s * leds + i].y = bottom.y + (top.y - bottom.y) * t;
+    }
+  }
+}
@@ -0,0 +1,117 @@
+#ifndef TOPOLOGY_LAYOUT_H
+#define TOPOLOGY_LAYOUT_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Constants.h"
+#include "Topology.h"
+
+/*
+A wall layout loaded at runtime. The node and segment counts must match the
+build (Constants::NUMBER_OF_NODES / NUMBER_OF_SEGMENTS, set with the
+CHROMANCE_* defines); everything else - connections, positions, strip
+routing, LEDs per segment, output pins - comes from the file. Each segment is
+rendered at LEDS_PER_SEGMENT and resampled onto however many LEDs it really
+has.
+
+The counts stay fixed on purpose. Animations, the ripples and the frame
+buffer keep per-node and per-segment state in arrays sized from those
+constants, and sizing all of them at load time would put each one on the
+heap. A file with other counts is rejected like any other bad file, so a wall
+of a different shape needs its own build.
+
+JSON (/topology.json):
+
+  {
+    "nodes":    [{"x": 20, "y": 1, "ports": [-1, -1, 1, -1, 0, -1]}, ...],
+    "segments": [{"ceiling": 0, "floor": 3, "strip": 2, "ceilingLed": 0, "floorLed": 13}, ...],
+    "strips":   [{"length": 154, "pin": 33, "clockPin": 2}, ...],
+    "groups":   {"center": 15, "border": [...], "cube": [...], "fun": [...]}
+  }
+
+Ports run clockwise from straight up: 0 up, 1 up-right, 2 down-right, 3 down,
+4 down-left, 5 up-left. "groups" is optional; missing groups are derived from
+node degree (border: 2 paths, cube: 3, fun: 4 or more, center: nearest the
+middle).
+
+Binary (/topology.bin), little endian, the same data without the keys:
+
+  'C' 'H' 'T' 'P', version, stripCount, nodeCount (u16), segmentCount (u16)
+  nodes:    x (i16), y (i16), 6 ports (i16, -1 unused)
+  segments: ceiling (u16), floor (u16), strip (u8), ceilingLed (u16), floorLed (u16)
+  strips:   length (u16), pin (u8), clockPin (u8, 255 unused)
+  groups:   center (u16), then border, cube and fun as count (u16) + ids (u16)
+
+Loading validates the same invariants Topology.cpp static_asserts for the
+stock layout and then builds the derived tables (adjacency, routing, LED
+positions), so nothing is worked out per frame.
+*/
+
+class TopologyLayout
+{
+public:
+  static const uint8_t BINARY_VERSION = 1;
+  static const size_t BINARY_HEADER_SIZE = 10;
+
+  TopologyLayout();
+  ~TopologyLayout();
+
+  bool loadStock();
+  bool loadBlank(); // Build-sized but unconnected and unrouted: nothing lights
+  bool loadJson(const char *json, size_t length);
+  bool loadBinary(const uint8_t *data, size_t length);
+  bool loadFile(const char *path); // SPIFFS; binary if it starts with the magic, JSON otherwise
+
+  size_t getBinarySize() const;
+  size_t writeBinary(uint8_t *out, size_t capacity) const; // 0 if it does not fit
+  void writeJson(JsonObject &doc) const;
+
+  bool isValid() const { return valid; }
+  const char *getError() const { return error; }
+
+  int getNodeCount() const { return nodeCount; }
+  int getSegmentCount() const { return segmentCount; }
+  int getStripCount() const { return stripCount; }
+  int getLedCount() const; // Physical LEDs over all segments
+
+private:
+  friend class Topology;
+
+  bool valid;
+  const char *error;
+  int nodeCount;
+  int segmentCount;
+  int stripCount;
+
+  // Source tables, sized at load
+  NodePorts *ports;
+  SegmentEnds *ends;
+  NodePosition *positions;
+  LedAssignment *assignments;
+  StripConfig *strips;
+  int center;
+  int groupCounts[3]; // border, cube, fun
+  int *groups[3];
+
+  // Derived
+  NodeNeighbors *neighbors;
+  PathList *paths;
+  PathList *downPaths;
+  PathList *upPaths;
+  PathList *feeders;
+  int8_t *routes;
+  LedPosition *ledPositions;
+
+  TopologyLayout(const TopologyLayout &);
+  TopologyLayout &operator=(const TopologyLayout &);
+
+  bool allocate(int nodes, int segments, int stripTotal);
+  void release();
+  bool fail(const char *message);
+  bool finish(); // Validates, derives missing groups and builds the caches
+  bool validate();
+  void deriveGroups();
+  void buildCaches();
+};
+
+#endif // TOPOLOGY_LAYOUT_H
@@ -0,0 +1,489 @@
+#include "WallSync.h"
+#include <string.h>
+
+namespace
+{
+  const uint8_t PACKET_STATE = 1;
+  const uint8_t PACKET_FRAME = 2;
+  const uint8_t FLAG_AUTO_SWITCHING = 0x01;
+
+  const int MAX_PACKETS_PER_UPDATE = 16; // Leaves time to render when flooded
+
+  // Packets are little-endian whatever the host
+  void put16(uint8_t *at, uint16_t value)
+  {
+    at[0] = (uint8_t)value;
+    at[1] = (uint8_t)(value >> 8);
+  }
+
+  void put32(uint8_t *at, uint32_t value)
+  {
+    for (int b = 0; b < 4; b++)
+    {
+      at[b] = (uint8_t)(value >> (8 * b));
+    }
+  }
+
+  uint16_t get16(const uint8_t *at)
+  {
+    return (uint16_t)(at[0] | (at[1] << 8));
+  }
+
+  uint32_t get32(const uint8_t *at)
+  {
+    return (uint32_t)at[0] | ((uint32_t)at[1] << 8) | ((uint32_t)at[2] << 16) | ((uint32_t)at[3] << 24);
+  }
+
+  template <typename Epoch>
+  bool sameEpoch(const Epoch &a, const Epoch &b)
+  {
+    // A leader that restarted counts epochs from 1 again
+    return a.id == b.id && a.seed == b.seed && a.start == b.start;
+  }
+
+  void putHeader(uint8_t *at, uint8_t type)
+  {
+    at[0] = 'C';
+    at[1] = 'S';
+    at[2] = 'Y';
+    at[3] = WallSync::VERSION;
+    at[4] = type;
+  }
+}
+
+static_assert(WallSync::FRAME_BYTES <= 0xFFFF, "Streamed frame offsets are 16 bits");
+static_assert(WallSync::FRAME_CHUNKS <= 32, "Streamed frame pieces are tracked in 32 bits");
+
+const uint16_t WallSync::PORT;
+const unsigned long WallSync::FRAME_MILLIS;
+const int WallSync::FRAME_CHUNK;
+const int WallSync::FRAME_BYTES;
+const int WallSync::STATE_SIZE;
+const int WallSync::FRAME_HEADER_SIZE;
+const int WallSync::MAX_PACKET;
+
+WallSync::WallSync(AnimationController &controller, SyncTransport &transport, Clock &local)
+    : controller(controller), transport(transport), local(local), frameClock(FRAME_MILLIS, local.now()),
+      role(SYNC_OFF), hasCurrent(false), hasPending(false), nextFrame(0), lastStateSent(0), lastChanges(0),
+      following(false), streaming(false), ownAutoSwitching(true), lastHeard(0), offset(0), sampleCount(0),
+      sampleNext(0), lastLeaderTime(0), streamFrame(0), chunksReceived(0), streamShown(false)
+{
+}
+
+void WallSync::begin()
+{
+  frameClock.set(local.now());
+  controller.setClock(frameClock);
+}
+
+void WallSync::setRole(SyncRole newRole)
+{
+  if (newRole == role)
+  {
+    return;
+  }
+  if (following)
+  {
+    stopFollowing();
+  }
+  role = newRole;
+  hasCurrent = false;
+  hasPending = false;
+  lastStateSent = 0;
+}
+
+int WallSync::update()
+{
+  switch (role)
+  {
+  case SYNC_LEADER:
+  case SYNC_STREAM:
+    return lead();
+  case SYNC_FOLLOWER:
+    return follow();
+  default:
+    return runFree(local.now() + offset);
+  }
+}
+
+int WallSync::runFree(unsigned long now)
+{
+  // As without sync: a frame per call at whatever time it is. Time never
+  // steps back, even when the offset estimate does.
+  if ((long)(now - frameClock.now()) > 0)
+  {
+    frameClock.set(now);
+  }
+  controller.update();
+  stats.framesRendered++;
+  return 1;
+}
+
+int WallSync::lead()
+{
+  // Followers keep the offset they had, so a wall that takes over keeps time
+  unsigned long now = local.now() + offset;
+  receive(now);
+
+  if (!hasCurrent)
+  {
+    // Epoch numbers carry on, so followers see this is a new one
+    current.start = now;
+    current.frameMillis = FRAME_MILLIS;
+    hasCurrent = true;
+    nextFrame = 0;
+    if (role == SYNC_LEADER)
+    {
+      announce(current, now);
+      startEpoch(current);
+      sendState(now);
+    }
+  }
+
+  int shown = renderDue(now);
+  if (role == SYNC_LEADER && now - lastStateSent >= STATE_INTERVAL)
+  {
+    sendState(now);
+  }
+  return shown;
+}
+
+bool WallSync::changed() const
+{
+  // Changing animation from the web page, or turning auto switching on or
+  // off. Auto switching itself needs no epoch, as every wall draws the same
+  // random numbers at the same frames and so makes the same choice; a new
+  // epoch still follows, in case one didn't.
+  return controller.getChangeCount() != lastChanges || controller.getCurrentAnimation() != current.animation ||
+         controller.isAutoSwitching() != current.autoSwitching;
+}
+
+void WallSync::announce(Epoch &epoch, unsigned long start)
+{
+  // The seed is mixed from the last one rather than drawn with random(), which
+  // would put the leader's numbers out of step with its followers'
+  epoch.id++;
+  epoch.animation = controller.getCurrentAnimation();
+  epoch.autoSwitching = controller.isAutoSwitching();
+  epoch.seed = (epoch.seed ^ start ^ ((uint32_t)epoch.id << 16)) * 2654435761u;
+  epoch.seed = epoch.seed ? epoch.seed : 1; // Zero would leave the ESP32 on its hardware generator
+  epoch.start = start;
+  epoch.frameMillis = FRAME_MILLIS;
+  lastChanges = controller.getChangeCount();
+}
+
+int WallSync::follow()
+{
+  unsigned long localNow = local.now();
+  int shown = receive(localNow);
+  if (following && localNow - lastHeard >= LEADER_TIMEOUT)
+  {
+    stopFollowing();
+  }
+
+  unsigned long now = localNow + offset;
+  if (!following)
+  {
+    return runFree(now);
+  }
+  if (streaming)
+  {
+    // The leader's pixels are shown as they arrive; keep the queue drained
+    controller.processCommands();
+    return shown;
+  }
+  if (!hasCurrent)
+  {
+    if (!hasPending || (long)(now - pending.start) < 0)
+    {
+      return runFree(now);
+    }
+    current = pending;
+    hasPending = false;
+    hasCurrent = true;
+    nextFrame = 0;
+    startEpoch(current);
+  }
+  return renderDue(now);
+}
+
+int WallSync::renderDue(unsigned long now)
+{
+  if ((long)(now - frameTime(nextFrame)) < 0)
+  {
+    return 0;
+  }
+  unsigned long due = (now - current.start) / current.frameMillis;
+  if (due - nextFrame > (unsigned long)MAX_REPLAY)
+  {
+    stats.framesSkipped += due - nextFrame;
+    nextFrame = due;
+  }
+
+  int shown = 0;
+  while (shown < MAX_CATCH_UP && nextFrame <= due)
+  {
+    if (hasPending && (long)(frameTime(nextFrame) - pending.start) >= 0)
+    {
+      current = pending;
+      hasPending = false;
+      nextFrame = 0;
+      due = (now - current.start) / current.frameMillis;
+      startEpoch(current);
+      continue;
+    }
+
+    frameClock.set(frameTime(nextFrame));
+    if (role == SYNC_LEADER)
+    {
+      // Apply changes here rather than in update(), so that an epoch starts
+      // on the frame that first shows them
+      controller.processCommands();
+      if (changed())
+      {
+        pending = current;
+        announce(pending, frameTime(nextFrame));
+        hasPending = true;
+        sendState(now);
+        continue;
+      }
+    }
+    controller.update();
+    if (role == SYNC_STREAM)
+    {
+      sendFrame();
+    }
+    stats.framesRendered++;
+    if (nextFrame < due)
+    {
+      stats.framesReplayed++;
+    }
+    else if (now - frameTime(nextFrame) > stats.worstLateness)
+    {
+      stats.worstLateness = now - frameTime(nextFrame);
+    }
+    nextFrame++;
+    shown++;
+  }
+  return shown;
+}
+
+void WallSync::startEpoch(const Epoch &epoch)
+{
+  frameClock.set(epoch.start);
+  if (role == SYNC_FOLLOWER && controller.isAutoSwitching() != epoch.autoSwitching)
+  {
+    controller.setAutoSwitching(epoch.autoSwitching);
+  }
+  controller.startSeeded(epoch.animation, epoch.seed);
+  stats.epochs++;
+}
+
+int WallSync::receive(unsigned long now)
+{
+  int shown = 0;
+  for (int k = 0; k < MAX_PACKETS_PER_UPDATE; k++)
+  {
+    int length = transport.receive(packet, sizeof(packet));
+    if (length <= 0)
+    {
+      break;
+    }
+    stats.packetsReceived++;
+    if (length < 5 || packet[0] != 'C' || packet[1] != 'S' || packet[2] != 'Y' || packet[3] != VERSION)
+    {
+      stats.badPackets++;
+      continue;
+    }
+    if (role != SYNC_FOLLOWER)
+    {
+      continue; // Only followers listen
+    }
+    if (packet[4] == PACKET_STATE && length == STATE_SIZE)
+    {
+      onState(packet, now);
+    }
+    else if (packet[4] == PACKET_FRAME && length > FRAME_HEADER_SIZE)
+    {
+      shown += onFrame(packet, length, now);
+    }
+    else
+    {
+      stats.badPackets++;
+    }
+  }
+  return shown;
+}
+
+void WallSync::onState(const uint8_t *data, unsigned long now)
+{
+  Epoch epoch;
+  uint32_t leaderTime = get32(data + 5);
+  epoch.id = get16(data + 9);
+  epoch.animation = data[11];
+  epoch.autoSwitching = (data[12] & FLAG_AUTO_SWITCHING) != 0;
+  epoch.seed = get32(data + 13);
+  epoch.start = get32(data + 17);
+  epoch.frameMillis = get16(data + 21);
+  if (epoch.frameMillis == 0)
+  {
+    stats.badPackets++;
+    return;
+  }
+
+  if (streaming)
+  {
+    streaming = false;
+    hasCurrent = false;
+  }
+  hear(now);
+
+  // A leader that restarted has a younger clock; forget the old one
+  if (sampleCount > 0 && (long)(leaderTime - lastLeaderTime) < 0)
+  {
+    sampleCount = 0;
+  }
+  lastLeaderTime = leaderTime;
+  addSample((long)(leaderTime - now));
+
+  if ((hasCurrent && sameEpoch(epoch, current)) || (hasPending && sameEpoch(epoch, pending)))
+  {
+    return;
+  }
+  pending = epoch;
+  hasPending = true;
+}
+
+int WallSync::onFrame(const uint8_t *data, int length, unsigned long now)
+{
+  uint32_t frame = get32(data + 5);
+  int at = get16(data + 9);
+  int size = get16(data + 11);
+  if (size != length - FRAME_HEADER_SIZE || at % FRAME_CHUNK != 0 || at + size > FRAME_BYTES)
+  {
+    stats.badPackets++;
+    return 0;
+  }
+
+  hear(now);
+  if (!streaming)
+  {
+    streaming = true;
+    hasCurrent = false;
+    hasPending = false;
+    chunksReceived = 0;
+    streamShown = true;
+    streamFrame = frame - 1;
+  }
+
+  // Pieces of a frame already shown or given up on come too late
+  if ((int32_t)(frame - streamFrame) < 0 || (frame == streamFrame && streamShown))
+  {
+    return 0;
+  }
+  if (frame != streamFrame)
+  {
+    if (!streamShown && chunksReceived != 0)
+    {
+      stats.incompleteFrames++;
+    }
+    streamFrame = frame;
+    streamShown = false;
+    chunksReceived = 0;
+  }
+
+  LedController &leds = controller.getLedController();
+  memcpy(leds.ledColors + at, data + FRAME_HEADER_SIZE, size);
+  chunksReceived |= 1u << (at / FRAME_CHUNK);
+
+  const uint32_t all = FRAME_CHUNKS == 32 ? 0xFFFFFFFFu : (1u << FRAME_CHUNKS) - 1;
+  if (chunksReceived != all)
+  {
+    return 0;
+  }
+  leds.show();
+  streamShown = true;
+  stats.streamedFrames++;
+  return 1;
+}
+
+void WallSync::addSample(long sample)
+{
+  samples[sampleNext] = sample;
+  sampleNext = (sampleNext + 1) % OFFSET_WINDOW;
+  if (sampleCount < OFFSET_WINDOW)
+  {
+    sampleCount++;
+  }
+
+  // The packet that was quickest to arrive is the best guess
+  long best = samples[(sampleNext + OFFSET_WINDOW - 1) % OFFSET_WINDOW];
+  for (int k = 0; k < sampleCount; k++)
+  {
+    if (samples[k] > best)
+    {
+      best = samples[k];
+    }
+  }
+  offset = best;
+}
+
+void WallSync::hear(unsigned long now)
+{
+  if (!following)
+  {
+    following = true;
+    ownAutoSwitching = controller.isAutoSwitching();
+  }
+  lastHeard = now;
+}
+
+void WallSync::stopFollowing()
+{
+  following = false;
+  streaming = false;
+  hasCurrent = false;
+  hasPending = false;
+  sampleCount = 0;
+  if (controller.isAutoSwitching() != ownAutoSwitching)
+  {
+    controller.setAutoSwitching(ownAutoSwitching);
+  }
+}
+
+void WallSync::sendState(unsigned long now)
+{
+  // The epoch to come once it is announced, so followers hear of it early
+  const Epoch &epoch = hasPending ? pending : current;
+  putHeader(packet, PACKET_STATE);
+  put32(packet + 5, now);
+  put16(packet + 9, epoch.id);
+  packet[11] = epoch.animation;
+  packet[12] = epoch.autoSwitching ? FLAG_AUTO_SWITCHING : 0;
+  put32(packet + 13, epoch.seed);
+  put32(packet + 17, epoch.start);
+  put16(packet + 21, epoch.frameMillis);
+  if (transport.send(packet, STATE_SIZE))
+  {
+    stats.packetsSent++;
+  }
+  lastStateSent = now;
+}
+
+void WallSync::sendFrame()
+{
+  const byte *pixels = controller.getLedController().ledColors;
+  for (int at = 0; at < FRAME_BYTES; at += FRAME_CHUNK)
+  {
+    int size = FRAME_BYTES - at < FRAME_CHUNK ? FRAME_BYTES - at : FRAME_CHUNK;
+    putHeader(packet, PACKET_FRAME);
+    put32(packet + 5, stats.framesRendered);
+    put16(packet + 9, at);
+    put16(packet + 11, size);
+    memcpy(packet + FRAME_HEADER_SIZE, pixels + at, size);
+    if (transport.send(packet, FRAME_HEADER_SIZE + size))
+    {
+      stats.packetsSent++;
+    }
+  }
+}
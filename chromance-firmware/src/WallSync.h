@@ -0,0 +1,156 @@
+#ifndef WALL_SYNC_H
+#define WALL_SYNC_H
+
+#include <Arduino.h>
+#include "Constants.h"
+#include "Clock.h"
+#include "AnimationController.h"
+
+/*
+Keeps several walls showing the same frame at the same moment. One wall
+leads and the rest follow it over UDP, in one of two ways.
+
+Lockstep (SYNC_LEADER) sends only a small state packet a few times a second.
+Each wall renders on the same frame grid of the leader's clock: frame n of an
+epoch is drawn at epoch start + n * frame millis. When the leader changes
+animation it starts a new epoch with a new seed, and every wall restarts the
+animation from that seed (AnimationController::startSeeded). Each follower
+then works out the same frames itself, auto switching included.
+
+A follower estimates the leader's clock from each state packet as leader time
+minus arrival time. A network delay only makes that too small, so it takes the
+largest over the last OFFSET_WINDOW packets. A follower that joins late,
+hears of an epoch late or falls behind replays the missed frames from the
+start of the epoch, MAX_CATCH_UP per update(). If it is more than MAX_REPLAY
+frames behind it jumps ahead and stays on the grid, but it no longer matches
+the leader pixel for pixel.
+
+Streaming (SYNC_STREAM) sends the leader's pixels every frame in FRAME_CHUNK
+pieces instead. This suits followers that can't reproduce the frames, such as
+other firmware, other layouts of the same size, or leaders driven by live
+input. A follower shows a frame once all of its pieces have arrived.
+
+A follower takes whichever kind the leader sends. After LEADER_TIMEOUT
+without hearing from it, the follower goes back to its own animations.
+*/
+
+// Sends and receives whole datagrams. The leader sends to every follower.
+class SyncTransport
+{
+public:
+  virtual ~SyncTransport() {}
+  virtual bool send(const uint8_t *data, size_t length) = 0;
+  virtual int receive(uint8_t *data, size_t capacity) = 0; // One datagram, 0 when none is waiting
+};
+
+struct WallSyncStats
+{
+  unsigned long packetsSent = 0;
+  unsigned long packetsReceived = 0;
+  unsigned long badPackets = 0; // Not ours, another version or malformed
+  unsigned long framesRendered = 0;
+  unsigned long framesReplayed = 0; // Rendered late to catch up
+  unsigned long framesSkipped = 0;  // Jumped over; lockstep was lost
+  unsigned long epochs = 0;
+  unsigned long streamedFrames = 0;
+  unsigned long incompleteFrames = 0; // Streamed frames that never got every piece
+  unsigned long worstLateness = 0;    // Most ms an on-time frame was drawn after its grid time
+};
+
+class WallSync
+{
+public:
+  static const uint16_t PORT = 7810;
+  static const uint8_t VERSION = 1;
+  static const unsigned long FRAME_MILLIS = 33;
+  static const unsigned long STATE_INTERVAL = 100; // ms between state packets
+  static const unsigned long LEADER_TIMEOUT = 2000;
+  static const int OFFSET_WINDOW = 16;
+  static const int MAX_CATCH_UP = 4;
+  static const int MAX_REPLAY = 150;
+  static const int FRAME_CHUNK = 1200; // Pixel bytes per packet; fits an Ethernet frame
+  static const int FRAME_BYTES = Constants::NUM_OF_PIXELS * 3;
+  static const int FRAME_CHUNKS = (FRAME_BYTES + FRAME_CHUNK - 1) / FRAME_CHUNK;
+  static const int STATE_SIZE = 23;
+  static const int FRAME_HEADER_SIZE = 13;
+  static const int MAX_PACKET = FRAME_HEADER_SIZE + FRAME_CHUNK;
+
+  WallSync(AnimationController &controller, SyncTransport &transport, Clock &local);
+
+  // Takes over the controller's clock; call after init()
+  void begin();
+  void setRole(SyncRole role);
+  SyncRole getRole() const { return role; }
+
+  // Call as often as possible. Reads what has arrived, renders the frames due
+  // by now and sends what a leader sends. Returns the frames shown.
+  int update();
+
+  bool isFollowing() const { return following; } // A leader was heard from within LEADER_TIMEOUT
+  bool isStreaming() const { return following && streaming; }
+  long getOffset() const { return offset; } // Leader clock minus ours
+  unsigned long getEpoch() const { return current.id; }
+  unsigned long getFrame() const { return nextFrame; } // Next frame of the epoch to render
+  const WallSyncStats &getStats() const { return stats; }
+
+private:
+  struct Epoch
+  {
+    uint16_t id = 0;
+    uint8_t animation = 0;
+    bool autoSwitching = true;
+    uint32_t seed = 0;
+    uint32_t start = 0; // Leader ms of frame 0
+    uint16_t frameMillis = FRAME_MILLIS;
+  };
+
+  AnimationController &controller;
+  SyncTransport &transport;
+  Clock &local;
+  VirtualClock frameClock;
+  SyncRole role;
+  WallSyncStats stats;
+
+  Epoch current;
+  Epoch pending;
+  bool hasCurrent;
+  bool hasPending;
+  unsigned long nextFrame;
+  unsigned long lastStateSent;
+  unsigned long lastChanges; // Controller change count when the latest epoch was announced
+
+  // Follower
+  bool following;
+  bool streaming;
+  bool ownAutoSwitching; // Restored when the leader goes quiet
+  unsigned long lastHeard;
+  long offset;
+  long samples[OFFSET_WINDOW];
+  int sampleCount;
+  int sampleNext;
+  unsigned long lastLeaderTime;
+  uint32_t streamFrame;
+  uint32_t chunksReceived;
+  bool streamShown;
+
+  uint8_t packet[MAX_PACKET];
+
+  unsigned long frameTime(unsigned long frame) const { return current.start + frame * current.frameMillis; }
+  int lead();
+  int follow();
+  int runFree(unsigned long now);
+  int renderDue(unsigned long now);
+  bool changed() const;
+  void announce(Epoch &epoch, unsigned long start);
+  void startEpoch(const Epoch &epoch);
+  int receive(unsigned long now);
+  void onState(const uint8_t *data, unsigned long now);
+  int onFrame(const uint8_t *data, int length, unsigned long now);
+  void addSample(long sample);
+  void hear(unsigned long now);
+  void stopFollowing();
+  void sendState(unsigned long now);
+  void sendFrame();
+};
+
+#endif // WALL_SYNC_H
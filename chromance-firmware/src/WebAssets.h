@@ -56,6 +56,16 @@ const char index_html[] PROGMEM = R"html(
                 <label>Rainbow Brightness (0-255)</label>
                 <input type="number" id="global_rainbowBrightness" min="0" max="255">
             </div>
+
+            <div class="config-field">
+                <label>Multi-Wall Sync</label>
+                <select id="global_syncRole">
+                    <option value="0">Off</option>
+                    <option value="1">Lead (followers render in lockstep)</option>
+                    <option value="2">Lead (stream pixels to followers)</option>
+                    <option value="3">Follow</option>
+                </select>
+            </div>
             
             <h4>Enabled Animations</h4>
             <div id="global_animationsList" style="max-height: 200px; overflow-y: auto; border: 1px solid #555; padding: 5px; margin-bottom: 10px;">
@@ -81,6 +91,19 @@ const char index_html[] PROGMEM = R"html(
         </div>
     </div>
 
+    <!-- Shader Editor Modal -->
+    <div id="shaderSection" style="display:none;" class="modal">
+        <div class="modal-content">
+            <h3>Shader</h3>
+            <textarea id="shaderSource" rows="10" spellcheck="false"></textarea>
+            <div id="shaderError" style="color:#f66; text-align:left; font-size:14px;"></div>
+            <div style="display:flex; gap:10px; margin-top:15px;">
+                <button onclick="saveShader()">Run</button>
+                <button onclick="closeShader()" style="background-color:#666">Close</button>
+            </div>
+        </div>
+    </div>
+
     <canvas id="emulatorCanvas" width="800" height="260"></canvas>
 
     <div id="status" style="margin-top: 20px; font-size: 12px; color: #888;"></div>
@@ -123,6 +146,7 @@ canvas { background: #000; border-radius: 5px; margin-top: 20px; width: 100%; ma
 .active-indicator.active { background-color: #00bcd4; box-shadow: 0 0 5px #00bcd4; }
 
 .modal { position: fixed; z-index: 100; left: 0; top: 0; width: 100%; height: 100%; overflow: auto; background-color: rgba(0,0,0,0.7); display: flex; align-items: center; justify-content: center; }
+textarea { width: 100%; box-sizing: border-box; padding: 10px; font-family: monospace; font-size: 14px; background-color: #444; color: #fff; border: none; border-radius: 5px; }
 .modal-content { background-color: #333; margin: auto; padding: 20px; border: 1px solid #888; width: 90%; max-width: 500px; border-radius: 10px; }
 )css";
 
@@ -135,6 +159,7 @@ const char script_js[] PROGMEM = R"js(
 
   let currentAnimConfig = {};
   let currentAnimId = -1;
+  let paletteNames = [];
 
   var gateway = `ws://${window.location.hostname}/ws`;
   var websocket;
@@ -158,6 +183,13 @@ const char script_js[] PROGMEM = R"js(
     // Pre-load global config so it's ready when the cog is clicked
     fetchGlobalConfig();
     fetchStatus();
+    fetchPalettes();
+  }
+
+  function fetchPalettes() {
+      fetch('/api/palettes')
+      .then(res => res.json())
+      .then(data => { paletteNames = data.palettes || []; });
   }
 
   function initWebSocket() {
@@ -214,23 +246,18 @@ const char script_js[] PROGMEM = R"js(
           } else {
                ledState.set(data.subarray(1, LED_BUFFER_SIZE + 1));
           }
-      } else if (type === 1) { // Diff
-          if (data.length < 3) return;
-          const count = (data[1] << 8) | data[2];
-          let ptr = 3;
-          for (let i = 0; i < count; i++) {
-              if (ptr + 4 >= data.length) break;
-              const idx = (data[ptr] << 8) | data[ptr+1];
-              const r = data[ptr+2];
-              const g = data[ptr+3];
-              const b = data[ptr+4];
-              const byteIdx = idx * 3;
-              if (byteIdx + 2 < LED_BUFFER_SIZE) {
-                  ledState[byteIdx] = r;
-                  ledState[byteIdx+1] = g;
-                  ledState[byteIdx+2] = b;
-              }
-              ptr += 5;
+      } else if (type === 2) { // Runs of changed pixels, see FrameDiff.h
+          if (data.length < 4) return;
+          const runs = (data[1] << 16) | (data[2] << 8) | data[3];
+          let ptr = 4;
+          for (let r = 0; r < runs; r++) {
+              if (ptr + 4 > data.length) break;
+              const start = (data[ptr] << 16) | (data[ptr+1] << 8) | data[ptr+2];
+              const bytes = data[ptr+3] * 3;
+              ptr += 4;
+              if (ptr + bytes > data.length || start * 3 + bytes > LED_BUFFER_SIZE) break;
+              ledState.set(data.subarray(ptr, ptr + bytes), start * 3);
+              ptr += bytes;
           }
       }
       drawLeds(ledState);
@@ -334,6 +361,15 @@ const char script_js[] PROGMEM = R"js(
                 controls.appendChild(configBtn);
             }
 
+            // Shader Editor Button
+            if (anim.name === 'Shader') {
+                const editBtn = document.createElement('button');
+                editBtn.className = 'btn-small';
+                editBtn.innerText = '✎';
+                editBtn.onclick = () => openShader();
+                controls.appendChild(editBtn);
+            }
+
             row.appendChild(controls);
             list.appendChild(row);
         });
@@ -366,6 +402,9 @@ const char script_js[] PROGMEM = R"js(
           if (data.sleepEnabled !== undefined) {
               document.getElementById('global_sleepToggle').checked = data.sleepEnabled;
           }
+          if (data.syncRole !== undefined) {
+              document.getElementById('global_syncRole').value = data.syncRole;
+          }
           // Emulator state is local but we can reflect current state in modal
           document.getElementById('global_emulatorToggle').checked = emulatorEnabled;
 
@@ -419,6 +458,7 @@ const char script_js[] PROGMEM = R"js(
       const config = {
           rainbowBrightness: parseInt(document.getElementById('global_rainbowBrightness').value),
           sleepEnabled: document.getElementById('global_sleepToggle').checked,
+          syncRole: parseInt(document.getElementById('global_syncRole').value),
           animations: []
       };
       
@@ -477,9 +517,18 @@ const char script_js[] PROGMEM = R"js(
                   const label = document.createElement('label');
                   label.innerText = key;
                   div.appendChild(label);
-                  const input = document.createElement('input');
+                  const isPalette = key === 'palette' && paletteNames.length > 0;
+                  const input = document.createElement(isPalette ? 'select' : 'input');
                   input.id = 'cfg_' + key;
-                  if (typeof val === 'number') {
+                  if (isPalette) {
+                      paletteNames.forEach(name => {
+                          const option = document.createElement('option');
+                          option.value = name;
+                          option.innerText = name;
+                          input.appendChild(option);
+                      });
+                      input.value = val;
+                  } else if (typeof val === 'number') {
                       input.type = 'number';
                       input.value = val;
                   } else if (typeof val === 'boolean') {
@@ -530,6 +579,38 @@ const char script_js[] PROGMEM = R"js(
       document.getElementById('animConfigSection').style.display = 'none';
   }
 
+  function openShader() {
+      document.getElementById('shaderSection').style.display = 'flex';
+      document.getElementById('shaderError').innerText = '';
+      fetch('/api/shader')
+      .then(res => res.text())
+      .then(text => { document.getElementById('shaderSource').value = text; });
+  }
+
+  function saveShader() {
+      const source = document.getElementById('shaderSource').value;
+      const error = document.getElementById('shaderError');
+      fetch('/api/shader', {
+          method: 'POST',
+          headers: { 'Content-Type': 'text/plain' },
+          body: source
+      }).then(res => res.json().then(data => {
+          if (res.ok) {
+              error.innerText = '';
+          } else if (data.position !== undefined) {
+              // Line and column of the mistake
+              const before = source.substring(0, data.position).split('\n');
+              error.innerText = `Line ${before.length}, column ${before[before.length - 1].length + 1}: ${data.message}`;
+          } else {
+              error.innerText = data.message || 'Error saving';
+          }
+      }));
+  }
+
+  function closeShader() {
+      document.getElementById('shaderSection').style.display = 'none';
+  }
+
   function startHeartbeat() {
       stopHeartbeat();
       heartbeatInterval = setInterval(() => {
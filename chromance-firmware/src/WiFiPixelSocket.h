@@ -0,0 +1,33 @@
+#ifndef WIFI_PIXEL_SOCKET_H
+#define WIFI_PIXEL_SOCKET_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "PixelReceiver.h"
+
+// A PixelReceiver input on one of the board's UDP ports. Device build only.
+class WiFiPixelSocket : public PixelSocket
+{
+public:
+  void begin(uint16_t port) { udp.begin(port); }
+
+  int next(uint32_t &source) override
+  {
+    // parsePacket() drops whatever was left unread of the last datagram
+    int size = udp.parsePacket();
+    if (size <= 0)
+    {
+      return 0;
+    }
+    source = (uint32_t)udp.remoteIP();
+    return size;
+  }
+
+  int read(uint8_t *data, size_t length) override { return udp.read(data, length); }
+
+private:
+  WiFiUDP udp;
+};
+
+#endif // WIFI_PIXEL_SOCKET_H
@@ -0,0 +1,40 @@
+#ifndef WIFI_SYNC_TRANSPORT_H
+#define WIFI_SYNC_TRANSPORT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "WallSync.h"
+
+// WallSync over the board's WiFi. Leaders broadcast to the local subnet on
+// WallSync::PORT, and every wall listens on it. Device build only.
+class WiFiSyncTransport : public SyncTransport
+{
+public:
+  void begin() { udp.begin(WallSync::PORT); }
+
+  bool send(const uint8_t *data, size_t length) override
+  {
+    if (WiFi.status() != WL_CONNECTED)
+    {
+      return false;
+    }
+    return udp.beginPacket(WiFi.broadcastIP(), WallSync::PORT) && udp.write(data, length) == length &&
+           udp.endPacket();
+  }
+
+  int receive(uint8_t *data, size_t capacity) override
+  {
+    // Anything longer than capacity is cut short and then fails WallSync's checks
+    if (udp.parsePacket() <= 0)
+    {
+      return 0;
+    }
+    return udp.read(data, capacity);
+  }
+
+private:
+  WiFiUDP udp;
+};
+
+#endif // WIFI_SYNC_TRANSPORT_H
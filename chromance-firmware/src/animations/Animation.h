@@ -9,6 +9,16 @@
 
 class AnimationController;
 
+// Declares which framebuffer passes an animation relies on, so the
+// controller only runs the ones whose result is actually visible.
+enum RenderContract
+{
+  RENDER_TRAILS,      // Draws sparsely or additively over the faded previous frame
+  RENDER_OVERWRITE,   // Writes every pixel every frame; the fade would be overwritten
+  RENDER_CLEAR,       // Draws onto a black canvas; the controller clears instead of fading
+  RENDER_RIPPLES_ONLY // Never touches pixels itself; output is ripples over faded trails
+};
+
 class Animation
 {
 public:
@@ -20,6 +30,7 @@ public:
   virtual void stop() {}
   virtual bool canBePreempted() { return true; }
   virtual bool isFinished() { return true; }
+  virtual RenderContract getRenderContract() const { return RENDER_TRAILS; }
   bool isEnabled() const { return enabled; }
   virtual const char *getName() const = 0;
   virtual bool hasConfig() const { return false; }
@@ -0,0 +1,179 @@
+#include "AutomataAnimation.h"
+#include "../AnimationController.h"
+#include "../AnimationRegistry.h"
+
+REGISTER_ANIMATION(AutomataAnimation)
+
+namespace
+{
+    // Found by running each rule on the stock wall from random starts: these
+    // keep changing instead of dying out or settling into a loop
+
+    // Life: born with 2 or 3 live neighbours, survives with 1 or 2, counting
+    // the LEDs up to 2 steps away (4 along a segment)
+    const int LIFE_REACH = 2;
+    const uint16_t LIFE_BIRTH = (1 << 2) | (1 << 3);
+    const uint16_t LIFE_SURVIVE = (1 << 1) | (1 << 2);
+    const int LIFE_PERCENT = 30;
+
+    // Brian's Brain fires on two neighbours, and on three as well so that
+    // its gliders make it through the junctions; a spark now and then keeps
+    // it from going quiet
+    const int BRAIN_REACH = 3;
+    const uint16_t BRAIN_BIRTH = (1 << 2) | (1 << 3);
+    const int BRAIN_PERCENT = 10;
+    const int SPARK_CHANCE = 20; // Percent a generation
+
+    const int CYCLIC_REACH = 3;
+    const int CYCLIC_STATES = 6;
+    const int CYCLIC_THRESHOLD = 1;
+
+    const int DEFAULT_SPEED = 60;
+    const int MAX_GENERATIONS_PER_FRAME = 16;
+}
+
+AutomataAnimation::AutomataAnimation(AnimationController &controller)
+    : Animation(controller), rule(CYCLIC), pickedRule(-1), speed(DEFAULT_SPEED), lastTime(0), owed(0),
+      lastPopulation(0), staleGenerations(0) {}
+
+void AutomataAnimation::run()
+{
+    rule = pickedRule >= 0 ? (Rule)pickedRule : (Rule)((rule + 1) % RULE_COUNT);
+    switch (rule)
+    {
+    case LIFE:
+        cells.useLeds(LIFE_REACH);
+        break;
+    case BRIANS_BRAIN:
+        cells.useLeds(BRAIN_REACH);
+        break;
+    default:
+        cells.useLeds(CYCLIC_REACH);
+        break;
+    }
+    start();
+    lastTime = controller.now();
+    owed = 0;
+}
+
+void AutomataAnimation::start()
+{
+    switch (rule)
+    {
+    case LIFE:
+        cells.randomize(2, LIFE_PERCENT);
+        break;
+    case BRIANS_BRAIN:
+        cells.randomize(3, BRAIN_PERCENT);
+        break;
+    default:
+        cells.randomize(CYCLIC_STATES, 100 - 100 / CYCLIC_STATES);
+        break;
+    }
+    lastPopulation = -1;
+    staleGenerations = 0;
+}
+
+void AutomataAnimation::advance(int generations)
+{
+    switch (rule)
+    {
+    case LIFE:
+        for (int g = 0; g < generations; g++)
+        {
+            cells.stepLife(LIFE_BIRTH, LIFE_SURVIVE);
+            int population = cells.countLive();
+            staleGenerations = population == lastPopulation ? staleGenerations + 1 : 0;
+            lastPopulation = population;
+            if (population == 0 || staleGenerations >= STALE_GENERATIONS)
+            {
+                start();
+            }
+        }
+        break;
+    case BRIANS_BRAIN:
+        for (int g = 0; g < generations; g++)
+        {
+            cells.stepBriansBrain(BRAIN_BIRTH);
+            if (random(100) < SPARK_CHANCE)
+            {
+                // Two firing LEDs side by side set off a glider each way
+                int segment = random(Constants::NUMBER_OF_SEGMENTS);
+                int led = random(1, Constants::LEDS_PER_SEGMENT - 2);
+                cells.set(LedController::pixelIndex(segment, led), 1);
+                cells.set(LedController::pixelIndex(segment, led + 1), 1);
+            }
+        }
+        break;
+    default:
+        cells.stepCyclic(CYCLIC_STATES, CYCLIC_THRESHOLD, generations);
+        break;
+    }
+}
+
+void AutomataAnimation::update()
+{
+    // As many generations as the time since the last frame is worth, so the
+    // speed does not depend on the frame rate
+    unsigned long now = controller.now();
+    owed += (now - lastTime) * speed;
+    lastTime = now;
+    int generations = owed / 1000;
+    owed %= 1000;
+    advance(generations < MAX_GENERATIONS_PER_FRAME ? generations : MAX_GENERATIONS_PER_FRAME);
+    draw();
+}
+
+void AutomataAnimation::draw()
+{
+    LedController &leds = controller.getLedController();
+    uint16_t drift = (uint16_t)(controller.now() % 60000 * 65536 / 60000);
+    byte *color = leds.ledColors;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++, color += 3)
+    {
+        int state = cells.get(p);
+        uint32_t rgb;
+        if (rule == CYCLIC)
+        {
+            rgb = leds.ColorHSV(drift + state * 65536 / CYCLIC_STATES, 255, 160);
+        }
+        else if (state == 1)
+        {
+            // Live or firing; the hue wanders along the frame buffer
+            rgb = leds.ColorHSV(drift + p * 117, rule == LIFE ? 255 : 80, 255);
+        }
+        else if (state == 2)
+        {
+            rgb = 0x000040; // Refractory
+        }
+        else
+        {
+            continue; // Dead cells fade with the trails
+        }
+        color[0] = (byte)((rgb >> 16) & 0xFF);
+        color[1] = (byte)((rgb >> 8) & 0xFF);
+        color[2] = (byte)(rgb & 0xFF);
+    }
+}
+
+void AutomataAnimation::getConfig(JsonObject &doc)
+{
+    Animation::getConfig(doc);
+    doc["rule"] = pickedRule;
+    doc["speed"] = speed;
+}
+
+void AutomataAnimation::setConfig(const JsonObject &doc)
+{
+    Animation::setConfig(doc);
+    if (doc["rule"].is<int>())
+    {
+        int value = doc["rule"];
+        pickedRule = value >= 0 && value < RULE_COUNT ? value : -1;
+    }
+    if (doc["speed"].is<int>())
+    {
+        int value = doc["speed"];
+        speed = value > 0 ? value : DEFAULT_SPEED;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef AUTOMATAANIMATION_H
+#define AUTOMATAANIMATION_H
+
+#include "Animation.h"
+#include "../GraphAutomaton.h"
+
+// Cellular automata with every LED a cell: a Life-like rule, Brian's Brain
+// and a cyclic automaton, taking turns each time the animation starts
+// unless one is picked in the config
+class AutomataAnimation : public Animation
+{
+public:
+    enum Rule
+    {
+        LIFE,
+        BRIANS_BRAIN,
+        CYCLIC,
+        RULE_COUNT
+    };
+
+    AutomataAnimation(AnimationController &controller);
+
+    void update() override;
+    void run() override;
+    bool isFinished() override { return false; }
+    RenderContract getRenderContract() const override { return rule == CYCLIC ? RENDER_OVERWRITE : RENDER_TRAILS; }
+    const char *getName() const override { return "Automata"; }
+    bool hasConfig() const override { return true; }
+    void getConfig(JsonObject &doc) override;
+    void setConfig(const JsonObject &doc) override;
+
+    Rule getRule() const { return rule; }
+
+private:
+    static const int STALE_GENERATIONS = 300; // Life restarts once its population stops changing this long
+
+    GraphAutomaton cells;
+    Rule rule;
+    int pickedRule;        // -1 to take turns
+    int speed;             // Generations a second
+    unsigned long lastTime;
+    unsigned long owed;    // Generations due, in thousandths
+    int lastPopulation;
+    int staleGenerations;
+
+    void start();
+    void advance(int generations);
+    void draw();
+};
+
+#endif
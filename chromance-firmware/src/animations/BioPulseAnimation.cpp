@@ -10,14 +10,14 @@ void BioPulseAnimation::run()
 
 void BioPulseAnimation::update()
 {
-    unsigned long time = millis();
+    unsigned long time = controller.now();
     float timeSec = time / 1000.0f;
     
     // Pulse parameters
     float speed = 2.0f; // Rad/sec
-    float phaseFactor = 0.1f; // Phase shift per unit distance
+    float phaseFactor = 0.07f; // Phase shift per LED step along the wiring
 
-    NodePosition center = Topology::nodePositions[15];
+    const uint8_t *distances = Topology::getDistanceField(Topology::starburstNode);
     LedController& leds = controller.getLedController();
 
     // Use a fixed or slowly changing hue
@@ -25,17 +25,9 @@ void BioPulseAnimation::update()
 
     for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
     {
-        int nodeA = Topology::segmentConnections[s][0];
-        int nodeB = Topology::segmentConnections[s][1];
-        NodePosition pA = Topology::nodePositions[nodeA];
-        NodePosition pB = Topology::nodePositions[nodeB];
-        
-        float midX = (pA.x + pB.x) / 2.0f;
-        float midY = (pA.y + pB.y) / 2.0f;
-        
-        float dx = midX - center.x;
-        float dy = midY - center.y;
-        float dist = sqrt(dx*dx + dy*dy);
+        // The segment pulses as one, timed by its middle LED
+        uint8_t dist = distances[LedController::pixelIndex(s, Constants::LEDS_PER_SEGMENT / 2)];
+        if (dist == Topology::DISTANCE_UNREACHABLE) continue;
 
         // Calculate sine wave
         // sin outputs -1 to 1
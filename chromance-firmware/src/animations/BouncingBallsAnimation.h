@@ -2,15 +2,7 @@
 #define BOUNCINGBALLSANIMATION_H
 
 #include "Animation.h"
-#include <vector>
-
-struct Ball {
-    int segmentIndex;
-    float position; // 0.0 (top) to 1.0 (bottom)
-    float velocity; // positive = down, negative = up
-    uint32_t color;
-    bool dying;
-};
+#include "../GraphParticles.h"
 
 class BouncingBallsAnimation : public Animation
 {
@@ -22,11 +14,17 @@ public:
     const char *getName() const override { return "Bouncing Balls"; }
 
 private:
-    std::vector<Ball> balls;
-    
-    // Helper
-    int getDownwardPaths(int nodeIndex, int resultSegments[]);
-    int getUpwardPaths(int nodeIndex, int resultSegments[]);
+    static const int MAX_BALLS = 8; // run() starts five; update() only tops up below three
+
+    // Balls fall down a random way at each node, bounce off the floor and
+    // roll back up until they run out of speed
+    Bounce floorBounce;
+    Bounce ceilingBounce;
+    RandomOnward falling;
+    RandomOnward rising;
+    GraphParticles balls;
+
+    void spawnBall();
 };
 
 #endif
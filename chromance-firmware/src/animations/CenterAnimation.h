@@ -8,6 +8,7 @@ class CenterAnimation : public Animation
 public:
   CenterAnimation(AnimationController &controller) : Animation(controller, Constants::centerPulseEnabled) {}
   void run() override;
+  RenderContract getRenderContract() const override { return RENDER_RIPPLES_ONLY; }
   const char *getName() const override { return "Center Pulse"; }
 };
 
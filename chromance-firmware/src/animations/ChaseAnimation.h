@@ -11,6 +11,7 @@ public:
   void update() override;
   void stop() override;
   bool isFinished() override;
+  RenderContract getRenderContract() const override { return RENDER_RIPPLES_ONLY; }
   const char* getName() const override { return "Chase"; }
 };
 
@@ -1,6 +1,7 @@
 #include "DigitalRainAnimation.h"
 #include "../AnimationController.h"
 #include "../Topology.h"
+#include "../PathLibrary.h"
 #include "../Constants.h"
 #include "../AnimationRegistry.h"
 
@@ -21,91 +22,57 @@ void DigitalRainAnimation::run()
     drops.clear();
     finished = false;
     stopping = false;
-    startTime = millis();
+    startTime = controller.now();
 }
 
 void DigitalRainAnimation::update()
 {
     if (finished) return;
 
-    if (!stopping && millis() - startTime > 10000) {
+    if (!stopping && controller.now() - startTime > 10000) {
         stopping = true;
     }
 
     // Spawn
-    if (!stopping && random(100) < 40) {
-        // Pick top segment? Or segment connected to top node?
-        // Top nodes: 0, 1, 2
-        int startNode = random(3);
-        
-        // Find downward path
-        for(int k=0; k<Constants::MAX_PATHS_PER_NODE; k++) {
-            int seg = Topology::nodeConnections[startNode][k];
-            if (seg >= 0) {
-                // Check if downward
-                int other = (Topology::segmentConnections[seg][0] == startNode) ? Topology::segmentConnections[seg][1] : Topology::segmentConnections[seg][0];
-                if (Topology::nodePositions[other].y > Topology::nodePositions[startNode].y) {
-                    RainDrop d;
-                    d.segment = seg;
-                    d.position = 0.0f;
-                    d.speed = 0.05f + (random(50)/1000.0f);
-                    drops.push_back(d);
-                    break; 
-                }
-            }
-        }
+    const PathLibrary &library = Topology::getPathLibrary();
+    int descents = library.getCount(PathLibrary::DESCENTS);
+    if (!stopping && random(100) < 40 && descents > 0) {
+        // Each drop runs the whole way down one precomputed descent
+        RainDrop d;
+        d.path = random(descents);
+        d.position = 0.0f;
+        d.speed = (0.05f + (random(50)/1000.0f)) * Constants::LEDS_PER_SEGMENT;
+        drops.push(d);
     }
 
+    // Canvas is cleared by the controller (RENDER_CLEAR)
     LedController& leds = controller.getLedController();
-    leds.clear();
 
-    std::vector<RainDrop> nextDrops;
-    for(auto d : drops) {
+    drops.retain([&](RainDrop &d) {
         d.position += d.speed;
-        
-        if (d.position >= 1.0f) {
-            // Move to next segment
-            int bottomNode = Topology::segmentConnections[d.segment][1]; // Side 1 is bottom
-            
-            // Find downward paths
-            std::vector<int> paths;
-            for(int k=0; k<Constants::MAX_PATHS_PER_NODE; k++) {
-                int seg = Topology::nodeConnections[bottomNode][k];
-                if (seg >= 0 && seg != d.segment) {
-                    int other = (Topology::segmentConnections[seg][0] == bottomNode) ? Topology::segmentConnections[seg][1] : Topology::segmentConnections[seg][0];
-                    if (Topology::nodePositions[other].y > Topology::nodePositions[bottomNode].y) {
-                        paths.push_back(seg);
-                    }
-                }
-            }
-            
-            if (!paths.empty()) {
-                d.segment = paths[random(paths.size())];
-                d.position = 0.0f;
-                nextDrops.push_back(d);
-            }
-            // Else die (fall off bottom)
-        } else {
-            nextDrops.push_back(d);
+
+        const uint16_t *pixels = library.getPixels(PathLibrary::DESCENTS, d.path);
+        int length = library.getLength(PathLibrary::DESCENTS, d.path);
+        int head = (int)d.position;
+        if (head >= length) {
+            return false; // Fell off the bottom
         }
-        
-        // Draw
-        int ledIdx = (int)((1.0f - d.position) * (Constants::LEDS_PER_SEGMENT - 1));
-        if (ledIdx >= 0 && ledIdx < Constants::LEDS_PER_SEGMENT) {
-            // Bright head
-            leds.setPixelColor(d.segment, ledIdx, 150, 255, 150);
-            
-            // Trail
-            for(int i=1; i<5; i++) {
-                int trailIdx = ledIdx + i;
-                if (trailIdx < Constants::LEDS_PER_SEGMENT) {
-                    int bright = 100 - (i * 20);
-                    leds.setPixelColor(d.segment, trailIdx, 0, bright, 0);
-                }
-            }
+
+        // Bright head
+        byte *color = leds.ledColors + pixels[head] * 3;
+        color[0] = 150;
+        color[1] = 255;
+        color[2] = 150;
+
+        // Trail, back up the path
+        for(int i=1; i<5 && head - i >= 0; i++) {
+            color = leds.ledColors + pixels[head - i] * 3;
+            color[0] = 0;
+            color[1] = 100 - (i * 20);
+            color[2] = 0;
         }
-    }
-    drops = nextDrops;
+        return true;
+    });
 
     if (stopping && drops.empty()) {
         finished = true;
@@ -2,12 +2,12 @@
 #define DIGITALRAINANIMATION_H
 
 #include "Animation.h"
-#include <vector>
+#include "../ParticlePool.h"
 
 struct RainDrop {
-    int segment;
-    float position; // 0.0 top to 1.0 bottom
-    float speed;
+    int path;       // Descent in Topology::getPathLibrary()
+    float position; // LED steps down the path
+    float speed;    // LED steps per frame
 };
 
 class DigitalRainAnimation : public Animation
@@ -19,10 +19,14 @@ public:
     void run() override;
     bool canBePreempted() override;
     bool isFinished() override;
+    // Once finished the last frame is left to fade out with the global trails
+    RenderContract getRenderContract() const override { return finished ? RENDER_TRAILS : RENDER_CLEAR; }
     const char *getName() const override { return "Digital Rain"; }
 
 private:
-    std::vector<RainDrop> drops;
+    static const int MAX_DROPS = 96; // About twice as many as ever fall at once
+
+    ParticlePool<RainDrop, MAX_DROPS> drops;
     bool finished;
     unsigned long startTime;
     bool stopping;
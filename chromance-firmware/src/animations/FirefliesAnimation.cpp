@@ -1,82 +1,71 @@
 #include "FirefliesAnimation.h"
 #include "../AnimationController.h"
 #include "../Constants.h"
+#include <algorithm>
 
-FirefliesAnimation::FirefliesAnimation(AnimationController &controller) : Animation(controller) {}
+FirefliesAnimation::FirefliesAnimation(AnimationController &controller) : Animation(controller), flies(NUM_FIREFLIES) {}
 
 void FirefliesAnimation::run()
 {
-    for(int i=0; i<NUM_FIREFLIES; i++) {
-        flies[i].state = 0; // Hidden
-        flies[i].brightness = 0.0f;
-    }
+    flies.clear();
 }
 
 void FirefliesAnimation::update()
 {
     LedController& lc = controller.getLedController();
-    
-    for(int i=0; i<NUM_FIREFLIES; i++) {
-        Firefly& f = flies[i];
-        
-        switch(f.state) {
-            case 0: // Hidden
-                if (random(100) < 2) { // 2% chance to spawn
-                    f.segment = random(Constants::NUMBER_OF_SEGMENTS);
-                    f.led = random(Constants::LEDS_PER_SEGMENT);
-                    f.state = 1; // Fade In
-                    f.brightness = 0.0f;
-                    f.speed = 0.02f + (random(100) / 5000.0f); // 0.02 - 0.04
-                    
-                    // Color: Yellow/Greenish or custom
-                    if (random(2)) {
-                        f.color = 0xFFFF00; // Yellow
-                    } else {
-                        f.color = 0xADFF2F; // GreenYellow
-                    }
-                }
-                break;
-                
-            case 1: // Fading In
-                f.brightness += f.speed;
-                if (f.brightness >= 1.0f) {
-                    f.brightness = 1.0f;
-                    f.state = 2; // Lit
-                }
-                break;
-                
-            case 2: // Lit
-                // Hold for a bit? Or immediately fade out?
-                // Let's hold based on random chance
-                if (random(100) < 5) {
-                    f.state = 3; // Start fading out
-                }
-                break;
-                
-            case 3: // Fading Out
-                f.brightness -= f.speed;
-                if (f.brightness <= 0.0f) {
-                    f.brightness = 0.0f;
-                    f.state = 0; // Hidden
-                }
-                break;
+
+    // Every hidden firefly has a 2% chance to appear
+    int hidden = NUM_FIREFLIES - flies.size();
+    for(int i=0; i<hidden; i++) {
+        if (random(100) >= 2) {
+            continue;
         }
-        
-        if (f.state != 0 && f.brightness > 0.001f) {
-            byte r = (f.color >> 16) & 0xFF;
-            byte g = (f.color >> 8) & 0xFF;
-            byte b = f.color & 0xFF;
-            
-            // Apply easing? Smoothstep: x*x*(3-2*x)
-            float val = f.brightness * f.brightness * (3.0f - 2.0f * f.brightness);
-            
-            lc.addPixelColor(f.segment, f.led, 
-                (byte)(r * val), 
-                (byte)(g * val), 
-                (byte)(b * val)
-            );
+        int segment = random(Constants::NUMBER_OF_SEGMENTS);
+        int led = random(Constants::LEDS_PER_SEGMENT);
+        int f = flies.spawn(segment, 1.0f - (float)led / (Constants::LEDS_PER_SEGMENT - 1), 0.0f);
+        float speed = 0.02f + (random(100) / 5000.0f); // 0.02 - 0.04
+        flies.setWeight(f, speed);
+
+        // Fade in, then stay lit until a 5% chance each frame to fade out
+        int fade = (int)(1.0f / speed) + 1;
+        int glow = 0;
+        while (glow < MAX_GLOW_FRAMES && random(100) >= 5) {
+            glow++;
+        }
+        flies.setLifetime(f, 2 * fade + glow);
+
+        // Color: Yellow/Greenish or custom
+        if (random(2)) {
+            flies.setColor(f, 0xFFFF00); // Yellow
+        } else {
+            flies.setColor(f, 0xADFF2F); // GreenYellow
         }
     }
+    flies.step();
+
+    for(int i=0; i<flies.size(); i++) {
+        float speed = flies.getWeight(i);
+        int age = flies.getAge(i);
+        int left = flies.getLifetime(i) - age;
+        float brightness = std::min(1.0f, std::min(age * speed, left * speed));
+        if (brightness <= 0.001f) {
+            continue;
+        }
+
+        uint32_t color = flies.getColor(i);
+        byte r = (color >> 16) & 0xFF;
+        byte g = (color >> 8) & 0xFF;
+        byte b = color & 0xFF;
+        
+        // Apply easing? Smoothstep: x*x*(3-2*x)
+        float val = brightness * brightness * (3.0f - 2.0f * brightness);
+        
+        lc.addPixelColor(flies.getSegment(i), flies.getLed(i), 
+            (byte)(r * val), 
+            (byte)(g * val), 
+            (byte)(b * val)
+        );
+    }
 }
 
 #include "../AnimationRegistry.h"
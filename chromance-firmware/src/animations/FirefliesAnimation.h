@@ -2,15 +2,7 @@
 #define FIREFLIESANIMATION_H
 
 #include "Animation.h"
-
-struct Firefly {
-    int segment;
-    int led;
-    float brightness; // 0.0 to 1.0
-    int state; // 0: Hidden, 1: Fading In, 2: Lit, 3: Fading Out
-    float speed;
-    uint32_t color;
-};
+#include "../GraphParticles.h"
 
 class FirefliesAnimation : public Animation
 {
@@ -23,7 +15,11 @@ public:
 
 private:
     static const int NUM_FIREFLIES = 20;
-    Firefly flies[NUM_FIREFLIES];
+    static const int MAX_GLOW_FRAMES = 200; // Longest a firefly stays fully lit
+
+    // Fireflies sit still: each one's lifetime is a fade in, a glow and a
+    // fade out, with its fade rate kept in its weight
+    GraphParticles flies;
 };
 
 #endif
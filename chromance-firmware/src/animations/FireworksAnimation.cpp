@@ -2,6 +2,7 @@
 #include "../AnimationController.h"
 #include "../Topology.h"
 #include "../Constants.h"
+#include "../Canvas.h"
 
 FireworksAnimation::FireworksAnimation(AnimationController &controller)
     : Animation(controller)
@@ -75,33 +76,19 @@ void FireworksAnimation::launchFirework()
     int startNode = 24;         // Bottom
     int targetNode = random(3); // Top nodes 0-2
 
-    int validDirs[Constants::MAX_PATHS_PER_NODE];
-    int validCount = 0;
-
-    for (int k = 0; k < Constants::MAX_PATHS_PER_NODE; k++)
-    {
-        int seg = Topology::nodeConnections[startNode][k];
-        if (seg >= 0)
-        {
-            int other = (Topology::segmentConnections[seg][0] == startNode) ? Topology::segmentConnections[seg][1] : Topology::segmentConnections[seg][0];
-            if (Topology::nodePositions[other].y < Topology::nodePositions[startNode].y)
-            {
-                validDirs[validCount++] = k;
-            }
-        }
-    }
+    const PathList &upPaths = Topology::getUpPaths(startNode);
 
     int direction = 0;
-    if (validCount > 0)
+    if (upPaths.count > 0)
     {
-        direction = validDirs[random(validCount)];
+        direction = upPaths.ports[random(upPaths.count)];
     }
 
     int minDuration = 1000;
     int maxDuration = 4000;
     unsigned long duration = minDuration + random(maxDuration - minDuration);
 
-    controller.getRipple(rippleIndex).start(startNode, direction, 0xFFFFFF, 0.75f, 10000, BEHAVIOR_RUNNER);
+    controller.getRipple(rippleIndex).start(startNode, direction, 0xFFFFFF, 0.75f, 10000, BEHAVIOR_RUNNER, controller.now());
     controller.getRipple(rippleIndex).targetNode = targetNode;
 
     fireworks[slot].active = true;
@@ -139,7 +126,7 @@ void FireworksAnimation::update()
             }
         }
 
-        bool timeUp = (millis() - r.birthday >= fireworks[i].duration);
+        bool timeUp = (controller.now() - r.birthday >= fireworks[i].duration);
         bool reachedTarget = (r.state != STATE_DEAD && r.state == STATE_WITHIN_NODE && r.node == fireworks[i].targetNode);
         bool isFalling = (r.state == STATE_TRAVEL_DOWN);
         bool dead = (r.state == STATE_DEAD);
@@ -223,6 +210,17 @@ void FireworksAnimation::explodeFirework(int index)
     // Spawn explosion
     uint32_t color = controller.getLedController().ColorHSV(random(65535), 255, 255);
 
+    if (explodeSeg >= 0 && explodeSeg < Constants::NUMBER_OF_SEGMENTS && explodeLed >= 0 && explodeLed < Constants::LEDS_PER_SEGMENT)
+    {
+        const LedPosition &burst = Topology::getLedPosition(explodeSeg, explodeLed);
+        flash(burst.x, burst.y, color);
+    }
+    else if (explodeNode != -1)
+    {
+        const NodePosition &burst = Topology::nodePositions[explodeNode];
+        flash(burst.x, burst.y, color);
+    }
+
     if (explodeSeg != -1)
     {
         int found = 0;
@@ -235,7 +233,7 @@ void FireworksAnimation::explodeFirework(int index)
                 part.speed = 0.5f;
                 part.lifespan = 800 + random(600);
                 part.behavior = BEHAVIOR_FEISTY;
-                part.birthday = millis();
+                part.birthday = controller.now();
                 part.state = (found == 0) ? STATE_TRAVEL_UP : STATE_TRAVEL_DOWN;
                 part.node = explodeSeg;
                 part.direction = explodeLed;
@@ -246,15 +244,10 @@ void FireworksAnimation::explodeFirework(int index)
     }
     else if (explodeNode != -1)
     {
+        const PathList &paths = Topology::getPaths(explodeNode);
         int validDirs[Constants::MAX_PATHS_PER_NODE];
-        int validCount = 0;
-        for (int k = 0; k < Constants::MAX_PATHS_PER_NODE; k++)
-        {
-            if (Topology::nodeConnections[explodeNode][k] >= 0)
-            {
-                validDirs[validCount++] = k;
-            }
-        }
+        int validCount = paths.count;
+        memcpy(validDirs, paths.ports, sizeof(validDirs));
 
         for (int k = 0; k < validCount; k++)
         {
@@ -279,5 +272,16 @@ void FireworksAnimation::explodeFirework(int index)
     }
 }
 
+void FireworksAnimation::flash(float x, float y, uint32_t color)
+{
+    // Everything within reach of the burst, brightest at the middle: a disc
+    // whose soft edge spans the whole flash ramps linearly from 0.6 at the
+    // middle to nothing at FLASH_RADIUS
+    Canvas canvas(controller.getLedController().ledColors);
+    canvas.setBlend(BLEND_ADD);
+    canvas.setSoftness(FLASH_RADIUS * 5 / 3);
+    canvas.disc(x, y, FLASH_RADIUS / 6, color);
+}
+
 #include "../AnimationRegistry.h"
 REGISTER_ANIMATION(FireworksAnimation)
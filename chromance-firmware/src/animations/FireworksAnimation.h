@@ -12,10 +12,13 @@ public:
     void run() override;
     bool canBePreempted() override;
     bool isFinished() override;
+    // Bursts flash the LEDs around them, so the buffer is faded rather than ripples-only
+    RenderContract getRenderContract() const override { return RENDER_TRAILS; }
     const char *getName() const override { return "Fireworks"; }
 
 private:
     static const int MAX_FIREWORKS = 3;
+    static constexpr float FLASH_RADIUS = 7.0f; // nodePositions units, about one hex edge
 
     struct Firework
     {
@@ -34,6 +37,7 @@ private:
     
     void launchFirework();
     void explodeFirework(int index);
+    void flash(float x, float y, uint32_t color);
 };
 
 #endif
@@ -10,6 +10,7 @@ public:
 
     void run() override; // One-shot trigger if needed, but update handles continuous
     void update() override;
+    RenderContract getRenderContract() const override { return RENDER_RIPPLES_ONLY; }
     const char *getName() const override { return "Glitch"; }
 };
 
@@ -4,17 +4,17 @@
 
 void HeartbeatAnimation::run()
 {
-  startTime = millis();
+  startTime = controller.now();
 }
 
 bool HeartbeatAnimation::isFinished()
 {
-  return (millis() - startTime) >= 1500;
+  return (controller.now() - startTime) >= 1500;
 }
 
 bool HeartbeatAnimation::canBePreempted()
 {
-  unsigned long t = (millis() - startTime);
+  unsigned long t = (controller.now() - startTime);
   // If we've finished at least one cycle, we can always be preempted
   if (t >= 1500)
     return true;
@@ -24,7 +24,7 @@ bool HeartbeatAnimation::canBePreempted()
 
 void HeartbeatAnimation::update()
 {
-  unsigned long t = millis() - startTime;
+  unsigned long t = controller.now() - startTime;
 
   float brightness = 0.1f; // Base brightness (dim red)
 
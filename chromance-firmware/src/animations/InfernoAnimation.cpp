@@ -3,25 +3,76 @@
 #include "../Topology.h"
 #include "../Constants.h"
 #include "../AnimationRegistry.h"
-#include <cmath>
+#include <algorithm>
 
-InfernoAnimation::InfernoAnimation(AnimationController &controller) : Animation(controller), finished(true)
+namespace
 {
-    for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
-    {
-        heatPixels[i] = 0.0f;
-    }
+    // Heat fractions in 16 bit
+    const uint32_t COOL_BASE = 328;      // 0.005 per frame...
+    const uint32_t COOL_STEP = 66;       // ...plus up to 15 x 0.001 at random
+    const uint32_t KEEP = 655;           // 0.01 of a pixel's heat stays put
+    const uint32_t RISE = 64225;         // 0.98 of the heat below moves up
+    const uint32_t BURN = 62258;         // 0.95 left in a bottom LED with nothing feeding it
+    const uint32_t EMBERS = 3277;        // 0.05: below this everywhere, the fire is out
+    const int FLICKER_CHANCE = 26;       // Out of 256, about one pixel in ten
+    const int FLICKER_MIN = 154;         // Flickering pixels drop to 0.6-1.0 brightness
+    const int FUEL_DEPTH = 3;            // Segments ending this close to the lowest node are ignited
+}
+
+const uint16_t InfernoAnimation::HEAT_MAX;
+
+InfernoAnimation::InfernoAnimation(AnimationController &controller)
+    : Animation(controller), finished(true), noise(1), palette(Palettes::HEAT)
+{
+    memset(heatPixels, 0, sizeof(heatPixels));
 }
 
 void InfernoAnimation::run()
 {
-    for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
-    {
-        heatPixels[i] = 0.0f;
-    }
-    startTime = millis();
+    memset(heatPixels, 0, sizeof(heatPixels));
+    prepareTables();
+    startTime = controller.now();
     duration = Constants::ANIMATION_TIME * 3; // Make it last longer than standard
     finished = false;
+    palette.snap();
+}
+
+void InfernoAnimation::prepareTables()
+{
+    segmentOrder.clear();
+    feederTops.assign(Constants::NUMBER_OF_SEGMENTS, -1);
+    fuelSegments.clear();
+
+    int lowest = 0;
+    for (int n = 0; n < Constants::NUMBER_OF_NODES; n++)
+    {
+        lowest = std::max(lowest, Topology::nodePositions[n].y);
+    }
+
+    for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+    {
+        segmentOrder.push_back(s);
+
+        // Heat flows from a neighbour's top LED into this bottom LED; with
+        // several segments hanging below, the last one feeds it
+        const PathList &feeders = Topology::getFeeders(s);
+        if (feeders.count > 0)
+        {
+            feederTops[s] = LedController::pixelIndex(feeders.segments[feeders.count - 1], Constants::LEDS_PER_SEGMENT - 1);
+        }
+
+        // Only ignite the very bottom segments
+        if (Topology::nodePositions[Topology::segmentConnections[s][1]].y >= lowest - FUEL_DEPTH)
+        {
+            fuelSegments.push_back(s);
+        }
+    }
+
+    // A segment hangs below the ones it feeds, so going down the wall every
+    // feeder's top LED is still last frame's when it is read
+    std::stable_sort(segmentOrder.begin(), segmentOrder.end(), [](int a, int b)
+                     { return Topology::nodePositions[Topology::segmentConnections[a][0]].y <
+                              Topology::nodePositions[Topology::segmentConnections[b][0]].y; });
 }
 
 bool InfernoAnimation::canBePreempted()
@@ -34,178 +85,118 @@ bool InfernoAnimation::isFinished()
     return finished;
 }
 
-uint32_t InfernoAnimation::getHeatColor(float h)
+void InfernoAnimation::getConfig(JsonObject &doc)
 {
-    if (h <= 0.0f)
-        return 0;
-    if (h > 1.0f)
-        h = 1.0f;
-
-    uint8_t r = 0, g = 0, b = 0;
+    Animation::getConfig(doc);
+    palette.getConfig(doc);
+}
 
-    if (h < 0.4f)
-    {
-        // 0.0 - 0.4: Black to Red
-        float val = (h / 0.4f);
-        val = val * val; // Quadratic for deeper black
-        r = (uint8_t)(val * 255);
-        g = 0;
-        b = 0;
-    }
-    else if (h < 0.7f)
-    {
-        // 0.4 - 0.7: Red to Orange
-        r = 255;
-        float t = (h - 0.4f) / 0.3f;
-        g = (uint8_t)(t * 128); // Green 0 -> 128
-        b = 0;
-    }
-    else
-    {
-        // 0.7 - 1.0: Orange to Yellow
-        r = 255;
-        float t = (h - 0.7f) / 0.3f;
-        g = 128 + (uint8_t)(t * 127); // Green 128 -> 255
-        b = 0;
-    }
+void InfernoAnimation::setConfig(const JsonObject &doc)
+{
+    Animation::setConfig(doc);
+    palette.setConfig(doc);
+}
 
-    return (uint32_t)((r << 16) | (g << 8) | b);
+uint32_t InfernoAnimation::nextNoise()
+{
+    noise ^= noise << 13;
+    noise ^= noise >> 17;
+    noise ^= noise << 5;
+    return noise;
 }
 
 void InfernoAnimation::update()
 {
     if (finished) return;
 
+    if (feederTops.size() != (size_t)Constants::NUMBER_OF_SEGMENTS)
+    {
+        prepareTables();
+    }
+
     // Check if we should stop adding fuel (time up)
-    bool fuelEnabled = (millis() - startTime < duration);
-    
+    bool fuelEnabled = (controller.now() - startTime < duration);
+
+    // One random() per frame; every pixel's cooling and flicker come from
+    // the bits of a single xorshift step
+    noise = random(1, 0x7FFFFFFF);
+
     // 1. Cooling
-    float maxHeat = 0.0f;
+    uint16_t maxHeat = 0;
     for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
     {
         // Slightly more cooling to help the bottom go dark
-        heatPixels[i] -= (random(15) / 1000.0f) + 0.005f;
-        if (heatPixels[i] < 0.0f)
-            heatPixels[i] = 0.0f;
-        
-        if (heatPixels[i] > maxHeat) maxHeat = heatPixels[i];
+        uint32_t cool = COOL_BASE + COOL_STEP * (nextNoise() & 15);
+        heatPixels[i] = heatPixels[i] > cool ? heatPixels[i] - cool : 0;
+        maxHeat = std::max(maxHeat, heatPixels[i]);
     }
-    
+
     // Check finish condition: No fuel left and heat is low
-    if (!fuelEnabled && maxHeat < 0.05f) {
+    if (!fuelEnabled && maxHeat < EMBERS) {
         finished = true;
-        // Clear leds
-        controller.getLedController().clear();
+        // Leds are left black by the controller (RENDER_CLEAR)
         return;
     }
 
-    // 2. Convection (Heat rises)
-    float nextHeat[Constants::NUM_OF_PIXELS];
-    for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
-        nextHeat[i] = heatPixels[i];
-
-    for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+    // 2. Convection (Heat rises), in place: within a segment each LED takes
+    // from the one below before that one is updated
+    for (size_t k = 0; k < segmentOrder.size(); k++)
     {
-        // Internal convection (Pixel 0 -> 13)
-        // Heat moves UP.
-        // Pixel i (higher) gets heat from i-1 (lower).
+        int s = segmentOrder[k];
+        uint16_t *segment = heatPixels + LedController::pixelIndex(s, 0);
         for (int i = Constants::LEDS_PER_SEGMENT - 1; i > 0; i--)
         {
-            int currentIdx = s * Constants::LEDS_PER_SEGMENT + i;
-            int belowIdx = s * Constants::LEDS_PER_SEGMENT + (i - 1);
-
-            // Move heat up (Advection/Diffusion blend)
             // Reduced the current pixel's retention (0.01) to make it more of a 'rising' fireball
-            nextHeat[currentIdx] = (heatPixels[currentIdx] * 0.01f) + (heatPixels[belowIdx] * 0.98f);
-            
-            // As heat moves up, the source below loses heat (cooling effect of moving fuel)
-            nextHeat[belowIdx] *= 0.95f; 
-        }
-
-        // Bottom LED (0) gets heat from lower segments
-        int bottomNode = Topology::segmentConnections[s][1]; // Side 1 is Floor/Bottom
-
-        int currentIdx = s * Constants::LEDS_PER_SEGMENT + 0;
-
-        for (int k = 0; k < Constants::MAX_PATHS_PER_NODE; k++)
-        {
-            int neighborSeg = Topology::nodeConnections[bottomNode][k];
-            if (neighborSeg >= 0 && neighborSeg != s)
-            {
-                // Check if neighborSeg connects to bottomNode at its Top (Side 0)
-                if (Topology::segmentConnections[neighborSeg][0] == bottomNode)
-                {
-                    // Heat flows from neighbor Top (LED 13) to current Bottom (LED 0)
-                    int sourceIdx = neighborSeg * Constants::LEDS_PER_SEGMENT + (Constants::LEDS_PER_SEGMENT - 1);
-                    nextHeat[currentIdx] = (heatPixels[currentIdx] * 0.01f) + (heatPixels[sourceIdx] * 0.98f);
-                    nextHeat[sourceIdx] *= 0.95f;
-                }
-            }
+            segment[i] = (segment[i] * KEEP + segment[i - 1] * RISE) >> 16;
         }
-    }
 
-    // Clamp
-    for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
-    {
-        if (nextHeat[i] > 1.0f)
-            nextHeat[i] = 1.0f;
-
-        heatPixels[i] = nextHeat[i];
+        // Bottom LED gets heat from the segment hanging below its floor node,
+        // or burns down if there is none
+        if (feederTops[s] >= 0)
+            segment[0] = (segment[0] * KEEP + heatPixels[feederTops[s]] * RISE) >> 16;
+        else
+            segment[0] = (segment[0] * BURN) >> 16;
     }
 
     // 3. Ignition (Bottom segments)
     if (fuelEnabled) {
-        for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+        for (size_t k = 0; k < fuelSegments.size(); k++)
         {
-            int n0 = Topology::segmentConnections[s][0];
-            int n1 = Topology::segmentConnections[s][1];
-
-            // Only ignite the very bottom segments
-            if (Topology::nodePositions[n0].y >= 22 || Topology::nodePositions[n1].y >= 22)
+            // Less frequent bursts to allow the previous fire to rise as a plume/ball
+            if (random(100) < 10)
             {
-                // Less frequent bursts to allow the previous fire to rise as a plume/ball
-                if (random(100) < 10)
-                {
-                    // Ignite bottom LED
-                    int idx = s * Constants::LEDS_PER_SEGMENT + 0;
-                    heatPixels[idx] += (random(80, 150) / 100.0f);
-
-                    if (heatPixels[idx] > 1.0f)
-                        heatPixels[idx] = 1.0f;
-                }
+                // Ignite bottom LED
+                uint16_t &heat = heatPixels[LedController::pixelIndex(fuelSegments[k], 0)];
+                heat = std::min<uint32_t>(HEAT_MAX, heat + random(80, 150) * HEAT_MAX / 100);
             }
         }
     }
 
     // 4. Render
-    LedController &lc = controller.getLedController();
-    lc.clear(); // Important to clear for non-additive rendering or handle black yourself
-    
-    for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
+    // Canvas is cleared by the controller (RENDER_CLEAR), so only lit pixels are written
+    palette.update(controller.now());
+    byte *color = controller.getLedController().ledColors;
+    for (int i = 0; i < Constants::NUM_OF_PIXELS; i++, color += 3)
     {
-        int s = i / Constants::LEDS_PER_SEGMENT;
-        int l = i % Constants::LEDS_PER_SEGMENT;
+        const byte *c = palette.lookup(heatPixels[i] >> 8);
+        if ((c[0] | c[1] | c[2]) == 0)
+            continue; // else black (already cleared)
 
-        uint32_t c = getHeatColor(heatPixels[i]);
-
-        if (c > 0)
+        // Flicker
+        uint32_t bits = nextNoise();
+        if ((bits & 0xFF) < FLICKER_CHANCE)
         {
-            byte r = (c >> 16) & 0xFF;
-            byte g = (c >> 8) & 0xFF;
-            byte b = c & 0xFF;
-
-            // Flicker
-            if (random(10) == 0)
-            {
-                float flicker = 0.6f + (random(40) / 100.0f);
-                lc.setPixelColor(s, l, (byte)(r * flicker), (byte)(g * flicker), (byte)(b * flicker));
-            }
-            else
-            {
-                lc.setPixelColor(s, l, r, g, b);
-            }
+            uint32_t flicker = FLICKER_MIN + (((bits >> 8) & 0xFF) * (256 - FLICKER_MIN) >> 8);
+            color[0] = (c[0] * flicker) >> 8;
+            color[1] = (c[1] * flicker) >> 8;
+            color[2] = (c[2] * flicker) >> 8;
+        }
+        else
+        {
+            color[0] = c[0];
+            color[1] = c[1];
+            color[2] = c[2];
         }
-        // else black (already cleared)
     }
 }
 
@@ -2,6 +2,8 @@
 #define INFERNOANIMATION_H
 
 #include "Animation.h"
+#include "../Palette.h"
+#include <vector>
 
 class InfernoAnimation : public Animation
 {
@@ -12,16 +14,32 @@ public:
     void run() override;
     bool canBePreempted() override;
     bool isFinished() override;
+    RenderContract getRenderContract() const override { return RENDER_CLEAR; }
     const char *getName() const override { return "Inferno"; }
+    bool hasConfig() const override { return true; }
+    void getConfig(JsonObject &doc) override;
+    void setConfig(const JsonObject &doc) override;
+
+    // Heat is 16 bit, HEAT_MAX being white hot; the palette has one entry
+    // per high byte
+    static const uint16_t HEAT_MAX = 0xFFFF;
 
 private:
-    float heatPixels[Constants::NUM_OF_PIXELS];
+    uint16_t heatPixels[Constants::NUM_OF_PIXELS];
     unsigned long startTime;
     unsigned long duration;
     bool finished;
-    
-    // Helper to map 0-255 heat to color
-    uint32_t getHeatColor(float h);
+    uint32_t noise; // xorshift32 state, reseeded from random() every frame
+
+    // Worked out for the layout by run()
+    std::vector<int> segmentOrder;  // Highest ceiling first, so heat can move up in place
+    std::vector<int> feederTops;    // Per segment: pixel its LED 0 draws heat from, -1 if none
+    std::vector<int> fuelSegments;  // Segments at the bottom of the wall that get ignited
+
+    PaletteSelection palette;
+
+    void prepareTables();
+    uint32_t nextNoise();
 };
 
 #endif
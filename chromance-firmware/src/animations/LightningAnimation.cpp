@@ -1,12 +1,14 @@
 #include "LightningAnimation.h"
 #include "../AnimationController.h"
 #include "../Topology.h"
+#include "../PathLibrary.h"
 #include "../Constants.h"
 #include "../AnimationRegistry.h"
 
 REGISTER_ANIMATION(LightningAnimation)
 
-LightningAnimation::LightningAnimation(AnimationController &controller) : Animation(controller)
+LightningAnimation::LightningAnimation(AnimationController &controller)
+    : Animation(controller), palette(Palettes::STORM)
 {
     for(int i=0; i<Constants::NUMBER_OF_SEGMENTS; i++) flashIntensity[i] = 0.0f;
     nextStrikeTime = 0;
@@ -15,7 +17,20 @@ LightningAnimation::LightningAnimation(AnimationController &controller) : Animat
 void LightningAnimation::run()
 {
     for(int i=0; i<Constants::NUMBER_OF_SEGMENTS; i++) flashIntensity[i] = 0.0f;
-    nextStrikeTime = millis() + random(100, 1000);
+    nextStrikeTime = controller.now() + random(100, 1000);
+    palette.snap();
+}
+
+void LightningAnimation::getConfig(JsonObject &doc)
+{
+    Animation::getConfig(doc);
+    palette.getConfig(doc);
+}
+
+void LightningAnimation::setConfig(const JsonObject &doc)
+{
+    Animation::setConfig(doc);
+    palette.setConfig(doc);
 }
 
 void LightningAnimation::update()
@@ -28,90 +43,46 @@ void LightningAnimation::update()
         }
     }
 
-    if (millis() >= nextStrikeTime) {
-        // Strike!
-        int currentNode = random(3); // Start at top (0, 1, 2)
-        
-        // Create a path down
-        while (true) {
-            // Find connected segments going down
-            int possibleSegments[6];
-            int count = 0;
-            
-            for(int k=0; k<Constants::MAX_PATHS_PER_NODE; k++) {
-                int seg = Topology::nodeConnections[currentNode][k];
-                if(seg >= 0) {
-                    int other = (Topology::segmentConnections[seg][0] == currentNode) ? 
-                                 Topology::segmentConnections[seg][1] : 
-                                 Topology::segmentConnections[seg][0];
-                    
-                    if(Topology::nodePositions[other].y > Topology::nodePositions[currentNode].y) {
-                        possibleSegments[count++] = seg;
-                    }
-                }
-            }
-            
-            if(count == 0) break; // Reached bottom
-            
-            // Pick one
-            int chosenSeg = possibleSegments[random(count)];
+    if (controller.now() >= nextStrikeTime) {
+        // Strike! Down one of the precomputed longest descents
+        const PathLibrary &library = Topology::getPathLibrary();
+        int descents = library.getCount(PathLibrary::DESCENTS);
+        int path = descents > 0 ? random(descents) : 0;
+        const uint16_t *pixels = library.getPixels(PathLibrary::DESCENTS, path);
+        int length = descents > 0 ? library.getLength(PathLibrary::DESCENTS, path) : 0;
+
+        // A descent holds whole segments, one LED step at a time
+        for (int step = 0; step < length; step += Constants::LEDS_PER_SEGMENT) {
+            int chosenSeg = pixels[step] / Constants::LEDS_PER_SEGMENT;
             flashIntensity[chosenSeg] = 1.0f;
-            
-            // Move to next node
-            currentNode = (Topology::segmentConnections[chosenSeg][0] == currentNode) ? 
-                           Topology::segmentConnections[chosenSeg][1] : 
-                           Topology::segmentConnections[chosenSeg][0];
-                           
+
             // Chance to branch?
-            if (random(100) < 30 && count > 1) {
+            const PathList &down = Topology::getDownPaths(Topology::segmentConnections[chosenSeg][0]);
+            if (random(100) < 30 && down.count > 1) {
                  // Pick another branch
-                 int branchSeg = possibleSegments[random(count)];
+                 int branchSeg = down.segments[random(down.count)];
                  if (branchSeg != chosenSeg) {
-                     flashIntensity[branchSeg] = 0.8f; 
+                     flashIntensity[branchSeg] = 0.8f;
                      // We don't follow the branch logic fully to keep recursion simple here, just light the segment
                  }
             }
         }
         
-        nextStrikeTime = millis() + random(200, 1500); // Random delay
+        nextStrikeTime = controller.now() + random(200, 1500); // Random delay
         
         // Sometimes double strike
-        if(random(100) < 20) nextStrikeTime = millis() + random(50, 150);
+        if(random(100) < 20) nextStrikeTime = controller.now() + random(50, 150);
     }
 
     LedController& leds = controller.getLedController();
+    palette.update(controller.now());
     for(int s=0; s<Constants::NUMBER_OF_SEGMENTS; s++) {
-        if(flashIntensity[s] > 0.001f) {
-            // White to Purple fade
-            // 1.0 -> White
-            // 0.5 -> Purple
-            // 0.0 -> Black
-            
-            byte r, g, b;
-            if(flashIntensity[s] > 0.5f) {
-                // White to Purple
-                // P: 150, 0, 255
-                // W: 255, 255, 255
-                float t = (flashIntensity[s] - 0.5f) * 2.0f;
-                r = 150 + (byte)(105 * t);
-                g = (byte)(255 * t);
-                b = 255;
-            } else {
-                // Purple to Black
-                float t = flashIntensity[s] * 2.0f;
-                r = (byte)(150 * t);
-                g = 0;
-                b = (byte)(255 * t);
-            }
-            
-            for(int i=0; i<Constants::LEDS_PER_SEGMENT; i++) {
-                leds.setPixelColor(s, i, r, g, b);
-            }
-        } else {
-             // Ensure black background
-             for(int i=0; i<Constants::LEDS_PER_SEGMENT; i++) {
-                leds.setPixelColor(s, i, 0, 0, 0);
-            }
+        // Full intensity is the top of the palette, white in Storm; black
+        // below 0.001 as before
+        uint8_t index = flashIntensity[s] > 0.001f ? (uint8_t)(flashIntensity[s] * 255.0f + 0.5f) : 0;
+        const byte *c = palette.lookup(index);
+        for(int i=0; i<Constants::LEDS_PER_SEGMENT; i++) {
+            leds.setPixelColor(s, i, c[0], c[1], c[2]);
         }
     }
 }
@@ -2,6 +2,8 @@
 #define LIGHTNINGANIMATION_H
 
 #include "Animation.h"
+#include "../Constants.h"
+#include "../Palette.h"
 
 class LightningAnimation : public Animation
 {
@@ -10,11 +12,16 @@ public:
 
     void update() override;
     void run() override;
+    RenderContract getRenderContract() const override { return RENDER_OVERWRITE; }
     const char *getName() const override { return "Lightning"; }
+    bool hasConfig() const override { return true; }
+    void getConfig(JsonObject &doc) override;
+    void setConfig(const JsonObject &doc) override;
 
 private:
-    float flashIntensity[40]; // One per segment
+    float flashIntensity[Constants::NUMBER_OF_SEGMENTS];
     unsigned long nextStrikeTime;
+    PaletteSelection palette; // Flash intensity 0-1 across the palette
 };
 
 #endif
@@ -9,6 +9,7 @@ public:
     MeteorShowerAnimation(AnimationController &controller) : Animation(controller) {}
 
     void run() override;
+    RenderContract getRenderContract() const override { return RENDER_RIPPLES_ONLY; }
     const char *getName() const override { return "Meteor Shower"; }
 };
 
@@ -0,0 +1,54 @@
+#include "NoiseFlowAnimation.h"
+#include "../AnimationController.h"
+#include "../AnimationRegistry.h"
+
+REGISTER_ANIMATION(NoiseFlowAnimation)
+
+namespace
+{
+    // About five lattice cells across the stock wall
+    const float CELLS_PER_UNIT = 1.0f / 16.0f;
+
+    // Movement through the noise per millisecond, in 16.16 lattice units
+    const uint32_t FLOW_X = 20;  // 0.3 cells a second sideways
+    const uint32_t FLOW_Y = 12;  // and 0.2 down
+    const uint32_t CHURN = 16;   // Through z, so the pattern changes as it moves
+    // The brightness slice comes from another part of the lattice, so it
+    // does not follow the hues
+    const uint32_t LEVEL_OFFSET = 97u << 16;
+}
+
+void NoiseFlowAnimation::run()
+{
+    noise.prepare(CELLS_PER_UNIT);
+}
+
+void NoiseFlowAnimation::update()
+{
+    if (!noise.isPrepared())
+    {
+        noise.prepare(CELLS_PER_UNIT);
+    }
+
+    uint32_t time = controller.now();
+    noise.fill(time * FLOW_X, time * FLOW_Y, time * CHURN, hues);
+    noise.fill(LEVEL_OFFSET - time * FLOW_Y, time * FLOW_X, LEVEL_OFFSET + time * CHURN, levels);
+
+    LedController &leds = controller.getLedController();
+    wheel.setBrightness(leds, controller.getConfiguration().getRainbowBrightness());
+
+    // Noise bunches up around its middle, so the hue spans the wheel twice
+    // over and brightness ramps up over the upper part of the range, leaving
+    // dark gaps between the clouds
+    uint16_t drift = (uint16_t)(time % 60000 * 65536 / 60000);
+    byte *color = leds.ledColors;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++, color += 3)
+    {
+        const byte *rgb = wheel.lookup(drift + (hues[p] << 9));
+        int level = (levels[p] - 112) * 3;
+        int scale = level < 0 ? 0 : (level > 255 ? 256 : level + 1);
+        color[0] = (byte)(rgb[0] * scale >> 8);
+        color[1] = (byte)(rgb[1] * scale >> 8);
+        color[2] = (byte)(rgb[2] * scale >> 8);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef NOISEFLOWANIMATION_H
+#define NOISEFLOWANIMATION_H
+
+#include "Animation.h"
+#include "../Noise.h"
+#include "../HueWheel.h"
+
+// Two slices of 3D noise drifting across the wall: one picks each LED's hue,
+// the other how brightly it shows, so bands of colour wander and fade in
+// and out
+class NoiseFlowAnimation : public Animation
+{
+public:
+    NoiseFlowAnimation(AnimationController &controller) : Animation(controller) {}
+
+    void update() override;
+    void run() override;
+    bool isFinished() override { return false; }
+    RenderContract getRenderContract() const override { return RENDER_OVERWRITE; }
+    const char *getName() const override { return "Noise Flow"; }
+
+private:
+    NoiseMap noise;
+    HueWheel wheel;
+    uint8_t hues[Constants::NUM_OF_PIXELS];
+    uint8_t levels[Constants::NUM_OF_PIXELS];
+};
+
+#endif
@@ -5,59 +5,103 @@
 #include "../AnimationRegistry.h"
 #include <cmath>
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 REGISTER_ANIMATION(PlasmaAnimation)
 
-void PlasmaAnimation::run() {}
+using FixedMath::Angle;
 
-void PlasmaAnimation::update()
-{
-    unsigned long time = millis();
-    float time1 = time / 1000.0f;
-    float time2 = time / 1234.0f;
-    float time3 = time / 2345.0f;
+/*
+Three sine waves summed per LED:
+
+  v1 = sin(10u + t1)
+  v2 = sin(10(u sin t2 + v cos t2) + t1)
+  v3 = sin(sqrt(100(cx^2 + cy^2)) + t1),  cx = u + sin(t3) / 2, cy = v + cos(t3) / 2
 
-    LedController& leds = controller.getLedController();
+Expanding the square, 100(cx^2 + cy^2) = 100(u^2 + v^2) + 100(u sin t3 +
+v cos t3) + 25, so each LED only needs its own 10u, 10v and 100(u^2 + v^2)
+and a frame is a few multiplies, an integer square root and sine lookups.
+*/
+
+void PlasmaAnimation::run()
+{
+    preparePoints();
+}
 
+void PlasmaAnimation::preparePoints()
+{
+    points.resize(Constants::NUM_OF_PIXELS);
     for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
     {
-        // Interpolate for each LED
-        int nodeTop = Topology::segmentConnections[s][0];
-        int nodeBottom = Topology::segmentConnections[s][1];
-        NodePosition pTop = Topology::nodePositions[nodeTop];
-        NodePosition pBottom = Topology::nodePositions[nodeBottom];
-
-        for(int i=0; i<Constants::LEDS_PER_SEGMENT; i++) {
-            float t = (float)i / (Constants::LEDS_PER_SEGMENT - 1);
-            float x = pBottom.x + (pTop.x - pBottom.x) * t;
-            float y = pBottom.y + (pTop.y - pBottom.y) * t;
-            
+        for (int i = 0; i < Constants::LEDS_PER_SEGMENT; i++)
+        {
+            const LedPosition &position = Topology::getLedPosition(s, i);
+
             // Normalize coords (approx 0-80, 0-26) to 0-1 range
-            float u = x / 80.0f;
-            float v = y / 26.0f;
-
-            // Calculate plasma value
-            float v1 = sin(u * 10.0f + time1);
-            float v2 = sin(10.0f * (u * sin(time2) + v * cos(time2)) + time1);
-            float cx = u + 0.5f * sin(time3);
-            float cy = v + 0.5f * cos(time3);
-            float v3 = sin(sqrt(100.0f * (cx*cx + cy*cy)) + time1);
-            
-            float val = (v1 + v2 + v3) / 3.0f; // -1 to 1
-            
-            // Map to color
-            // Hue based on val
-            uint16_t hue = (uint16_t)((val + 1.0f) * 32768.0f);
-            
-            // Brightness variation
-            uint8_t bright = 128 + (uint8_t)(sin(val * 3.14f) * 127);
-            
-            uint32_t color = leds.ColorHSV(hue, 255, bright);
-            
-            byte r = (byte)((color >> 16) & 0xFF);
-            byte g = (byte)((color >> 8) & 0xFF);
-            byte b = (byte)(color & 0xFF);
-
-            leds.setPixelColor(s, i, r, g, b);
+            double u = position.x / 80.0;
+            double v = position.y / 26.0;
+
+            PlasmaPoint &point = points[LedController::pixelIndex(s, i)];
+            point.u = (Angle)lround(10.0 * u / (2.0 * M_PI) * FixedMath::TURN);
+            point.v = (Angle)lround(10.0 * v / (2.0 * M_PI) * FixedMath::TURN);
+            point.radius = (int32_t)lround(100.0 * (u * u + v * v) * 65536.0);
         }
     }
 }
+
+void PlasmaAnimation::update()
+{
+    if (points.size() != (size_t)Constants::NUM_OF_PIXELS)
+    {
+        preparePoints();
+    }
+
+    unsigned long time = controller.now();
+    Angle time1 = FixedMath::fromRadians(time / 1000.0);
+    Angle time2 = FixedMath::fromRadians(time / 1234.0);
+    Angle time3 = FixedMath::fromRadians(time / 2345.0);
+
+    // Rotation for v2, in Q15
+    int32_t sin2 = FixedMath::sin16(time2);
+    int32_t cos2 = FixedMath::cos16(time2);
+
+    // 100 sin(t3) per turn of u, so (point.u * weight) >> 15 is 100u sin(t3) in 16.16
+    const double radiusPerTurn = 100.0 * 2.0 * M_PI / 10.0;
+    int32_t weightU = (int32_t)lround(FixedMath::sin16(time3) * radiusPerTurn);
+    int32_t weightV = (int32_t)lround(FixedMath::cos16(time3) * radiusPerTurn);
+    const int32_t centerOffset = 25 * 65536;
+
+    // Whole turns per radian of sqrt(), with the root in 24.8
+    const int32_t turnsPerRoot = (int32_t)lround(FixedMath::TURN / (2.0 * M_PI));
+
+    LedController &leds = controller.getLedController();
+    byte *color = leds.ledColors;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++, color += 3)
+    {
+        const PlasmaPoint &point = points[p];
+
+        int32_t v1 = FixedMath::sin16(point.u + time1);
+        Angle rotated = (Angle)(((int64_t)point.u * sin2 + (int64_t)point.v * cos2) >> 15);
+        int32_t v2 = FixedMath::sin16(rotated + time1);
+        int32_t radius = point.radius + (int32_t)(((int64_t)point.u * weightU + (int64_t)point.v * weightV) >> 15) + centerOffset;
+        uint32_t root = FixedMath::sqrt32(radius > 0 ? radius : 0); // 24.8
+        int32_t v3 = FixedMath::sin16((Angle)((root * turnsPerRoot) >> 8) + time1);
+
+        int32_t val = (v1 + v2 + v3) / 3; // Q15, -1 to 1
+
+        // Map to color
+        // Hue based on val
+        uint16_t hue = (uint16_t)(val + FixedMath::ONE);
+
+        // Brightness variation: sin(3.14 val), 3.14 radians being 0.49975 turns
+        int32_t wave = FixedMath::sin16((Angle)((val * 32753) >> 15));
+        uint8_t bright = 128 + wave * 127 / FixedMath::ONE;
+
+        uint32_t hsv = leds.ColorHSV(hue, 255, bright);
+        color[0] = (byte)((hsv >> 16) & 0xFF);
+        color[1] = (byte)((hsv >> 8) & 0xFF);
+        color[2] = (byte)(hsv & 0xFF);
+    }
+}
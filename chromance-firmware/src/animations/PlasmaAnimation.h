@@ -2,6 +2,16 @@
 #define PLASMAANIMATION_H
 
 #include "Animation.h"
+#include "../FixedMath.h"
+#include <vector>
+
+// The per-LED part of the plasma, worked out once (u and v are the LED
+// position scaled to about 0-1 across the stock wall)
+struct PlasmaPoint {
+    FixedMath::Angle u; // 10u radians
+    FixedMath::Angle v; // 10v radians
+    int32_t radius;     // 100(u^2 + v^2), 16.16
+};
 
 class PlasmaAnimation : public Animation
 {
@@ -10,7 +20,13 @@ public:
 
     void update() override;
     void run() override;
+    RenderContract getRenderContract() const override { return RENDER_OVERWRITE; }
     const char *getName() const override { return "Plasma"; }
+
+private:
+    std::vector<PlasmaPoint> points; // One per frame buffer pixel
+
+    void preparePoints();
 };
 
 #endif
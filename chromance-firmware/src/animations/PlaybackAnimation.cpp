@@ -0,0 +1,72 @@
+#include "PlaybackAnimation.h"
+#include "../AnimationController.h"
+#include "../LedController.h"
+
+void PlaybackAnimation::run()
+{
+    stop();
+
+    if (SPIFFS.exists(Sequence::DEFAULT_PATH))
+    {
+        file = SPIFFS.open(Sequence::DEFAULT_PATH, FILE_READ);
+    }
+    if (!file || !decoder.begin(source) || !decoder.nextFrame())
+    {
+        Serial.println("No sequence to play");
+        file.close();
+        return;
+    }
+
+    playing = true;
+    startTime = controller.now();
+    update();
+}
+
+void PlaybackAnimation::update()
+{
+    byte *pixels = controller.getLedController().ledColors;
+    if (!playing)
+    {
+        memset(pixels, 0, Constants::NUM_OF_PIXELS * 3);
+        return;
+    }
+
+    // Frame 0 is already applied when startTime is reached
+    unsigned long due = (controller.now() - startTime) / decoder.getFrameMillis();
+    if (due > decoder.getFrameIndex() - 1 + MAX_CATCH_UP_FRAMES)
+    {
+        // Too far behind (e.g. after a long stall): drop frames instead of catching up
+        startTime = controller.now() - (decoder.getFrameIndex() - 1) * decoder.getFrameMillis();
+        due = decoder.getFrameIndex() - 1;
+    }
+
+    while (decoder.getFrameIndex() - 1 < due)
+    {
+        if (!decoder.nextFrame())
+        {
+            // Loop: restart the clock at frame 0
+            if (!decoder.rewind() || !decoder.nextFrame())
+            {
+                stop();
+                memset(pixels, 0, Constants::NUM_OF_PIXELS * 3);
+                return;
+            }
+            startTime = controller.now();
+            break;
+        }
+    }
+
+    decoder.render(pixels);
+}
+
+void PlaybackAnimation::stop()
+{
+    if (playing)
+    {
+        file.close();
+    }
+    playing = false;
+}
+
+#include "../AnimationRegistry.h"
+REGISTER_ANIMATION(PlaybackAnimation)
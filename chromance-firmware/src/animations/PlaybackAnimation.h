@@ -0,0 +1,32 @@
+#ifndef PLAYBACK_ANIMATION_H
+#define PLAYBACK_ANIMATION_H
+
+#include "Animation.h"
+#include "../Sequence.h"
+
+// Plays a pre-rendered sequence (see Sequence.h) from SPIFFS in a loop.
+// Decoding only touches the pixels that changed, so expensive effects can be
+// recorded offline and shown at full frame rate for a fraction of the CPU.
+class PlaybackAnimation : public Animation
+{
+public:
+  PlaybackAnimation(AnimationController &controller) : Animation(controller, false), source(file) {}
+  void run() override;
+  void update() override;
+  void stop() override;
+  bool isFinished() override { return false; }
+  bool isPlaying() const { return playing; }
+  RenderContract getRenderContract() const override { return RENDER_OVERWRITE; }
+  const char *getName() const override { return "Playback"; }
+
+private:
+  static const int MAX_CATCH_UP_FRAMES = 8;
+
+  File file;
+  FileSequenceSource source;
+  SequenceDecoder decoder;
+  bool playing = false;
+  unsigned long startTime = 0;
+};
+
+#endif
@@ -13,7 +13,7 @@ void RainbowAnimation::update()
     // Use time-based hue calculation to ensure the rainbow animation
     // moves continuously.
     // Speed: 2048ms for full cycle (65536 hue units)
-    firstHue = (millis() % 2048) * 32;
+    firstHue = (controller.now() % 2048) * 32;
 
     // Define scale for the spatial gradient
     // Total height is roughly 25 units.
@@ -10,6 +10,7 @@ public:
   void run() override;
   void update() override;
   bool isFinished() override { return false; }
+  RenderContract getRenderContract() const override { return RENDER_OVERWRITE; }
   const char *getName() const override { return "Rainbow"; }
 
 private:
@@ -11,60 +11,54 @@
 
 void RainbowPinwheelAnimation::run()
 {
+    prepareAngles();
     // Use update() to set the initial state immediately
     update();
 }
 
-void RainbowPinwheelAnimation::update()
+void RainbowPinwheelAnimation::prepareAngles()
 {
-    // Calculate center node position
     const NodePosition &centerPos = Topology::nodePositions[Topology::starburstNode];
 
-    // Time-based rotation - similar speed to RainbowAnimation
-    // 32 units/ms gives a ~2 second cycle for full rotation
-    float rotationOffset = (millis() % 2048) * rotationSpeed * rotationDirection;
-
-    // Calculate angle and apply rainbow for each pixel
+    angleHues.resize(Constants::NUM_OF_PIXELS);
     for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
     {
-        // Get the two nodes connected by this segment
-        int node0 = Topology::segmentConnections[segment][0];
-        int node1 = Topology::segmentConnections[segment][1];
-
-        // Get node positions
-        const NodePosition &pos0 = Topology::nodePositions[node0];
-        const NodePosition &pos1 = Topology::nodePositions[node1];
-
-        // Calculate per-pixel colors along the segment
         for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
         {
-            // Interpolate position along the segment (0.0 to 1.0)
-            // LedController maps index 0 to Floor (pos1) and index 13 to Ceiling (pos0)
-            float t = (float)led / (Constants::LEDS_PER_SEGMENT - 1);
-            float ledX = pos1.x + (pos0.x - pos1.x) * t;
-            float ledY = pos1.y + (pos0.y - pos1.y) * t;
-
             // Calculate angle from center to this LED position
-            float dx = ledX - centerPos.x;
-            float dy = ledY - centerPos.y;
-            float angle = atan2(dy, dx); // Returns angle in radians from -PI to PI
+            const LedPosition &position = Topology::getLedPosition(segment, led);
+            float angle = atan2(position.y - centerPos.y, position.x - centerPos.x); // -PI to PI
 
             // Convert angle to hue space (0 to 65536)
             // Normalize angle to 0-2PI, then scale to 0-65536
             float normalizedAngle = angle + M_PI; // Shift from [-PI, PI] to [0, 2PI]
-            uint16_t angleHue = (uint16_t)(normalizedAngle * 65536.0f / (2.0f * M_PI));
+            angleHues[LedController::pixelIndex(segment, led)] = (uint16_t)(int32_t)(normalizedAngle * 65536.0f / (2.0f * M_PI));
+        }
+    }
+}
 
-            // Apply rotation offset and calculate final hue
-            uint16_t hue = (angleHue + (uint16_t)rotationOffset) % 65536;
+void RainbowPinwheelAnimation::update()
+{
+    if (angleHues.size() != (size_t)Constants::NUM_OF_PIXELS)
+    {
+        prepareAngles();
+    }
 
-            // Apply rainbow color to this pixel
-            uint32_t color = controller.getLedController().ColorHSV(hue, 255, controller.getConfiguration().getRainbowBrightness());
-            byte r = (uint8_t)(color >> 16);
-            byte g = (uint8_t)(color >> 8);
-            byte b = (uint8_t)(color);
+    // Time-based rotation - similar speed to RainbowAnimation
+    // 32 units/ms gives a ~2 second cycle for full rotation
+    uint16_t rotationOffset = (uint16_t)(int32_t)((controller.now() % 2048) * rotationSpeed * rotationDirection);
 
-            controller.getLedController().setPixelColor(segment, led, r, g, b);
-        }
+    LedController &leds = controller.getLedController();
+    wheel.setBrightness(leds, controller.getConfiguration().getRainbowBrightness());
+
+    // Only the rotation moves: one add and a wheel lookup per pixel
+    byte *color = leds.ledColors;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++, color += 3)
+    {
+        const byte *rgb = wheel.lookup((uint16_t)(angleHues[p] + rotationOffset));
+        color[0] = rgb[0];
+        color[1] = rgb[1];
+        color[2] = rgb[2];
     }
 }
 
@@ -2,6 +2,8 @@
 #define RAINBOW_PINWHEEL_ANIMATION_H
 
 #include "Animation.h"
+#include "../HueWheel.h"
+#include <vector>
 
 class RainbowPinwheelAnimation : public Animation
 {
@@ -11,14 +13,19 @@ public:
   void update() override;
   bool isFinished() override { return false; }
   bool hasConfig() const override { return true; }
+  RenderContract getRenderContract() const override { return RENDER_OVERWRITE; }
   const char *getName() const override { return "Rainbow Pinwheel"; }
   void getConfig(JsonObject &doc) override;
   void setConfig(const JsonObject &doc) override;
 
 private:
-  uint16_t baseHue = 0;
   int rotationDirection = 1; // 1 for clockwise, -1 for counterclockwise
   float rotationSpeed = 32.0f; // Units per ms (similar to RainbowAnimation)
+
+  std::vector<uint16_t> angleHues; // Per pixel, from its bearing off the centre
+  HueWheel wheel;
+
+  void prepareAngles();
 };
 
 #endif
@@ -3,93 +3,67 @@
 #include "../LedController.h"
 #include "../Topology.h"
 #include "../Constants.h"
-#include <math.h>
 
 void RainbowRadiateAnimation::run()
 {
-    // Calculate maximum distance from center for normalization
-    const NodePosition &centerPos = Topology::nodePositions[Topology::starburstNode];
-    maxDistance = 0.0f;
-
-    for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
-    {
-        int node0 = Topology::segmentConnections[segment][0];
-        int node1 = Topology::segmentConnections[segment][1];
-
-        const NodePosition &pos0 = Topology::nodePositions[node0];
-        const NodePosition &pos1 = Topology::nodePositions[node1];
-
-        float midX = (pos0.x + pos1.x) / 2.0f;
-        float midY = (pos0.y + pos1.y) / 2.0f;
+    prepareOffsets();
+    // Use update() to set the initial state immediately
+    update();
+}
 
-        float dx = midX - centerPos.x;
-        float dy = midY - centerPos.y;
-        float distance = sqrt(dx * dx + dy * dy);
+void RainbowRadiateAnimation::prepareOffsets()
+{
+    // Distance from the center along the wiring, so the rings follow the
+    // segments instead of cutting across the gaps between them
+    const uint8_t *distances = Topology::getDistanceField(Topology::starburstNode);
+    float maxDistance = Topology::getMaxDistance(Topology::starburstNode);
 
-        if (distance > maxDistance)
+    hueOffsets.resize(Constants::NUM_OF_PIXELS);
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+    {
+        if (distances[p] == Topology::DISTANCE_UNREACHABLE)
         {
-            maxDistance = distance;
+            hueOffsets[p] = DARK;
+            continue;
         }
+        // Normalize distance (0.0 to 1.0) and spread it over the hue wheel
+        float normalizedDistance = maxDistance > 0 ? (distances[p] / maxDistance) : 0.0f;
+        hueOffsets[p] = (uint16_t)(int32_t)(normalizedDistance * 65536.0f);
     }
-
-    // Use update() to set the initial state immediately
-    update();
 }
 
 void RainbowRadiateAnimation::update()
 {
-    // Calculate center node position
-    const NodePosition &centerPos = Topology::nodePositions[Topology::starburstNode];
+    if (hueOffsets.size() != (size_t)Constants::NUM_OF_PIXELS)
+    {
+        prepareOffsets();
+    }
 
     // Time-based phase for radiating animation
     // Creates a wave that radiates outward over time
     // 32 units/ms gives a ~2 second cycle
-    float phaseOffset = (millis() % 2048) * radiateSpeed;
+    uint16_t phaseOffset = (uint16_t)((controller.now() % 2048) * radiateSpeed);
 
-    // Calculate distance and apply rainbow for each segment
-    for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
-    {
-        // Get the two nodes connected by this segment
-        int node0 = Topology::segmentConnections[segment][0];
-        int node1 = Topology::segmentConnections[segment][1];
+    // Brightness is reduced to prevent ESP32 crash due to high power draw from the LED wall
+    int brightness = controller.getConfiguration().getRainbowBrightness();
+    if (brightness > 40) brightness = 40; // Hard cap for safety
 
-        // Get node positions
-        const NodePosition &pos0 = Topology::nodePositions[node0];
-        const NodePosition &pos1 = Topology::nodePositions[node1];
+    LedController &leds = controller.getLedController();
+    wheel.setBrightness(leds, brightness);
 
-        for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
+    // Only the phase moves: one add and a wheel lookup per pixel
+    byte *color = leds.ledColors;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++, color += 3)
+    {
+        if (hueOffsets[p] == DARK)
         {
-            // Interpolate position along the segment (0.0 to 1.0)
-            // LedController maps index 0 to Floor (pos1) and index 13 to Ceiling (pos0)
-            float t = (float)led / (Constants::LEDS_PER_SEGMENT - 1);
-            float ledX = pos1.x + (pos0.x - pos1.x) * t;
-            float ledY = pos1.y + (pos0.y - pos1.y) * t;
-
-            // Calculate distance from center to this LED
-            float dx = ledX - centerPos.x;
-            float dy = ledY - centerPos.y;
-            float distance = sqrt(dx * dx + dy * dy);
-
-            // Normalize distance (0.0 to 1.0) and add phase offset for animation
-            // This creates a wave that radiates outward
-            float normalizedDistance = maxDistance > 0 ? (distance / maxDistance) : 0.0f;
-
-            // Map distance + phase to hue space
-            float hueValue = (normalizedDistance * 65536.0f + phaseOffset);
-            uint16_t hue = (uint16_t)hueValue % 65536;
-
-            // Apply rainbow color to this pixel
-            // Brightness is reduced to prevent ESP32 crash due to high power draw from the LED wall
-            int brightness = controller.getConfiguration().getRainbowBrightness();
-            if (brightness > 40) brightness = 40; // Hard cap for safety
-            
-            uint32_t color = controller.getLedController().ColorHSV(hue, 255, brightness);
-            byte r = (uint8_t)(color >> 16);
-            byte g = (uint8_t)(color >> 8);
-            byte b = (uint8_t)(color);
-
-            controller.getLedController().setPixelColor(segment, led, r, g, b);
+            color[0] = color[1] = color[2] = 0;
+            continue;
         }
+        const byte *rgb = wheel.lookup((uint16_t)(hueOffsets[p] + phaseOffset));
+        color[0] = rgb[0];
+        color[1] = rgb[1];
+        color[2] = rgb[2];
     }
 }
 
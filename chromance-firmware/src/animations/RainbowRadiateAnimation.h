@@ -2,6 +2,8 @@
 #define RAINBOW_RADIATE_ANIMATION_H
 
 #include "Animation.h"
+#include "../HueWheel.h"
+#include <vector>
 
 class RainbowRadiateAnimation : public Animation
 {
@@ -10,12 +12,17 @@ public:
   void run() override;
   void update() override;
   bool isFinished() override { return false; }
+  RenderContract getRenderContract() const override { return RENDER_OVERWRITE; }
   const char *getName() const override { return "Rainbow Radiate"; }
 
 private:
-  float animationPhase = 0.0f;
   float radiateSpeed = 32.0f; // Units per ms (similar to RainbowAnimation)
-  float maxDistance = 0.0f; // Will be calculated in run()
+
+  static const int32_t DARK = -1;
+  std::vector<int32_t> hueOffsets; // Per pixel, from the distance to the centre; DARK if unreachable
+  HueWheel wheel;
+
+  void prepareOffsets();
 };
 
 #endif
@@ -8,6 +8,7 @@ class RandomAnimation : public Animation
 public:
   RandomAnimation(AnimationController &controller) : Animation(controller, Constants::randomPulsesEnabled) {}
   void run() override;
+  RenderContract getRenderContract() const override { return RENDER_RIPPLES_ONLY; }
   const char* getName() const override { return "Random Pulse"; }
 };
 
@@ -0,0 +1,83 @@
+#include "ReactionDiffusionAnimation.h"
+#include "../AnimationController.h"
+#include "../AnimationRegistry.h"
+
+REGISTER_ANIMATION(ReactionDiffusionAnimation)
+
+namespace
+{
+    // Diffusion above 0.5 a step makes neighbouring LEDs oscillate; V spreads
+    // at half U's rate as usual. Feed 0.014, kill 0.047
+    const GraphField::GrayScott CHEMISTRY = {32768, 16384, 918, 3080};
+
+    const int SEED_CHANCE = 2;      // Percent chance a frame of an extra seed
+    const int SEED_RADIUS = 2;      // LEDs either side of a seed's centre
+    const uint16_t SEED_U = 32768;
+    const uint16_t SEED_V = 32768;
+    const int BRIGHT_V = 24000;     // V drawn at full brightness; it rarely peaks higher
+}
+
+ReactionDiffusionAnimation::ReactionDiffusionAnimation(AnimationController &controller)
+    : Animation(controller), field(2) {}
+
+void ReactionDiffusionAnimation::run()
+{
+    field.fill(U, GraphField::ONE);
+    field.fill(V, 0);
+    for (int i = 0; i < SEEDS; i++)
+    {
+        seed(random(Constants::NUM_OF_PIXELS));
+    }
+}
+
+void ReactionDiffusionAnimation::seed(int pixel)
+{
+    uint16_t *u = field.get(U);
+    uint16_t *v = field.get(V);
+    // A seed stays on its segment; the graph carries it over the ends
+    int segmentStart = pixel - pixel % Constants::LEDS_PER_SEGMENT;
+    for (int p = pixel - SEED_RADIUS; p <= pixel + SEED_RADIUS; p++)
+    {
+        if (p >= segmentStart && p < segmentStart + Constants::LEDS_PER_SEGMENT)
+        {
+            u[p] = SEED_U;
+            v[p] = SEED_V;
+        }
+    }
+}
+
+void ReactionDiffusionAnimation::update()
+{
+    field.grayScott(CHEMISTRY, U, V, STEPS_PER_FRAME);
+
+    const uint16_t *v = field.get(V);
+    uint16_t highest = 0;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+    {
+        highest = v[p] > highest ? v[p] : highest;
+    }
+    if (highest < DEAD_LEVEL)
+    {
+        run();
+    }
+    else if (random(100) < SEED_CHANCE)
+    {
+        seed(random(Constants::NUM_OF_PIXELS));
+    }
+
+    // V's brightness, its hue drifting round the wheel about once a minute
+    // and pushed on by how much U is left around it
+    LedController &leds = controller.getLedController();
+    const uint16_t *u = field.get(U);
+    uint16_t baseHue = (uint16_t)(controller.now() % 60000 * 65536 / 60000);
+    byte *color = leds.ledColors;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++, color += 3)
+    {
+        int level = v[p] * 255 / BRIGHT_V;
+        uint8_t bright = level > 255 ? 255 : level;
+        uint32_t hsv = leds.ColorHSV(baseHue + (u[p] >> 2), 255, bright);
+        color[0] = (byte)((hsv >> 16) & 0xFF);
+        color[1] = (byte)((hsv >> 8) & 0xFF);
+        color[2] = (byte)(hsv & 0xFF);
+    }
+}
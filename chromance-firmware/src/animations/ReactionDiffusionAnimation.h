@@ -0,0 +1,33 @@
+#ifndef REACTIONDIFFUSIONANIMATION_H
+#define REACTIONDIFFUSIONANIMATION_H
+
+#include "Animation.h"
+#include "../GraphField.h"
+
+// Gray-Scott chemistry running along the wiring: V feeds on U and spreads
+// more slowly, and with this feed and kill rate the spots it forms keep
+// splitting, wandering and dying out instead of settling
+class ReactionDiffusionAnimation : public Animation
+{
+public:
+    ReactionDiffusionAnimation(AnimationController &controller);
+
+    void update() override;
+    void run() override;
+    bool isFinished() override { return false; }
+    RenderContract getRenderContract() const override { return RENDER_OVERWRITE; }
+    const char *getName() const override { return "Reaction Diffusion"; }
+
+private:
+    static const int U = 0;
+    static const int V = 1;
+    static const int STEPS_PER_FRAME = 8;
+    static const int SEEDS = 10;           // Dropped at the start and whenever V dies out
+    static const uint16_t DEAD_LEVEL = 2000; // Highest V below which the pattern has died
+
+    GraphField field;
+
+    void seed(int pixel);
+};
+
+#endif
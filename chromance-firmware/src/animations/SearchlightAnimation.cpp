@@ -2,6 +2,7 @@
 #include "../AnimationController.h"
 #include "../Topology.h"
 #include "../Constants.h"
+#include "../SpatialIndex.h"
 #include <cmath>
 
 #ifndef M_PI
@@ -12,6 +13,7 @@ void SearchlightAnimation::run()
 {
     // Can reset angle here if desired
     // currentAngle = 0.0f;
+    bearingsCenter = -1; // The layout may have changed
 }
 
 void SearchlightAnimation::update()
@@ -23,64 +25,61 @@ void SearchlightAnimation::update()
     currentAngle += 0.05f;
     if (currentAngle > M_PI) currentAngle -= 2 * M_PI;
 
-    // Center node position (Node 15)
-    // 40, 13
-    NodePosition center = Topology::nodePositions[15];
-    
+    int centerNode = Topology::starburstNode;
+    NodePosition center = Topology::nodePositions[centerNode];
+    const float TURNS_PER_RADIAN = 32768.0f / M_PI;
+    if (bearingsCenter != centerNode)
+    {
+        for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+        {
+            for (int i = 0; i < Constants::LEDS_PER_SEGMENT; i++)
+            {
+                const LedPosition &p = Topology::getLedPosition(s, i);
+                float bearing = atan2(p.y - center.y, p.x - center.x);
+                ledBearings[LedController::pixelIndex(s, i)] = (uint16_t)(int32_t)lroundf(bearing * TURNS_PER_RADIAN);
+            }
+        }
+        bearingsCenter = centerNode;
+    }
+
+    // The beam loses strength the further the light has to travel along the wiring
+    const uint8_t *distances = Topology::getDistanceField(centerNode);
+    float reach = Topology::getMaxDistance(centerNode) + 1.0f;
+
     // Beam width in radians
     float beamWidth = 0.4f;
+    uint16_t beamBearing = (uint16_t)(int32_t)lroundf(currentAngle * TURNS_PER_RADIAN);
+    int32_t beamTurns = (int32_t)(beamWidth * TURNS_PER_RADIAN);
 
     LedController& leds = controller.getLedController();
-    uint32_t color = controller.getRandomColor(); 
-    // Or use a fixed radar green: 0x00FF00
-    // Let's use baseColor but ensure it's bright
-    // uint32_t color = leds.ColorHSV(controller.getBaseColor(), 255, 255);
 
     // Fade out existing (done globally in AnimationController::update usually, but we can enforce it)
     // Actually, AnimationController calls fade() before update(), so we just draw on top.
 
-    for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
-    {
-        int nodeA = Topology::segmentConnections[s][0];
-        int nodeB = Topology::segmentConnections[s][1];
-
-        NodePosition pA = Topology::nodePositions[nodeA];
-        NodePosition pB = Topology::nodePositions[nodeB];
-
-        // Midpoint of segment
-        float midX = (pA.x + pB.x) / 2.0f;
-        float midY = (pA.y + pB.y) / 2.0f;
-
-        // Vector from center
-        float dx = midX - center.x;
-        float dy = midY - center.y;
+    // Only the LEDs inside the beam, from the spatial index
+    LedSpan spans[MAX_BEAM_SPANS];
+    int count = Topology::getSpatialIndex().querySector(center.x, center.y, currentAngle, beamWidth,
+                                                        SpatialIndex::ANY_DISTANCE, spans, MAX_BEAM_SPANS);
 
-        // Angle of segment relative to center
-        float angle = atan2(dy, dx);
+    for (int k = 0; k < count; k++)
+    {
+        int s = spans[k].segment;
+        for (int i = spans[k].first; i < spans[k].first + spans[k].count; i++)
+        {
+            int pixel = LedController::pixelIndex(s, i);
+            uint8_t dist = distances[pixel];
+            if (dist == Topology::DISTANCE_UNREACHABLE) continue;
 
-        // Normalize angle difference to -PI to +PI
-        float diff = angle - currentAngle;
-        while (diff <= -M_PI) diff += 2 * M_PI;
-        while (diff > M_PI) diff -= 2 * M_PI;
+            // Wrapping to 16 bits puts the difference in -PI to +PI
+            int32_t diff = std::abs((int16_t)(ledBearings[pixel] - beamBearing));
 
-        // Calculate brightness based on proximity to beam center
-        if (std::abs(diff) < beamWidth)
-        {
-            float intensity = 1.0f - (std::abs(diff) / beamWidth);
-            // intensity = pow(intensity, 2); // Sharpen beam
+            // Calculate brightness based on proximity to beam center
+            float intensity = diff < beamTurns ? 1.0f - (float)diff / beamTurns : 0.0f;
+            float falloff = 1.0f - 0.6f * dist / reach;
 
-            // Draw segment
             // Reduced max brightness (80 instead of 255) to prevent brownout crashes
-            uint32_t segColor = leds.ColorHSV(controller.getBaseColor(), 255, 80 * intensity);
-            
-            byte r = (byte)((segColor >> 16) & 0xFF);
-            byte g = (byte)((segColor >> 8) & 0xFF);
-            byte b = (byte)(segColor & 0xFF);
-
-            for (int i = 0; i < Constants::LEDS_PER_SEGMENT; i++)
-            {
-                leds.addPixelColor(s, i, r, g, b);
-            }
+            uint32_t color = leds.ColorHSV(controller.getBaseColor(), 255, 80 * intensity * falloff);
+            leds.addPixelColor(s, i, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
         }
     }
 }
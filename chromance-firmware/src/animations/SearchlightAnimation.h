@@ -6,14 +6,21 @@
 class SearchlightAnimation : public Animation
 {
 public:
-    SearchlightAnimation(AnimationController &controller) : Animation(controller), currentAngle(0.0f) {}
+    SearchlightAnimation(AnimationController &controller) : Animation(controller), currentAngle(0.0f), bearingsCenter(-1) {}
 
     void update() override;
     void run() override; // Needed for interface, but logic is in update
     const char *getName() const override { return "Searchlight"; }
 
 private:
+    static const int MAX_BEAM_SPANS = 64;
+
     float currentAngle;
+
+    // Bearing of each LED from the center in 1/65536 turns, worked out once
+    // per center node, so the beam is compared with a subtraction
+    uint16_t ledBearings[Constants::NUM_OF_PIXELS];
+    int bearingsCenter;
 };
 
 #endif
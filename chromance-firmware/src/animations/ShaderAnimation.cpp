@@ -0,0 +1,69 @@
+#include "ShaderAnimation.h"
+#include "../AnimationController.h"
+#include "../AnimationRegistry.h"
+#include <SPIFFS.h>
+#include <string.h>
+
+REGISTER_ANIMATION(ShaderAnimation)
+
+// Rings of colour spreading from the middle
+const char *const ShaderAnimation::DEFAULT_SOURCE =
+    "let wave = fract(r * 2 - t * 0.5);\n"
+    "hsv(a + t * 0.05, 1, wave * wave)\n";
+
+void ShaderAnimation::readSource(char *source)
+{
+    size_t length = 0;
+    if (SPIFFS.exists(PATH))
+    {
+        File file = SPIFFS.open(PATH, FILE_READ);
+        if (file)
+        {
+            length = file.read((uint8_t *)source, ShaderCompiler::MAX_SOURCE);
+            file.close();
+        }
+    }
+    if (length == 0)
+    {
+        strcpy(source, DEFAULT_SOURCE);
+        return;
+    }
+    source[length] = '\0';
+}
+
+bool ShaderAnimation::load(const char *text)
+{
+    if (!compiler.compile(text, program))
+    {
+        return false;
+    }
+    if (text != source)
+    {
+        strncpy(source, text, ShaderCompiler::MAX_SOURCE);
+        source[ShaderCompiler::MAX_SOURCE] = '\0';
+    }
+    return true;
+}
+
+void ShaderAnimation::run()
+{
+    vm.prepare();
+    wheel.setBrightness(controller.getLedController(), 255);
+
+    readSource(source);
+    if (!load(source))
+    {
+        Serial.print("Shader does not compile: ");
+        Serial.println(compiler.getError());
+        load(DEFAULT_SOURCE);
+    }
+}
+
+void ShaderAnimation::update()
+{
+    if (!vm.isPrepared())
+    {
+        run();
+    }
+    vm.render(program, controller.now(), wheel, controller.getLedController().ledColors);
+}
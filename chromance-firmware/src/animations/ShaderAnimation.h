@@ -0,0 +1,45 @@
+#ifndef SHADERANIMATION_H
+#define SHADERANIMATION_H
+
+#include "Animation.h"
+#include "../ShaderVM.h"
+#include "../ShaderCompiler.h"
+#include "../HueWheel.h"
+
+// Runs the shader uploaded from the web page (see ShaderCompiler.h) on every
+// LED. The source is kept on SPIFFS and compiled each time the animation
+// starts; with no file, or one that does not compile, a built-in shader
+// runs instead.
+class ShaderAnimation : public Animation
+{
+public:
+    static constexpr const char *PATH = "/shader.txt";
+    static const char *const DEFAULT_SOURCE;
+
+    ShaderAnimation(AnimationController &controller) : Animation(controller) {}
+
+    void update() override;
+    void run() override;
+    bool isFinished() override { return false; }
+    RenderContract getRenderContract() const override { return RENDER_OVERWRITE; }
+    const char *getName() const override { return "Shader"; }
+
+    // Compiles and switches to source; the running shader is kept if it
+    // fails, with the reason in getCompiler()
+    bool load(const char *source);
+    const ShaderProgram &getProgram() const { return program; }
+    const ShaderCompiler &getCompiler() const { return compiler; }
+
+    // The shader on SPIFFS into source (MAX_SOURCE + 1 bytes), or the
+    // built-in one when there is none
+    static void readSource(char *source);
+
+private:
+    ShaderProgram program;
+    ShaderCompiler compiler;
+    ShaderVM vm;
+    HueWheel wheel;
+    char source[ShaderCompiler::MAX_SOURCE + 1];
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "ShapesAnimation.h"
+#include "../AnimationController.h"
+#include "../AnimationRegistry.h"
+#include "../Canvas.h"
+#include <math.h>
+
+REGISTER_ANIMATION(ShapesAnimation)
+
+namespace
+{
+    const float BEAM_LENGTH = 40.0f;     // nodePositions units; past the edge of the stock wall
+    const float BEAM_WIDTH = 1.5f;
+    const float BEAM_TURNS_PER_SECOND = 0.25f;
+    const unsigned long RING_PERIOD = 2500; // ms for a ring to reach RING_REACH
+    const float RING_REACH = 45.0f;
+    const float RING_WIDTH = 2.0f;
+    const float TRIANGLE_RADIUS = 12.0f;
+    const float TRIANGLE_TURNS_PER_SECOND = -0.1f;
+    const byte TRIANGLE_OPACITY = 96;
+    const float TWO_PI = 6.2831853f;
+}
+
+void ShapesAnimation::update()
+{
+    // The canvas is cleared by the controller (RENDER_CLEAR)
+    LedController &leds = controller.getLedController();
+    Canvas canvas(leds.ledColors);
+    const NodePosition &center = Topology::nodePositions[Topology::starburstNode];
+    const float seconds = controller.now() / 1000.0f;
+    const uint16_t hue = controller.getBaseColor();
+
+    // Lighten, so where the shapes cross the brighter one shows
+    canvas.setBlend(BLEND_LIGHTEN);
+    canvas.setOpacity(TRIANGLE_OPACITY);
+    LedPosition corners[3];
+    for (int k = 0; k < 3; k++)
+    {
+        float angle = TWO_PI * (seconds * TRIANGLE_TURNS_PER_SECOND + k / 3.0f);
+        corners[k].x = center.x + TRIANGLE_RADIUS * cosf(angle);
+        corners[k].y = center.y + TRIANGLE_RADIUS * sinf(angle);
+    }
+    canvas.polygon(corners, 3, leds.ColorHSV(hue + 0x5555, 255, 255));
+
+    // Each ring fades as it grows
+    float grown = (controller.now() % RING_PERIOD) / (float)RING_PERIOD;
+    canvas.setOpacity((byte)(255 * (1.0f - grown)));
+    canvas.ring(center.x, center.y, grown * RING_REACH, RING_WIDTH, leds.ColorHSV(hue + 0xAAAA, 255, 255));
+
+    float angle = TWO_PI * seconds * BEAM_TURNS_PER_SECOND;
+    canvas.setOpacity(255);
+    canvas.line(center.x, center.y, center.x + BEAM_LENGTH * cosf(angle), center.y + BEAM_LENGTH * sinf(angle),
+                BEAM_WIDTH, leds.ColorHSV(hue, 255, 255));
+}
@@ -0,0 +1,21 @@
+#ifndef SHAPESANIMATION_H
+#define SHAPESANIMATION_H
+
+#include "Animation.h"
+
+// Drawn with the vector canvas (see Canvas.h): a beam sweeping round the
+// middle of the wall, rings spreading out from it and a triangle turning the
+// other way, all with soft edges that glide between LEDs
+class ShapesAnimation : public Animation
+{
+public:
+    ShapesAnimation(AnimationController &controller) : Animation(controller) {}
+
+    void update() override;
+    void run() override {}
+    bool isFinished() override { return false; }
+    RenderContract getRenderContract() const override { return RENDER_CLEAR; }
+    const char *getName() const override { return "Shapes"; }
+};
+
+#endif
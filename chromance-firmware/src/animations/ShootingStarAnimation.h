@@ -6,7 +6,7 @@
 
 struct ShootingStar
 {
-  int pathIndex;
+  int pathIndex;  // Column in Topology::getPathLibrary()
   float distance; // Logical distance along the path (LEDs)
   float speed;    // LEDs per frame
   bool active;
@@ -26,10 +26,6 @@ private:
   void spawnStar(ShootingStar &star);
 
   static const int MAX_STARS = 5;
-  // 7 vertical paths. Max length is 3 segments (including gaps).
-  // Segments 12, 13, 14, 15, 16, 17, 18
-  static const int NUM_PATHS = 7;
-  static const int MAX_PATH_SEGMENTS = 3;
 
   ShootingStar stars[MAX_STARS];
 };
@@ -3,20 +3,86 @@
 #include "../Topology.h"
 #include "../Constants.h"
 #include "../AnimationRegistry.h"
+#include <string.h>
 
 REGISTER_ANIMATION(SnakeAnimation)
 
-SnakeAnimation::SnakeAnimation(AnimationController &controller) 
-    : Animation(controller), 
-      headSegment(-1), 
-      headLed(-1), 
-      moveDirection(1), 
+namespace
+{
+    const int HOP = Constants::LEDS_PER_SEGMENT + 1; // LED steps from node to node
+    const int MAX_STEPS_PER_FRAME = 8;
+    const int FOOD_TRIES = 8; // Random picks before searching for a free LED
+
+    // Nodes away from start, -1 where it cannot be reached
+    void hopsFrom(int start, int *hops)
+    {
+        int queue[Constants::NUMBER_OF_NODES];
+        for (int n = 0; n < Constants::NUMBER_OF_NODES; n++)
+        {
+            hops[n] = -1;
+        }
+        hops[start] = 0;
+        queue[0] = start;
+        for (int head = 0, tail = 1; head < tail; head++)
+        {
+            int node = queue[head];
+            for (int port = 0; port < Constants::MAX_PATHS_PER_NODE; port++)
+            {
+                int next = Topology::getNeighborNode(node, port);
+                if (next >= 0 && hops[next] < 0)
+                {
+                    hops[next] = hops[node] + 1;
+                    queue[tail++] = next;
+                }
+            }
+        }
+    }
+
+    int portOf(int node, int segment)
+    {
+        for (int port = 0; port < Constants::MAX_PATHS_PER_NODE; port++)
+        {
+            if (Topology::nodeConnections[node][port] == segment)
+            {
+                return port;
+            }
+        }
+        return -1;
+    }
+}
+
+const int SnakeAnimation::STEPS_PER_SECOND;
+const int SnakeAnimation::START_LENGTH;
+const int SnakeAnimation::GROWTH;
+const int SnakeAnimation::MAX_LENGTH;
+const int SnakeAnimation::PATIENCE;
+
+SnakeAnimation::SnakeAnimation(AnimationController &controller)
+    : Animation(controller),
+      head(0),
+      length(0),
+      targetLength(START_LENGTH),
+      headSegment(0),
+      headLed(0),
+      moveDirection(1),
       targetNode(-1),
-      foodSegment(-1),
-      foodLed(-1),
-      snakeLength(10),
-      finished(false)
+      food(0),
+      foodSegment(0),
+      foodLed(0),
+      finished(false),
+      steps(0),
+      foodSince(0),
+      lastTime(0),
+      owed(0)
 {
+    body[0] = 0;
+    memset(occupied, 0, sizeof(occupied));
+    memset(placedAt, 0, sizeof(placedAt));
+    memset(foodPort, -1, sizeof(foodPort));
+    for (int n = 0; n < Constants::NUMBER_OF_NODES; n++)
+    {
+        foodCost[n] = -1;
+    }
 }
 
 bool SnakeAnimation::canBePreempted()
@@ -29,156 +95,290 @@ bool SnakeAnimation::isFinished()
     return finished;
 }
 
-void SnakeAnimation::spawnFood()
-{
-    // Simple random spawn
-    foodSegment = random(Constants::NUMBER_OF_SEGMENTS);
-    foodLed = random(Constants::LEDS_PER_SEGMENT);
-}
-
 void SnakeAnimation::run()
 {
-    body.clear();
+    memset(occupied, 0, sizeof(occupied));
     finished = false;
-    // Start at a random border node
+    steps = 0;
+    owed = 0;
+    lastTime = controller.now();
+
+    // Start at a random border node, on one of its segments
     int startNode = Topology::borderNodes[random(Topology::numberOfBorderNodes)];
-    // Pick a segment
-    int k = random(Constants::MAX_PATHS_PER_NODE);
-    headSegment = Topology::nodeConnections[startNode][k];
-    
-    if (headSegment == -1) {
-        headSegment = 0; // Fallback
-    }
-    
-    // Determine start LED based on connection
-    // If startNode is at side 0 (top), start at led 13 (top). Wait, LED 0 is bottom.
-    // Side 0 is Top. Side 1 is Bottom.
-    // If we enter from Top (Side 0), we start at LED 13 and go down (-1).
-    // If we enter from Bottom (Side 1), we start at LED 0 and go up (+1).
-    
-    if (Topology::segmentConnections[headSegment][0] == startNode) {
+    int ports[Constants::MAX_PATHS_PER_NODE];
+    int count = 0;
+    for (int port = 0; port < Constants::MAX_PATHS_PER_NODE; port++)
+    {
+        if (Topology::nodeConnections[startNode][port] >= 0)
+        {
+            ports[count++] = port;
+        }
+    }
+    enterSegment(count > 0 ? Topology::nodeConnections[startNode][ports[random(count)]] : 0, startNode);
+
+    head = 0;
+    length = 1;
+    targetLength = START_LENGTH;
+    body[head] = LedController::pixelIndex(headSegment, headLed);
+    placedAt[body[head]] = 0;
+    occupied[body[head] / 32] |= 1u << (body[head] % 32);
+    spawnFood();
+}
+
+void SnakeAnimation::enterSegment(int segment, int fromNode)
+{
+    // Side 0 is the ceiling end, where LED LEDS_PER_SEGMENT - 1 is
+    headSegment = segment;
+    if (Topology::segmentConnections[segment][0] == fromNode)
+    {
         headLed = Constants::LEDS_PER_SEGMENT - 1;
         moveDirection = -1;
-        targetNode = Topology::segmentConnections[headSegment][1];
-    } else {
+        targetNode = Topology::segmentConnections[segment][1];
+    }
+    else
+    {
         headLed = 0;
         moveDirection = 1;
-        targetNode = Topology::segmentConnections[headSegment][0];
+        targetNode = Topology::segmentConnections[segment][0];
     }
-    
-    body.push_front({headSegment, headLed});
-    snakeLength = 10;
-    spawnFood();
 }
 
-void SnakeAnimation::update()
+void SnakeAnimation::spawnFood()
+{
+    // Anywhere the snake is not
+    food = random(Constants::NUM_OF_PIXELS);
+    for (int tries = 1; tries < FOOD_TRIES && isOccupied(food); tries++)
+    {
+        food = random(Constants::NUM_OF_PIXELS);
+    }
+    for (int k = 0; k < Constants::NUM_OF_PIXELS && isOccupied(food); k++)
+    {
+        food = food + 1 < Constants::NUM_OF_PIXELS ? food + 1 : 0;
+    }
+    foodSegment = food / Constants::LEDS_PER_SEGMENT;
+    foodLed = food % Constants::LEDS_PER_SEGMENT;
+    foodSince = steps;
+    routeToFood();
+}
+
+void SnakeAnimation::routeToFood()
+{
+    // The food is reached from one end of its segment or the other: LED
+    // steps in from the ceiling end and the floor end
+    const int ends[2] = {Topology::segmentConnections[foodSegment][0], Topology::segmentConnections[foodSegment][1]};
+    const int along[2] = {Constants::LEDS_PER_SEGMENT - foodLed, foodLed + 1};
+    int hops[2][Constants::NUMBER_OF_NODES];
+    hopsFrom(ends[0], hops[0]);
+    hopsFrom(ends[1], hops[1]);
+
+    for (int n = 0; n < Constants::NUMBER_OF_NODES; n++)
+    {
+        foodCost[n] = -1;
+        foodPort[n] = -1;
+        for (int e = 0; e < 2; e++)
+        {
+            if (hops[e][n] < 0)
+            {
+                continue;
+            }
+            int cost = hops[e][n] * HOP + along[e];
+            if (foodCost[n] < 0 || cost < foodCost[n])
+            {
+                foodCost[n] = cost;
+                foodPort[n] = n == ends[e] ? portOf(n, foodSegment) : Topology::getNextStep(n, ends[e]);
+            }
+        }
+    }
+}
+
+int SnakeAnimation::costVia(int node, int port) const
+{
+    int segment = Topology::nodeConnections[node][port];
+    if (segment == foodSegment)
+    {
+        return Topology::segmentConnections[segment][0] == node ? Constants::LEDS_PER_SEGMENT - foodLed : foodLed + 1;
+    }
+    int rest = foodCost[Topology::getNeighborNode(node, port)];
+    return rest < 0 ? 0x7FFF : HOP + rest;
+}
+
+bool SnakeAnimation::isClear(int first, int count) const
 {
-    if (finished) return;
-
-    // Move every frame? Or every N frames?
-    // Let's move every 2 frames for visible speed (30fps -> 15 steps/sec)
-    static int frameCount = 0;
-    if (frameCount++ % 2 != 0) return;
-
-    // 1. Move Head
-    headLed += moveDirection;
-    
-    bool changedSegment = false;
-    
-    // Check boundaries
-    if (headLed < 0 || headLed >= Constants::LEDS_PER_SEGMENT) {
-        // Reached a node!
-        int currentNode = targetNode;
-        
-        // Pick next segment
-        // Simple AI: Get closer to food?
-        // Food is at (foodSegment, foodLed).
-        // Find food Node? (one of the endpoints of foodSegment)
-        // Or just navigate nodes using BFS to find path to foodSegment?
-        
-        // Simplified AI: Just pick a random valid path for now, maybe biased towards food?
-        // Let's just do random walk for now to ensure movement works, 
-        // implementing full A* on 4000 leds is overkill, but A* on 25 nodes is fast.
-        
-        // Find food's closest node
-        int foodNodeA = Topology::segmentConnections[foodSegment][0];
-        int foodNodeB = Topology::segmentConnections[foodSegment][1];
-        int targetFoodNode = (random(2) == 0) ? foodNodeA : foodNodeB; 
-        
-        int pathIdx = Topology::getNextStep(currentNode, targetFoodNode);
-        
-        int nextSeg = -1;
-        if (pathIdx != -1) {
-            nextSeg = Topology::nodeConnections[currentNode][pathIdx];
+    // A word of the bitmap at a time
+    for (int p = first; p < first + count;)
+    {
+        int bit = p % 32;
+        int take = first + count - p < 32 - bit ? first + count - p : 32 - bit;
+        uint32_t mask = (take == 32 ? ~0u : (1u << take) - 1) << bit;
+        if (occupied[p / 32] & mask)
+        {
+            return false;
         }
-        
-        // Fallback or random
-        if (nextSeg == -1 || nextSeg == headSegment) {
-             int validPaths[6];
-             int count = 0;
-             for(int k=0; k<Constants::MAX_PATHS_PER_NODE; k++) {
-                 int s = Topology::nodeConnections[currentNode][k];
-                 if(s >= 0 && s != headSegment) { // Don't go back immediately
-                     validPaths[count++] = s;
-                 }
-             }
-             if (count > 0) {
-                 nextSeg = validPaths[random(count)];
-             } else {
-                 nextSeg = headSegment; // Dead end, turn back
-             }
+        p += take;
+    }
+    return true;
+}
+
+int SnakeAnimation::freeAhead(int node, int segment, int delay) const
+{
+    const int first = LedController::pixelIndex(segment, 0);
+    if (isClear(first, Constants::LEDS_PER_SEGMENT))
+    {
+        return Constants::LEDS_PER_SEGMENT;
+    }
+
+    // Some of the body is on it; a body LED is only in the way if the tail
+    // will not have left it by the time the head gets there
+    bool down = Topology::segmentConnections[segment][0] == node;
+    for (int j = 0; j < Constants::LEDS_PER_SEGMENT; j++)
+    {
+        int pixel = first + (down ? Constants::LEDS_PER_SEGMENT - 1 - j : j);
+        if (isOccupied(pixel) && steps + delay + 1 + j < placedAt[pixel] + targetLength)
+        {
+            return j;
         }
-        
-        headSegment = nextSeg;
-        
-        // Setup new direction
-        if (Topology::segmentConnections[headSegment][0] == currentNode) {
-            headLed = Constants::LEDS_PER_SEGMENT - 1;
-            moveDirection = -1;
-            targetNode = Topology::segmentConnections[headSegment][1];
-        } else {
-            headLed = 0;
-            moveDirection = 1;
-            targetNode = Topology::segmentConnections[headSegment][0];
+    }
+    return Constants::LEDS_PER_SEGMENT;
+}
+
+int SnakeAnimation::safety(int node, int port) const
+{
+    // 2: clear all the way, with a clear way on from the far node; 1: clear
+    // all the way; 0: runs into the body part way
+    const int segment = Topology::nodeConnections[node][port];
+    if (freeAhead(node, segment, 0) < Constants::LEDS_PER_SEGMENT)
+    {
+        return 0;
+    }
+    const int far = Topology::getOtherEnd(segment, node);
+    for (int next = 0; next < Constants::MAX_PATHS_PER_NODE; next++)
+    {
+        int onward = Topology::nodeConnections[far][next];
+        if (onward >= 0 && onward != segment &&
+            freeAhead(far, onward, Constants::LEDS_PER_SEGMENT) == Constants::LEDS_PER_SEGMENT)
+        {
+            return 2;
         }
-        changedSegment = true;
     }
-    
-    // Check Collision with Body
-    for (const auto& pixel : body) {
-        if (pixel.segment == headSegment && pixel.led == headLed) {
-            finished = true;
+    return 1;
+}
+
+int SnakeAnimation::choosePort(int node) const
+{
+    // The way to the food unless there is a safer one; among equally safe
+    // ways the one that keeps the food nearest, and among ways that all run
+    // into the body the one that goes furthest, which only puts off the end
+    int best = -1;
+    int bestSafety = 0;
+    int bestFree = 0;
+    int bestCost = 0;
+    for (int port = 0; port < Constants::MAX_PATHS_PER_NODE; port++)
+    {
+        int segment = Topology::nodeConnections[node][port];
+        if (segment < 0 || segment == headSegment)
+        {
+            continue;
+        }
+        int level = safety(node, port);
+        int free = level > 0 ? Constants::LEDS_PER_SEGMENT : freeAhead(node, segment, 0);
+        int cost = port == foodPort[node] ? -1 : costVia(node, port);
+        if (port == foodPort[node] && level == 1 && steps - foodSince > (unsigned long)PATIENCE)
+        {
+            level = 2; // Circling safely has gone on long enough
+        }
+        if (free > 0 && (best < 0 || level > bestSafety ||
+                         (level == bestSafety && (free > bestFree || (free == bestFree && cost < bestCost)))))
+        {
+            best = port;
+            bestSafety = level;
+            bestFree = free;
+            bestCost = cost;
+        }
+    }
+    return best;
+}
+
+void SnakeAnimation::step()
+{
+    int led = headLed + moveDirection;
+    if (led >= 0 && led < Constants::LEDS_PER_SEGMENT)
+    {
+        headLed = led;
+    }
+    else
+    {
+        int node = targetNode;
+        int port = choosePort(node);
+        if (port < 0)
+        {
+            finished = true; // Boxed in
             return;
         }
+        enterSegment(Topology::nodeConnections[node][port], node);
+    }
+
+    // The tail moves on first, unless the snake is growing, so the head can
+    // follow it round
+    int pixel = LedController::pixelIndex(headSegment, headLed);
+    if (length >= targetLength)
+    {
+        int tail = body[(head - length + 1 + MAX_LENGTH) % MAX_LENGTH];
+        occupied[tail / 32] &= ~(1u << (tail % 32));
+        length--;
+    }
+    if (isOccupied(pixel))
+    {
+        finished = true;
+        return;
     }
+    head = (head + 1) % MAX_LENGTH;
+    steps++;
+    body[head] = pixel;
+    placedAt[pixel] = steps;
+    occupied[pixel / 32] |= 1u << (pixel % 32);
+    length++;
 
-    // 2. Update Body
-    body.push_front({headSegment, headLed});
-    
-    // Check Food
-    if (headSegment == foodSegment && abs(headLed - foodLed) <= 1) {
-        snakeLength += 5;
+    if (pixel == food)
+    {
+        targetLength += GROWTH;
+        if (targetLength > MAX_LENGTH)
+        {
+            finished = true;
+            return;
+        }
         spawnFood();
     }
-    
-    // Trim
-    while(body.size() > snakeLength) {
-        body.pop_back();
-    }
-
-    // 3. Draw
-    LedController& leds = controller.getLedController();
-    leds.clear();
-    
-    // Draw Food
-    leds.setPixelColor(foodSegment, foodLed, 255, 0, 0);
-    
-    // Draw Body
-    for(size_t i=0; i<body.size(); i++) {
-        // Gradient green
-        int brightness = 255 - (i * 255 / body.size());
-        if (brightness < 0) brightness = 0;
-        
-        leds.setPixelColor(body[i].segment, body[i].led, 0, (uint8_t)brightness, 0);
+}
+
+void SnakeAnimation::update()
+{
+    if (finished)
+        return;
+
+    // As many steps as the time since the last frame is worth, so the speed
+    // does not depend on the frame rate
+    unsigned long now = controller.now();
+    owed += (now - lastTime) * STEPS_PER_SECOND;
+    lastTime = now;
+    int due = owed / 1000;
+    owed %= 1000;
+    for (int s = 0; s < due && s < MAX_STEPS_PER_FRAME && !finished; s++)
+    {
+        step();
+    }
+    draw();
+}
+
+void SnakeAnimation::draw()
+{
+    // The canvas is cleared by the controller (RENDER_CLEAR)
+    byte *colors = controller.getLedController().ledColors;
+    colors[food * 3] = 255;
+
+    // Green, dimming from the head to the tail
+    for (int i = 0; i < length; i++)
+    {
+        byte *color = colors + body[(head - i + MAX_LENGTH) % MAX_LENGTH] * 3;
+        color[1] = (byte)(255 - i * 255 / length);
     }
 }
@@ -2,13 +2,13 @@
 #define SNAKEANIMATION_H
 
 #include "Animation.h"
-#include <deque>
-
-struct SnakePixel {
-    int segment;
-    int led;
-};
 
+// A snake that steers along the wiring to the food, growing as it eats.
+// Each time food appears, every node gets the port to leave by for the
+// shortest way to it, so at a node the snake reads one entry and checks
+// the segment it leads into against a bitmap of the LEDs its body covers,
+// detouring round itself when its tail would still be in the way. It runs
+// into itself only when every way on is blocked, which ends the game.
 class SnakeAnimation : public Animation
 {
 public:
@@ -18,22 +18,65 @@ public:
     void run() override;
     bool canBePreempted() override;
     bool isFinished() override;
+    RenderContract getRenderContract() const override { return RENDER_CLEAR; }
     const char *getName() const override { return "Snake"; }
 
+    static const int STEPS_PER_SECOND = 15; // LEDs the head moves
+    static const int START_LENGTH = 10;
+    static const int GROWTH = 5;            // LEDs added per food eaten
+    static const int MAX_LENGTH = Constants::NUM_OF_PIXELS / 2; // The snake wins here
+    // Steps spent on the food after which the way to it is taken even when
+    // its far end has no clear way on, so the snake cannot circle forever
+    static const int PATIENCE = Constants::NUMBER_OF_NODES * (Constants::LEDS_PER_SEGMENT + 1);
+
+    // Frame buffer pixels
+    int getHead() const { return body[head]; }
+    int getFood() const { return food; }
+    int getLength() const { return length; }
+    unsigned long getSteps() const { return steps; }
+    // LED steps from node to the food on the shortest way, -1 if unreachable
+    int getFoodDistance(int node) const { return foodCost[node]; }
+
 private:
-    std::deque<SnakePixel> body;
+    static const int WORDS = (Constants::NUM_OF_PIXELS + 31) / 32;
+
+    // The body is a ring of pixels, head first, with a bit set in occupied
+    // for each
+    uint16_t body[MAX_LENGTH];
+    int head;   // body[head] is the head; the tail is length - 1 entries behind
+    int length;
+    int targetLength;
+    uint32_t occupied[WORDS];
+    uint32_t placedAt[Constants::NUM_OF_PIXELS]; // Step each body LED was entered on
+
     int headSegment;
     int headLed;
     int moveDirection; // 1 or -1
-    int targetNode; // Node we are moving towards
-    
+    int targetNode;    // Node we are moving towards
+
+    int food;
     int foodSegment;
     int foodLed;
-    
-    size_t snakeLength;
+    int8_t foodPort[Constants::NUMBER_OF_NODES]; // Per node: port to leave by for the food
+    int foodCost[Constants::NUMBER_OF_NODES];    // Per node: LED steps to the food
+
     bool finished;
-    
+    unsigned long steps;
+    unsigned long foodSince; // Step the food appeared on
+    unsigned long lastTime;
+    unsigned long owed; // Steps due, in thousandths
+
     void spawnFood();
+    void routeToFood();
+    void enterSegment(int segment, int fromNode);
+    int choosePort(int node) const;
+    int freeAhead(int node, int segment, int delay) const;
+    int safety(int node, int port) const;
+    int costVia(int node, int port) const;
+    bool isClear(int first, int count) const;
+    bool isOccupied(int pixel) const { return (occupied[pixel / 32] >> (pixel % 32)) & 1; }
+    void step();
+    void draw();
 };
 
 #endif
@@ -8,6 +8,7 @@ class StarburstAnimation : public Animation
 public:
   StarburstAnimation(AnimationController &controller) : Animation(controller, Constants::starburstPulsesEnabled) {}
   void run() override;
+  RenderContract getRenderContract() const override { return RENDER_RIPPLES_ONLY; }
   const char* getName() const override { return "Starburst"; }
 };
 
@@ -2,14 +2,8 @@
 #define WATERANIMATION_H
 
 #include "Animation.h"
-#include <vector>
-
-struct WaterDrop {
-    int segmentIndex;
-    float position; // 0.0 (top) to 1.0 (bottom)
-    float speed;
-    float volume; // 0.0 to 1.0 (affects brightness/width)
-};
+#include "../GraphParticles.h"
+#include "../Palette.h"
 
 class WaterAnimation : public Animation
 {
@@ -18,18 +12,50 @@ public:
 
     void update() override;
     void run() override;
+    RenderContract getRenderContract() const override { return RENDER_CLEAR; }
     const char *getName() const override { return "Water Pour"; }
+    bool hasConfig() const override { return true; }
+    void getConfig(JsonObject &doc) override;
+    void setConfig(const JsonObject &doc) override;
 
 private:
+    static const int MAX_DROPS = 128;
+
+    // At a node a drop splits between the segments below that are not full
+    class Spill : public SplitOnward
+    {
+    public:
+        Spill(WaterAnimation &water, JunctionPolicy *deadEnd) : SplitOnward(deadEnd), water(water) {}
+
+    protected:
+        bool accept(int segment) override { return water.segmentLevels[segment] < 1.0f; }
+
+    private:
+        WaterAnimation &water;
+    };
+
+    // With nowhere to go it backs up in the segment it is on
+    class Puddle : public JunctionPolicy
+    {
+    public:
+        explicit Puddle(WaterAnimation &water) : water(water) {}
+
+        bool arrive(GraphParticles &particles, int i, int node, bool down) override;
+
+    private:
+        WaterAnimation &water;
+    };
+
     float segmentLevels[Constants::NUMBER_OF_SEGMENTS];
-    std::vector<WaterDrop> drops;
+    Puddle puddle;
+    Spill spill;
+    GraphParticles drops; // Weight is the drop's volume
+
+    void addWater(int segment, float volume);
     
     int sourceNode;
     unsigned long lastSourceChange;
-    
-    // Helper to find downward connected segments from a node
-    // Returns number of paths found, fills result array with segment indices
-    int getDownwardPaths(int nodeIndex, int resultSegments[]);
+    PaletteSelection palette;
 };
 
 #endif
@@ -10,14 +10,15 @@ void WaveAnimation::run()
 
 void WaveAnimation::update()
 {
-    unsigned long time = millis();
+    unsigned long time = controller.now();
     float timeSec = time / 1000.0f;
     
     // Pulse parameters
     float speed = 2.0f; // Rad/sec
-    float phaseFactor = 0.1f; // Phase shift per unit distance
+    float phaseFactor = 0.07f; // Phase shift per LED step along the wiring
 
-    NodePosition center = Topology::nodePositions[15];
+    // Rings travel outward along the segments from the center
+    const uint8_t *distances = Topology::getDistanceField(Topology::starburstNode);
     LedController& leds = controller.getLedController();
 
     // Use a slowly changing base hue for temporal variety
@@ -25,24 +26,13 @@ void WaveAnimation::update()
 
     for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
     {
-        // Side 0: Ceiling (Top), Side 1: Floor (Bottom)
-        int nodeTop = Topology::segmentConnections[s][0];
-        int nodeBottom = Topology::segmentConnections[s][1];
-        NodePosition pTop = Topology::nodePositions[nodeTop];
-        NodePosition pBottom = Topology::nodePositions[nodeBottom];
-        
-        // Nested loop for each LED in the segment
+        // Nested loop for each LED in the segment (i=0 is bottom, i=max is top)
         for(int i=0; i<Constants::LEDS_PER_SEGMENT; i++) {
-            // Calculate interpolation factor (i=0 is bottom, i=max is top)
-            float t = (float)i / (Constants::LEDS_PER_SEGMENT - 1);
-            
-            // Interpolate position
-            float ledX = pBottom.x + (pTop.x - pBottom.x) * t;
-            float ledY = pBottom.y + (pTop.y - pBottom.y) * t;
-            
-            float dx = ledX - center.x;
-            float dy = ledY - center.y;
-            float dist = sqrt(dx*dx + dy*dy);
+            uint8_t dist = distances[LedController::pixelIndex(s, i)];
+            if (dist == Topology::DISTANCE_UNREACHABLE) {
+                leds.setPixelColor(s, i, 0, 0, 0);
+                continue;
+            }
 
             // Calculate wave phase
             float phase = timeSec * speed - dist * phaseFactor;
@@ -10,6 +10,7 @@ public:
 
     void update() override;
     void run() override;
+    RenderContract getRenderContract() const override { return RENDER_OVERWRITE; }
     const char *getName() const override { return "Wave"; }
 };
 
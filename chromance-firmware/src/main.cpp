@@ -20,12 +20,24 @@
 #include "AnimationController.h"
 #include "ChromanceWebServer.h"
 #include "Configuration.h"
+#include "Topology.h"
+#include "WallSync.h"
+#include "WiFiSyncTransport.h"
+#include "PixelReceiver.h"
+#include "WiFiPixelSocket.h"
 
 // Globals
 Configuration configuration;
 LedController ledController;
 AnimationController animationController(ledController, configuration);
 ChromanceWebServer webServer(animationController, configuration);
+RealTimeClock boardClock;
+WiFiSyncTransport syncTransport;
+WallSync wallSync(animationController, syncTransport, boardClock);
+WiFiPixelSocket ddpSocket;
+WiFiPixelSocket e131Socket;
+WiFiPixelSocket artNetSocket;
+PixelReceiver pixelReceiver(ledController, boardClock);
 
 const char *ntpServer = "pool.ntp.org";
 const long gmtOffset_sec = -18000;       // EST is UTC-5 (-5 * 3600)
@@ -207,6 +219,9 @@ void setup()
     Serial.println("An Error has occurred while mounting SPIFFS");
   }
 
+  // A layout file on SPIFFS replaces the stock wall before anything uses it
+  Topology::begin();
+
   // Create mutex semaphore for protecting shared animation state
   ledController.begin();
 
@@ -236,6 +251,19 @@ void setup()
 
   webServer.begin();
 
+  // Every wall listens for a leader; the role decides what it does about it
+  syncTransport.begin();
+  wallSync.begin();
+
+  // Lighting software can take over the pixels at any time
+  ddpSocket.begin(PixelReceiver::DDP_PORT);
+  e131Socket.begin(PixelReceiver::E131_PORT);
+  artNetSocket.begin(PixelReceiver::ARTNET_PORT);
+  pixelReceiver.addInput(ddpSocket, PIXEL_DDP);
+  pixelReceiver.addInput(e131Socket, PIXEL_E131);
+  pixelReceiver.addInput(artNetSocket, PIXEL_ARTNET);
+  webServer.setPixelReceiver(&pixelReceiver);
+
   setupOTA();
 }
 
@@ -256,6 +284,17 @@ void loop()
     return;
   }
 
-  animationController.update();
+  // External pixels win while they keep coming; the web page's commands still
+  // apply so nothing queues up behind them
+  if (pixelReceiver.update())
+  {
+    animationController.processCommands();
+    return;
+  }
+
+  // Renders as before when sync is off. The role is set from the web page,
+  // which applies it on this core inside update().
+  wallSync.setRole(configuration.getSyncRole());
+  wallSync.update();
   // webServer.broadcastLedData(); // Moved to Core 0
 }
@@ -13,14 +13,14 @@ Ripple::Ripple(int id) : rippleId(id)
     // Serial.println(rippleId);
 }
 
-void Ripple::start(int node, int direction, unsigned long color, float speed, unsigned long lifespan, RippleBehavior behavior)
+void Ripple::start(int node, int direction, unsigned long color, float speed, unsigned long lifespan, RippleBehavior behavior, unsigned long now)
 {
     Ripple::color = color;
     Ripple::speed = speed;
     Ripple::lifespan = (lifespan == 0) ? 1 : lifespan;
     Ripple::behavior = behavior;
 
-    birthday = millis();
+    birthday = now;
     pressure = 0;
     state = STATE_WITHIN_NODE;
 
@@ -70,9 +70,9 @@ void Ripple::renderLed(LedController &ledController, unsigned long age)
     ledController.addPixelColor(segment, led, valR, valG, valB);
 }
 
-void Ripple::advance(LedController &ledController)
+void Ripple::advance(LedController &ledController, unsigned long now)
 {
-    unsigned long age = millis() - birthday;
+    unsigned long age = now - birthday;
 
     if (state == STATE_DEAD)
     {
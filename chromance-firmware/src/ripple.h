@@ -34,8 +34,8 @@ class Ripple
 public:
   Ripple(int id = 0); // Default constructor with default ID
 
-  void start(int node, int direction, unsigned long color, float speed, unsigned long lifespan, RippleBehavior behavior);
-  void advance(LedController &ledController);
+  void start(int node, int direction, unsigned long color, float speed, unsigned long lifespan, RippleBehavior behavior, unsigned long now);
+  void advance(LedController &ledController, unsigned long now);
   RippleBehavior getBehavior() const { return behavior; }
 
   RippleState state = STATE_DEAD;
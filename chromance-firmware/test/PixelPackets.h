@@ -0,0 +1,125 @@
+// Builds the DDP, E1.31 and Art-Net packets PixelReceiver reads, for the
+// tests, benchmarks and pixel_blaster.
+
+#ifndef PIXEL_PACKETS_H
+#define PIXEL_PACKETS_H
+
+#include <cstring>
+#include <vector>
+#include "PixelReceiver.h"
+
+namespace PixelPackets
+{
+  typedef std::vector<uint8_t> Packet;
+
+  const int DDP_CHUNK = 1440; // Pixel bytes per DDP packet, 480 LEDs
+  const uint8_t DDP_PUSH = 0x01;
+  const uint8_t E131_PREVIEW = 0x80;
+  const uint8_t E131_TERMINATED = 0x40;
+
+  inline void putBigEndian16(uint8_t *at, uint16_t value)
+  {
+    at[0] = value >> 8;
+    at[1] = value & 0xFF;
+  }
+
+  inline void putBigEndian32(uint8_t *at, uint32_t value)
+  {
+    putBigEndian16(at, value >> 16);
+    putBigEndian16(at + 2, value & 0xFFFF);
+  }
+
+  inline Packet ddp(uint32_t offset, const uint8_t *data, uint16_t length, uint8_t sequence, bool push)
+  {
+    Packet packet(10 + length);
+    packet[0] = 0x40 | (push ? DDP_PUSH : 0);
+    packet[1] = sequence & 0x0F;
+    packet[2] = 0x0B; // RGB, 8 bits each
+    packet[3] = 1;    // Display
+    putBigEndian32(&packet[4], offset);
+    putBigEndian16(&packet[8], length);
+    memcpy(&packet[10], data, length);
+    return packet;
+  }
+
+  inline Packet e131(uint16_t universe, const uint8_t *data, uint16_t length, uint8_t sequence, uint8_t options = 0)
+  {
+    static const char IDENTIFIER[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+    Packet packet(126 + length);
+    uint8_t *p = packet.data();
+    putBigEndian16(p, 0x0010);
+    memcpy(p + 4, IDENTIFIER, sizeof(IDENTIFIER));
+    putBigEndian16(p + 16, 0x7000 | (packet.size() - 16));
+    putBigEndian32(p + 18, 0x00000004);
+    memcpy(p + 22, "chromance-tests!", 16); // CID
+    putBigEndian16(p + 38, 0x7000 | (packet.size() - 38));
+    putBigEndian32(p + 40, 0x00000002);
+    strcpy((char *)p + 44, "pixel_blaster");
+    p[108] = 100; // Priority
+    p[111] = sequence;
+    p[112] = options;
+    putBigEndian16(p + 113, universe);
+    putBigEndian16(p + 115, 0x7000 | (packet.size() - 115));
+    p[117] = 0x02;
+    p[118] = 0xA1;
+    putBigEndian16(p + 121, 1);
+    putBigEndian16(p + 123, length + 1);
+    memcpy(p + 126, data, length);
+    return packet;
+  }
+
+  inline Packet artNet(uint16_t universe, const uint8_t *data, uint16_t length, uint8_t sequence)
+  {
+    Packet packet(18 + length);
+    uint8_t *p = packet.data();
+    memcpy(p, "Art-Net", 8);
+    p[8] = 0x00; // ArtDmx, little endian
+    p[9] = 0x50;
+    putBigEndian16(p + 10, 14);
+    p[12] = sequence;
+    p[14] = universe & 0xFF;
+    p[15] = universe >> 8;
+    putBigEndian16(p + 16, length);
+    memcpy(p + 18, data, length);
+    return packet;
+  }
+
+  // Splits a whole frame (PixelReceiver::FRAME_BYTES) into the packets a
+  // sender would use, advancing sequence as that protocol counts. DDP counts
+  // packets; E1.31 and Art-Net count each universe on its own, so every
+  // universe of a frame carries the same number.
+  inline std::vector<Packet> frame(PixelProtocol protocol, const uint8_t *pixels, uint8_t &sequence)
+  {
+    const int bytes = PixelReceiver::FRAME_BYTES;
+    const int chunk = protocol == PIXEL_DDP ? DDP_CHUNK : PixelReceiver::UNIVERSE_BYTES;
+    if (protocol == PIXEL_E131)
+    {
+      sequence++;
+    }
+    else if (protocol == PIXEL_ARTNET)
+    {
+      sequence = sequence % 255 + 1;
+    }
+    std::vector<Packet> packets;
+    for (int offset = 0, index = 0; offset < bytes; offset += chunk, index++)
+    {
+      uint16_t length = bytes - offset < chunk ? bytes - offset : chunk;
+      switch (protocol)
+      {
+      case PIXEL_DDP:
+        sequence = sequence % 15 + 1;
+        packets.push_back(ddp(offset, pixels + offset, length, sequence, offset + length == bytes));
+        break;
+      case PIXEL_E131:
+        packets.push_back(e131(PixelReceiver::FIRST_E131_UNIVERSE + index, pixels + offset, length, sequence));
+        break;
+      default:
+        packets.push_back(artNet(PixelReceiver::FIRST_ARTNET_UNIVERSE + index, pixels + offset, length, sequence));
+        break;
+      }
+    }
+    return packets;
+  }
+}
+
+#endif // PIXEL_PACKETS_H
@@ -0,0 +1,139 @@
+#ifndef POSIX_UDP_H
+#define POSIX_UDP_H
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "WallSync.h"
+#include "PixelReceiver.h"
+
+// UDP for the native builds, so several emulators on one machine can talk.
+// Broadcast on loopback depends on the OS, so a sender sends each datagram to
+// every peer's port instead.
+//
+// As a PixelSocket it peeks at the start of each datagram for the header, and
+// the read that goes past the peek takes the rest of the datagram straight
+// into the caller's buffer.
+class PosixUdpSocket : public SyncTransport, public PixelSocket
+{
+public:
+  ~PosixUdpSocket() { close(); }
+
+  // Non-blocking; port 0 takes any free port
+  bool open(uint16_t port, const char *address = "127.0.0.1")
+  {
+    close();
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+      return false;
+    }
+    sockaddr_in local = makeAddress(address, port);
+    socklen_t size = sizeof(local);
+    if (bind(fd, (sockaddr *)&local, size) != 0 || getsockname(fd, (sockaddr *)&local, &size) != 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) != 0)
+    {
+      close();
+      return false;
+    }
+    boundPort = ntohs(local.sin_port);
+    return true;
+  }
+
+  void close()
+  {
+    if (fd >= 0)
+    {
+      ::close(fd);
+      fd = -1;
+    }
+    pending = false;
+  }
+
+  uint16_t getPort() const { return boundPort; }
+  void addPeer(uint16_t port, const char *address = "127.0.0.1") { peers.push_back(makeAddress(address, port)); }
+
+  bool send(const uint8_t *data, size_t length) override
+  {
+    bool sent = !peers.empty();
+    for (const sockaddr_in &peer : peers)
+    {
+      sent &= sendto(fd, data, length, 0, (const sockaddr *)&peer, sizeof(peer)) == (ssize_t)length;
+    }
+    return sent;
+  }
+
+  int receive(uint8_t *data, size_t capacity) override
+  {
+    ssize_t length = recv(fd, data, capacity, 0);
+    return length > 0 ? (int)length : 0;
+  }
+
+  int next(uint32_t &source) override
+  {
+    if (pending)
+    {
+      recv(fd, peek, 1, 0); // Drops the rest of the last datagram
+      pending = false;
+    }
+    sockaddr_in from = {};
+    socklen_t size = sizeof(from);
+    ssize_t length = recvfrom(fd, peek, sizeof(peek), MSG_PEEK | MSG_TRUNC, (sockaddr *)&from, &size);
+    if (length <= 0)
+    {
+      return 0;
+    }
+    pending = true;
+    peeked = (size_t)length < sizeof(peek) ? (size_t)length : sizeof(peek);
+    position = 0;
+    source = from.sin_addr.s_addr;
+    return (int)length;
+  }
+
+  int read(uint8_t *data, size_t length) override
+  {
+    if (!pending)
+    {
+      return 0;
+    }
+    if (position + length <= peeked)
+    {
+      memcpy(data, peek + position, length);
+      position += length;
+      return (int)length;
+    }
+    // Take the datagram, dropping the part already read into the peek buffer
+    iovec parts[2] = {{peek, position}, {data, length}};
+    msghdr message = {};
+    message.msg_iov = parts;
+    message.msg_iovlen = 2;
+    ssize_t received = recvmsg(fd, &message, 0);
+    pending = false;
+    return received > (ssize_t)position ? (int)(received - position) : 0;
+  }
+
+private:
+  int fd = -1;
+  uint16_t boundPort = 0;
+  std::vector<sockaddr_in> peers;
+  uint8_t peek[128]; // Holds the longest pixel protocol header
+  size_t peeked = 0;
+  size_t position = 0;
+  bool pending = false; // A datagram has been peeked at but not taken
+
+  static sockaddr_in makeAddress(const char *address, uint16_t port)
+  {
+    sockaddr_in result = {};
+    result.sin_family = AF_INET;
+    result.sin_port = htons(port);
+    inet_pton(AF_INET, address, &result.sin_addr);
+    return result;
+  }
+};
+
+#endif // POSIX_UDP_H
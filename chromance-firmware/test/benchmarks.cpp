@@ -0,0 +1,893 @@
+// Native micro-benchmarks. Timings are host numbers: compare them with each
+// other, not with the ESP32.
+//
+//   make bench && ./benchmarks
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "Arduino.h"
+#include "AnimationController.h"
+#include "animations/Animation.h"
+#include "LedController.h"
+#include "Configuration.h"
+#include "Clock.h"
+#include "Sequence.h"
+#include "Topology.h"
+#include "TopologyLayout.h"
+#include "FrameDiff.h"
+#include "SpatialIndex.h"
+#include "GraphParticles.h"
+#include "GraphField.h"
+#include "GraphAutomaton.h"
+#include "Noise.h"
+#include "Palette.h"
+#include "animations/ShaderAnimation.h"
+#include "Canvas.h"
+#include "WallSync.h"
+#include "PixelReceiver.h"
+#include "PixelPackets.h"
+#include "mocks/SPIFFS.h"
+#include "reference_kernels.h"
+
+namespace ArduinoMock
+{
+  unsigned long _millis = 0;
+}
+HardwareSerial Serial;
+SPIFFSFS SPIFFS;
+
+// Keeps results alive so the optimiser cannot drop the work being timed
+static volatile uint32_t sink;
+
+template <typename F>
+static double timeIt(long iterations, F body)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; i++)
+  {
+    body();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+}
+
+static void report(const std::string &name, double microsPerOp, const std::string &unit = "frame")
+{
+  std::cout << "  " << std::left << std::setw(44) << name << std::right << std::setw(10) << std::fixed
+            << std::setprecision(2) << microsPerOp << " us/" << unit << std::endl;
+}
+
+// Runs one animation on a virtual clock
+struct Harness
+{
+  LedController ledController;
+  Configuration configuration;
+  AnimationController controller;
+  VirtualClock clock;
+  Animation *animation = nullptr;
+
+  Harness(const char *name) : controller(ledController, configuration), clock(33)
+  {
+    std::srand(12345);
+    controller.setClock(clock);
+    ledController.begin();
+    controller.init();
+    controller.setAutoSwitching(false);
+    for (int i = 0; i < controller.getAnimationCount(); i++)
+    {
+      if (std::string(controller.getAnimation(i)->getName()) == name)
+      {
+        animation = controller.getAnimation(i);
+        controller.startAnimation(i);
+      }
+    }
+  }
+
+  // Whole controller frame: passes, animation, ripples, show()
+  void frame()
+  {
+    controller.update();
+    clock.step();
+  }
+
+  // Only the animation's own update()
+  void render()
+  {
+    animation->update();
+    clock.step();
+  }
+
+  const byte *pixels() { return ledController.ledColors; }
+};
+
+class VectorSequenceSink : public SequenceSink
+{
+public:
+  std::vector<uint8_t> data;
+  bool write(const uint8_t *bytes, size_t length) override
+  {
+    data.insert(data.end(), bytes, bytes + length);
+    return true;
+  }
+};
+
+static void benchSequencePlayback()
+{
+  std::cout << "Sequence playback" << std::endl;
+
+  const char *effects[] = {"Plasma", "Inferno", "Rainbow"};
+  const int frames = 300;
+
+  for (const char *effect : effects)
+  {
+    Harness live(effect);
+    report(std::string(effect) + " live update()", timeIt(frames, [&]()
+                                                          { live.render(); }));
+
+    Harness recorded(effect);
+    static SequenceEncoder encoder;
+    VectorSequenceSink out;
+    encoder.begin(out, 33);
+    for (int f = 0; f < frames; f++)
+    {
+      recorded.frame();
+      encoder.addFrame(recorded.pixels());
+    }
+    encoder.finish();
+
+    static SequenceDecoder decoder;
+    static byte rgb[Constants::NUM_OF_PIXELS * 3];
+    MemorySequenceSource source(out.data.data(), out.data.size());
+    decoder.begin(source);
+    double decode = timeIt(frames * 20, [&]()
+                           {
+      if (!decoder.nextFrame()) {
+        decoder.rewind();
+        decoder.nextFrame();
+      }
+      decoder.render(rgb);
+      sink = sink + rgb[0]; });
+    report(std::string(effect) + " decode + render", decode);
+    std::cout << "    " << out.data.size() / frames << " bytes/frame vs " << Constants::NUM_OF_PIXELS * 3 << " raw" << std::endl;
+  }
+}
+
+// The stock wall from flash against the same wall loaded as a layout file:
+// animations should not notice where the tables live
+static void benchTopologyLayout()
+{
+  std::cout << "Topology layout" << std::endl;
+
+  static TopologyLayout loaded;
+  loaded.loadStock();
+  const int frames = 300;
+  const char *effects[] = {"Water Pour", "Wave", "Plasma", "Snake"};
+
+  for (const char *effect : effects)
+  {
+    Topology::setLayout(nullptr);
+    Harness stock(effect);
+    report(std::string(effect) + " stock", timeIt(frames, [&]()
+                                                  { stock.frame(); }));
+
+    Topology::setLayout(&loaded);
+    Harness custom(effect);
+    report(std::string(effect) + " loaded", timeIt(frames, [&]()
+                                                   { custom.frame(); }));
+  }
+  Topology::setLayout(nullptr);
+
+  const int nodes = Constants::NUMBER_OF_NODES;
+  report("getNextStep, all pairs", timeIt(2000, [&]()
+                                         {
+    for (int a = 0; a < nodes; a++)
+      for (int b = 0; b < nodes; b++)
+        sink = sink + Topology::getNextStep(a, b); }), "table");
+
+  static TopologyLayout parsed;
+  static uint8_t binary[4096];
+  size_t size = loaded.writeBinary(binary, sizeof(binary));
+  report("Load + validate binary layout", timeIt(200, [&]()
+                                                { sink = sink + parsed.loadBinary(binary, size); }), "load");
+}
+
+// Radial effects read a per-node distance field instead of measuring each LED
+static void benchDistanceFields()
+{
+  std::cout << "Distance fields" << std::endl;
+
+  report("Build one node's field", timeIt(200, [&]()
+                                         {
+    Topology::setLayout(nullptr); // Drops the cached fields
+    sink = sink + Topology::getDistanceField(Topology::starburstNode)[0]; }), "field");
+
+  const char *effects[] = {"Rainbow Radiate", "Wave", "Bio Pulse", "Searchlight"};
+  for (const char *effect : effects)
+  {
+    Harness harness(effect);
+    report(std::string(effect) + " update()", timeIt(300, [&]()
+                                                     { harness.render(); }));
+  }
+}
+
+// Brute force: test every LED, building the same spans the index returns
+template <typename Test>
+static int scanAllLeds(Test test, LedSpan *out, int capacity)
+{
+  int written = 0;
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+  {
+    bool open = false;
+    for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
+    {
+      if (!test(Topology::getLedPosition(s, led)))
+      {
+        open = false;
+      }
+      else if (open)
+      {
+        out[written - 1].count++;
+      }
+      else if (written < capacity)
+      {
+        LedSpan span = {s, led, 1};
+        out[written++] = span;
+        open = true;
+      }
+    }
+  }
+  return written;
+}
+
+static void benchSpatialIndex()
+{
+  std::cout << "Spatial index vs testing every LED" << std::endl;
+
+  const SpatialIndex &index = Topology::getSpatialIndex();
+  static LedSpan spans[Constants::NUM_OF_PIXELS];
+  const int queries = 20000;
+  const NodePosition &center = Topology::nodePositions[Topology::starburstNode];
+  float x = center.x;
+  float y = center.y;
+
+  // A firework flash
+  float radius = 7.0f;
+  report("Radius 7, index", timeIt(queries, [&]()
+                                   { sink = sink + index.queryRadius(x, y, radius, spans, Constants::NUM_OF_PIXELS); }),
+         "query");
+  report("Radius 7, every LED", timeIt(queries, [&]()
+                                       { sink = sink + scanAllLeds([&](const LedPosition &p)
+                                                                   {
+        float dx = p.x - x;
+        float dy = p.y - y;
+        return dx * dx + dy * dy <= radius * radius; }, spans, Constants::NUM_OF_PIXELS); }),
+         "query");
+
+  // A band across the wall
+  report("Rectangle 20 x 6, index", timeIt(queries, [&]()
+                                           { sink = sink + index.queryRect(x - 10, y - 3, x + 10, y + 3, spans, Constants::NUM_OF_PIXELS); }),
+         "query");
+  report("Rectangle 20 x 6, every LED", timeIt(queries, [&]()
+                                               { sink = sink + scanAllLeds([&](const LedPosition &p)
+                                                                           { return p.x >= x - 10 && p.x <= x + 10 && p.y >= y - 3 && p.y <= y + 3; },
+                                                                           spans, Constants::NUM_OF_PIXELS); }),
+         "query");
+
+  // The Searchlight beam, compared with atan2 per LED
+  float angle = 0.7f;
+  float halfWidth = 0.4f;
+  report("Sector 0.8 rad, index", timeIt(queries, [&]()
+                                         { sink = sink + index.querySector(x, y, angle, halfWidth, SpatialIndex::ANY_DISTANCE, spans,
+                                                                           Constants::NUM_OF_PIXELS); }),
+         "query");
+  report("Sector 0.8 rad, every LED", timeIt(queries, [&]()
+                                             { sink = sink + scanAllLeds([&](const LedPosition &p)
+                                                                         {
+        float diff = std::fabs(std::remainder(std::atan2(p.y - y, p.x - x) - angle, 2 * (float)M_PI));
+        return diff <= halfWidth; }, spans, Constants::NUM_OF_PIXELS); }),
+         "query");
+}
+
+// The stock shape with LEDS_PER_SEGMENT physical LEDs on every segment, dealt
+// round-robin onto SCALE_STRIPS outputs, so the strips carry as many LEDs as
+// the frame buffer has pixels. `make bench_scale` builds this at 560, 5000
+// and 10000 LEDs.
+static const int SCALE_STRIPS = 16;
+
+static bool loadScaledLayout(TopologyLayout &layout)
+{
+  TopologyLayout stock;
+  if (!stock.loadStock())
+  {
+    return false;
+  }
+  JsonDocument doc;
+  JsonObject root = doc.to<JsonObject>();
+  stock.writeJson(root);
+
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  const int segmentsPerStrip = (Constants::NUMBER_OF_SEGMENTS + SCALE_STRIPS - 1) / SCALE_STRIPS;
+  JsonArray segments = doc["segments"];
+  for (int s = 0; s < (int)segments.size(); s++)
+  {
+    JsonObject segment = segments[s];
+    int first = (s / SCALE_STRIPS) * leds;
+    segment["strip"] = s % SCALE_STRIPS;
+    segment["floorLed"] = first;
+    segment["ceilingLed"] = first + leds - 1;
+  }
+  JsonArray strips = doc["strips"].to<JsonArray>();
+  for (int i = 0; i < SCALE_STRIPS; i++)
+  {
+    JsonObject strip = strips.add<JsonObject>();
+    strip["length"] = segmentsPerStrip * leds;
+    strip["pin"] = i;
+  }
+
+  std::string json;
+  serializeJson(doc, json);
+  return layout.loadJson(json.data(), json.size());
+}
+
+static void reportPerLed(const std::string &name, double microsPerFrame)
+{
+  report(name, microsPerFrame);
+  std::cout << "    " << std::fixed << std::setprecision(1) << microsPerFrame * 1000.0 / Constants::NUM_OF_PIXELS
+            << " ns/LED" << std::endl;
+}
+
+// Each stage of a frame at this build's LED count. Per-LED cost should stay
+// flat as the wall grows.
+static void benchPipeline()
+{
+  static TopologyLayout scaled;
+  if (!loadScaledLayout(scaled))
+  {
+    std::cout << "Scaled layout rejected: " << scaled.getError() << std::endl;
+    return;
+  }
+  Topology::setLayout(&scaled);
+
+  std::cout << "Pipeline at " << Constants::NUM_OF_PIXELS << " LEDs (" << Constants::NUMBER_OF_SEGMENTS << " x "
+            << Constants::LEDS_PER_SEGMENT << ", " << SCALE_STRIPS << " strips)" << std::endl;
+
+  const int frames = 200;
+  {
+    Harness plasma("Plasma");
+    reportPerLed("Plasma update()", timeIt(frames, [&]()
+                                           { plasma.render(); }));
+    reportPerLed("Whole controller frame (Plasma)", timeIt(frames, [&]()
+                                                           { plasma.frame(); }));
+
+    LedController &leds = plasma.ledController;
+    leds.rainbow();
+    reportPerLed("fade()", timeIt(frames * 10, [&]()
+                                  { sink = sink + leds.fade(0.99f); }));
+    leds.rainbow();
+    reportPerLed("show() (power limit, routing, strips)", timeIt(frames, [&]()
+                                                                 { leds.show(); }));
+  }
+
+  // Emulator stream: a dense effect changes nearly every pixel, a sparse one a few
+  const char *effects[] = {"Plasma", "Water Pour"};
+  for (const char *effect : effects)
+  {
+    Harness harness(effect);
+    std::vector<std::vector<uint8_t>> recorded;
+    for (int f = 0; f < 100; f++)
+    {
+      harness.frame(); // Let walkers spread out
+    }
+    for (int f = 0; f < 16; f++)
+    {
+      harness.frame();
+      recorded.push_back(std::vector<uint8_t>(harness.pixels(), harness.pixels() + Constants::NUM_OF_PIXELS * 3));
+    }
+
+    static FrameDiffEncoder encoder;
+    encoder.begin(Constants::NUM_OF_PIXELS);
+    size_t bytes = 0;
+    int next = 0;
+    double micros = timeIt(frames * 4, [&]()
+                           {
+      bytes += encoder.encode(recorded[next].data());
+      next = (next + 1) % recorded.size(); });
+    reportPerLed(std::string("FrameDiff encode (") + effect + ")", micros);
+    std::cout << "    " << bytes / (frames * 4) << " bytes/frame vs " << Constants::NUM_OF_PIXELS * 3 + 1 << " full"
+              << std::endl;
+  }
+
+  Topology::setLayout(nullptr);
+}
+
+// Table-driven kernels against the float code they replaced
+static void benchKernels()
+{
+  std::cout << "Kernels vs float reference" << std::endl;
+
+  Harness plasma("Plasma");
+  report("Plasma update(), tables", timeIt(2000, [&]()
+                                           { plasma.render(); }));
+  report("Plasma, float reference", timeIt(2000, [&]()
+                                           {
+    Reference::plasma(plasma.ledController, plasma.clock.now());
+    plasma.clock.step(); }));
+
+  Harness radiate("Rainbow Radiate");
+  report("Rainbow Radiate update(), cached offsets", timeIt(2000, [&]()
+                                                             { radiate.render(); }));
+  report("Rainbow Radiate, float reference", timeIt(2000, [&]()
+                                                    {
+    Reference::rainbowRadiate(radiate.ledController, radiate.configuration.getRainbowBrightness(), radiate.clock.now());
+    radiate.clock.step(); }));
+
+  Harness pinwheel("Rainbow Pinwheel");
+  report("Rainbow Pinwheel update(), cached angles", timeIt(2000, [&]()
+                                                            { pinwheel.render(); }));
+  report("Rainbow Pinwheel, float reference", timeIt(2000, [&]()
+                                                     {
+    Reference::rainbowPinwheel(pinwheel.ledController, pinwheel.configuration.getRainbowBrightness(), pinwheel.clock.now(), 1);
+    pinwheel.clock.step(); }));
+
+  // Timed while the fire is burning; each run() lasts about 9 seconds of frames
+  Harness inferno("Inferno");
+  report("Inferno update(), integer solver", timeIt(250, [&]()
+                                                    { inferno.render(); }));
+  Reference::Inferno fire;
+  report("Inferno, float reference", timeIt(250, [&]()
+                                            { sink = sink + fire.update(inferno.ledController, true); }));
+  std::cout << "  Inferno state: " << sizeof(uint16_t) * Constants::NUM_OF_PIXELS << " bytes, was "
+            << 2 * sizeof(float) * Constants::NUM_OF_PIXELS << " (heat and per-frame copy)" << std::endl;
+
+  // Heat to colour: a palette read against the float curve it replaced
+  const Palette &heat = Palettes::get(Palettes::HEAT);
+  report("Heat colours, palette", timeIt(2000, [&]()
+                                         {
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+      sink = sink + heat.lookup(p & 255)[1]; }));
+  report("Heat colours, float reference", timeIt(2000, [&]()
+                                                 {
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+      sink = sink + Reference::heatColor((p & 255) / 255.0f); }));
+  // Only paid while a newly chosen palette fades in
+  Palette mixed;
+  int amount = 0;
+  report("Palette blend(), a frame of a fade", timeIt(2000, [&]()
+                                                      {
+    mixed.blend(heat, Palettes::get(Palettes::OCEAN), amount++ & 255);
+    sink = sink + mixed.lookup(128)[0]; }));
+}
+
+static void benchParticles()
+{
+  std::cout << "Particles: GraphParticles vs hand-rolled" << std::endl;
+
+  // Whole update()s, timed once the effects have filled up
+  Harness water("Water Pour");
+  Reference::WaterPour handWater;
+  for (int f = 0; f < 300; f++)
+  {
+    water.render();
+    handWater.update(water.ledController, water.clock.now());
+  }
+  report("Water Pour update()", timeIt(2000, [&]()
+                                       { water.render(); }));
+  double drops = 0;
+  report("Water Pour, hand-rolled", timeIt(2000, [&]()
+                                           {
+    handWater.update(water.ledController, water.clock.now());
+    drops += handWater.size(); }));
+  std::cout << "  (" << std::setprecision(1) << drops / 2000 << " drops a frame)" << std::endl;
+
+  Harness balls("Bouncing Balls");
+  Reference::BouncingBalls<8> handBalls;
+  for (int i = 0; i < 5; i++)
+  {
+    handBalls.spawn(0xFF0000);
+  }
+  report("Bouncing Balls update()", timeIt(2000, [&]()
+                                           { balls.render(); }));
+  report("Bouncing Balls, hand-rolled", timeIt(2000, [&]()
+                                               { handBalls.update(balls.ledController, 0xFF0000); }));
+
+  Harness fireflies("Fireflies");
+  Reference::Fireflies handFlies;
+  report("Fireflies update()", timeIt(2000, [&]()
+                                      { fireflies.render(); }));
+  report("Fireflies, hand-rolled", timeIt(2000, [&]()
+                                          { handFlies.update(fireflies.ledController); }));
+
+  // A crowd of balls, topped up every frame, to time the cost per particle
+  const int CROWD = 512;
+  GraphParticles crowd(CROWD);
+  Bounce floorBounce(0.8f, 0.02f);
+  Bounce ceilingBounce(0.5f);
+  RandomOnward falling(&floorBounce);
+  RandomOnward rising(&ceilingBounce);
+  crowd.setPhysics(0.005f, 0.0f);
+  crowd.setJunctions(&falling, &rising);
+  double moved = 0;
+  double engine = timeIt(1000, [&]()
+                         {
+    while (crowd.size() < CROWD)
+    {
+      const PathList &paths = Topology::getDownPaths(random(3));
+      int b = crowd.spawn(paths.segments[random(paths.count)], 0.0f, 0.0f);
+      crowd.setColor(b, 0xFF0000);
+    }
+    crowd.step();
+    crowd.draw(balls.ledController, 2, 128, 0.1f);
+    moved += crowd.size(); });
+  report("512 balls, GraphParticles", engine);
+  std::cout << "  (" << std::setprecision(1) << engine * 1000 * 1000 / moved << " ns a ball)" << std::endl;
+  Reference::BouncingBalls<CROWD> handCrowd;
+  moved = 0;
+  double hand = timeIt(1000, [&]()
+                       {
+    while (handCrowd.size() < CROWD)
+    {
+      handCrowd.spawn(0xFF0000);
+    }
+    handCrowd.update(balls.ledController, 0xFF0000);
+    moved += handCrowd.size(); });
+  report("512 balls, hand-rolled", hand);
+  std::cout << "  (" << std::setprecision(1) << hand * 1000 * 1000 / moved << " ns a ball)" << std::endl;
+  std::cout << std::setprecision(2);
+}
+
+static void benchFields()
+{
+  std::cout << "Fields: GraphField over " << Constants::NUM_OF_PIXELS << " LEDs" << std::endl;
+
+  GraphField field(2);
+  field.fill(0, GraphField::ONE);
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p += 37)
+  {
+    field.get(1)[p] = 32768;
+  }
+  field.setFlow(0.0f, -1.0f);
+  GraphField::GrayScott chemistry = {32768, 16384, 918, 3080};
+  report("diffuse()", timeIt(5000, [&]()
+                              { field.diffuse(0, 16384); }),
+         "step");
+  report("advect()", timeIt(5000, [&]()
+                             { field.advect(1, 16384); }),
+         "step");
+  report("grayScott(), two species", timeIt(5000, [&]()
+                                              { field.grayScott(chemistry, 0, 1); }),
+         "step");
+
+  // A 60 fps frame leaves 16667 us for everything
+  Harness reaction("Reaction Diffusion");
+  for (int f = 0; f < 100; f++)
+  {
+    reaction.render();
+  }
+  report("Reaction Diffusion update()", timeIt(1000, [&]()
+                                              { reaction.render(); }));
+}
+
+static void benchAutomata()
+{
+  std::cout << "Automata: GraphAutomaton, one LED a cell" << std::endl;
+
+  GraphAutomaton cells;
+  const uint16_t birth = (1 << 2) | (1 << 3);
+  const uint16_t survive = (1 << 1) | (1 << 2);
+  struct
+  {
+    const char *name;
+    int reach;
+    int states;
+  } rules[] = {{"Life", 2, 2}, {"Brian's Brain", 3, 3}, {"Cyclic, 6 states", 3, 6}};
+  for (int r = 0; r < 3; r++)
+  {
+    cells.useLeds(rules[r].reach);
+    std::srand(12345);
+    cells.randomize(rules[r].states, 30);
+    double us = timeIt(20000, [&]()
+                       {
+      if (r == 0)
+        cells.stepLife(birth, survive);
+      else if (r == 1)
+        cells.stepBriansBrain(birth);
+      else
+        cells.stepCyclic(6, 1);
+      sink = cells.countLive(); });
+    report(rules[r].name, us, "generation");
+    std::cout << "  (" << std::setprecision(0) << 1e6 / us << " generations a second)" << std::setprecision(2)
+              << std::endl;
+  }
+}
+
+static void benchNoise()
+{
+  std::cout << "Noise: Perlin noise over " << Constants::NUM_OF_PIXELS << " LEDs" << std::endl;
+
+  NoiseMap map;
+  map.prepare(1.0f / 16.0f);
+  uint8_t out[Constants::NUM_OF_PIXELS];
+  uint32_t t = 0;
+  report("NoiseMap 2D fill()", timeIt(5000, [&]()
+                                      {
+    map.fill(t * 20, t * 12, out);
+    sink = out[t++ % Constants::NUM_OF_PIXELS]; }),
+         "frame");
+  report("NoiseMap 3D fill()", timeIt(5000, [&]()
+                                      {
+    map.fill(t * 20, t * 12, t * 16, out);
+    sink = out[t++ % Constants::NUM_OF_PIXELS]; }),
+         "frame");
+
+  // Two 3D fills a frame, against the sine waves of Plasma
+  Harness flow("Noise Flow");
+  report("Noise Flow update()", timeIt(2000, [&]()
+                                       { flow.render(); }));
+  Harness plasma("Plasma");
+  report("Plasma update(), tables", timeIt(2000, [&]()
+                                           { plasma.render(); }));
+  report("Plasma, float reference", timeIt(2000, [&]()
+                                           {
+    Reference::plasma(plasma.ledController, plasma.clock.now());
+    plasma.clock.step(); }));
+}
+
+static void benchShader()
+{
+  std::cout << "Shader: bytecode run on " << Constants::NUM_OF_PIXELS << " LEDs" << std::endl;
+
+  // Short, the built-in one, something plasma-like, and noise with lets
+  const char *shaders[][2] = {
+      {"gradient", "rgb(x, y, 0)"},
+      {"built-in rings", ShaderAnimation::DEFAULT_SOURCE},
+      {"plasma", "hsv(sin(x * 2 + t * 0.2) + sin(y * 3 - t * 0.3) + sin(r * 4 + t * 0.1), 1, 1)"},
+      {"noise", "let n = noise(x * 5, y * 2, t * 0.5);\nlet v = clamp((n - 0.45) * 4, 0, 1);\n"
+                "hsv(n * 2 + t * 0.05, 1, v * v)"},
+  };
+  Harness harness("Shader");
+  ShaderAnimation *shader = static_cast<ShaderAnimation *>(harness.animation);
+  for (auto &entry : shaders)
+  {
+    if (!shader->load(entry[1]))
+    {
+      std::cout << "  " << entry[0] << ": " << shader->getCompiler().getError() << std::endl;
+      continue;
+    }
+    int instructions = shader->getProgram().getInstructionCount();
+    double micros = timeIt(2000, [&]()
+                           { harness.render(); });
+    report(std::string("Shader update(), ") + entry[0] + " (" + std::to_string(instructions) + " ops)", micros);
+    std::cout << "  " << std::left << std::setw(44) << "  instructions" << std::right << std::setw(10)
+              << std::fixed << std::setprecision(1)
+              << instructions * (double)Constants::NUM_OF_PIXELS / micros << " M/s" << std::endl;
+  }
+
+  // Compiling happens once per upload
+  ShaderCompiler compiler;
+  ShaderProgram program;
+  report("ShaderCompiler compile(), noise", timeIt(20000, [&]()
+                                                   { sink = compiler.compile(shaders[3][1], program); }),
+         "shader");
+}
+
+static void benchCanvas()
+{
+  std::cout << "Canvas: anti-aliased shapes on " << Constants::NUM_OF_PIXELS << " LEDs" << std::endl;
+
+  static byte pixels[Constants::NUM_OF_PIXELS * 3];
+  Canvas canvas(pixels);
+  const NodePosition &center = Topology::nodePositions[Topology::starburstNode];
+  const float x = center.x;
+  const float y = center.y;
+  const uint32_t color = 0xFF8000;
+
+  // Coverage of every LED worked out directly, as an effect without the
+  // canvas would, against the canvas visiting only what the index returns
+  auto everyLed = [&](float (*edge)(const LedPosition &, float, float))
+  {
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+    {
+      float coverage = edge(Topology::getLedPosition(p / Constants::LEDS_PER_SEGMENT, p % Constants::LEDS_PER_SEGMENT), x, y) + 0.5f;
+      if (coverage > 0)
+      {
+        byte *pixel = pixels + p * 3;
+        int alpha = (int)((coverage < 1 ? coverage : 1) * 255);
+        pixel[0] = (byte)(pixel[0] + ((255 - pixel[0]) * alpha) / 255);
+      }
+    }
+  };
+
+  const int iterations = 20000;
+  report("Line 30 long, canvas", timeIt(iterations, [&]()
+                                        { canvas.line(x - 15, y - 4, x + 15, y + 4, 1.5f, color); }),
+         "shape");
+  report("Line 30 long, every LED", timeIt(iterations, [&]()
+                                           { everyLed([](const LedPosition &p, float x, float y)
+                                                      {
+    float dx = 30, dy = 8;
+    float t = ((p.x - x + 15) * dx + (p.y - y + 4) * dy) / (dx * dx + dy * dy);
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    return 0.75f - hypotf(p.x - x + 15 - t * dx, p.y - y + 4 - t * dy); }); }),
+         "shape");
+  report("Disc radius 7, canvas", timeIt(iterations, [&]()
+                                         { canvas.disc(x, y, 7.0f, color); }),
+         "shape");
+  report("Disc radius 7, every LED", timeIt(iterations, [&]()
+                                            { everyLed([](const LedPosition &p, float x, float y)
+                                                       { return 7.0f - hypotf(p.x - x, p.y - y); }); }),
+         "shape");
+  report("Ring radius 12, canvas", timeIt(iterations, [&]()
+                                          { canvas.ring(x, y, 12.0f, 2.0f, color); }),
+         "shape");
+  report("Ring radius 12, every LED", timeIt(iterations, [&]()
+                                             { everyLed([](const LedPosition &p, float x, float y)
+                                                        { return 1.0f - fabsf(hypotf(p.x - x, p.y - y) - 12.0f); }); }),
+         "shape");
+  const LedPosition hexagon[] = {{x + 10, y}, {x + 5, y + 8}, {x - 5, y + 8}, {x - 10, y}, {x - 5, y - 8}, {x + 5, y - 8}};
+  report("Hexagon 20 wide, canvas", timeIt(iterations, [&]()
+                                           { canvas.polygon(hexagon, 6, color); }),
+         "shape");
+  std::cout << "    (LEDs tested per shape: " << canvas.getLastTested() << ")" << std::endl;
+
+  Harness shapes("Shapes");
+  report("Shapes update()", timeIt(2000, [&]()
+                                   { shapes.render(); }));
+}
+
+// Carries a leader's packets straight to one follower
+class BenchTransport : public SyncTransport
+{
+public:
+  std::vector<std::vector<uint8_t>> queue;
+  size_t next = 0;
+  unsigned long bytes = 0;
+
+  bool send(const uint8_t *data, size_t length) override
+  {
+    queue.push_back(std::vector<uint8_t>(data, data + length));
+    bytes += length;
+    return true;
+  }
+  int receive(uint8_t *data, size_t capacity) override
+  {
+    if (next == queue.size())
+    {
+      queue.clear();
+      next = 0;
+      return 0;
+    }
+    memcpy(data, queue[next].data(), queue[next].size());
+    return (int)queue[next++].size();
+  }
+};
+
+static void benchWallSync()
+{
+  std::cout << "Wall sync: a leader and a follower over an in-memory network" << std::endl;
+
+  // Lockstep sends a state packet a few times a second; streaming sends the
+  // pixels of every frame
+  for (int streaming = 0; streaming < 2; streaming++)
+  {
+    LedController leaderLeds, followerLeds;
+    Configuration leaderConfiguration, followerConfiguration;
+    AnimationController leader(leaderLeds, leaderConfiguration), follower(followerLeds, followerConfiguration);
+    VirtualClock clock(1);
+    BenchTransport network;
+    WallSync leaderSync(leader, network, clock);
+    WallSync followerSync(follower, network, clock);
+    std::srand(12345);
+    leaderLeds.begin();
+    followerLeds.begin();
+    leader.init();
+    follower.init();
+    leaderSync.begin();
+    followerSync.begin();
+    leaderSync.setRole(streaming ? SYNC_STREAM : SYNC_LEADER);
+    followerSync.setRole(SYNC_FOLLOWER);
+
+    // Polled every millisecond, as the firmware's loop() does
+    const long frames = 300;
+    double micros = timeIt(frames * WallSync::FRAME_MILLIS, [&]()
+                           {
+      clock.advance(1);
+      leaderSync.update();
+      followerSync.update(); });
+    const char *mode = streaming ? "Stream" : "Lockstep";
+    report(std::string(mode) + ", leader + follower", micros * WallSync::FRAME_MILLIS);
+    std::cout << "    (" << network.bytes * 1000 / (frames * WallSync::FRAME_MILLIS) << " bytes/s to each follower)"
+              << std::endl;
+  }
+}
+
+// Hands out one frame's packets per update(), cycling through a recording
+class BenchPixelSocket : public PixelSocket
+{
+public:
+  std::vector<std::vector<PixelPackets::Packet>> frames;
+  size_t frame = 0;
+  size_t packet = 0;
+  size_t position = 0;
+  const PixelPackets::Packet *current = nullptr;
+
+  int next(uint32_t &source) override
+  {
+    if (packet == frames[frame].size())
+    {
+      frame = (frame + 1) % frames.size();
+      packet = 0;
+      return 0;
+    }
+    current = &frames[frame][packet++];
+    position = 0;
+    source = 0x0100007F;
+    return (int)current->size();
+  }
+  int read(uint8_t *data, size_t length) override
+  {
+    memcpy(data, current->data() + position, length);
+    position += length;
+    return (int)length;
+  }
+};
+
+static void benchPixelReceiver()
+{
+  std::cout << "Pixel receiver: one frame read into ledColors and shown" << std::endl;
+  LedController ledController;
+  ledController.begin();
+  VirtualClock clock(16);
+  report("show() alone", timeIt(2000, [&]()
+                                { ledController.show(); }));
+
+  for (int protocol = 0; protocol < PIXEL_PROTOCOL_COUNT; protocol++)
+  {
+    // Going round the recording again steps the sequence back 63, too far to
+    // look stale to E1.31
+    BenchPixelSocket socket;
+    uint8_t sequence = 0;
+    std::vector<uint8_t> pixels(PixelReceiver::FRAME_BYTES);
+    for (int f = 0; f < 64; f++)
+    {
+      for (size_t i = 0; i < pixels.size(); i++)
+        pixels[i] = (uint8_t)(i * 7 + f);
+      socket.frames.push_back(PixelPackets::frame((PixelProtocol)protocol, pixels.data(), sequence));
+    }
+    PixelReceiver receiver(ledController, clock);
+    receiver.addInput(socket, (PixelProtocol)protocol);
+    double micros = timeIt(2000, [&]()
+                           {
+      clock.step();
+      receiver.update(); });
+    report(std::string(PixelReceiver::getProtocolName((PixelProtocol)protocol)) + " (" +
+               std::to_string(socket.frames[0].size()) + " packets)",
+           micros);
+    sink = receiver.getSource(0).frames;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // --scale runs only the pipeline, which is all a resized build can run
+  if (argc < 2 || std::string(argv[1]) != "--scale")
+  {
+    benchSequencePlayback();
+    benchTopologyLayout();
+    benchDistanceFields();
+    benchSpatialIndex();
+    benchKernels();
+    benchParticles();
+    benchFields();
+    benchAutomata();
+    benchNoise();
+    benchShader();
+    benchCanvas();
+    benchWallSync();
+    benchPixelReceiver();
+  }
+  benchPipeline();
+  return 0;
+}
@@ -8,6 +8,7 @@
 #include <string>
 #include <vector>
 #include <cmath>
+#include <chrono>
 
 // Types
 typedef uint8_t byte;
@@ -33,11 +34,27 @@ inline unsigned long millis()
   return ArduinoMock::_millis;
 }
 
+// Unlike millis(), micros() reports host time so profiling code measures real cost
+inline unsigned long micros()
+{
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
 inline void delay(unsigned long ms)
 {
   ArduinoMock::advanceMillis(ms);
 }
 
+// Like the ESP32 core: zero keeps the current sequence
+inline void randomSeed(unsigned long seed)
+{
+  if (seed != 0)
+  {
+    std::srand(seed);
+  }
+}
+
 inline long random(long max)
 {
   return std::rand() % max;
@@ -19,10 +19,10 @@ public:
     File(const std::string& p, const char* mode) : path(p) {
         if (std::string(mode) == "w") {
             writeMode = true;
-            fs.open(path, std::ios::out | std::ios::trunc);
+            fs.open(path, std::ios::out | std::ios::trunc | std::ios::binary);
         } else {
             writeMode = false;
-            fs.open(path, std::ios::in);
+            fs.open(path, std::ios::in | std::ios::binary);
         }
     }
 
@@ -44,6 +44,13 @@ public:
         return size;
     }
 
+    bool seek(uint32_t pos) {
+        fs.clear();
+        if (writeMode) fs.seekp(pos);
+        else fs.seekg(pos);
+        return !fs.fail();
+    }
+
     int read() {
         return fs.get();
     }
@@ -0,0 +1,180 @@
+// Sends frames at 60 fps over DDP, E1.31 or Art-Net. By default it also runs a
+// PixelReceiver on a local port and reports how long each frame takes from
+// its first packet being read, and from it being sent, to the end of show().
+// With --host it only sends, to drive a real wall.
+//
+//   ./pixel_blaster [--protocol ddp|e131|artnet] [--frames N] [--fps N]
+//                   [--host ADDRESS] [--port PORT]
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "Arduino.h"
+#include "LedController.h"
+#include "Clock.h"
+#include "PixelReceiver.h"
+#include "PixelPackets.h"
+#include "PosixUdp.h"
+#include "mocks/SPIFFS.h"
+
+namespace ArduinoMock
+{
+  unsigned long _millis = 0;
+}
+HardwareSerial Serial;
+SPIFFSFS SPIFFS;
+
+// The mock millis() only moves when told to; the receiver needs real time
+class HostClock : public Clock
+{
+public:
+  unsigned long now() override { return micros() / 1000; }
+};
+
+// Each frame carries its number in its first four bytes, so the receiving
+// side can find when it was sent
+void fillFrame(uint8_t *pixels, uint32_t frame)
+{
+  for (int i = 0; i < PixelReceiver::FRAME_BYTES; i++)
+  {
+    pixels[i] = (uint8_t)(i + frame * 3);
+  }
+  memcpy(pixels, &frame, sizeof(frame));
+}
+
+int main(int argc, char *argv[])
+{
+  PixelProtocol protocol = PIXEL_DDP;
+  uint32_t frames = 600;
+  int fps = 60;
+  const char *host = nullptr;
+  int port = -1;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--protocol" && i + 1 < argc)
+    {
+      std::string name = argv[++i];
+      int found = -1;
+      for (int p = 0; p < PIXEL_PROTOCOL_COUNT; p++)
+      {
+        if (name == PixelReceiver::getProtocolName((PixelProtocol)p))
+          found = p;
+      }
+      if (found < 0)
+      {
+        std::cerr << "Unknown protocol " << name << std::endl;
+        return 1;
+      }
+      protocol = (PixelProtocol)found;
+    }
+    else if (arg == "--frames" && i + 1 < argc)
+      frames = std::stoul(argv[++i]);
+    else if (arg == "--fps" && i + 1 < argc)
+      fps = std::max(1, std::stoi(argv[++i]));
+    else if (arg == "--host" && i + 1 < argc)
+      host = argv[++i];
+    else if (arg == "--port" && i + 1 < argc)
+      port = std::stoi(argv[++i]);
+    else
+    {
+      std::cerr << "Usage: " << argv[0]
+                << " [--protocol ddp|e131|artnet] [--frames N] [--fps N] [--host ADDRESS] [--port PORT]" << std::endl;
+      return 1;
+    }
+  }
+  const uint16_t defaultPorts[PIXEL_PROTOCOL_COUNT] = {PixelReceiver::DDP_PORT, PixelReceiver::E131_PORT,
+                                                       PixelReceiver::ARTNET_PORT};
+
+  // Without --host the receiver takes any free port unless one is given
+  PosixUdpSocket input;
+  if (!host && !input.open(port >= 0 ? port : 0))
+  {
+    std::cerr << "Can't listen on port " << port << std::endl;
+    return 1;
+  }
+  PosixUdpSocket output;
+  if (!output.open(0, "0.0.0.0"))
+  {
+    std::cerr << "Can't open a socket to send from" << std::endl;
+    return 1;
+  }
+  output.addPeer(host ? (port >= 0 ? port : defaultPorts[protocol]) : input.getPort(), host ? host : "127.0.0.1");
+
+  std::vector<std::atomic<unsigned long>> sentAt(frames);
+  std::atomic<bool> sending(true);
+  std::thread sender([&]()
+                     {
+    uint8_t pixels[PixelReceiver::FRAME_BYTES];
+    uint8_t sequence = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t f = 0; f < frames; f++)
+    {
+      std::this_thread::sleep_until(start + std::chrono::microseconds(1000000ull * f / fps));
+      fillFrame(pixels, f);
+      std::vector<PixelPackets::Packet> packets = PixelPackets::frame(protocol, pixels, sequence);
+      sentAt[f] = micros();
+      for (const PixelPackets::Packet &packet : packets)
+        output.send(packet.data(), packet.size());
+    }
+    sending = false; });
+
+  if (host)
+  {
+    sender.join();
+    std::cout << "Sent " << frames << " " << PixelReceiver::getProtocolName(protocol) << " frames to " << host
+              << std::endl;
+    return 0;
+  }
+
+  // Poll as a busy wall would, and time each frame once it is shown
+  LedController ledController;
+  ledController.begin();
+  HostClock clock;
+  PixelReceiver receiver(ledController, clock);
+  receiver.addInput(input, protocol);
+  std::vector<unsigned long> sendToShow;
+  unsigned long lastFrames = 0;
+  unsigned long stopAt = 0;
+  while (sending || micros() < stopAt)
+  {
+    if (sending)
+      stopAt = micros() + 100000; // Drains what is still in flight
+    receiver.update();
+    if (receiver.getSourceCount() > 0 && receiver.getSource(0).frames != lastFrames)
+    {
+      lastFrames = receiver.getSource(0).frames;
+      uint32_t frame;
+      memcpy(&frame, ledController.ledColors, sizeof(frame));
+      if (frame < frames)
+        sendToShow.push_back(micros() - sentAt[frame]);
+    }
+  }
+  sender.join();
+
+  if (receiver.getSourceCount() == 0)
+  {
+    std::cerr << "Nothing arrived" << std::endl;
+    return 1;
+  }
+  const PixelSourceStats &stats = receiver.getSource(0);
+  std::sort(sendToShow.begin(), sendToShow.end());
+  unsigned long total = 0;
+  for (unsigned long latency : sendToShow)
+    total += latency;
+
+  std::cout << PixelReceiver::getProtocolName(protocol) << ": " << frames << " frames at " << fps << " fps, "
+            << stats.packets << " packets, " << stats.frames << " shown, " << stats.sequenceErrors
+            << " sequence errors, " << receiver.getBadPackets() << " bad packets" << std::endl;
+  std::cout << "  receive to show: " << stats.averageLatency() << " us average, " << stats.worstLatency << " us worst"
+            << std::endl;
+  if (!sendToShow.empty())
+    std::cout << "  send to show:    " << total / sendToShow.size() << " us average, "
+              << sendToShow[sendToShow.size() * 99 / 100] << " us 99th percentile, " << sendToShow.back()
+              << " us worst" << std::endl;
+  return stats.frames == frames ? 0 : 1;
+}
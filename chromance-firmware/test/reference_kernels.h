@@ -0,0 +1,534 @@
+// Kernels as they were before being rewritten (in fixed point, or onto
+// shared engines), kept as the reference the tests bound their error
+// against and the benchmarks time them against.
+
+#ifndef REFERENCE_KERNELS_H
+#define REFERENCE_KERNELS_H
+
+#include <cmath>
+#include "LedController.h"
+#include "Topology.h"
+#include "ParticlePool.h"
+
+namespace Reference
+{
+  // PlasmaAnimation::update() before the lookup tables
+  inline void plasma(LedController &leds, unsigned long time)
+  {
+    float time1 = time / 1000.0f;
+    float time2 = time / 1234.0f;
+    float time3 = time / 2345.0f;
+
+    for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+    {
+      for (int i = 0; i < Constants::LEDS_PER_SEGMENT; i++)
+      {
+        const LedPosition &position = Topology::getLedPosition(s, i);
+        float u = position.x / 80.0f;
+        float v = position.y / 26.0f;
+
+        float v1 = sin(u * 10.0f + time1);
+        float v2 = sin(10.0f * (u * sin(time2) + v * cos(time2)) + time1);
+        float cx = u + 0.5f * sin(time3);
+        float cy = v + 0.5f * cos(time3);
+        float v3 = sin(sqrt(100.0f * (cx * cx + cy * cy)) + time1);
+
+        float val = (v1 + v2 + v3) / 3.0f;
+        uint16_t hue = (uint16_t)((val + 1.0f) * 32768.0f);
+        uint8_t bright = 128 + (int)(sin(val * 3.14f) * 127);
+
+        uint32_t color = leds.ColorHSV(hue, 255, bright);
+        leds.setPixelColor(s, i, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
+      }
+    }
+  }
+
+  // RainbowRadiateAnimation::update() before the per-pixel hue offsets
+  inline void rainbowRadiate(LedController &leds, int brightness, unsigned long time)
+  {
+    const uint8_t *distances = Topology::getDistanceField(Topology::starburstNode);
+    float maxDistance = Topology::getMaxDistance(Topology::starburstNode);
+    float phaseOffset = (time % 2048) * 32.0f;
+    if (brightness > 40)
+      brightness = 40;
+
+    for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
+    {
+      for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
+      {
+        uint8_t distance = distances[LedController::pixelIndex(segment, led)];
+        if (distance == Topology::DISTANCE_UNREACHABLE)
+        {
+          leds.setPixelColor(segment, led, 0, 0, 0);
+          continue;
+        }
+        float normalizedDistance = maxDistance > 0 ? (distance / maxDistance) : 0.0f;
+        float hueValue = (normalizedDistance * 65536.0f + phaseOffset);
+        uint16_t hue = (uint16_t)(uint32_t)hueValue;
+        uint32_t color = leds.ColorHSV(hue, 255, brightness);
+        leds.setPixelColor(segment, led, color >> 16, color >> 8, color);
+      }
+    }
+  }
+
+  // RainbowPinwheelAnimation::update() before the per-pixel angles
+  inline void rainbowPinwheel(LedController &leds, int brightness, unsigned long time, int direction)
+  {
+    const NodePosition &centerPos = Topology::nodePositions[Topology::starburstNode];
+    float rotationOffset = (time % 2048) * 32.0f * direction;
+
+    for (int segment = 0; segment < Constants::NUMBER_OF_SEGMENTS; segment++)
+    {
+      const NodePosition &pos0 = Topology::nodePositions[Topology::segmentConnections[segment][0]];
+      const NodePosition &pos1 = Topology::nodePositions[Topology::segmentConnections[segment][1]];
+      for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
+      {
+        float t = (float)led / (Constants::LEDS_PER_SEGMENT - 1);
+        float ledX = pos1.x + (pos0.x - pos1.x) * t;
+        float ledY = pos1.y + (pos0.y - pos1.y) * t;
+        float angle = atan2(ledY - centerPos.y, ledX - centerPos.x);
+        float normalizedAngle = angle + M_PI;
+        uint16_t angleHue = (uint16_t)(normalizedAngle * 65536.0f / (2.0f * M_PI));
+        uint16_t hue = angleHue + (uint16_t)(int32_t)rotationOffset;
+        uint32_t color = leds.ColorHSV(hue, 255, brightness);
+        leds.setPixelColor(segment, led, color >> 16, color >> 8, color);
+      }
+    }
+  }
+  // InfernoAnimation's colour for 0.0-1.0 heat, worked out per pixel
+  // before it used the Heat palette
+  inline uint32_t heatColor(float h)
+  {
+    if (h <= 0.0f)
+      return 0;
+    if (h > 1.0f)
+      h = 1.0f;
+
+    uint8_t r = 0, g = 0, b = 0;
+    if (h < 0.4f)
+    {
+      // Black to red, quadratic for deeper black
+      float val = h / 0.4f;
+      val = val * val;
+      r = (uint8_t)(val * 255);
+    }
+    else if (h < 0.7f)
+    {
+      // Red to orange
+      r = 255;
+      g = (uint8_t)((h - 0.4f) / 0.3f * 128);
+    }
+    else
+    {
+      // Orange to yellow
+      r = 255;
+      g = 128 + (uint8_t)((h - 0.7f) / 0.3f * 127);
+    }
+    return (uint32_t)((r << 16) | (g << 8) | b);
+  }
+
+  // InfernoAnimation before the integer solver: float heat, a second
+  // buffer per frame and random() per pixel
+  struct Inferno
+  {
+    float heatPixels[Constants::NUM_OF_PIXELS];
+
+    Inferno()
+    {
+      for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
+        heatPixels[i] = 0.0f;
+    }
+
+    // Returns false once the fire is out
+    bool update(LedController &lc, bool fuelEnabled)
+    {
+      float maxHeat = 0.0f;
+      for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
+      {
+        heatPixels[i] -= (random(15) / 1000.0f) + 0.005f;
+        if (heatPixels[i] < 0.0f)
+          heatPixels[i] = 0.0f;
+        if (heatPixels[i] > maxHeat)
+          maxHeat = heatPixels[i];
+      }
+      if (!fuelEnabled && maxHeat < 0.05f)
+        return false;
+
+      float nextHeat[Constants::NUM_OF_PIXELS];
+      for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
+        nextHeat[i] = heatPixels[i];
+      for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+      {
+        for (int i = Constants::LEDS_PER_SEGMENT - 1; i > 0; i--)
+        {
+          int currentIdx = s * Constants::LEDS_PER_SEGMENT + i;
+          int belowIdx = s * Constants::LEDS_PER_SEGMENT + (i - 1);
+          nextHeat[currentIdx] = (heatPixels[currentIdx] * 0.01f) + (heatPixels[belowIdx] * 0.98f);
+          nextHeat[belowIdx] *= 0.95f;
+        }
+        int currentIdx = s * Constants::LEDS_PER_SEGMENT + 0;
+        const PathList &feeders = Topology::getFeeders(s);
+        for (int k = 0; k < feeders.count; k++)
+        {
+          int sourceIdx = feeders.segments[k] * Constants::LEDS_PER_SEGMENT + (Constants::LEDS_PER_SEGMENT - 1);
+          nextHeat[currentIdx] = (heatPixels[currentIdx] * 0.01f) + (heatPixels[sourceIdx] * 0.98f);
+          nextHeat[sourceIdx] *= 0.95f;
+        }
+      }
+      for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
+        heatPixels[i] = nextHeat[i] > 1.0f ? 1.0f : nextHeat[i];
+
+      if (fuelEnabled)
+      {
+        for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+        {
+          int n0 = Topology::segmentConnections[s][0];
+          int n1 = Topology::segmentConnections[s][1];
+          if ((Topology::nodePositions[n0].y >= 22 || Topology::nodePositions[n1].y >= 22) && random(100) < 10)
+          {
+            int idx = s * Constants::LEDS_PER_SEGMENT + 0;
+            heatPixels[idx] += (random(80, 150) / 100.0f);
+            if (heatPixels[idx] > 1.0f)
+              heatPixels[idx] = 1.0f;
+          }
+        }
+      }
+
+      lc.clearBuffer();
+      for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
+      {
+        uint32_t c = heatColor(heatPixels[i]);
+        if (c > 0)
+        {
+          byte r = (c >> 16) & 0xFF;
+          byte g = (c >> 8) & 0xFF;
+          byte b = c & 0xFF;
+          int s = i / Constants::LEDS_PER_SEGMENT;
+          int l = i % Constants::LEDS_PER_SEGMENT;
+          if (random(10) == 0)
+          {
+            float flicker = 0.6f + (random(40) / 100.0f);
+            lc.setPixelColor(s, l, (byte)(r * flicker), (byte)(g * flicker), (byte)(b * flicker));
+          }
+          else
+          {
+            lc.setPixelColor(s, l, r, g, b);
+          }
+        }
+      }
+      return true;
+    }
+  };
+
+  // WaterAnimation before GraphParticles: its own drops, double-buffered,
+  // splitting and backing up by hand
+  struct WaterPour
+  {
+    struct Drop
+    {
+      int segmentIndex;
+      float position; // 0.0 (top) to 1.0 (bottom)
+      float speed;
+      float volume;
+    };
+
+    float segmentLevels[Constants::NUMBER_OF_SEGMENTS];
+    ParticlePool<Drop, 128> drops[2];
+    int front;
+    int sourceNode;
+
+    WaterPour() : front(0), sourceNode(0)
+    {
+      for (int i = 0; i < Constants::NUMBER_OF_SEGMENTS; i++)
+        segmentLevels[i] = 0.0f;
+    }
+
+    int size() const { return drops[front].size(); }
+
+    void addWater(int segment, float volume)
+    {
+      segmentLevels[segment] += volume;
+      if (segmentLevels[segment] > 1.0f)
+        segmentLevels[segment] = 1.0f;
+    }
+
+    void update(LedController &leds, unsigned long time)
+    {
+      ParticlePool<Drop, 128> &nextDrops = drops[1 - front];
+      nextDrops.clear();
+      if (random(100) < 30)
+      {
+        const PathList &paths = Topology::getDownPaths(sourceNode);
+        if (paths.count > 0)
+        {
+          Drop drop = {paths.segments[random(paths.count)], 0.0f, 0.15f + (random(100) / 2000.0f), 0.02f};
+          nextDrops.push(drop);
+        }
+      }
+      for (int i = 0; i < Constants::NUMBER_OF_SEGMENTS; i++)
+      {
+        if (segmentLevels[i] > 0.0f)
+        {
+          segmentLevels[i] -= 0.005f;
+          if (segmentLevels[i] < 0.0f)
+            segmentLevels[i] = 0.0f;
+        }
+      }
+      for (const Drop *it = drops[front].begin(); it != drops[front].end(); ++it)
+      {
+        Drop d = *it;
+        d.position += d.speed;
+        float waterLevel = segmentLevels[d.segmentIndex];
+        if (d.position >= 1.0f - waterLevel && waterLevel > 0.01f)
+        {
+          addWater(d.segmentIndex, d.volume);
+          continue;
+        }
+        if (d.position < 1.0f)
+        {
+          if (!nextDrops.push(d))
+            addWater(d.segmentIndex, d.volume);
+          continue;
+        }
+        const PathList &nextPaths = Topology::getDownPaths(Topology::segmentConnections[d.segmentIndex][1]);
+        int validPaths[6];
+        int validCount = 0;
+        for (int k = 0; k < nextPaths.count; k++)
+        {
+          if (segmentLevels[nextPaths.segments[k]] < 1.0f)
+            validPaths[validCount++] = nextPaths.segments[k];
+        }
+        if (validCount == 0)
+        {
+          addWater(d.segmentIndex, d.volume);
+          continue;
+        }
+        int numToSplit = random(1, validCount + 1);
+        for (int k = 0; k < validCount; k++)
+        {
+          int r = random(validCount);
+          int temp = validPaths[k];
+          validPaths[k] = validPaths[r];
+          validPaths[r] = temp;
+        }
+        float newVol = d.volume / numToSplit;
+        for (int k = 0; k < numToSplit; k++)
+        {
+          Drop *newDrop = nextDrops.add();
+          if (!newDrop)
+          {
+            addWater(d.segmentIndex, newVol * (numToSplit - k));
+            break;
+          }
+          Drop split = {validPaths[k], 0.0f, d.speed, newVol};
+          *newDrop = split;
+        }
+      }
+      front = 1 - front;
+
+      for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+      {
+        if (segmentLevels[s] > 0.001f)
+        {
+          int numLit = (int)(segmentLevels[s] * Constants::LEDS_PER_SEGMENT);
+          if (segmentLevels[s] < 0.99f)
+          {
+            float x = Topology::nodePositions[Topology::segmentConnections[s][0]].x;
+            numLit += (int)(sin(time / 150.0f + x / 8.0f) * 1.8f);
+            if (numLit < 0)
+              numLit = 0;
+            if (numLit > Constants::LEDS_PER_SEGMENT)
+              numLit = Constants::LEDS_PER_SEGMENT;
+          }
+          for (int i = 0; i < numLit; i++)
+          {
+            leds.setPixelColor(s, i, 0, 0, 150);
+            if (i >= numLit - 2)
+              leds.setPixelColor(s, i, 100, 100, 180);
+          }
+        }
+      }
+      for (const Drop *d = drops[front].begin(); d != drops[front].end(); ++d)
+      {
+        int ledIndex = (int)((1.0f - d->position) * (Constants::LEDS_PER_SEGMENT - 1));
+        if (ledIndex < 0)
+          ledIndex = 0;
+        if (ledIndex >= Constants::LEDS_PER_SEGMENT)
+          ledIndex = Constants::LEDS_PER_SEGMENT - 1;
+        leds.setPixelColor(d->segmentIndex, ledIndex, 150, 220, 255);
+        if (ledIndex + 1 < Constants::LEDS_PER_SEGMENT)
+          leds.setPixelColor(d->segmentIndex, ledIndex + 1, 0, 100, 180);
+      }
+    }
+  };
+
+  // BouncingBallsAnimation before GraphParticles, which kept at most 8
+  template <size_t Capacity>
+  struct BouncingBalls
+  {
+    struct Ball
+    {
+      int segmentIndex;
+      float position;
+      float velocity; // positive = down
+      uint32_t color;
+    };
+
+    ParticlePool<Ball, Capacity> balls;
+
+    int size() const { return balls.size(); }
+
+    void spawn(uint32_t color)
+    {
+      const PathList &paths = Topology::getDownPaths(random(3));
+      if (paths.count > 0)
+      {
+        Ball b = {paths.segments[random(paths.count)], 0.0f, 0.0f, color};
+        balls.push(b);
+      }
+    }
+
+    void update(LedController &lc, uint32_t color)
+    {
+      balls.retain([](Ball &b)
+                   {
+        b.velocity += 0.005f;
+        b.position += b.velocity;
+        if (b.position >= 1.0f)
+        {
+          const PathList &downPaths = Topology::getDownPaths(Topology::segmentConnections[b.segmentIndex][1]);
+          if (downPaths.count > 0)
+          {
+            b.segmentIndex = downPaths.segments[random(downPaths.count)];
+            b.position = 0.0f;
+          }
+          else
+          {
+            b.position = 1.0f;
+            b.velocity = -b.velocity * 0.8f;
+            if (std::abs(b.velocity) < 0.02f)
+              return false;
+          }
+        }
+        else if (b.position <= 0.0f)
+        {
+          const PathList &upPaths = Topology::getUpPaths(Topology::segmentConnections[b.segmentIndex][0]);
+          if (upPaths.count > 0)
+          {
+            b.segmentIndex = upPaths.segments[random(upPaths.count)];
+            b.position = 1.0f;
+          }
+          else
+          {
+            b.position = 0.0f;
+            b.velocity = -b.velocity * 0.5f;
+          }
+        }
+        return true; });
+      if (balls.size() < 3 && random(100) < 5)
+        spawn(color);
+
+      for (const Ball *b = balls.begin(); b != balls.end(); ++b)
+      {
+        int ledIdx = (int)((1.0f - b->position) * (Constants::LEDS_PER_SEGMENT - 1));
+        if (ledIdx < 0)
+          ledIdx = 0;
+        if (ledIdx >= Constants::LEDS_PER_SEGMENT)
+          ledIdx = Constants::LEDS_PER_SEGMENT - 1;
+        byte r = (b->color >> 16) & 0xFF;
+        byte g = (b->color >> 8) & 0xFF;
+        byte bl = b->color & 0xFF;
+        lc.addPixelColor(b->segmentIndex, ledIdx, r, g, bl);
+        if (std::abs(b->velocity) > 0.1f)
+        {
+          int trailIdx = ledIdx + (b->velocity > 0 ? 1 : -1);
+          if (trailIdx >= 0 && trailIdx < Constants::LEDS_PER_SEGMENT)
+            lc.addPixelColor(b->segmentIndex, trailIdx, r / 2, g / 2, bl / 2);
+        }
+      }
+    }
+  };
+
+  // FirefliesAnimation before GraphParticles: a state machine per slot
+  struct Fireflies
+  {
+    struct Firefly
+    {
+      int segment;
+      int led;
+      float brightness;
+      int state; // 0: Hidden, 1: Fading In, 2: Lit, 3: Fading Out
+      float speed;
+      uint32_t color;
+    };
+
+    Firefly flies[20];
+
+    Fireflies()
+    {
+      for (int i = 0; i < 20; i++)
+      {
+        flies[i].state = 0;
+        flies[i].brightness = 0.0f;
+      }
+    }
+
+    int size() const
+    {
+      int shown = 0;
+      for (int i = 0; i < 20; i++)
+        shown += flies[i].state != 0;
+      return shown;
+    }
+
+    void update(LedController &lc)
+    {
+      for (int i = 0; i < 20; i++)
+      {
+        Firefly &f = flies[i];
+        switch (f.state)
+        {
+        case 0:
+          if (random(100) < 2)
+          {
+            f.segment = random(Constants::NUMBER_OF_SEGMENTS);
+            f.led = random(Constants::LEDS_PER_SEGMENT);
+            f.state = 1;
+            f.brightness = 0.0f;
+            f.speed = 0.02f + (random(100) / 5000.0f);
+            f.color = random(2) ? 0xFFFF00 : 0xADFF2F;
+          }
+          break;
+        case 1:
+          f.brightness += f.speed;
+          if (f.brightness >= 1.0f)
+          {
+            f.brightness = 1.0f;
+            f.state = 2;
+          }
+          break;
+        case 2:
+          if (random(100) < 5)
+            f.state = 3;
+          break;
+        case 3:
+          f.brightness -= f.speed;
+          if (f.brightness <= 0.0f)
+          {
+            f.brightness = 0.0f;
+            f.state = 0;
+          }
+          break;
+        }
+        if (f.state != 0 && f.brightness > 0.001f)
+        {
+          float val = f.brightness * f.brightness * (3.0f - 2.0f * f.brightness);
+          lc.addPixelColor(f.segment, f.led, (byte)(((f.color >> 16) & 0xFF) * val), (byte)(((f.color >> 8) & 0xFF) * val),
+                           (byte)((f.color & 0xFF) * val));
+        }
+      }
+    }
+  };
+}
+
+#endif // REFERENCE_KERNELS_H
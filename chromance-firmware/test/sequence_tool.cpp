@@ -0,0 +1,230 @@
+// Offline sequence encoder: renders an animation natively on a virtual clock
+// and writes it as a .chsq file (see src/Sequence.h) for PlaybackAnimation.
+// The palette is a median cut over every recorded frame, which looks much
+// better than the first-come palette the on-device recorder has to use.
+//
+//   ./sequence_tool <animation id|name> <frames> <out.chsq> [frame ms] [seed]
+//   ./sequence_tool --info <file.chsq>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include "Arduino.h"
+#include "AnimationController.h"
+#include "animations/Animation.h"
+#include "LedController.h"
+#include "Configuration.h"
+#include "Clock.h"
+#include "Sequence.h"
+#include "mocks/SPIFFS.h"
+
+namespace ArduinoMock
+{
+  unsigned long _millis = 0;
+}
+HardwareSerial Serial;
+SPIFFSFS SPIFFS;
+
+class VectorSequenceSink : public SequenceSink
+{
+public:
+  std::vector<uint8_t> data;
+  bool write(const uint8_t *bytes, size_t length) override
+  {
+    data.insert(data.end(), bytes, bytes + length);
+    return true;
+  }
+};
+
+struct ColorCount
+{
+  byte rgb[3];
+  unsigned long count;
+};
+
+// Splits the colour box with the widest channel at its weighted median until
+// there are `target` boxes, then averages each box
+static std::vector<ColorCount> medianCut(std::vector<ColorCount> colors, size_t target)
+{
+  struct Box
+  {
+    size_t begin, end;
+  };
+  std::vector<Box> boxes;
+  boxes.push_back({0, colors.size()});
+
+  while (boxes.size() < target)
+  {
+    int bestBox = -1;
+    int bestChannel = 0;
+    int bestRange = 0;
+    for (size_t b = 0; b < boxes.size(); b++)
+    {
+      if (boxes[b].end - boxes[b].begin < 2)
+        continue;
+      for (int c = 0; c < 3; c++)
+      {
+        int lo = 255, hi = 0;
+        for (size_t i = boxes[b].begin; i < boxes[b].end; i++)
+        {
+          lo = std::min(lo, (int)colors[i].rgb[c]);
+          hi = std::max(hi, (int)colors[i].rgb[c]);
+        }
+        if (hi - lo > bestRange)
+        {
+          bestRange = hi - lo;
+          bestBox = b;
+          bestChannel = c;
+        }
+      }
+    }
+    if (bestBox < 0)
+      break;
+
+    Box box = boxes[bestBox];
+    std::sort(colors.begin() + box.begin, colors.begin() + box.end, [bestChannel](const ColorCount &a, const ColorCount &b)
+              { return a.rgb[bestChannel] < b.rgb[bestChannel]; });
+
+    unsigned long total = 0;
+    for (size_t i = box.begin; i < box.end; i++)
+      total += colors[i].count;
+    unsigned long running = 0;
+    size_t split = box.begin + 1;
+    for (size_t i = box.begin; i < box.end - 1; i++)
+    {
+      running += colors[i].count;
+      split = i + 1;
+      if (running * 2 >= total)
+        break;
+    }
+
+    boxes[bestBox].end = split;
+    boxes.push_back({split, box.end});
+  }
+
+  std::vector<ColorCount> palette;
+  for (const Box &box : boxes)
+  {
+    double sum[3] = {0, 0, 0};
+    unsigned long total = 0;
+    for (size_t i = box.begin; i < box.end; i++)
+    {
+      for (int c = 0; c < 3; c++)
+        sum[c] += (double)colors[i].rgb[c] * colors[i].count;
+      total += colors[i].count;
+    }
+    ColorCount entry;
+    for (int c = 0; c < 3; c++)
+      entry.rgb[c] = (byte)(sum[c] / total + 0.5);
+    entry.count = total;
+    palette.push_back(entry);
+  }
+  return palette;
+}
+
+static int info(const char *path)
+{
+  std::ifstream in(path, std::ios::binary);
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  MemorySequenceSource source(data.data(), data.size());
+  SequenceDecoder decoder;
+  if (!decoder.begin(source))
+    return 1;
+
+  unsigned long frames = 0;
+  while (decoder.nextFrame())
+    frames++;
+  std::cout << path << ": " << frames << " frames at " << decoder.getFrameMillis() << " ms, "
+            << data.size() << " bytes (" << (frames ? data.size() / frames : 0) << " bytes/frame, raw "
+            << Constants::NUM_OF_PIXELS * 3 << ")" << std::endl;
+  return decoder.isValid() ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc == 3 && std::string(argv[1]) == "--info")
+    return info(argv[2]);
+
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <animation id|name> <frames> <out.chsq> [frame ms] [seed]" << std::endl;
+    std::cerr << "       " << argv[0] << " --info <file.chsq>" << std::endl;
+    return 1;
+  }
+
+  std::string animationArg = argv[1];
+  unsigned long frames = std::stoul(argv[2]);
+  const char *outPath = argv[3];
+  unsigned long frameMillis = argc > 4 ? std::stoul(argv[4]) : 33;
+  std::srand(argc > 5 ? std::stoul(argv[5]) : 12345);
+
+  Configuration configuration;
+  LedController ledController;
+  AnimationController animationController(ledController, configuration);
+  VirtualClock clock(frameMillis);
+  animationController.setClock(clock);
+  ledController.begin();
+  animationController.init();
+
+  int animation = -1;
+  for (int i = 0; i < animationController.getAnimationCount(); i++)
+  {
+    if (animationController.getAnimation(i)->getName() == animationArg || std::to_string(i) == animationArg)
+      animation = i;
+  }
+  if (animation < 0)
+  {
+    std::cerr << "Unknown animation " << animationArg << std::endl;
+    return 1;
+  }
+  animationController.setAutoSwitching(false);
+  animationController.startAnimation(animation);
+
+  // Pass 1: render and histogram every frame
+  const size_t frameBytes = Constants::NUM_OF_PIXELS * 3;
+  std::vector<byte> recording;
+  std::map<uint32_t, unsigned long> histogram;
+  for (unsigned long f = 0; f < frames; f++)
+  {
+    animationController.update();
+    clock.step();
+    const byte *rgb = ledController.ledColors;
+    recording.insert(recording.end(), rgb, rgb + frameBytes);
+    for (size_t i = 0; i < frameBytes; i += 3)
+      histogram[(uint32_t)rgb[i] << 16 | (uint32_t)rgb[i + 1] << 8 | rgb[i + 2]]++;
+  }
+
+  std::vector<ColorCount> colors;
+  for (const auto &entry : histogram)
+    colors.push_back({{(byte)(entry.first >> 16), (byte)(entry.first >> 8), (byte)entry.first}, entry.second});
+  std::vector<ColorCount> palette = colors.size() <= Sequence::MAX_PALETTE ? colors : medianCut(colors, Sequence::MAX_PALETTE);
+
+  byte paletteRgb[Sequence::MAX_PALETTE][3];
+  for (size_t i = 0; i < palette.size(); i++)
+    memcpy(paletteRgb[i], palette[i].rgb, 3);
+
+  // Pass 2: encode against the fixed palette
+  static SequenceEncoder encoder;
+  VectorSequenceSink sink;
+  encoder.setPalette(paletteRgb, palette.size());
+  encoder.begin(sink, frameMillis);
+  for (unsigned long f = 0; f < frames; f++)
+    encoder.addFrame(&recording[f * frameBytes]);
+  encoder.finish();
+
+  std::ofstream out(outPath, std::ios::binary);
+  out.write((const char *)sink.data.data(), sink.data.size());
+  if (!out)
+  {
+    std::cerr << "Failed to write " << outPath << std::endl;
+    return 1;
+  }
+
+  std::cout << "Wrote " << frames << " frames of " << animationController.getAnimation(animation)->getName()
+            << " to " << outPath << ": " << sink.data.size() << " bytes, " << colors.size() << " colours -> "
+            << palette.size() << " palette entries (raw " << frames * frameBytes << " bytes)" << std::endl;
+  return 0;
+}
@@ -2,6 +2,15 @@
 #include <vector>
 #include <string>
 #include <cassert>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <cstdlib>
+#include <new>
+#include <functional>
+#include <map>
+#include <set>
+#include <algorithm>
 #include "Arduino.h"
 #include "AnimationController.h"
 #include "LedController.h"
@@ -9,6 +18,34 @@
 #include "mocks/Arduino.h"
 #include "mocks/SPIFFS.h"
 #include "Topology.h"
+#include "TopologyLayout.h"
+#include "animations/Animation.h"
+#include "CommandQueue.h"
+#include "Clock.h"
+#include "Sequence.h"
+#include "FrameDiff.h"
+#include "SpatialIndex.h"
+#include "PathLibrary.h"
+#include "FixedMath.h"
+#include "ParticlePool.h"
+#include "GraphParticles.h"
+#include "LedGraph.h"
+#include "GraphField.h"
+#include "GraphAutomaton.h"
+#include "Noise.h"
+#include "Palette.h"
+#include "animations/AutomataAnimation.h"
+#include "animations/SnakeAnimation.h"
+#include "animations/ShaderAnimation.h"
+#include "ShaderVM.h"
+#include "ShaderCompiler.h"
+#include "Canvas.h"
+#include "WallSync.h"
+#include "PixelReceiver.h"
+#include "PixelPackets.h"
+#include "PosixUdp.h"
+#include "reference_kernels.h"
+#include "animations/PlaybackAnimation.h"
 
 // Mock Definitions
 namespace ArduinoMock
@@ -18,6 +55,26 @@ namespace ArduinoMock
 HardwareSerial Serial;
 SPIFFSFS SPIFFS;
 
+// Every heap allocation in the test binary is counted, so a test can check
+// that frames leave the heap alone once an animation is running
+std::atomic<unsigned long> heapAllocations(0);
+
+void *operator new(size_t size)
+{
+  heapAllocations++;
+  void *p = std::malloc(size > 0 ? size : 1);
+  if (!p)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
 // Simple Test Framework
 int tests_passed = 0;
 int tests_failed = 0;
@@ -41,6 +98,22 @@ void reset_mocks()
   ArduinoMock::_millis = 0;
   // Reset random seed if needed
   std::srand(12345);
+  Ripple::runnerNode = -1;
+}
+
+// Registry order is alphabetical by class name, so look animations up by
+// display name instead of hard-coding indices that shift as effects are added.
+int find_animation(AnimationController &controller, const char *name)
+{
+  for (int i = 0; i < controller.getAnimationCount(); i++)
+  {
+    Animation *anim = controller.getAnimation(i);
+    if (anim && std::string(anim->getName()) == name)
+    {
+      return i;
+    }
+  }
+  return -1;
 }
 
 void test_random_animation()
@@ -55,8 +128,7 @@ void test_random_animation()
   animController.init();
   animController.setAutoSwitching(false);
 
-  // RandomAnimation is index 14 (Alphabetical order)
-  animController.startAnimation(14);
+  animController.startAnimation(find_animation(animController, "Random Pulse"));
 
   // RandomAnimation::run() immediately starts ripples at a random node.
 
@@ -90,8 +162,7 @@ void test_cube_animation()
   animController.init();
   animController.setAutoSwitching(false);
 
-  // CubeAnimation is index 4 (Alphabetical)
-  animController.startAnimation(4);
+  animController.startAnimation(find_animation(animController, "Cube Pulse"));
 
   // It should spawn ripples immediately or over time
   // CubeAnimation::run() iterates over nodes and starts ripples
@@ -116,8 +187,7 @@ void test_starburst_animation()
   animController.init();
   animController.setAutoSwitching(false);
 
-  // StarburstAnimation is index 17 (Alphabetical)
-  animController.startAnimation(17);
+  animController.startAnimation(find_animation(animController, "Starburst"));
 
   // Starburst spawns multiple ripples from a central node
   int count = animController.getActiveRippleCount();
@@ -137,8 +207,7 @@ void test_center_animation()
   animController.init();
   animController.setAutoSwitching(false);
 
-  // CenterAnimation is index 2 (Alphabetical)
-  animController.startAnimation(2);
+  animController.startAnimation(find_animation(animController, "Center Pulse"));
 
   int count = animController.getActiveRippleCount();
   std::cout << "CenterAnimation Ripple Count: " << count << std::endl;
@@ -157,8 +226,7 @@ void test_rainbow_animation()
   animController.init();
   animController.setAutoSwitching(false);
 
-  // RainbowAnimation is index 11 (Alphabetical)
-  animController.startAnimation(11);
+  animController.startAnimation(find_animation(animController, "Rainbow"));
 
   // Force a show to update the strips from the internal buffer
   ledController.show();
@@ -201,8 +269,7 @@ void test_chase_animation()
   animController.init();
   animController.setAutoSwitching(false);
 
-  // ChaseAnimation is index 3 (Alphabetical)
-  animController.startAnimation(3);
+  animController.startAnimation(find_animation(animController, "Chase"));
 
   // Should have exactly 2 ripples initially (runner and chaser)
   int count = animController.getActiveRippleCount();
@@ -241,8 +308,7 @@ void test_heartbeat_animation()
   animController.init();
   animController.setAutoSwitching(false);
 
-  // HeartbeatAnimation is index 8 (Alphabetical)
-  animController.startAnimation(8);
+  animController.startAnimation(find_animation(animController, "Heartbeat"));
 
   // Run update to set the LEDs
   animController.update();
@@ -282,8 +348,7 @@ void test_wave_animation()
   animController.init();
   animController.setAutoSwitching(false);
 
-  // WaveAnimation is index 19
-  animController.startAnimation(19);
+  animController.startAnimation(find_animation(animController, "Wave"));
 
   // Run update
   animController.update();
@@ -306,6 +371,3135 @@ void test_wave_animation()
   TEST_ASSERT(anyLit);
 }
 
+// Runs one animation for a fixed number of frames and records every frame
+// that reached the strips plus the final framebuffer.
+std::vector<uint32_t> record_frames(int animationIndex, bool optimized, int frames)
+{
+  reset_mocks();
+
+  LedController ledController;
+  Configuration configuration;
+  AnimationController animController(ledController, configuration);
+  ledController.begin();
+  animController.init();
+  animController.setAutoSwitching(false);
+  animController.setRenderPassOptimization(optimized);
+  animController.startAnimation(animationIndex);
+
+  std::vector<uint32_t> output;
+  for (int f = 0; f < frames; f++)
+  {
+    animController.update();
+    ArduinoMock::advanceMillis(33);
+
+    for (int s = 0; s < ledController.getStripCount(); s++)
+    {
+      auto strip = ledController.getStrip(s);
+      output.insert(output.end(), strip->pixels.begin(), strip->pixels.end());
+    }
+  }
+
+  const byte *raw = ledController.ledColors;
+  output.insert(output.end(), raw, raw + sizeof(ledController.ledColors));
+  return output;
+}
+
+void test_render_pass_optimization()
+{
+  TEST_CASE("RenderPassOptimization");
+
+  // Enough frames to cover ripple lifetimes and a few animation restarts
+  const int frames = 150;
+
+  LedController ledController;
+  Configuration configuration;
+  AnimationController animController(ledController, configuration);
+  animController.init();
+
+  for (int i = 0; i < animController.getAnimationCount(); i++)
+  {
+    std::vector<uint32_t> legacy = record_frames(i, false, frames);
+    std::vector<uint32_t> optimized = record_frames(i, true, frames);
+
+    bool identical = (legacy == optimized);
+    if (!identical)
+    {
+      std::cout << "Render passes changed output of " << animController.getAnimation(i)->getName() << std::endl;
+    }
+    TEST_ASSERT(identical);
+  }
+}
+
+void test_overwrite_frames_shown_undimmed()
+{
+  TEST_CASE("OverwriteFramesShownUndimmed");
+  reset_mocks();
+
+  // Each frame is drawn and then shown, so an effect that rewrites every
+  // pixel reaches the strips as drawn, without a 0.97 fade on top
+  const char *names[] = {"Rainbow", "Wave", "Plasma"};
+  for (const char *name : names)
+  {
+    LedController ledController;
+    Configuration configuration;
+    AnimationController animController(ledController, configuration);
+    ledController.begin();
+    animController.init();
+    animController.setAutoSwitching(false);
+    int index = find_animation(animController, name);
+    TEST_ASSERT(index >= 0);
+    animController.startAnimation(index);
+
+    for (int f = 0; f < 5; f++)
+    {
+      animController.update();
+      ArduinoMock::advanceMillis(33);
+    }
+    ArduinoMock::_millis -= 33;
+
+    // Drawing again at the same time leaves the buffer as it was, and
+    // showing it again leaves the strips as they were
+    std::vector<byte> shown(ledController.ledColors, ledController.ledColors + sizeof(ledController.ledColors));
+    std::vector<uint32_t> strips;
+    for (int s = 0; s < ledController.getStripCount(); s++)
+    {
+      auto strip = ledController.getStrip(s);
+      strips.insert(strips.end(), strip->pixels.begin(), strip->pixels.end());
+    }
+    animController.getAnimation(index)->update();
+    ledController.show();
+    std::vector<byte> drawn(ledController.ledColors, ledController.ledColors + sizeof(ledController.ledColors));
+    std::vector<uint32_t> redrawn;
+    for (int s = 0; s < ledController.getStripCount(); s++)
+    {
+      auto strip = ledController.getStrip(s);
+      redrawn.insert(redrawn.end(), strip->pixels.begin(), strip->pixels.end());
+    }
+
+    if (drawn != shown || redrawn != strips)
+    {
+      std::cout << name << " was not shown as drawn" << std::endl;
+    }
+    TEST_ASSERT(drawn == shown);
+    TEST_ASSERT(redrawn == strips);
+  }
+}
+
+void test_command_queue_ordering()
+{
+  TEST_CASE("CommandQueueOrdering");
+
+  // Producer thread pushes a counter; the consumer must see every value once, in order
+  const uint32_t count = 200000;
+  SpscQueue<uint32_t, 64> queue;
+
+  std::thread producer([&queue, count]()
+                       {
+    for (uint32_t i = 0; i < count; i++) {
+      while (!queue.push(i)) {
+        std::this_thread::yield();
+      }
+    } });
+
+  uint32_t expected = 0;
+  bool inOrder = true;
+  while (expected < count)
+  {
+    uint32_t value;
+    if (queue.pop(value))
+    {
+      if (value != expected)
+      {
+        inOrder = false;
+      }
+      expected++;
+    }
+  }
+  producer.join();
+
+  TEST_ASSERT(inOrder);
+  TEST_ASSERT(queue.empty());
+}
+
+void test_command_queue_while_rendering()
+{
+  TEST_CASE("CommandQueueWhileRendering");
+  reset_mocks();
+
+  LedController ledController;
+  Configuration configuration;
+  AnimationController animController(ledController, configuration);
+  ledController.begin();
+  animController.init();
+  animController.startAnimation(0);
+
+  // Hammer the controller from a second thread while the main thread renders.
+  // The producer only ever touches the queue, never the controller state.
+  const int commands = 5000;
+  const int finalAnimation = find_animation(animController, "Rainbow");
+  std::atomic<int> rejected(0);
+
+  std::thread producer([&animController, &rejected, commands, finalAnimation]()
+                       {
+    std::mt19937 rng(4242);
+    int animationCount = animController.getAnimationCount();
+    for (int i = 0; i < commands; i++) {
+      AnimationCommand command = {};
+      if (i == commands - 1) {
+        command.type = COMMAND_CHANGE_ANIMATION;
+        command.animation = finalAnimation;
+      } else {
+        switch (rng() % 3) {
+        case 0:
+          command.type = COMMAND_CHANGE_ANIMATION;
+          command.animation = rng() % animationCount;
+          break;
+        case 1:
+          command.type = COMMAND_SET_AUTO_SWITCHING;
+          command.enabled = rng() % 2;
+          break;
+        default:
+          command.type = COMMAND_SET_ANIMATION_CONFIG;
+          command.animation = rng() % animationCount;
+          strcpy(command.payload, "{\"enabled\":true}");
+          break;
+        }
+      }
+      while (!animController.postCommand(command)) {
+        rejected++;
+        std::this_thread::yield();
+      }
+    } });
+
+  int frames = 0;
+  while (animController.getProcessedCommandCount() < (unsigned long)commands && frames < 10000000)
+  {
+    animController.update();
+    ArduinoMock::advanceMillis(16);
+    frames++;
+  }
+  producer.join();
+  animController.update();
+
+  std::cout << "  " << commands << " commands over " << frames << " frames, "
+            << rejected.load() << " pushes rejected while full" << std::endl;
+
+  TEST_ASSERT(animController.getProcessedCommandCount() == (unsigned long)commands);
+  TEST_ASSERT(animController.getCurrentAnimation() == finalAnimation);
+  TEST_ASSERT(!animController.isAutoSwitching());
+}
+
+void test_snapshot_buffer()
+{
+  TEST_CASE("SnapshotBuffer");
+
+  // The writer fills every word of a copy with its number; the reader must
+  // never see a copy mixing two numbers, nor an older one after a newer one
+  struct Counted
+  {
+    uint32_t words[64];
+  };
+  const uint32_t count = 100000;
+  SnapshotBuffer<Counted> buffer;
+  for (int i = 0; i < 3; i++)
+  {
+    memset(buffer.writable().words, 0, sizeof(Counted));
+    buffer.publish();
+  }
+
+  std::thread writer([&buffer, count]()
+                     {
+    for (uint32_t i = 1; i <= count; i++) {
+      Counted &copy = buffer.writable();
+      for (int w = 0; w < 64; w++) {
+        copy.words[w] = i;
+      }
+      buffer.publish();
+    } });
+
+  bool whole = true;
+  bool ordered = true;
+  uint32_t last = 0;
+  while (last < count)
+  {
+    const Counted &copy = buffer.read();
+    for (int w = 1; w < 64; w++)
+    {
+      if (copy.words[w] != copy.words[0])
+      {
+        whole = false;
+      }
+    }
+    if (copy.words[0] < last)
+    {
+      ordered = false;
+    }
+    last = copy.words[0];
+  }
+  writer.join();
+
+  TEST_ASSERT(whole);
+  TEST_ASSERT(ordered);
+}
+
+void test_controller_snapshots()
+{
+  TEST_CASE("ControllerSnapshots");
+  reset_mocks();
+
+  LedController ledController;
+  Configuration configuration;
+  AnimationController animController(ledController, configuration);
+  configuration.setAnimationController(&animController);
+  ledController.begin();
+  animController.init();
+  animController.setAutoSwitching(false);
+  int rainbow = find_animation(animController, "Rainbow");
+
+  // Nothing is published before the first frame
+  TEST_ASSERT(!animController.readConfigSnapshot().published);
+  TEST_ASSERT(!animController.readLayerSnapshot().published);
+
+  animController.update();
+  const AnimationController::ConfigSnapshot &first = animController.readConfigSnapshot();
+  TEST_ASSERT(first.published);
+  TEST_ASSERT(first.animations.size() == (size_t)animController.getAnimationCount());
+  JsonDocument doc;
+  TEST_ASSERT(!deserializeJson(doc, first.global));
+  TEST_ASSERT(doc["sleepEnabled"].is<bool>());
+  JsonArray list = doc["animations"];
+  TEST_ASSERT(list[rainbow]["name"] == "Rainbow");
+  TEST_ASSERT(list[rainbow]["enabled"].as<bool>());
+
+  // Commands show up in the snapshots only once the render side has run them
+  AnimationCommand command = {};
+  command.type = COMMAND_SET_ANIMATION_CONFIG;
+  command.animation = rainbow;
+  strcpy(command.payload, "{\"enabled\":false}");
+  TEST_ASSERT(animController.postCommand(command));
+  command = {};
+  command.type = COMMAND_SET_LAYER;
+  snprintf(command.payload, sizeof(command.payload), "{\"slot\":2,\"animation\":%d,\"enabled\":true}", rainbow);
+  TEST_ASSERT(animController.postCommand(command));
+
+  TEST_ASSERT(!deserializeJson(doc, animController.readConfigSnapshot().global));
+  list = doc["animations"];
+  TEST_ASSERT(list[rainbow]["enabled"].as<bool>());
+  TEST_ASSERT(!animController.readLayerSnapshot().settings[2].enabled);
+
+  animController.update();
+  const AnimationController::ConfigSnapshot &second = animController.readConfigSnapshot();
+  TEST_ASSERT(!deserializeJson(doc, second.global));
+  list = doc["animations"];
+  TEST_ASSERT(!list[rainbow]["enabled"].as<bool>());
+  TEST_ASSERT(!deserializeJson(doc, second.animations[rainbow]));
+  TEST_ASSERT(doc["enabled"].is<bool>() && !doc["enabled"].as<bool>());
+  const AnimationController::LayerSnapshot &layers = animController.readLayerSnapshot();
+  TEST_ASSERT(layers.settings[2].enabled);
+  TEST_ASSERT(layers.settings[2].animation == rainbow);
+
+  // Layer costs are copied every frame, before that frame renders
+  animController.update();
+  TEST_ASSERT(animController.readLayerSnapshot().renderedFrames[2] > 0);
+  TEST_ASSERT(animController.readLayerSnapshot().renderedFrames[2] == animController.getLayer(2).renderedFrames - 1);
+}
+
+void test_clocks()
+{
+  TEST_CASE("Clocks");
+
+  VirtualClock virtualClock(20, 100);
+  virtualClock.step();
+  virtualClock.advance(5);
+  TEST_ASSERT(virtualClock.now() == 125);
+
+  ScaledClock scaled(virtualClock, 4.0f);
+  virtualClock.advance(10);
+  TEST_ASSERT(scaled.now() == 40);
+
+  // Rescaling keeps time continuous
+  scaled.setScale(0.5f);
+  TEST_ASSERT(scaled.now() == 40);
+  virtualClock.advance(10);
+  TEST_ASSERT(scaled.now() == 45);
+
+  // Still counts single milliseconds after days of running
+  VirtualClock longRunning(1, 0);
+  ScaledClock realTime(longRunning, 1.0f);
+  longRunning.set(3UL * 24 * 60 * 60 * 1000);
+  unsigned long before = realTime.now();
+  longRunning.advance(1);
+  TEST_ASSERT(before == 3UL * 24 * 60 * 60 * 1000 && realTime.now() == before + 1);
+}
+
+// Simulates `minutes` of auto-switching on a virtual clock and returns a
+// digest of every frame. The mocked millis() is left at zero throughout, so
+// anything still reading it instead of the controller's clock stalls.
+std::vector<uint32_t> simulate_minutes(int minutes, int &switches)
+{
+  reset_mocks();
+
+  LedController ledController;
+  Configuration configuration;
+  AnimationController animController(ledController, configuration);
+  VirtualClock clock(33);
+  animController.setClock(clock);
+  ledController.begin();
+  animController.init();
+
+  std::vector<uint32_t> digest;
+  switches = 0;
+  byte lastAnimation = animController.getCurrentAnimation();
+  const unsigned long end = minutes * 60UL * 1000UL;
+  while (clock.now() < end)
+  {
+    animController.update();
+    clock.step();
+
+    if (animController.getCurrentAnimation() != lastAnimation)
+    {
+      lastAnimation = animController.getCurrentAnimation();
+      switches++;
+    }
+
+    uint32_t hash = 2166136261u;
+    const byte *raw = ledController.ledColors;
+    for (size_t i = 0; i < sizeof(ledController.ledColors); i++)
+    {
+      hash = (hash ^ raw[i]) * 16777619u;
+    }
+    digest.push_back(hash);
+  }
+  TEST_ASSERT(ArduinoMock::_millis == 0);
+  return digest;
+}
+
+void test_virtual_clock_simulation()
+{
+  TEST_CASE("VirtualClockSimulation");
+
+  int firstSwitches = 0;
+  int secondSwitches = 0;
+  std::vector<uint32_t> first = simulate_minutes(10, firstSwitches);
+  std::vector<uint32_t> second = simulate_minutes(10, secondSwitches);
+
+  // Auto switching only advances if the controller follows the virtual clock
+  TEST_ASSERT(firstSwitches > 10);
+  TEST_ASSERT(first == second);
+}
+
+void test_blend_modes()
+{
+  TEST_CASE("BlendModes");
+
+  static LayerBuffer below;
+  static LayerBuffer above;
+  const BlendMode modes[] = {BLEND_NORMAL, BLEND_ADD, BLEND_SCREEN, BLEND_MULTIPLY, BLEND_LIGHTEN};
+  const byte expected[] = {200, 240, 209, 31, 200};
+
+  for (int m = 0; m < 5; m++)
+  {
+    memset(below, 40, sizeof(below));
+    memset(above, 200, sizeof(above));
+    blendLayer(below, above, modes[m], 255);
+    TEST_ASSERT(below[7][3][1] == expected[m]);
+
+    BlendMode parsed;
+    TEST_ASSERT(parseBlendMode(getBlendModeName(modes[m]), parsed) && parsed == modes[m]);
+  }
+
+  // Half opacity lands halfway between the layers
+  memset(below, 40, sizeof(below));
+  blendLayer(below, above, BLEND_NORMAL, 128);
+  TEST_ASSERT(below[0][0][0] == 120);
+}
+
+void test_animation_layers()
+{
+  TEST_CASE("AnimationLayers");
+  reset_mocks();
+
+  LedController ledController;
+  Configuration configuration;
+  AnimationController animController(ledController, configuration);
+  VirtualClock clock(33);
+  animController.setClock(clock);
+  ledController.begin();
+  animController.init();
+  animController.setAutoSwitching(false);
+  animController.startAnimation(find_animation(animController, "Cube Pulse"));
+
+  // Ripple effects share the controller's ripples and cannot be a layer
+  LayerSettings rippleLayer;
+  rippleLayer.animation = find_animation(animController, "Starburst");
+  rippleLayer.enabled = true;
+  TEST_ASSERT(!animController.setLayer(0, rippleLayer));
+
+  // Rainbow underneath the ripples, posted the way the web API does it
+  AnimationCommand command = {};
+  command.type = COMMAND_SET_LAYER;
+  snprintf(command.payload, sizeof(command.payload),
+           "{\"slot\":1,\"animation\":%d,\"position\":\"background\",\"blend\":\"normal\",\"enabled\":true}",
+           find_animation(animController, "Rainbow"));
+  TEST_ASSERT(animController.postCommand(command));
+
+  bool neverBlack = true;
+  bool brightened = false;
+  for (int frame = 0; frame < 200; frame++)
+  {
+    animController.update();
+    clock.step();
+
+    const AnimationLayer &background = animController.getLayer(1);
+    for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+    {
+      for (int l = 0; l < Constants::LEDS_PER_SEGMENT; l++)
+      {
+        byte *out = ledController.getPixel(s, l);
+        const byte *bg = background.buffer[s][l];
+        if (out[0] == 0 && out[1] == 0 && out[2] == 0)
+        {
+          neverBlack = false;
+        }
+        // Screen never darkens what is below it
+        for (int c = 0; c < 3; c++)
+        {
+          if (out[c] < bg[c])
+          {
+            neverBlack = false;
+          }
+          if (out[c] > bg[c])
+          {
+            brightened = true;
+          }
+        }
+      }
+    }
+  }
+  TEST_ASSERT(animController.isLayering());
+  TEST_ASSERT(animController.getLayer(1).settings.enabled);
+  TEST_ASSERT(neverBlack);
+  TEST_ASSERT(brightened);
+
+  // Disabling the last layer goes back to drawing straight into the strips
+  strcpy(command.payload, "{\"slot\":1,\"enabled\":false}");
+  TEST_ASSERT(animController.postCommand(command));
+  animController.update();
+  TEST_ASSERT(!animController.isLayering());
+}
+
+void test_layer_budget()
+{
+  TEST_CASE("LayerBudget");
+  reset_mocks();
+
+  LedController ledController;
+  Configuration configuration;
+  AnimationController animController(ledController, configuration);
+  VirtualClock clock(33);
+  animController.setClock(clock);
+  ledController.begin();
+  animController.init();
+  animController.setAutoSwitching(false);
+  animController.startAnimation(find_animation(animController, "Cube Pulse"));
+
+  LayerSettings unlimited;
+  unlimited.animation = find_animation(animController, "Plasma");
+  unlimited.enabled = true;
+  TEST_ASSERT(animController.setLayer(0, unlimited));
+
+  // A budget far below Plasma's real cost forces most frames to be skipped
+  LayerSettings tight;
+  tight.animation = find_animation(animController, "Wave");
+  tight.position = LAYER_FOREGROUND;
+  tight.blend = BLEND_ADD;
+  tight.enabled = true;
+  tight.budgetMicros = 1;
+  TEST_ASSERT(animController.setLayer(2, tight));
+
+  for (int frame = 0; frame < 100; frame++)
+  {
+    animController.update();
+    clock.step();
+  }
+
+  TEST_ASSERT(animController.getLayer(0).renderedFrames == 100);
+  TEST_ASSERT(animController.getLayer(0).skippedFrames == 0);
+  TEST_ASSERT(animController.getLayer(2).renderedFrames > 0);
+  TEST_ASSERT(animController.getLayer(2).skippedFrames > animController.getLayer(2).renderedFrames);
+}
+
+class VectorSequenceSink : public SequenceSink
+{
+public:
+  std::vector<uint8_t> data;
+  bool write(const uint8_t *bytes, size_t length) override
+  {
+    data.insert(data.end(), bytes, bytes + length);
+    return true;
+  }
+};
+
+void test_sequence_round_trip()
+{
+  TEST_CASE("SequenceRoundTrip");
+
+  const int frames = 60;
+  const size_t frameBytes = Constants::NUM_OF_PIXELS * 3;
+  std::vector<byte> recording(frames * frameBytes);
+  std::mt19937 rng(99);
+
+  // Runs, gradients, static areas and noise, with fewer than 256 colours
+  for (int f = 0; f < frames; f++)
+  {
+    byte *rgb = &recording[f * frameBytes];
+    for (int i = 0; i < Constants::NUM_OF_PIXELS; i++)
+    {
+      byte level;
+      if (i < 100)
+        level = 0;
+      else if (i < 300)
+        level = ((i + f * 3) / 20) * 10;
+      else if (i < 400)
+        level = (i % 7 == f % 7) ? 250 : 40;
+      else
+        level = (rng() % 20) * 12;
+      rgb[i * 3] = level;
+      rgb[i * 3 + 1] = 255 - level;
+      rgb[i * 3 + 2] = level / 2;
+    }
+  }
+
+  static SequenceEncoder encoder;
+  VectorSequenceSink out;
+  TEST_ASSERT(encoder.begin(out, 40));
+  for (int f = 0; f < frames; f++)
+  {
+    encoder.addFrame(&recording[f * frameBytes]);
+  }
+  TEST_ASSERT(encoder.finish());
+  TEST_ASSERT(out.data.size() < recording.size() / 2);
+
+  static SequenceDecoder decoder;
+  static byte decoded[Constants::NUM_OF_PIXELS * 3];
+  MemorySequenceSource source(out.data.data(), out.data.size());
+  TEST_ASSERT(decoder.begin(source));
+  TEST_ASSERT(decoder.getFrameMillis() == 40);
+
+  // Two passes to cover rewinding
+  bool lossless = true;
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (int f = 0; f < frames; f++)
+    {
+      if (!decoder.nextFrame())
+      {
+        lossless = false;
+        break;
+      }
+      decoder.render(decoded);
+      if (memcmp(decoded, &recording[f * frameBytes], frameBytes) != 0)
+      {
+        lossless = false;
+      }
+    }
+    TEST_ASSERT(!decoder.nextFrame() && decoder.isValid());
+    TEST_ASSERT(decoder.rewind());
+  }
+  TEST_ASSERT(lossless);
+
+  // Truncated files are rejected rather than read past the end
+  MemorySequenceSource truncated(out.data.data(), out.data.size() / 3);
+  TEST_ASSERT(decoder.begin(truncated));
+  int decodedFrames = 0;
+  while (decoder.nextFrame())
+  {
+    decodedFrames++;
+  }
+  TEST_ASSERT(decodedFrames < frames);
+  TEST_ASSERT(!decoder.isValid());
+}
+
+void test_sequence_worst_case()
+{
+  TEST_CASE("SequenceWorstCase");
+
+  // Full-colour noise overflows the palette and changes every pixel
+  static SequenceEncoder encoder;
+  VectorSequenceSink out;
+  std::mt19937 rng(7);
+  static byte rgb[Constants::NUM_OF_PIXELS * 3];
+  encoder.begin(out, 33);
+  for (int f = 0; f < 20; f++)
+  {
+    for (size_t i = 0; i < sizeof(rgb); i++)
+    {
+      rgb[i] = rng();
+    }
+    encoder.addFrame(rgb);
+  }
+  encoder.finish();
+
+  static SequenceDecoder decoder;
+  MemorySequenceSource source(out.data.data(), out.data.size());
+  TEST_ASSERT(decoder.begin(source));
+  int frames = 0;
+  while (decoder.nextFrame())
+  {
+    frames++;
+  }
+  TEST_ASSERT(frames == 20);
+  TEST_ASSERT(decoder.isValid());
+}
+
+void test_sequence_record_and_playback()
+{
+  TEST_CASE("SequenceRecordAndPlayback");
+  reset_mocks();
+  SPIFFS.begin();
+
+  LedController ledController;
+  Configuration configuration;
+  AnimationController animController(ledController, configuration);
+  VirtualClock clock(33);
+  animController.setClock(clock);
+  ledController.begin();
+  animController.init();
+  animController.setAutoSwitching(false);
+  animController.startAnimation(find_animation(animController, "Rainbow"));
+
+  // Record every other rendered frame; Rainbow fits the palette, so
+  // playback must reproduce it exactly
+  TEST_ASSERT(animController.startRecording(30, 66));
+  std::vector<byte> shown;
+  int rendered = 0;
+  while (animController.isRecording() && rendered < 1000)
+  {
+    animController.update();
+    if (rendered % 2 == 0)
+    {
+      const byte *raw = ledController.ledColors;
+      shown.insert(shown.end(), raw, raw + sizeof(ledController.ledColors));
+    }
+    clock.step();
+    rendered++;
+  }
+  TEST_ASSERT(!animController.isRecording());
+  TEST_ASSERT(rendered == 59);
+
+  // Play it back frame-locked to the recording
+  int playback = find_animation(animController, "Playback");
+  animController.changeAnimation(playback);
+  PlaybackAnimation *anim = static_cast<PlaybackAnimation *>(animController.getAnimation(playback));
+  TEST_ASSERT(anim->isPlaying());
+
+  int maxError = 0;
+  for (int f = 0; f < 30; f++)
+  {
+    animController.update();
+    const byte *raw = ledController.ledColors;
+    for (size_t i = 0; i < sizeof(ledController.ledColors); i++)
+    {
+      maxError = std::max(maxError, std::abs((int)raw[i] - (int)shown[f * sizeof(ledController.ledColors) + i]));
+    }
+    clock.advance(66);
+  }
+  TEST_ASSERT(maxError == 0);
+
+  // Loops instead of finishing
+  for (int f = 0; f < 90; f++)
+  {
+    animController.update();
+    clock.advance(66);
+  }
+  TEST_ASSERT(anim->isPlaying());
+}
+
+void test_topology_tables()
+{
+  TEST_CASE("Derived Topology Tables");
+
+  // Rederive everything by brute force from the hand-written tables
+  int mismatches = 0;
+  for (int n = 0; n < Constants::NUMBER_OF_NODES; n++)
+  {
+    int down = 0, up = 0, any = 0;
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      int seg = Topology::nodeConnections[n][p];
+      int other = -1;
+      if (seg >= 0)
+      {
+        other = Topology::segmentConnections[seg][0] == n ? Topology::segmentConnections[seg][1] : Topology::segmentConnections[seg][0];
+        if (Topology::getPaths(n).segments[any] != seg || Topology::getPaths(n).ports[any] != p)
+          mismatches++;
+        any++;
+        const PathList &list = Topology::nodePositions[other].y > Topology::nodePositions[n].y ? Topology::getDownPaths(n) : Topology::getUpPaths(n);
+        int &index = Topology::nodePositions[other].y > Topology::nodePositions[n].y ? down : up;
+        if (list.segments[index] != seg || list.ports[index] != p)
+          mismatches++;
+        index++;
+      }
+      if (Topology::getNeighborNode(n, p) != other)
+        mismatches++;
+    }
+    if (Topology::getPaths(n).count != any || Topology::getDownPaths(n).count != down || Topology::getUpPaths(n).count != up)
+      mismatches++;
+  }
+
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+  {
+    int bottom = Topology::segmentConnections[s][1];
+    int count = 0;
+    for (int p = 0; p < Constants::MAX_PATHS_PER_NODE; p++)
+    {
+      int seg = Topology::nodeConnections[bottom][p];
+      if (seg >= 0 && seg != s && Topology::segmentConnections[seg][0] == bottom)
+      {
+        if (Topology::getFeeders(s).segments[count++] != seg)
+          mismatches++;
+      }
+    }
+    if (Topology::getFeeders(s).count != count)
+      mismatches++;
+  }
+  TEST_ASSERT(mismatches == 0);
+
+  // Spot checks: the bottom node only leads up, the top row only down
+  TEST_ASSERT(Topology::getDownPaths(24).count == 0);
+  TEST_ASSERT(Topology::getUpPaths(24).count == 2);
+  TEST_ASSERT(Topology::getUpPaths(0).count == 0);
+  TEST_ASSERT(Topology::getNeighborNode(3, 3) == 10);
+  TEST_ASSERT(Topology::getNextStep(0, 24) >= 0);
+
+  // The animations that walk the derived tables keep running on them
+  const char *walkers[] = {"Water Pour", "Bouncing Balls", "Digital Rain", "Lightning", "Inferno", "Fireworks"};
+  for (const char *name : walkers)
+  {
+    reset_mocks();
+    LedController ledController;
+    Configuration configuration;
+    AnimationController animController(ledController, configuration);
+    VirtualClock clock(33);
+    animController.setClock(clock);
+    ledController.begin();
+    animController.init();
+    animController.setAutoSwitching(false);
+
+    int index = find_animation(animController, name);
+    TEST_ASSERT(index >= 0);
+    if (index < 0)
+      continue;
+    animController.startAnimation(index);
+
+    bool lit = false;
+    for (int f = 0; f < 300; f++)
+    {
+      animController.update();
+      clock.step();
+      const byte *rgb = ledController.ledColors;
+      for (int i = 0; i < Constants::NUM_OF_PIXELS * 3 && !lit; i++)
+        lit = rgb[i] != 0;
+    }
+    if (!lit)
+      std::cout << "  " << name << " never lit a pixel" << std::endl;
+    TEST_ASSERT(lit);
+  }
+}
+
+void test_topology_layout()
+{
+  TEST_CASE("Runtime Topology Layout");
+  reset_mocks();
+
+  // The stock wall loaded at runtime derives the same tables as the compiled one
+  TopologyLayout stock;
+  TEST_ASSERT(stock.loadStock());
+  TEST_ASSERT(stock.getLedCount() == Constants::NUM_OF_PIXELS);
+
+  int stockRoutes[Constants::NUMBER_OF_NODES][Constants::NUMBER_OF_NODES];
+  for (int a = 0; a < Constants::NUMBER_OF_NODES; a++)
+    for (int b = 0; b < Constants::NUMBER_OF_NODES; b++)
+      stockRoutes[a][b] = Topology::getNextStep(a, b);
+  PathList stockDown = Topology::getDownPaths(4);
+  LedPosition stockLed = Topology::getLedPosition(17, 5);
+
+  Topology::setLayout(&stock);
+  TEST_ASSERT(!Topology::isStockLayout());
+  int mismatches = 0;
+  for (int a = 0; a < Constants::NUMBER_OF_NODES; a++)
+    for (int b = 0; b < Constants::NUMBER_OF_NODES; b++)
+      mismatches += Topology::getNextStep(a, b) != stockRoutes[a][b];
+  TEST_ASSERT(mismatches == 0);
+  TEST_ASSERT(memcmp(&Topology::getDownPaths(4), &stockDown, sizeof(PathList)) == 0);
+  TEST_ASSERT(Topology::getLedPosition(17, 5).x == stockLed.x && Topology::getLedPosition(17, 5).y == stockLed.y);
+  TEST_ASSERT(Topology::starburstNode == 15 && Topology::numberOfCubeNodes == 8);
+  Topology::setLayout(nullptr);
+  TEST_ASSERT(Topology::isStockLayout());
+
+  // Binary and JSON round trips
+  std::vector<uint8_t> binary(stock.getBinarySize());
+  TEST_ASSERT(stock.writeBinary(binary.data(), binary.size()) == binary.size());
+  TopologyLayout fromBinary;
+  TEST_ASSERT(fromBinary.loadBinary(binary.data(), binary.size()));
+  TEST_ASSERT(!fromBinary.loadBinary(binary.data(), binary.size() - 1));
+
+  JsonDocument doc;
+  JsonObject root = doc.to<JsonObject>();
+  stock.writeJson(root);
+  std::string json;
+  serializeJson(doc, json);
+  TopologyLayout fromJson;
+  TEST_ASSERT(fromJson.loadJson(json.data(), json.size()));
+  std::vector<uint8_t> again(fromJson.getBinarySize());
+  fromJson.writeBinary(again.data(), again.size());
+  TEST_ASSERT(again == binary);
+
+  // Broken tables are rejected with a reason
+  JsonArray nodes = doc["nodes"];
+  JsonObject node0 = nodes[0];
+  JsonArray ports0 = node0["ports"];
+  ports0[2] = 7; // Segment 7 does not end at node 0
+  serializeJson(doc, json);
+  TopologyLayout broken;
+  TEST_ASSERT(!broken.loadJson(json.data(), json.size()));
+  TEST_ASSERT(broken.getError() != nullptr);
+  ports0[2] = 1;
+
+  // A custom wall: segment 0 has only 8 LEDs, at the ceiling end of its old range
+  JsonArray segments = doc["segments"];
+  JsonObject segment0 = segments[0];
+  int floorLed = segment0["floorLed"].as<int>();
+  int ceilingLed = segment0["ceilingLed"].as<int>();
+  int step = ceilingLed < floorLed ? 1 : -1;
+  segment0["floorLed"] = ceilingLed + 7 * step;
+  serializeJson(doc, json);
+  TopologyLayout custom;
+  TEST_ASSERT(custom.loadJson(json.data(), json.size()));
+  TEST_ASSERT(custom.getLedCount() == Constants::NUM_OF_PIXELS - 6);
+
+  // Through SPIFFS at boot, and onto the strips with the frame buffer resampled
+  SPIFFS.begin();
+  File file = SPIFFS.open(Topology::LAYOUT_JSON_PATH, FILE_WRITE);
+  file.write((const uint8_t *)json.data(), json.size());
+  file.close();
+  TEST_ASSERT(Topology::begin());
+  TEST_ASSERT(!Topology::isStockLayout());
+  TEST_ASSERT(Topology::getSegmentLedCount(0) == 8);
+  {
+    LedController ledController;
+    ledController.begin();
+    TEST_ASSERT(ledController.getPixelRouteCount() == Constants::NUM_OF_PIXELS - 6);
+    ledController.setPixelColor(0, 0, 10, 0, 0);
+    ledController.setPixelColor(0, Constants::LEDS_PER_SEGMENT - 1, 0, 20, 0);
+    ledController.show();
+    int strip = Topology::ledAssignments[0][0];
+    TEST_ASSERT(ledController.getStrip(strip)->getPixelColor(ceilingLed + 7 * step) == Adafruit_NeoPixel::Color(10, 0, 0));
+    TEST_ASSERT(ledController.getStrip(strip)->getPixelColor(ceilingLed) == Adafruit_NeoPixel::Color(0, 20, 0));
+  }
+
+  // A bad file is reported and the running layout stays
+  file = SPIFFS.open(Topology::LAYOUT_JSON_PATH, FILE_WRITE);
+  file.write((const uint8_t *)"{\"nodes\": 1}", 12);
+  file.close();
+  TEST_ASSERT(!Topology::begin());
+  TEST_ASSERT(Topology::getSegmentLedCount(0) == 8);
+
+  remove((std::string("tmp_spiffs") + Topology::LAYOUT_JSON_PATH).c_str());
+  Topology::setLayout(nullptr);
+  TEST_ASSERT(Topology::getSegmentLedCount(0) == Constants::LEDS_PER_SEGMENT);
+}
+
+void test_frame_diff()
+{
+  TEST_CASE("FrameDiff");
+
+  // More pixels than a 16-bit index can reach
+  const int pixels = 70000;
+  std::vector<uint8_t> frame(pixels * 3, 0);
+  std::vector<uint8_t> client(pixels * 3, 0);
+  static FrameDiffEncoder encoder;
+  encoder.begin(pixels);
+
+  // Nothing changed: just the header
+  size_t length = encoder.encode(frame.data());
+  TEST_ASSERT(length == FrameDiff::RUNS_HEADER_SIZE && encoder.getMessage()[0] == FrameDiff::TYPE_RUNS);
+
+  // One pixel past 65535
+  frame[69000 * 3 + 1] = 200;
+  length = encoder.encode(frame.data());
+  TEST_ASSERT(length == FrameDiff::RUNS_HEADER_SIZE + FrameDiff::RUN_HEADER_SIZE + 3);
+  TEST_ASSERT(FrameDiff::apply(encoder.getMessage(), length, client.data(), pixels));
+  TEST_ASSERT(client == frame);
+
+  // Changes one pixel apart share a run; two apart start a new one
+  frame[10 * 3] = 1;
+  frame[12 * 3] = 1;
+  frame[15 * 3] = 1;
+  length = encoder.encode(frame.data());
+  TEST_ASSERT(encoder.getMessage()[3] == 2);
+  TEST_ASSERT(length == FrameDiff::RUNS_HEADER_SIZE + 2 * FrameDiff::RUN_HEADER_SIZE + 4 * 3);
+  TEST_ASSERT(FrameDiff::apply(encoder.getMessage(), length, client.data(), pixels));
+  TEST_ASSERT(client == frame);
+
+  // Random sparse and dense frames stay in sync; long runs are split
+  std::mt19937 rng(7);
+  bool inSync = true;
+  for (int f = 0; f < 20; f++)
+  {
+    int changes = f % 2 ? pixels / 50 : 0;
+    for (int c = 0; c < changes; c++)
+    {
+      frame[(rng() % (pixels * 3))] = rng();
+    }
+    if (f == 10)
+    {
+      memset(frame.data() + 1000 * 3, f, 600 * 3);
+    }
+    length = encoder.encode(frame.data());
+    inSync = inSync && FrameDiff::apply(encoder.getMessage(), length, client.data(), pixels) && client == frame;
+  }
+  TEST_ASSERT(inSync);
+
+  // Everything changed: the full frame is smaller
+  for (size_t i = 0; i < frame.size(); i++)
+  {
+    frame[i] = ~frame[i];
+  }
+  length = encoder.encode(frame.data());
+  TEST_ASSERT(length == 1 + frame.size() && encoder.getMessage()[0] == FrameDiff::TYPE_FULL);
+  TEST_ASSERT(FrameDiff::apply(encoder.getMessage(), length, client.data(), pixels) && client == frame);
+
+  // New clients get the whole frame
+  length = encoder.encodeFull(frame.data());
+  std::vector<uint8_t> joined(pixels * 3, 0);
+  TEST_ASSERT(FrameDiff::apply(encoder.getFullFrame(), length, joined.data(), pixels) && joined == frame);
+
+  // Runs past the end of the frame are rejected
+  const uint8_t bad[] = {FrameDiff::TYPE_RUNS, 0, 0, 1, 0x01, 0x11, 0x6F, 2, 1, 2, 3, 4, 5, 6};
+  TEST_ASSERT(!FrameDiff::apply(bad, sizeof(bad), client.data(), pixels));
+  TEST_ASSERT(!FrameDiff::apply(bad, 9, client.data(), pixels));
+}
+
+void test_many_strips()
+{
+  TEST_CASE("Many Strips");
+  reset_mocks();
+
+  // The stock wall dealt round-robin onto 20 outputs
+  const int stripCount = 20;
+  TopologyLayout stock;
+  TEST_ASSERT(stock.loadStock());
+  JsonDocument doc;
+  JsonObject root = doc.to<JsonObject>();
+  stock.writeJson(root);
+  JsonArray segments = doc["segments"];
+  for (int s = 0; s < (int)segments.size(); s++)
+  {
+    JsonObject segment = segments[s];
+    int first = (s / stripCount) * Constants::LEDS_PER_SEGMENT;
+    segment["strip"] = s % stripCount;
+    segment["floorLed"] = first;
+    segment["ceilingLed"] = first + Constants::LEDS_PER_SEGMENT - 1;
+  }
+  JsonArray strips = doc["strips"].to<JsonArray>();
+  for (int i = 0; i < stripCount; i++)
+  {
+    JsonObject strip = strips.add<JsonObject>();
+    strip["length"] = 2 * Constants::LEDS_PER_SEGMENT;
+    strip["pin"] = i;
+  }
+  std::string json;
+  serializeJson(doc, json);
+  TopologyLayout wide;
+  TEST_ASSERT(wide.loadJson(json.data(), json.size()));
+
+  Topology::setLayout(&wide);
+  {
+    LedController ledController;
+    ledController.begin();
+    TEST_ASSERT(ledController.getStripCount() == stripCount);
+    TEST_ASSERT(ledController.getPixelRouteCount() == Constants::NUM_OF_PIXELS);
+
+    // Segment 39 is the second segment on strip 19
+    ledController.setPixelColor(39, 0, 1, 2, 3);
+    ledController.show();
+    TEST_ASSERT(ledController.getStrip(19)->getPixelColor(Constants::LEDS_PER_SEGMENT) == Adafruit_NeoPixel::Color(1, 2, 3));
+    TEST_ASSERT(ledController.getPixel(39, 0)[2] == 3);
+  }
+  Topology::setLayout(nullptr);
+}
+
+void test_distance_fields()
+{
+  TEST_CASE("Distance Fields");
+  reset_mocks();
+
+  // Brute force: a breadth-first search over every LED, with each node one
+  // step beyond the end LEDs of its segments
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  const int vertices = Constants::NUMBER_OF_NODES + Constants::NUM_OF_PIXELS;
+  std::vector<std::vector<int>> edges(vertices);
+  auto link = [&](int a, int b)
+  {
+    edges[a].push_back(b);
+    edges[b].push_back(a);
+  };
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+  {
+    int first = Constants::NUMBER_OF_NODES + s * leds;
+    link(Topology::segmentConnections[s][1], first);
+    for (int i = 1; i < leds; i++)
+    {
+      link(first + i - 1, first + i);
+    }
+    link(first + leds - 1, Topology::segmentConnections[s][0]);
+  }
+
+  int mismatches = 0;
+  int maxMismatches = 0;
+  for (int node = 0; node < Constants::NUMBER_OF_NODES; node++)
+  {
+    std::vector<int> dist(vertices, -1);
+    std::vector<int> queue(1, node);
+    dist[node] = 0;
+    for (size_t q = 0; q < queue.size(); q++)
+    {
+      for (int next : edges[queue[q]])
+      {
+        if (dist[next] < 0)
+        {
+          dist[next] = dist[queue[q]] + 1;
+          queue.push_back(next);
+        }
+      }
+    }
+
+    const uint8_t *field = Topology::getDistanceField(node);
+    int furthest = 0;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+    {
+      mismatches += field[p] != dist[Constants::NUMBER_OF_NODES + p];
+      furthest = std::max(furthest, dist[Constants::NUMBER_OF_NODES + p]);
+    }
+    maxMismatches += Topology::getMaxDistance(node) != furthest;
+  }
+  TEST_ASSERT(mismatches == 0);
+  TEST_ASSERT(maxMismatches == 0);
+  TEST_ASSERT(Topology::getDistanceField(-1) == nullptr);
+
+  // Next to the center along the wiring, far from it across empty space
+  const uint8_t *fromCenter = Topology::getDistanceField(Topology::starburstNode);
+  const PathList &centerPaths = Topology::getPaths(Topology::starburstNode);
+  for (int k = 0; k < centerPaths.count; k++)
+  {
+    int s = centerPaths.segments[k];
+    int nearEnd = Topology::segmentConnections[s][1] == Topology::starburstNode ? 0 : leds - 1;
+    TEST_ASSERT(fromCenter[LedController::pixelIndex(s, nearEnd)] == 1);
+  }
+
+  // Wave is the same colour at the same distance along the wiring
+  LedController ledController;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  ledController.begin();
+  controller.init();
+  int waveIndex = find_animation(controller, "Wave");
+  TEST_ASSERT(waveIndex >= 0);
+  Animation *wave = controller.getAnimation(waveIndex);
+  wave->run();
+  ArduinoMock::advanceMillis(1234);
+  wave->update();
+  std::vector<int> colorAt(256, -1);
+  bool consistent = true;
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const byte *rgb = ledController.ledColors + p * 3;
+    int color = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+    int &seen = colorAt[fromCenter[p]];
+    consistent = consistent && (seen < 0 || seen == color);
+    seen = color;
+  }
+  TEST_ASSERT(consistent);
+}
+
+void test_spatial_index()
+{
+  TEST_CASE("Spatial Index");
+  reset_mocks();
+
+  const SpatialIndex &index = Topology::getSpatialIndex();
+  TEST_ASSERT(index.getColumns() > 1 && index.getRows() > 1);
+
+  // Every query matches a test of every LED, as sorted, merged spans
+  std::mt19937 rng(35);
+  auto uniform = [&](float lo, float hi)
+  { return lo + (hi - lo) * (rng() % 10000) / 10000.0f; };
+
+  static LedSpan spans[Constants::NUM_OF_PIXELS];
+  int mismatches = 0;
+  int unmerged = 0;
+  int totalHits = 0;
+  for (int q = 0; q < 300; q++)
+  {
+    float x = uniform(0, 80);
+    float y = uniform(-5, 30);
+    float radius = uniform(0.5f, 20);
+    float angle = uniform(-3.2f, 3.2f);
+    float halfWidth = uniform(0.05f, 3.3f);
+    float right = x + uniform(0, 30);
+    float bottom = y + uniform(0, 15);
+    float inner = radius * uniform(0, 1);
+    int shape = q % 4;
+
+    int count;
+    if (shape == 0)
+      count = index.queryRadius(x, y, radius, spans, Constants::NUM_OF_PIXELS);
+    else if (shape == 1)
+      count = index.queryRect(x, y, right, bottom, spans, Constants::NUM_OF_PIXELS);
+    else if (shape == 2)
+      count = index.querySector(x, y, angle, halfWidth, radius, spans, Constants::NUM_OF_PIXELS);
+    else
+      count = index.queryRing(x, y, inner, radius, spans, Constants::NUM_OF_PIXELS);
+
+    std::vector<bool> hit(Constants::NUM_OF_PIXELS, false);
+    for (int k = 0; k < count; k++)
+    {
+      for (int led = spans[k].first; led < spans[k].first + spans[k].count; led++)
+      {
+        hit[LedController::pixelIndex(spans[k].segment, led)] = true;
+      }
+      if (k > 0 && spans[k - 1].segment == spans[k].segment && spans[k - 1].first + spans[k - 1].count >= spans[k].first)
+      {
+        unmerged++;
+      }
+      if (k > 0 && spans[k - 1].segment > spans[k].segment)
+      {
+        unmerged++;
+      }
+    }
+
+    for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+    {
+      for (int led = 0; led < Constants::LEDS_PER_SEGMENT; led++)
+      {
+        const LedPosition &p = Topology::getLedPosition(s, led);
+        float dx = p.x - x;
+        float dy = p.y - y;
+        bool inside;
+        if (shape == 0)
+          inside = dx * dx + dy * dy <= radius * radius;
+        else if (shape == 1)
+          inside = p.x >= x && p.x <= right && p.y >= y && p.y <= bottom;
+        else if (shape == 2)
+        {
+          float diff = std::fabs(std::remainder(std::atan2(dy, dx) - angle, 2 * (float)M_PI));
+          inside = dx * dx + dy * dy <= radius * radius && (diff <= halfWidth || (dx == 0 && dy == 0));
+        }
+        else
+          inside = dx * dx + dy * dy >= inner * inner && dx * dx + dy * dy <= radius * radius;
+        // Leave LEDs right on an edge to rounding
+        bool onEdge = shape == 2 && std::fabs(std::fabs(std::remainder(std::atan2(dy, dx) - angle, 2 * (float)M_PI)) - halfWidth) < 1e-4f;
+        if (!onEdge && inside != hit[LedController::pixelIndex(s, led)])
+        {
+          mismatches++;
+        }
+        totalHits += inside;
+      }
+    }
+  }
+  TEST_ASSERT(mismatches == 0);
+  TEST_ASSERT(unmerged == 0);
+  TEST_ASSERT(totalHits > 1000);
+
+  // A query covering the wall returns each segment whole; capacity is respected
+  int count = index.queryRect(-100, -100, 200, 200, spans, Constants::NUM_OF_PIXELS);
+  TEST_ASSERT(count == Constants::NUMBER_OF_SEGMENTS);
+  TEST_ASSERT(spans[7].segment == 7 && spans[7].first == 0 && spans[7].count == Constants::LEDS_PER_SEGMENT);
+  TEST_ASSERT(index.queryRect(-100, -100, 200, 200, spans, 5) == 5);
+  TEST_ASSERT(index.queryRadius(500, 500, 3, spans, Constants::NUM_OF_PIXELS) == 0);
+
+  // Searchlight lights a wedge from the center, Fireworks a flash around each burst
+  LedController ledController;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  ledController.begin();
+  controller.init();
+  controller.setAutoSwitching(false);
+  const char *effects[] = {"Searchlight", "Fireworks"};
+  for (const char *effect : effects)
+  {
+    controller.startAnimation(find_animation(controller, effect));
+    int maxLit = 0;
+    for (int f = 0; f < 300; f++)
+    {
+      controller.update();
+      ArduinoMock::advanceMillis(33);
+      int lit = 0;
+      for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+      {
+        lit += ledController.ledColors[p * 3] || ledController.ledColors[p * 3 + 1] || ledController.ledColors[p * 3 + 2];
+      }
+      maxLit = std::max(maxLit, lit);
+    }
+    TEST_ASSERT(maxLit > 20);
+    TEST_ASSERT(maxLit < Constants::NUM_OF_PIXELS);
+  }
+}
+
+// Node at the end of the segment a pixel sits on, -1 mid-segment
+static int pixelEndNode(int pixel)
+{
+  int segment = pixel / Constants::LEDS_PER_SEGMENT;
+  int led = pixel % Constants::LEDS_PER_SEGMENT;
+  if (led == 0)
+    return Topology::segmentConnections[segment][1];
+  if (led == Constants::LEDS_PER_SEGMENT - 1)
+    return Topology::segmentConnections[segment][0];
+  return -1;
+}
+
+// Neighbouring LEDs of one segment, or the end LEDs of two segments at one node
+static bool pixelsAdjacent(int a, int b)
+{
+  int segmentA = a / Constants::LEDS_PER_SEGMENT;
+  int segmentB = b / Constants::LEDS_PER_SEGMENT;
+  if (segmentA == segmentB)
+    return std::abs(a - b) == 1;
+  return pixelEndNode(a) >= 0 && pixelEndNode(a) == pixelEndNode(b);
+}
+
+void test_path_library()
+{
+  TEST_CASE("Path Library");
+  reset_mocks();
+
+  const PathLibrary &library = Topology::getPathLibrary();
+  const int L = Constants::LEDS_PER_SEGMENT;
+
+  // Columns reproduce the seven hand-written Shooting Star paths, -1 a gap
+  const int expected[7][3] = {{12, -1, -1}, {13, 29, -1}, {14, -1, 30}, {15, 31, -1}, {16, -1, 32}, {17, 33, -1}, {18, -1, -1}};
+  const int expectedBlocks[7] = {1, 2, 3, 2, 3, 2, 1};
+  TEST_ASSERT(library.getCount(PathLibrary::COLUMNS) == 7);
+  TEST_ASSERT(library.getLongest(PathLibrary::COLUMNS) == 3 * L);
+  bool columnsMatch = true;
+  for (int c = 0; c < 7 && c < library.getCount(PathLibrary::COLUMNS); c++)
+  {
+    const uint16_t *pixels = library.getPixels(PathLibrary::COLUMNS, c);
+    columnsMatch = columnsMatch && library.getLength(PathLibrary::COLUMNS, c) == expectedBlocks[c] * L;
+    for (int i = 0; columnsMatch && i < expectedBlocks[c] * L; i++)
+    {
+      int segment = expected[c][i / L];
+      int want = segment < 0 ? PathLibrary::GAP : LedController::pixelIndex(segment, L - 1 - i % L);
+      columnsMatch = pixels[i] == want;
+    }
+  }
+  TEST_ASSERT(columnsMatch);
+
+  // Descents start at the top and fall one whole segment after another to
+  // a node with nothing below it, six segments on the stock wall
+  int descents = library.getCount(PathLibrary::DESCENTS);
+  TEST_ASSERT(descents == 56);
+  bool descentsValid = true;
+  for (int d = 0; d < descents; d++)
+  {
+    const uint16_t *pixels = library.getPixels(PathLibrary::DESCENTS, d);
+    int length = library.getLength(PathLibrary::DESCENTS, d);
+    int start = library.getNode(PathLibrary::DESCENTS, d);
+    descentsValid = descentsValid && length == 6 * L && Topology::getUpPaths(start).count == 0;
+    descentsValid = descentsValid && pixelEndNode(pixels[0]) == start &&
+                    Topology::getDownPaths(pixelEndNode(pixels[length - 1])).count == 0;
+    for (int i = 1; i < length; i++)
+    {
+      int y0 = Topology::getLedPosition(pixels[i - 1] / L, pixels[i - 1] % L).y;
+      int y1 = Topology::getLedPosition(pixels[i] / L, pixels[i] % L).y;
+      descentsValid = descentsValid && pixelsAdjacent(pixels[i - 1], pixels[i]) && y1 >= y0;
+    }
+  }
+  TEST_ASSERT(descentsValid);
+
+  // One border loop, closed, covering the 16 outside segments once each
+  TEST_ASSERT(library.getCount(PathLibrary::BORDERS) == 1);
+  const uint16_t *border = library.getPixels(PathLibrary::BORDERS, 0);
+  int borderLength = library.getLength(PathLibrary::BORDERS, 0);
+  TEST_ASSERT(borderLength == 16 * L);
+  bool borderValid = pixelsAdjacent(border[borderLength - 1], border[0]);
+  std::vector<int> seen(Constants::NUM_OF_PIXELS, 0);
+  for (int i = 0; i < borderLength; i++)
+  {
+    borderValid = borderValid && (i == 0 || pixelsAdjacent(border[i - 1], border[i])) && seen[border[i]]++ == 0;
+  }
+  TEST_ASSERT(borderValid);
+  TEST_ASSERT(seen[LedController::pixelIndex(0, 3)] == 1 && seen[LedController::pixelIndex(39, 3)] == 1);
+  TEST_ASSERT(seen[LedController::pixelIndex(15, 3)] == 0);
+
+  // A hexagon round each cube corner, twelve segments round the six-way node
+  TEST_ASSERT(library.getCount(PathLibrary::RINGS) == Topology::numberOfCubeNodes + 1);
+  bool ringsValid = true;
+  for (int r = 0; r < library.getCount(PathLibrary::RINGS); r++)
+  {
+    const uint16_t *pixels = library.getPixels(PathLibrary::RINGS, r);
+    int length = library.getLength(PathLibrary::RINGS, r);
+    int centre = library.getNode(PathLibrary::RINGS, r);
+    int segments = Topology::getPaths(centre).count == 6 ? 12 : 6;
+    ringsValid = ringsValid && length == segments * L && pixelsAdjacent(pixels[length - 1], pixels[0]);
+    for (int i = 0; i < length; i++)
+    {
+      int segment = pixels[i] / L;
+      ringsValid = ringsValid && (i == 0 || pixelsAdjacent(pixels[i - 1], pixels[i])) &&
+                   Topology::segmentConnections[segment][0] != centre && Topology::segmentConnections[segment][1] != centre;
+    }
+  }
+  TEST_ASSERT(ringsValid);
+  TEST_ASSERT(library.getNode(PathLibrary::RINGS, 0) == 7);
+  TEST_ASSERT(library.getLongest(PathLibrary::RINGS) == 12 * L);
+
+  // The animations that walk the library still draw
+  LedController ledController;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  ledController.begin();
+  controller.init();
+  controller.setAutoSwitching(false);
+  const char *effects[] = {"Shooting Star", "Digital Rain", "Lightning"};
+  for (const char *effect : effects)
+  {
+    controller.startAnimation(find_animation(controller, effect));
+    int maxLit = 0;
+    for (int f = 0; f < 200; f++)
+    {
+      controller.update();
+      ArduinoMock::advanceMillis(33);
+      int lit = 0;
+      for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+      {
+        lit += ledController.ledColors[p * 3] || ledController.ledColors[p * 3 + 1] || ledController.ledColors[p * 3 + 2];
+      }
+      maxLit = std::max(maxLit, lit);
+    }
+    TEST_ASSERT(maxLit > 5);
+  }
+}
+
+void test_fixed_point_plasma()
+{
+  TEST_CASE("Fixed Point Plasma");
+  reset_mocks();
+
+  // The tables themselves
+  int worstSine = 0;
+  for (int a = 0; a < FixedMath::TURN; a += 7)
+  {
+    int exact = (int)lround(std::sin(2 * M_PI * a / FixedMath::TURN) * FixedMath::ONE);
+    worstSine = std::max(worstSine, std::abs(FixedMath::sin16(a) - exact));
+  }
+  TEST_ASSERT(worstSine <= 102); // 0.0031 in Q15
+  TEST_ASSERT(FixedMath::sin16(FixedMath::TURN / 4) == FixedMath::ONE);
+  TEST_ASSERT(FixedMath::cos16(-3 * FixedMath::TURN) == FixedMath::ONE);
+  TEST_ASSERT(FixedMath::fromRadians(-M_PI / 2) == 3 * FixedMath::TURN / 4);
+  TEST_ASSERT(FixedMath::fromRadians(1e6 * 2 * M_PI + M_PI) == FixedMath::TURN / 2);
+  bool rootsClose = FixedMath::sqrt32(0) == 0 && FixedMath::sqrt32(1) == 1 && FixedMath::sqrt32(0xFFFFFFFFu) >= 65534;
+  for (uint64_t n = 0; n < 0x100000000ull; n = n * 5 / 4 + 1)
+  {
+    long exact = (long)std::floor(std::sqrt((double)n));
+    rootsClose = rootsClose && std::labs((long)FixedMath::sqrt32((uint32_t)n) - exact) <= 1;
+  }
+  for (uint32_t n = 0; n < 100000; n++)
+  {
+    rootsClose = rootsClose && std::labs((long)FixedMath::sqrt32(n) - (long)std::sqrt((double)n)) <= 1;
+  }
+  TEST_ASSERT(rootsClose);
+
+  // Against the float kernel: colours within a few steps over a minute of frames
+  LedController ledController;
+  LedController reference;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  ledController.begin();
+  controller.init();
+  controller.setAutoSwitching(false);
+  controller.startAnimation(find_animation(controller, "Plasma"));
+
+  int worst = 0;
+  long total = 0;
+  long channels = 0;
+  for (int f = 0; f < 1800; f++)
+  {
+    controller.update();
+    Reference::plasma(reference, controller.now());
+    for (int c = 0; c < Constants::NUM_OF_PIXELS * 3; c++)
+    {
+      int diff = std::abs(ledController.ledColors[c] - reference.ledColors[c]);
+      worst = std::max(worst, diff);
+      total += diff;
+      channels++;
+    }
+    ArduinoMock::advanceMillis(33);
+  }
+  // About one sine table step of hue at the steepest part of the colour wheel
+  TEST_ASSERT(worst <= 16);
+  TEST_ASSERT((double)total / channels < 0.75);
+}
+
+void test_rainbow_hue_offsets()
+{
+  TEST_CASE("Rainbow Hue Offsets");
+  reset_mocks();
+
+  // Cached offsets and the hue wheel against the per-frame float maths, at
+  // the default brightness and at full brightness
+  LedController ledController;
+  LedController reference;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  ledController.begin();
+  controller.init();
+  controller.setAutoSwitching(false);
+
+  const char *effects[] = {"Rainbow Radiate", "Rainbow Pinwheel"};
+  int brightnesses[] = {30, 255};
+  for (const char *effect : effects)
+  {
+    for (int brightness : brightnesses)
+    {
+      configuration.setRainbowBrightness(brightness);
+      controller.startAnimation(find_animation(controller, effect));
+      int worst = 0;
+      for (int f = 0; f < 120; f++)
+      {
+        controller.update();
+        if (std::string(effect) == "Rainbow Radiate")
+          Reference::rainbowRadiate(reference, brightness, controller.now());
+        else
+          Reference::rainbowPinwheel(reference, brightness, controller.now(), 1);
+        for (int c = 0; c < Constants::NUM_OF_PIXELS * 3; c++)
+        {
+          worst = std::max(worst, std::abs(ledController.ledColors[c] - reference.ledColors[c]));
+        }
+        ArduinoMock::advanceMillis(37);
+      }
+      // Half a wheel step of hue either way
+      TEST_ASSERT(worst <= (brightness > 40 ? 3 : 1));
+    }
+  }
+}
+
+void test_inferno_solver()
+{
+  TEST_CASE("Inferno Solver");
+  reset_mocks();
+
+  // The integer solver burns like the float one it replaced: about as many
+  // pixels alight, as bright and as yellow, averaged over the fire
+  LedController ledController;
+  LedController reference;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  ledController.begin();
+  controller.init();
+  controller.setAutoSwitching(false);
+  controller.startAnimation(find_animation(controller, "Inferno"));
+  Reference::Inferno referenceFire;
+
+  double lit[2] = {0, 0};
+  double red[2] = {0, 0};
+  double green[2] = {0, 0};
+  double height[2] = {0, 0};
+  for (int f = 0; f < 240; f++)
+  {
+    controller.update();
+    referenceFire.update(reference, true);
+    ArduinoMock::advanceMillis(33);
+    if (f < 60)
+      continue; // Let both fires climb the wall
+    LedController *outputs[2] = {&ledController, &reference};
+    for (int k = 0; k < 2; k++)
+    {
+      for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+      {
+        const byte *c = outputs[k]->ledColors + p * 3;
+        if (c[0] || c[1] || c[2])
+        {
+          lit[k]++;
+          height[k] += Topology::getLedPosition(p / Constants::LEDS_PER_SEGMENT, p % Constants::LEDS_PER_SEGMENT).y;
+        }
+        red[k] += c[0];
+        green[k] += c[1];
+      }
+    }
+  }
+  TEST_ASSERT(lit[0] > 0 && lit[1] > 0);
+  TEST_ASSERT(std::fabs(lit[0] / lit[1] - 1) < 0.15);
+  TEST_ASSERT(std::fabs(red[0] / red[1] - 1) < 0.15);
+  TEST_ASSERT(std::fabs(green[0] / green[1] - 1) < 0.2);
+  TEST_ASSERT(std::fabs(height[0] / lit[0] - height[1] / lit[1]) < 1.0);
+}
+
+void test_particle_pools()
+{
+  TEST_CASE("Particle Pools");
+  reset_mocks();
+
+  ParticlePool<int, 4> pool;
+  for (int i = 0; i < 5; i++)
+  {
+    pool.push(i);
+  }
+  TEST_ASSERT(pool.full() && pool.size() == 4);
+  TEST_ASSERT(pool.add() == nullptr);
+  pool.retain([](int &value)
+              { return value % 2 == 1; });
+  TEST_ASSERT(pool.size() == 2 && pool[0] == 1 && pool[1] == 3);
+  pool.removeSwap(0);
+  TEST_ASSERT(pool.size() == 1 && pool[0] == 3);
+
+  // Spawning and retiring particles must not touch the heap once warm
+  const char *effects[] = {"Water Pour", "Digital Rain", "Bouncing Balls", "Fireflies"};
+  for (int e = 0; e < 4; e++)
+  {
+    LedController ledController;
+    Configuration configuration;
+    AnimationController controller(ledController, configuration);
+    VirtualClock clock(33);
+    controller.setClock(clock);
+    ledController.begin();
+    controller.init();
+    controller.setAutoSwitching(false);
+    controller.startAnimation(find_animation(controller, effects[e]));
+    for (int f = 0; f < 30; f++)
+    {
+      controller.update();
+      clock.step();
+    }
+    unsigned long before = heapAllocations;
+    for (int f = 0; f < 600; f++)
+    {
+      controller.update();
+      clock.step();
+    }
+    if (heapAllocations != before)
+    {
+      std::cout << effects[e] << ": " << heapAllocations - before << " allocations" << std::endl;
+    }
+    TEST_ASSERT(heapAllocations == before);
+  }
+}
+
+void test_graph_particles()
+{
+  TEST_CASE("Graph Particles");
+  reset_mocks();
+
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  Bounce stop(0.5f, 0.2f);
+  Bounce bounce(0.5f);
+  RandomOnward falling(&bounce);
+  SplitOnward splitting;
+
+  // Find a segment whose floor end has several ways down, and one that
+  // ends on the floor
+  int split = -1;
+  int floor = -1;
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+  {
+    int below = Topology::getDownPaths(Topology::segmentConnections[s][1]).count;
+    if (split < 0 && below > 1)
+      split = s;
+    if (floor < 0 && below == 0)
+      floor = s;
+  }
+  TEST_ASSERT(split >= 0 && floor >= 0);
+  int node = Topology::segmentConnections[split][1];
+  const PathList &ways = Topology::getDownPaths(node);
+
+  // Over the node with the rest of the frame's movement, trailing back
+  // onto the segment it came from
+  GraphParticles particles(4);
+  particles.setJunctions(&falling, nullptr);
+  particles.spawn(split, 0.9f, 0.2f);
+  particles.step();
+  TEST_ASSERT(particles.size() == 1);
+  int on = particles.getSegment(0);
+  TEST_ASSERT(Topology::segmentConnections[on][0] == node);
+  TEST_ASSERT(std::fabs(particles.getPosition(0) - 0.1f) < 1e-4f);
+  TEST_ASSERT(particles.getVelocity(0) > 0.0f);
+  uint16_t trail[leds + 4];
+  int length = leds - particles.getLed(0) + 2;
+  TEST_ASSERT(particles.getTrail(0, trail, length) == length);
+  TEST_ASSERT(trail[0] == on * leds + particles.getLed(0));
+  TEST_ASSERT(trail[length - 3] == on * leds + leds - 1);
+  TEST_ASSERT(trail[length - 2] == split * leds);
+  TEST_ASSERT(trail[length - 1] == split * leds + 1);
+
+  // Bouncing off the floor keeps half the speed, or retires the particle
+  // once too slow
+  particles.clear();
+  particles.spawn(floor, 0.95f, 0.1f);
+  particles.step();
+  TEST_ASSERT(particles.size() == 1);
+  TEST_ASSERT(std::fabs(particles.getVelocity(0) + 0.05f) < 1e-4f);
+  TEST_ASSERT(std::fabs(particles.getPosition(0) - 0.975f) < 1e-4f);
+  particles.setJunctions(&stop, nullptr);
+  particles.clear();
+  particles.spawn(floor, 0.95f, 0.1f);
+  particles.step();
+  TEST_ASSERT(particles.size() == 0);
+
+  // A split shares the weight between different ways down
+  for (int trial = 0; trial < 20; trial++)
+  {
+    particles.setJunctions(&splitting, nullptr);
+    particles.clear();
+    int i = particles.spawn(split, 0.95f, 0.1f);
+    particles.setWeight(i, 1.0f);
+    particles.step();
+    TEST_ASSERT(particles.size() >= 1 && particles.size() <= ways.count);
+    float total = 0.0f;
+    bool distinct = true;
+    for (int p = 0; p < particles.size(); p++)
+    {
+      total += particles.getWeight(p);
+      TEST_ASSERT(Topology::segmentConnections[particles.getSegment(p)][0] == node);
+      for (int q = 0; q < p; q++)
+        distinct = distinct && particles.getSegment(q) != particles.getSegment(p);
+    }
+    TEST_ASSERT(distinct);
+    TEST_ASSERT(std::fabs(total - 1.0f) < 1e-4f);
+  }
+
+  // Lifetimes, retiring and capacity
+  particles.clear();
+  int aging = particles.spawn(split, 0.5f, 0.0f);
+  particles.setLifetime(aging, 3);
+  particles.spawn(split, 0.5f, 0.0f);
+  particles.retire(1);
+  TEST_ASSERT(particles.size() == 2);
+  particles.step();
+  TEST_ASSERT(particles.size() == 1);
+  particles.step();
+  TEST_ASSERT(particles.size() == 1 && particles.getAge(0) == 2);
+  particles.step();
+  TEST_ASSERT(particles.size() == 0);
+  for (int p = 0; p < 4; p++)
+    particles.spawn(split, 0.5f, 0.0f);
+  TEST_ASSERT(particles.spawn(split, 0.5f, 0.0f) == -1);
+}
+
+void test_graph_field()
+{
+  TEST_CASE("Graph Field");
+  reset_mocks();
+
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  const int pixels = Constants::NUM_OF_PIXELS;
+  const LedGraph &graph = Topology::getLedGraph();
+
+  // Every edge runs both ways with the same coupling, and no pixel couples
+  // more than its whole value away
+  bool symmetric = true;
+  bool bounded = true;
+  for (int p = 0; p < pixels; p++)
+  {
+    int coupled = 0;
+    for (int k = 0; k < graph.getDegree(p); k++)
+    {
+      int q = graph.getNeighbors(p)[k];
+      coupled += graph.getCouplings(p)[k];
+      bool found = false;
+      for (int j = 0; j < graph.getDegree(q); j++)
+        if (graph.getNeighbors(q)[j] == p)
+          found = graph.getCouplings(q)[j] == graph.getCouplings(p)[k];
+      symmetric = symmetric && found;
+    }
+    bounded = bounded && coupled <= 256;
+  }
+  TEST_ASSERT(symmetric);
+  TEST_ASSERT(bounded);
+  TEST_ASSERT(graph.getMaxDegree() <= Constants::MAX_PATHS_PER_NODE);
+  TEST_ASSERT(graph.getDegree(LedController::pixelIndex(0, leds / 2)) == 2);
+
+  // The LEDs beside a node all neighbour each other: the ceiling end of a
+  // segment is its last LED
+  int node = Topology::segmentConnections[0][0];
+  std::vector<int> ends;
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+  {
+    if (Topology::segmentConnections[s][0] == node)
+      ends.push_back(s * leds + leds - 1);
+    if (Topology::segmentConnections[s][1] == node)
+      ends.push_back(s * leds);
+  }
+  TEST_ASSERT(ends.size() > 1);
+  for (size_t a = 0; a < ends.size(); a++)
+  {
+    TEST_ASSERT(graph.getDegree(ends[a]) == (int)ends.size());
+    for (size_t b = 0; b < ends.size(); b++)
+    {
+      bool linked = false;
+      for (int k = 0; k < graph.getDegree(ends[a]); k++)
+        linked = linked || graph.getNeighbors(ends[a])[k] == ends[b];
+      TEST_ASSERT(linked == (a != b));
+    }
+  }
+
+  // Diffusion leaves an even field alone and spreads a spike across the
+  // node to every segment there, keeping the total
+  GraphField field(2);
+  field.fill(0, 20000);
+  field.diffuse(0, 32768);
+  bool even = true;
+  for (int p = 0; p < pixels; p++)
+    even = even && field.get(0)[p] == 20000;
+  TEST_ASSERT(even);
+  field.fill(0, 0);
+  field.get(0)[ends[0]] = GraphField::ONE;
+  field.diffuse(0, 32768);
+  long total = 0;
+  for (int p = 0; p < pixels; p++)
+    total += field.get(0)[p];
+  TEST_ASSERT(std::labs(total - GraphField::ONE) <= 2 * (long)ends.size());
+  for (size_t a = 1; a < ends.size(); a++)
+    TEST_ASSERT(field.get(0)[ends[a]] > 0);
+  for (int step = 0; step < 5000; step++)
+    field.diffuse(0, 32768);
+  int lowest = GraphField::ONE;
+  int highest = 0;
+  for (int p = 0; p < pixels; p++)
+  {
+    lowest = std::min(lowest, (int)field.get(0)[p]);
+    highest = std::max(highest, (int)field.get(0)[p]);
+  }
+  TEST_ASSERT(highest - lowest < 20);
+
+  // Advection upwards carries dye up the wall and loses none of it
+  field.setFlow(0.0f, -1.0f);
+  field.fill(1, 0);
+  int start = LedController::pixelIndex(0, leds / 2);
+  field.get(1)[start] = 40000;
+  float startY = Topology::getLedPosition(0, leds / 2).y;
+  for (int step = 0; step < 20; step++)
+    field.advect(1, 16384);
+  long after = 0;
+  float weightedY = 0.0f;
+  for (int p = 0; p < pixels; p++)
+  {
+    after += field.get(1)[p];
+    weightedY += field.get(1)[p] * Topology::getLedPosition(p / leds, p % leds).y;
+  }
+  TEST_ASSERT(after == 40000);
+  TEST_ASSERT(weightedY / after < startY - 0.5f);
+
+  // All feed and no V is a steady state; a seeded pattern keeps going
+  GraphField::GrayScott chemistry = {32768, 16384, 918, 3080};
+  field.fill(0, GraphField::ONE);
+  field.fill(1, 0);
+  field.grayScott(chemistry, 0, 1, 100);
+  even = true;
+  for (int p = 0; p < pixels; p++)
+    even = even && field.get(0)[p] == GraphField::ONE && field.get(1)[p] == 0;
+  TEST_ASSERT(even);
+  for (int p = start - 2; p <= start + 2; p++)
+  {
+    field.get(0)[p] = 32768;
+    field.get(1)[p] = 32768;
+  }
+  field.grayScott(chemistry, 0, 1, 4000);
+  int alive = 0;
+  for (int p = 0; p < pixels; p++)
+    alive += field.get(1)[p] > 8000;
+  TEST_ASSERT(alive > 0);
+
+  // The animation lights the wall and never touches the heap after start
+  LedController ledController;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  VirtualClock clock(33);
+  controller.setClock(clock);
+  ledController.begin();
+  controller.init();
+  controller.setAutoSwitching(false);
+  controller.startAnimation(find_animation(controller, "Reaction Diffusion"));
+  controller.update();
+  clock.step();
+  unsigned long allocations = heapAllocations;
+  int lit = 0;
+  for (int f = 0; f < 300; f++)
+  {
+    controller.update();
+    clock.step();
+  }
+  for (int p = 0; p < pixels * 3; p++)
+    lit += ledController.ledColors[p] > 0;
+  TEST_ASSERT(heapAllocations == allocations);
+  TEST_ASSERT(lit > 0);
+}
+
+void test_graph_automaton()
+{
+  TEST_CASE("Graph Automaton");
+  reset_mocks();
+
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  const int pixels = Constants::NUM_OF_PIXELS;
+  const LedGraph &graph = Topology::getLedGraph();
+  GraphAutomaton cells;
+
+  // One step away is the LED graph itself
+  cells.useLeds(1);
+  TEST_ASSERT(cells.getCellCount() == pixels);
+  bool same = true;
+  for (int p = 0; p < pixels; p++)
+    same = same && cells.getNeighborCount(p) == graph.getDegree(p);
+  TEST_ASSERT(same);
+
+  // A Life step through the masks matches counting the graph directly
+  const uint16_t birth = (1 << 2) | (1 << 3);
+  const uint16_t survive = (1 << 1) | (1 << 2);
+  cells.randomize(2, 40);
+  std::vector<int> before(pixels);
+  for (int p = 0; p < pixels; p++)
+    before[p] = cells.get(p);
+  cells.stepLife(birth, survive);
+  bool matches = true;
+  for (int p = 0; p < pixels; p++)
+  {
+    int live = 0;
+    for (int k = 0; k < graph.getDegree(p); k++)
+      live += before[graph.getNeighbors(p)[k]];
+    int expected = ((before[p] ? survive : birth) >> live) & 1;
+    matches = matches && cells.get(p) == expected;
+  }
+  TEST_ASSERT(matches);
+
+  // Two steps reach across a node to the second LED of the other segments
+  cells.useLeds(2);
+  int middle = LedController::pixelIndex(0, leds / 2);
+  TEST_ASSERT(cells.getNeighborCount(middle) == 4);
+  int node = Topology::segmentConnections[0][1];
+  int meeting = 0;
+  for (int s = 0; s < Constants::NUMBER_OF_SEGMENTS; s++)
+    meeting += (Topology::segmentConnections[s][0] == node) + (Topology::segmentConnections[s][1] == node);
+  TEST_ASSERT(cells.getNeighborCount(LedController::pixelIndex(0, 0)) == 2 * meeting);
+
+  // Brian's Brain: a firing pair lights the LED either side, which sees
+  // both of them, then rests
+  cells.clear();
+  cells.set(middle, 1);
+  cells.set(middle + 1, 1);
+  cells.stepBriansBrain();
+  TEST_ASSERT(cells.get(middle) == 2 && cells.get(middle + 1) == 2);
+  TEST_ASSERT(cells.get(middle - 1) == 1 && cells.get(middle + 2) == 1);
+  TEST_ASSERT(cells.countLive() == 4);
+  cells.stepBriansBrain();
+  TEST_ASSERT(cells.get(middle) == 0 && cells.get(middle - 1) == 2);
+
+  // Cyclic: a cell moves on when a neighbour is one state ahead, wrapping
+  cells.clear();
+  cells.set(middle, 5);
+  cells.set(middle + 1, 0);
+  cells.set(middle - 3, 3);
+  cells.set(middle - 2, 4);
+  cells.stepCyclic(6, 1);
+  TEST_ASSERT(cells.get(middle) == 0);
+  TEST_ASSERT(cells.get(middle - 3) == 4);
+  TEST_ASSERT(cells.get(middle - 2) == 5); // The 5 is two steps away
+  TEST_ASSERT(cells.get(middle - 1) == 0);
+
+  // Segments neighbour the segments they meet, both ways
+  cells.useSegments();
+  TEST_ASSERT(cells.getCellCount() == Constants::NUMBER_OF_SEGMENTS);
+  TEST_ASSERT(cells.getNeighborCount(0) > 0);
+  cells.set(0, 1);
+  cells.stepLife(1 << 1, 0);
+  int lit = cells.countLive();
+  TEST_ASSERT(lit == cells.getNeighborCount(0) && cells.get(0) == 0);
+
+  // Each rule keeps the wall lit and runs without touching the heap
+  for (int r = 0; r < AutomataAnimation::RULE_COUNT; r++)
+  {
+    LedController ledController;
+    Configuration configuration;
+    AnimationController controller(ledController, configuration);
+    VirtualClock clock(33);
+    controller.setClock(clock);
+    ledController.begin();
+    controller.init();
+    controller.setAutoSwitching(false);
+    int index = find_animation(controller, "Automata");
+    AutomataAnimation *automata = static_cast<AutomataAnimation *>(controller.getAnimation(index));
+    JsonDocument doc;
+    JsonObject config = doc.to<JsonObject>();
+    config["rule"] = r;
+    automata->setConfig(config);
+    controller.startAnimation(index);
+    TEST_ASSERT(automata->getRule() == r);
+    controller.update();
+    clock.step();
+    unsigned long allocations = heapAllocations;
+    for (int f = 0; f < 300; f++)
+    {
+      controller.update();
+      clock.step();
+    }
+    TEST_ASSERT(heapAllocations == allocations);
+    int shown = 0;
+    for (int p = 0; p < pixels * 3; p++)
+      shown += ledController.ledColors[p] > 0;
+    TEST_ASSERT(shown > 0);
+  }
+}
+
+void test_noise()
+{
+  TEST_CASE("Noise");
+  reset_mocks();
+
+  // Gradient noise passes through the middle at every lattice point, and
+  // repeats every 256 units
+  TEST_ASSERT(Noise::noise3(5 << 16, 7 << 16, 9 << 16) == 32768);
+  TEST_ASSERT(Noise::noise2(3 << 16, 250u << 16) == 32768);
+  TEST_ASSERT(Noise::noise3(0x12345, 0x6789A, 0xBCDEF) == Noise::noise3(0x12345 + (256 << 16), 0x6789A, 0xBCDEF));
+
+  // Smooth, and spread over most of the range
+  int lowest = 65535;
+  int highest = 0;
+  int steepest = 0;
+  for (uint32_t i = 0; i < 20000; i++)
+  {
+    uint32_t x = i * 7919;
+    uint32_t y = i * 104729;
+    uint32_t z = i * 1299709;
+    int here = Noise::noise3(x, y, z);
+    int flat = Noise::noise2(x, y);
+    lowest = std::min(lowest, std::min(here, flat));
+    highest = std::max(highest, std::max(here, flat));
+    steepest = std::max(steepest, std::abs(Noise::noise3(x + 256, y, z) - here));
+    steepest = std::max(steepest, std::abs(Noise::noise2(x, y + 256) - flat));
+  }
+  TEST_ASSERT(lowest < 12000 && highest > 53000);
+  TEST_ASSERT(steepest < 1024);
+
+  // The batch gives the same samples as asking LED by LED
+  const int leds = Constants::LEDS_PER_SEGMENT;
+  const float scale = 1.0f / 16.0f;
+  NoiseMap map;
+  map.prepare(scale);
+  uint8_t flat[Constants::NUM_OF_PIXELS];
+  uint8_t deep[Constants::NUM_OF_PIXELS];
+  map.fill(12345, 67890, flat);
+  map.fill(12345, 67890, 1u << 20, deep);
+  bool same = true;
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const LedPosition &position = Topology::getLedPosition(p / leds, p % leds);
+    uint32_t x = (uint32_t)(int32_t)(position.x * scale * 65536.0f) + 12345;
+    uint32_t y = (uint32_t)(int32_t)(position.y * scale * 65536.0f) + 67890;
+    same = same && flat[p] == Noise::noise8(x, y) && deep[p] == Noise::noise8(x, y, 1u << 20);
+  }
+  TEST_ASSERT(same);
+
+  // Noise Flow lights part of the wall, moves, and leaves the heap alone
+  LedController ledController;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  VirtualClock clock(33);
+  controller.setClock(clock);
+  ledController.begin();
+  controller.init();
+  controller.setAutoSwitching(false);
+  controller.startAnimation(find_animation(controller, "Noise Flow"));
+  controller.update();
+  clock.step();
+  std::vector<byte> first(ledController.ledColors, ledController.ledColors + Constants::NUM_OF_PIXELS * 3);
+  unsigned long allocations = heapAllocations;
+  for (int f = 0; f < 100; f++)
+  {
+    controller.update();
+    clock.step();
+  }
+  TEST_ASSERT(heapAllocations == allocations);
+  int lit = 0;
+  int changed = 0;
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const byte *rgb = ledController.ledColors + p * 3;
+    lit += rgb[0] + rgb[1] + rgb[2] > 0;
+    changed += rgb[0] != first[p * 3] || rgb[1] != first[p * 3 + 1] || rgb[2] != first[p * 3 + 2];
+  }
+  TEST_ASSERT(lit > Constants::NUM_OF_PIXELS / 10 && lit < Constants::NUM_OF_PIXELS);
+  TEST_ASSERT(changed > Constants::NUM_OF_PIXELS / 4);
+}
+
+void test_palette()
+{
+  TEST_CASE("Palette");
+  reset_mocks();
+
+  // Stops land exactly, with straight lines between them and the end
+  // colours held beyond
+  const GradientStop stops[] = {{16, 200, 0, 100}, {144, 0, 128, 100}};
+  Palette ramp;
+  ramp.compile(stops, 2);
+  TEST_ASSERT(ramp.lookup(0)[0] == 200 && ramp.lookup(16)[0] == 200 && ramp.lookup(16)[2] == 100);
+  TEST_ASSERT(ramp.lookup(80)[0] == 100 && ramp.lookup(80)[1] == 64 && ramp.lookup(80)[2] == 100);
+  TEST_ASSERT(ramp.lookup(144)[1] == 128 && ramp.lookup(255)[0] == 0 && ramp.lookup(255)[1] == 128);
+
+  // The built in palettes all start from black, and Heat stays close to
+  // the float curve Inferno used to work out per pixel
+  int worst = 0;
+  for (int i = 0; i < Palette::SIZE; i++)
+  {
+    uint32_t c = Reference::heatColor(i / 255.0f);
+    const byte *entry = Palettes::get(Palettes::HEAT).lookup(i);
+    worst = std::max(worst, std::abs(entry[0] - (int)((c >> 16) & 0xFF)));
+    worst = std::max(worst, std::abs(entry[1] - (int)((c >> 8) & 0xFF)));
+    worst = std::max(worst, std::abs(entry[2] - (int)(c & 0xFF)));
+  }
+  TEST_ASSERT(worst <= 8);
+  bool black = true;
+  for (int id = 0; id < Palettes::COUNT; id++)
+  {
+    const byte *first = Palettes::get(id).lookup(0);
+    black = black && first[0] == 0 && first[1] == 0 && first[2] == 0;
+    TEST_ASSERT(Palettes::find(Palettes::getName(id)) == id);
+  }
+  TEST_ASSERT(black);
+  TEST_ASSERT(Palettes::find("Plaid") == -1);
+
+  // A new choice fades in from the old one, starting at the next update
+  PaletteSelection selection(Palettes::STORM);
+  const byte *white = Palettes::get(Palettes::STORM).lookup(255);
+  const byte *green = Palettes::get(Palettes::FOREST).lookup(255);
+  JsonDocument doc;
+  JsonObject config = doc.to<JsonObject>();
+  config["palette"] = "Forest";
+  selection.setConfig(config);
+  TEST_ASSERT(selection.getSelected() == Palettes::FOREST);
+  selection.update(1000);
+  TEST_ASSERT(selection.lookup(255)[0] == white[0] && selection.lookup(255)[2] == white[2]);
+  selection.update(1000 + PaletteSelection::BLEND_TIME / 2);
+  TEST_ASSERT(std::abs(selection.lookup(255)[2] - (white[2] + green[2]) / 2) <= 1);
+  selection.update(1000 + PaletteSelection::BLEND_TIME);
+  TEST_ASSERT(selection.lookup(255) == green);
+  config["palette"] = "Plaid";
+  selection.setConfig(config);
+  TEST_ASSERT(selection.getSelected() == Palettes::FOREST);
+  JsonDocument out;
+  JsonObject saved = out.to<JsonObject>();
+  selection.getConfig(saved);
+  TEST_ASSERT(saved["palette"] == "Forest");
+
+  // The converted effects take their colours from the chosen palette:
+  // every lit pixel is Forest green, even through Inferno's flicker
+  const char *effects[] = {"Inferno", "Lightning", "Water Pour"};
+  for (int e = 0; e < 3; e++)
+  {
+    LedController ledController;
+    Configuration configuration;
+    AnimationController controller(ledController, configuration);
+    VirtualClock clock(33);
+    controller.setClock(clock);
+    ledController.begin();
+    controller.init();
+    controller.setAutoSwitching(false);
+    int index = find_animation(controller, effects[e]);
+    controller.getAnimation(index)->setConfig(saved);
+    controller.startAnimation(index);
+    int lit = 0;
+    bool forest = true;
+    for (int f = 0; f < 90; f++)
+    {
+      controller.update();
+      clock.step();
+      for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+      {
+        const byte *c = ledController.ledColors + p * 3;
+        lit += (c[0] | c[1] | c[2]) != 0;
+        forest = forest && c[1] >= c[0] && c[1] >= c[2];
+      }
+    }
+    TEST_ASSERT(lit > 0);
+    TEST_ASSERT(forest);
+  }
+}
+
+void test_snake()
+{
+  TEST_CASE("Snake");
+  reset_mocks();
+
+  LedController ledController;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  VirtualClock clock(33);
+  controller.setClock(clock);
+  ledController.begin();
+  controller.init();
+  controller.setAutoSwitching(false);
+  int index = find_animation(controller, "Snake");
+  SnakeAnimation *snake = static_cast<SnakeAnimation *>(controller.getAnimation(index));
+  controller.startAnimation(index);
+
+  // Every food is reached within the patience plus the longest way to it,
+  // each step moves the head to a neighbouring LED, and games last
+  const LedGraph &graph = Topology::getLedGraph();
+  const int hop = Constants::LEDS_PER_SEGMENT + 1;
+  auto furthest = [&]()
+  {
+    int distance = 0;
+    for (int n = 0; n < Constants::NUMBER_OF_NODES; n++)
+    {
+      distance = std::max(distance, snake->getFoodDistance(n));
+    }
+    return distance;
+  };
+  int eaten = 0;
+  int games = 0;
+  int longestSnake = 0;
+  int food = snake->getFood();
+  int bound = SnakeAnimation::PATIENCE + furthest() + hop;
+  unsigned long foundAt = 0;
+  unsigned long lastSteps = 0;
+  int lastHead = snake->getHead();
+  bool adjacent = true;
+  bool bounded = true;
+  for (int f = 0; f < 60000; f++)
+  {
+    controller.update();
+    clock.step();
+    unsigned long now = snake->getSteps();
+    if (now < lastSteps)
+    {
+      // Ran into itself and started again
+      games++;
+      foundAt = 0;
+    }
+    else if (now == lastSteps + 1)
+    {
+      bool next = false;
+      for (int k = 0; k < graph.getDegree(lastHead); k++)
+      {
+        next = next || graph.getNeighbors(lastHead)[k] == snake->getHead();
+      }
+      adjacent = adjacent && next;
+    }
+    bounded = bounded && now - foundAt <= (unsigned long)bound;
+    if (snake->getFood() != food && now > 0)
+    {
+      eaten++;
+      foundAt = now;
+      bound = SnakeAnimation::PATIENCE + furthest() + hop;
+    }
+    food = snake->getFood();
+    lastSteps = now;
+    lastHead = snake->getHead();
+    longestSnake = std::max(longestSnake, snake->getLength());
+  }
+  TEST_ASSERT(adjacent);
+  TEST_ASSERT(bounded);
+  TEST_ASSERT(eaten > 100);
+  TEST_ASSERT(longestSnake > 100);
+
+  // The same time at different frame rates moves the snake as far
+  unsigned long moved[2];
+  const int frameTimes[2] = {16, 50};
+  for (int k = 0; k < 2; k++)
+  {
+    reset_mocks();
+    VirtualClock steady(frameTimes[k]);
+    controller.setClock(steady);
+    controller.startAnimation(index);
+    while (steady.now() < 4000)
+    {
+      controller.update();
+      steady.step();
+    }
+    moved[k] = snake->getSteps();
+  }
+  TEST_ASSERT(moved[0] > 50 && moved[0] + 1 >= moved[1] && moved[1] + 1 >= moved[0]);
+}
+
+void test_shader()
+{
+  TEST_CASE("Shader");
+  reset_mocks();
+
+  ShaderCompiler compiler;
+  ShaderProgram program;
+  ShaderVM vm;
+  vm.prepare();
+  int32_t out[3];
+  auto run = [&](const char *source, unsigned long millis = 0, int pixel = 0)
+  {
+    out[0] = out[1] = out[2] = -1;
+    bool ok = compiler.compile(source, program);
+    if (ok)
+    {
+      vm.evaluate(program, pixel, millis, out);
+    }
+    return ok;
+  };
+  auto near = [](int32_t value, double expected)
+  {
+    return std::abs(value - expected * Shader::ONE) <= 8;
+  };
+
+  // Numbers, precedence, lets and comparisons
+  TEST_ASSERT(run("rgb(1, 0.5, .25)"));
+  TEST_ASSERT(out[0] == Shader::ONE && out[1] == Shader::ONE / 2 && out[2] == Shader::ONE / 4);
+  TEST_ASSERT(program.getOutput() == Shader::RGB && program.getInstructionCount() == 3);
+  TEST_ASSERT(run("let v = 1 + 2 * 3; // seven\nlet v = v - 0.5;\nrgb(v, -v % 4, (1 + 2) * 3 >= 9);"));
+  TEST_ASSERT(near(out[0], 6.5) && near(out[1], 1.5) && out[2] == Shader::ONE);
+  TEST_ASSERT(run("rgb(1 / 0, 2 < 1, 3 / 4)"));
+  TEST_ASSERT(out[0] == 0 && out[1] == 0 && near(out[2], 0.75));
+
+  // Functions work in turns and wrap like GLSL
+  TEST_ASSERT(run("rgb(sin(0.25), cos(0.5), sqrt(0.25))"));
+  TEST_ASSERT(near(out[0], 1) && near(out[1], -1) && near(out[2], 0.5));
+  TEST_ASSERT(run("rgb(floor(-0.5), fract(-0.25), abs(-2))"));
+  TEST_ASSERT(out[0] == -Shader::ONE && near(out[1], 0.75) && out[2] == 2 * Shader::ONE);
+  TEST_ASSERT(run("hsv(clamp(2, 0, 1), mix(0, 2, 0.25), min(3, max(0.5, -1)))"));
+  TEST_ASSERT(program.getOutput() == Shader::HSV);
+  TEST_ASSERT(out[0] == Shader::ONE && near(out[1], 0.5) && near(out[2], 0.5));
+  TEST_ASSERT(run("rgb(noise(1, 2, 3), noise(0.5, 0.5, 0.5), 0)"));
+  TEST_ASSERT(out[0] == 32768 && out[1] == Noise::noise3(32768, 32768, 32768));
+
+  // Inputs: time in seconds, positions from 0 to 1 across the wall
+  TEST_ASSERT(run("rgb(t, seg, led)", 1500, 3 * Constants::LEDS_PER_SEGMENT + 2));
+  TEST_ASSERT(out[0] == 3 * Shader::ONE / 2 && out[1] == 3 * Shader::ONE && out[2] == 2 * Shader::ONE);
+  int32_t lowest[3] = {INT32_MAX, INT32_MAX, INT32_MAX};
+  int32_t highest[3] = {INT32_MIN, INT32_MIN, INT32_MIN};
+  TEST_ASSERT(compiler.compile("rgb(x, y, r)", program));
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    vm.evaluate(program, p, 0, out);
+    for (int k = 0; k < 3; k++)
+    {
+      lowest[k] = std::min(lowest[k], out[k]);
+      highest[k] = std::max(highest[k], out[k]);
+    }
+  }
+  TEST_ASSERT(lowest[0] == 0 && highest[0] == Shader::ONE && lowest[1] == 0 && highest[1] == Shader::ONE);
+  TEST_ASSERT(lowest[2] >= 0 && highest[2] == Shader::ONE);
+
+  // Mistakes come back with where they are, and leave the program alone
+  TEST_ASSERT(compiler.compile("rgb(1, 0, 0)", program));
+  TEST_ASSERT(!run("rgb(1, 2)"));
+  TEST_ASSERT(std::string(compiler.getError()) == "Expected ," && compiler.getErrorPosition() == 8);
+  TEST_ASSERT(program.isValid() && program.getInstructionCount() == 3);
+  TEST_ASSERT(!run("hsv(hue, 1, 1)"));
+  TEST_ASSERT(std::string(compiler.getError()) == "Unknown name" && compiler.getErrorPosition() == 4);
+  TEST_ASSERT(!run("let x = 1; rgb(0, 0, 0)"));
+  TEST_ASSERT(!run("rgb(0, 0, 0) rgb"));
+  TEST_ASSERT(!run("rgb(wobble(1), 0, 0)"));
+  TEST_ASSERT(!run("rgb(min(1), 0, 0)"));
+  TEST_ASSERT(!run("rgb(123456, 0, 0)"));
+  TEST_ASSERT(!run("let a=1; let b=1; let c=1; let d=1; let e=1; let f=1; let g=1; let h=1; let j=1; rgb(0,0,0)"));
+  std::string deep = "rgb(";
+  for (int k = 0; k < Shader::MAX_STACK; k++)
+  {
+    deep += "1 + (";
+  }
+  deep += "1" + std::string(Shader::MAX_STACK, ')') + ", 0, 0)";
+  TEST_ASSERT(!run(deep.c_str()));
+  TEST_ASSERT(std::string(compiler.getError()) == "Stack overflow");
+  std::string tooLong = "rgb(0, 0, 0)" + std::string(ShaderCompiler::MAX_SOURCE, ' ');
+  TEST_ASSERT(!run(tooLong.c_str()));
+
+  // Bytecode is checked before it can run
+  ShaderProgram raw;
+  const uint8_t three[] = {Shader::OP_PUSH, 0, 0, 1, 0, Shader::OP_INPUT, Shader::X, Shader::OP_LOAD, 0};
+  TEST_ASSERT(raw.load(Shader::RGB, three, sizeof(three)) && raw.getInstructionCount() == 3);
+  const uint8_t underflow[] = {Shader::OP_INPUT, 0, Shader::OP_INPUT, 0, Shader::OP_ADD, Shader::OP_ADD};
+  TEST_ASSERT(!raw.load(Shader::RGB, underflow, sizeof(underflow)) && !raw.isValid());
+  TEST_ASSERT(std::string(raw.getError()) == "Stack underflow");
+  const uint8_t truncated[] = {Shader::OP_INPUT, 0, Shader::OP_INPUT, 0, Shader::OP_PUSH, 0, 0};
+  TEST_ASSERT(!raw.load(Shader::RGB, truncated, sizeof(truncated)));
+  const uint8_t badInput[] = {Shader::OP_INPUT, 0, Shader::OP_INPUT, 0, Shader::OP_INPUT, Shader::INPUT_COUNT};
+  TEST_ASSERT(!raw.load(Shader::RGB, badInput, sizeof(badInput)));
+  const uint8_t badLocal[] = {Shader::OP_INPUT, 0, Shader::OP_INPUT, 0, Shader::OP_LOAD, Shader::MAX_LOCALS};
+  TEST_ASSERT(!raw.load(Shader::RGB, badLocal, sizeof(badLocal)));
+  const uint8_t badOp[] = {Shader::OP_INPUT, 0, Shader::OP_INPUT, 0, Shader::OP_INPUT, 0, 200};
+  TEST_ASSERT(!raw.load(Shader::RGB, badOp, sizeof(badOp)));
+  const uint8_t four[] = {Shader::OP_INPUT, 0, Shader::OP_INPUT, 0, Shader::OP_INPUT, 0, Shader::OP_INPUT, 0};
+  TEST_ASSERT(!raw.load(Shader::RGB, four, sizeof(four)));
+  TEST_ASSERT(!raw.load(Shader::RGB, four, 0));
+
+  // The animation runs the shader saved on SPIFFS
+  LedController ledController;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  VirtualClock clock(33);
+  controller.setClock(clock);
+  ledController.begin();
+  controller.init();
+  controller.setAutoSwitching(false);
+  int index = find_animation(controller, "Shader");
+  ShaderAnimation *shader = static_cast<ShaderAnimation *>(controller.getAnimation(index));
+  TEST_ASSERT(index >= 0);
+
+  SPIFFS.begin();
+  const std::string path = std::string("tmp_spiffs") + ShaderAnimation::PATH;
+  File file = SPIFFS.open(ShaderAnimation::PATH, FILE_WRITE);
+  const char *gradient = "rgb(1 - x, 0, x)";
+  file.write((const uint8_t *)gradient, strlen(gradient));
+  file.close();
+  controller.startAnimation(index);
+  controller.update();
+  int left = 0, right = 0;
+  for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+  {
+    const LedPosition &position = Topology::getLedPosition(p / Constants::LEDS_PER_SEGMENT, p % Constants::LEDS_PER_SEGMENT);
+    left = position.x < Topology::getLedPosition(left / Constants::LEDS_PER_SEGMENT, left % Constants::LEDS_PER_SEGMENT).x ? p : left;
+    right = position.x > Topology::getLedPosition(right / Constants::LEDS_PER_SEGMENT, right % Constants::LEDS_PER_SEGMENT).x ? p : right;
+  }
+  const byte *leftColor = ledController.ledColors + left * 3;
+  const byte *rightColor = ledController.ledColors + right * 3;
+  TEST_ASSERT(leftColor[0] == 255 && leftColor[2] == 0 && rightColor[0] == 0 && rightColor[2] == 255);
+
+  // HSV with no saturation is white at full value, and frames allocate nothing
+  TEST_ASSERT(shader->load("hsv(t, 0, 1)"));
+  unsigned long before = heapAllocations;
+  for (int f = 0; f < 30; f++)
+  {
+    controller.update();
+    clock.step();
+  }
+  TEST_ASSERT(heapAllocations == before);
+  bool white = true;
+  for (int p = 0; p < Constants::NUM_OF_PIXELS * 3; p++)
+  {
+    white = white && ledController.ledColors[p] == 255;
+  }
+  TEST_ASSERT(white);
+
+  // A shader that does not compile falls back to the built-in one
+  file = SPIFFS.open(ShaderAnimation::PATH, FILE_WRITE);
+  file.write((const uint8_t *)"rgb(", 4);
+  file.close();
+  controller.startAnimation(index);
+  TEST_ASSERT(compiler.compile(ShaderAnimation::DEFAULT_SOURCE, program));
+  TEST_ASSERT(shader->getProgram().isValid() && shader->getProgram().getInstructionCount() == program.getInstructionCount());
+  remove(path.c_str());
+  char source[ShaderCompiler::MAX_SOURCE + 1];
+  ShaderAnimation::readSource(source);
+  TEST_ASSERT(std::string(source) == ShaderAnimation::DEFAULT_SOURCE);
+}
+
+void test_canvas()
+{
+  TEST_CASE("Canvas");
+  reset_mocks();
+
+  // Every shape against working out every LED's coverage the long way: the
+  // index must not miss any LED the shape reaches
+  static byte drawn[Constants::NUM_OF_PIXELS * 3];
+  const NodePosition &center = Topology::nodePositions[Topology::starburstNode];
+  const float cx = center.x, cy = center.y;
+  const uint32_t color = 0xC08040;
+  auto check = [&](std::function<void(Canvas &)> draw, std::function<float(const LedPosition &)> edge)
+  {
+    memset(drawn, 0, sizeof(drawn));
+    Canvas canvas(drawn);
+    draw(canvas);
+    int worst = 0;
+    int partial = 0;
+    int covered = 0;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+    {
+      float coverage = edge(Topology::getLedPosition(p / Constants::LEDS_PER_SEGMENT, p % Constants::LEDS_PER_SEGMENT)) /
+                           Canvas::DEFAULT_SOFTNESS + 0.5f;
+      coverage = std::max(0.0f, std::min(1.0f, coverage));
+      int alpha = (int)(coverage * 255 + 0.5f);
+      for (int c = 0; c < 3; c++)
+      {
+        int expected = (((color >> (16 - 8 * c)) & 0xFF) * alpha) / 255;
+        worst = std::max(worst, std::abs(drawn[p * 3 + c] - expected));
+      }
+      partial += alpha > 0 && alpha < 255;
+      covered += alpha > 0;
+    }
+    TEST_ASSERT(worst <= 1);
+    TEST_ASSERT(covered > 0 && covered == canvas.getLastCovered());
+    TEST_ASSERT(canvas.getLastTested() < Constants::NUM_OF_PIXELS);
+    return partial;
+  };
+  auto segmentDistance = [](const LedPosition &p, float x0, float y0, float x1, float y1)
+  {
+    float dx = x1 - x0, dy = y1 - y0;
+    float t = std::max(0.0f, std::min(1.0f, ((p.x - x0) * dx + (p.y - y0) * dy) / (dx * dx + dy * dy)));
+    return std::hypot(p.x - x0 - t * dx, p.y - y0 - t * dy);
+  };
+
+  int partial = check([&](Canvas &canvas)
+                      { canvas.line(cx - 20, cy - 6, cx + 15, cy + 4, 2.0f, color); },
+                      [&](const LedPosition &p)
+                      { return 1.0f - segmentDistance(p, cx - 20, cy - 6, cx + 15, cy + 4); });
+  TEST_ASSERT(partial > 0); // Soft edges, not a hard cut
+  check([&](Canvas &canvas)
+        { canvas.disc(cx + 3, cy - 2, 6.5f, color); },
+        [&](const LedPosition &p)
+        { return 6.5f - std::hypot(p.x - cx - 3, p.y - cy + 2); });
+  check([&](Canvas &canvas)
+        { canvas.ring(cx, cy, 12.0f, 1.5f, color); },
+        [&](const LedPosition &p)
+        { return 0.75f - std::fabs(std::hypot(p.x - cx, p.y - cy) - 12.0f); });
+  const LedPosition triangle[] = {{cx - 10, cy + 8}, {cx + 10, cy + 8}, {cx, cy - 9}};
+  check([&](Canvas &canvas)
+        { canvas.polygon(triangle, 3, color); },
+        [&](const LedPosition &p)
+        {
+          float distance = std::min({segmentDistance(p, cx - 10, cy + 8, cx + 10, cy + 8),
+                                     segmentDistance(p, cx + 10, cy + 8, cx, cy - 9),
+                                     segmentDistance(p, cx, cy - 9, cx - 10, cy + 8)});
+          // Inside when on the same side of all three edges
+          auto side = [&](const LedPosition &a, const LedPosition &b)
+          { return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x); };
+          bool inside = side(triangle[0], triangle[1]) <= 0 && side(triangle[1], triangle[2]) <= 0 &&
+                        side(triangle[2], triangle[0]) <= 0;
+          return inside ? distance : -distance; });
+
+  // A line sliding across an LED brightens it bit by bit
+  const LedPosition &led = Topology::getLedPosition(5, 7);
+  int steps = 0;
+  int last = -1;
+  bool rising = true;
+  for (float offset = -2.0f; offset <= 0.0f; offset += 0.125f)
+  {
+    memset(drawn, 0, sizeof(drawn));
+    Canvas canvas(drawn);
+    canvas.line(led.x + offset - 30, led.y - 30, led.x + offset + 30, led.y + 30, 1.0f, 0xFFFFFF);
+    int value = drawn[LedController::pixelIndex(5, 7) * 3];
+    rising = rising && value >= last;
+    steps += value != last;
+    last = value;
+  }
+  TEST_ASSERT(rising && steps > 4 && last == 255);
+
+  // Blend modes and opacity work like layers; a polygon needs three corners
+  memset(drawn, 0, sizeof(drawn));
+  Canvas canvas(drawn);
+  canvas.disc(cx, cy, 3.0f, 0x404040);
+  const int middle = [&]()
+  {
+    int nearest = 0;
+    float best = 1e9f;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+    {
+      const LedPosition &q = Topology::getLedPosition(p / Constants::LEDS_PER_SEGMENT, p % Constants::LEDS_PER_SEGMENT);
+      float distance = std::hypot(q.x - cx, q.y - cy);
+      nearest = distance < best ? p : nearest;
+      best = std::min(best, distance);
+    }
+    return nearest;
+  }();
+  TEST_ASSERT(drawn[middle * 3] == 0x40);
+  canvas.setBlend(BLEND_ADD);
+  canvas.disc(cx, cy, 3.0f, 0x404040);
+  TEST_ASSERT(drawn[middle * 3] == 0x80);
+  canvas.setBlend(BLEND_NORMAL);
+  canvas.setOpacity(128);
+  canvas.disc(cx, cy, 3.0f, 0xFF0000);
+  TEST_ASSERT(drawn[middle * 3] == 0x80 + (0x7F * 128) / 255 && drawn[middle * 3 + 1] == 0x80 - (0x80 * 128) / 255);
+  canvas.polygon(triangle, 2, color);
+  TEST_ASSERT(canvas.getLastCovered() == 0);
+
+  // The Shapes animation draws only with the canvas, without allocating
+  LedController ledController;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  VirtualClock clock(33);
+  controller.setClock(clock);
+  ledController.begin();
+  controller.init();
+  controller.setAutoSwitching(false);
+  controller.startAnimation(find_animation(controller, "Shapes"));
+  controller.update(); // The first frame publishes the web side's config snapshot
+  clock.step();
+  unsigned long before = heapAllocations;
+  int maxLit = 0;
+  for (int f = 0; f < 150; f++)
+  {
+    controller.update();
+    clock.step();
+    int lit = 0;
+    for (int p = 0; p < Constants::NUM_OF_PIXELS; p++)
+    {
+      lit += (ledController.ledColors[p * 3] | ledController.ledColors[p * 3 + 1] | ledController.ledColors[p * 3 + 2]) != 0;
+    }
+    maxLit = std::max(maxLit, lit);
+  }
+  TEST_ASSERT(heapAllocations == before);
+  TEST_ASSERT(maxLit > 30 && maxLit < Constants::NUM_OF_PIXELS);
+}
+
+// What a leader sent, and when by the true clock
+struct SyncPacket
+{
+  unsigned long at;
+  std::vector<uint8_t> data;
+};
+
+class RecordingTransport : public SyncTransport
+{
+public:
+  RecordingTransport(Clock &clock) : clock(clock) {}
+  bool send(const uint8_t *data, size_t length) override
+  {
+    sent.push_back({clock.now(), std::vector<uint8_t>(data, data + length)});
+    return true;
+  }
+  int receive(uint8_t *data, size_t capacity) override { return 0; }
+
+  Clock &clock;
+  std::vector<SyncPacket> sent;
+};
+
+// Hands a recording back out once each packet's delivery time comes
+class ReplayTransport : public SyncTransport
+{
+public:
+  ReplayTransport(Clock &clock, std::vector<SyncPacket> packets) : clock(clock), packets(packets)
+  {
+    std::stable_sort(this->packets.begin(), this->packets.end(),
+                     [](const SyncPacket &a, const SyncPacket &b)
+                     { return a.at < b.at; });
+  }
+  bool send(const uint8_t *data, size_t length) override { return true; }
+  int receive(uint8_t *data, size_t capacity) override
+  {
+    if (next == packets.size() || packets[next].at > clock.now())
+    {
+      return 0;
+    }
+    const std::vector<uint8_t> &packet = packets[next++].data;
+    size_t length = std::min(packet.size(), capacity);
+    memcpy(data, packet.data(), length);
+    return (int)length;
+  }
+
+  Clock &clock;
+  std::vector<SyncPacket> packets;
+  size_t next = 0;
+};
+
+struct SyncFrame
+{
+  uint32_t checksum;
+  unsigned long at;
+  bool replayed; // Caught up on, so drawn late on purpose
+};
+
+uint32_t checksum_leds(const LedController &ledController)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < sizeof(ledController.ledColors); i++)
+  {
+    hash = (hash ^ ledController.ledColors[i]) * 16777619u;
+  }
+  return hash;
+}
+
+void test_wall_sync()
+{
+  TEST_CASE("WallSync");
+
+  // One process shares std::rand between controllers, so the leader runs
+  // first and its packets are replayed to each follower afterwards. Every
+  // wall's clock is the true clock plus an offset of its own.
+  const unsigned long DURATION = 40000;
+  const unsigned long LEADER_CLOCK = 100000;
+  typedef std::map<std::pair<unsigned long, unsigned long>, SyncFrame> SyncFrames;
+
+  auto lead = [&](SyncRole role, SyncFrames &frames, std::vector<uint32_t> &shown)
+  {
+    reset_mocks();
+    LedController ledController;
+    Configuration configuration;
+    AnimationController controller(ledController, configuration);
+    VirtualClock now(1);
+    VirtualClock local(1, LEADER_CLOCK);
+    RecordingTransport transport(now);
+    ledController.begin();
+    controller.init();
+    WallSync sync(controller, transport, local);
+    sync.begin();
+    sync.setRole(role);
+    for (unsigned long t = 0; t < DURATION; t++)
+    {
+      now.set(t);
+      local.set(t + LEADER_CLOCK);
+      if (t == 8000)
+      {
+        controller.changeAnimation(find_animation(controller, "Cube Pulse"));
+      }
+      if (sync.update() > 0)
+      {
+        frames[{sync.getEpoch(), sync.getFrame() - 1}] = {checksum_leds(ledController), t, false};
+        shown.push_back(checksum_leds(ledController));
+      }
+    }
+    TEST_ASSERT(sync.getStats().worstLateness <= 1);
+    return transport.sent;
+  };
+
+  // Followers get each packet 2 to 24 ms after it was sent, and some never
+  auto follow = [&](const std::vector<SyncPacket> &sent, unsigned long join, unsigned long period, int drop,
+                    SyncFrames &frames, std::vector<uint32_t> &shown, bool &followingAtEnd, WallSyncStats &stats)
+  {
+    std::vector<SyncPacket> delayed;
+    for (size_t k = 0; k < sent.size(); k++)
+    {
+      if (sent[k].at >= join && (drop == 0 || k % drop != 0))
+      {
+        delayed.push_back({sent[k].at + 2 + (k * 7919) % 23, sent[k].data});
+      }
+    }
+    reset_mocks();
+    LedController ledController;
+    Configuration configuration;
+    AnimationController controller(ledController, configuration);
+    VirtualClock now(1, join);
+    VirtualClock local(1);
+    ReplayTransport transport(now, delayed);
+    ledController.begin();
+    controller.init();
+    controller.setAutoSwitching(false);
+    WallSync sync(controller, transport, local);
+    sync.begin();
+    sync.setRole(SYNC_FOLLOWER);
+    for (unsigned long t = join; t < DURATION + 3000; t += period)
+    {
+      now.set(t);
+      local.set(t + 7);
+      bool following = sync.isFollowing() && !sync.isStreaming();
+      unsigned long replayed = sync.getStats().framesReplayed;
+      if (sync.update() > 0)
+      {
+        if (following && sync.isFollowing())
+        {
+          frames[{sync.getEpoch(), sync.getFrame() - 1}] = {checksum_leds(ledController), t,
+                                                             sync.getStats().framesReplayed != replayed};
+        }
+        shown.push_back(checksum_leds(ledController));
+      }
+      if (t == join + 1000 && sync.isFollowing() && !sync.isStreaming())
+      {
+        // A leader 100 s ahead, seen through at least 2 ms of network
+        TEST_ASSERT(sync.getOffset() <= (long)(LEADER_CLOCK - 7 - 2) && sync.getOffset() >= (long)(LEADER_CLOCK - 7 - 24));
+      }
+    }
+    // The leader went quiet at DURATION; the follower is on its own again
+    followingAtEnd = sync.isFollowing();
+    TEST_ASSERT(!controller.isAutoSwitching());
+    stats = sync.getStats();
+  };
+
+  // The same frame number of the same epoch is the same picture, drawn
+  // within a frame of when the leader drew it
+  auto compare = [&](const SyncFrames &leader, const SyncFrames &follower)
+  {
+    int matched = 0;
+    int different = 0;
+    unsigned long worstSkew = 0;
+    for (const auto &frame : follower)
+    {
+      auto found = leader.find(frame.first);
+      if (found == leader.end())
+      {
+        continue;
+      }
+      matched++;
+      different += found->second.checksum != frame.second.checksum;
+      if (frame.second.replayed)
+      {
+        continue;
+      }
+      unsigned long skew = frame.second.at > found->second.at ? frame.second.at - found->second.at
+                                                              : found->second.at - frame.second.at;
+      worstSkew = std::max(worstSkew, skew);
+    }
+    TEST_ASSERT(different == 0);
+    TEST_ASSERT(worstSkew < WallSync::FRAME_MILLIS);
+    return matched;
+  };
+
+  SyncFrames leaderFrames;
+  std::vector<uint32_t> leaderShown;
+  std::vector<SyncPacket> sent = lead(SYNC_LEADER, leaderFrames, leaderShown);
+  // A few dozen bytes a few times a second, not pixels
+  TEST_ASSERT(sent.size() < DURATION / WallSync::STATE_INTERVAL + 20);
+  TEST_ASSERT(leaderFrames.rbegin()->first.first >= 3); // The change at 8 s and an auto switch later
+
+  SyncFrames followerFrames;
+  std::vector<uint32_t> followerShown;
+  bool followingAtEnd = true;
+  WallSyncStats stats;
+  follow(sent, 0, 1, 0, followerFrames, followerShown, followingAtEnd, stats);
+  TEST_ASSERT(compare(leaderFrames, followerFrames) > (int)(DURATION / WallSync::FRAME_MILLIS) * 9 / 10);
+  TEST_ASSERT(!followingAtEnd);
+  TEST_ASSERT(stats.epochs >= 3 && stats.framesSkipped == 0);
+
+  // Polled every 5 ms, with a tenth of the packets lost
+  followerFrames.clear();
+  follow(sent, 0, 5, 10, followerFrames, followerShown, followingAtEnd, stats);
+  TEST_ASSERT(compare(leaderFrames, followerFrames) > (int)(DURATION / WallSync::FRAME_MILLIS) * 8 / 10);
+
+  // Joining 4 s in replays the epoch so far and then matches exactly
+  followerFrames.clear();
+  follow(sent, 4000, 1, 0, followerFrames, followerShown, followingAtEnd, stats);
+  TEST_ASSERT(stats.framesReplayed > 50);
+  TEST_ASSERT(compare(leaderFrames, followerFrames) > (int)((DURATION - 4000) / WallSync::FRAME_MILLIS) * 9 / 10);
+
+  // Streaming: every frame a follower shows is one the leader showed, and
+  // frames missing a piece are dropped instead of shown half done
+  SyncFrames streamFrames;
+  std::vector<uint32_t> streamed;
+  sent = lead(SYNC_STREAM, streamFrames, streamed);
+  TEST_ASSERT(sent.size() >= streamed.size() * WallSync::FRAME_CHUNKS);
+  std::vector<uint32_t> received;
+  follow(sent, 0, 1, 13, followerFrames, received, followingAtEnd, stats);
+  std::set<uint32_t> leaderPictures(streamed.begin(), streamed.end());
+  int streamedShown = 0;
+  int unknown = 0;
+  for (size_t k = 0; k < received.size(); k++)
+  {
+    unknown += !leaderPictures.count(received[k]);
+  }
+  streamedShown = stats.streamedFrames;
+  TEST_ASSERT(streamedShown > (int)streamed.size() * 3 / 4);
+  TEST_ASSERT(stats.incompleteFrames > 0 && stats.streamedFrames + stats.incompleteFrames <= streamed.size());
+  // The follower's own frames before the first piece and after the timeout
+  TEST_ASSERT(unknown <= (int)(received.size() - streamedShown));
+
+  // Anything that isn't a whole packet of ours is counted and ignored
+  std::vector<SyncPacket> junk = {{0, {'C', 'S', 'Y', 9, 1}}, {0, {'X'}}, {0, std::vector<uint8_t>(WallSync::STATE_SIZE)}};
+  follow(junk, 0, 1, 0, followerFrames, received, followingAtEnd, stats);
+  TEST_ASSERT(stats.badPackets == 3 && stats.epochs == 0);
+
+  // A seeded start draws the same frames however the controller got there
+  reset_mocks();
+  LedController ledController;
+  Configuration configuration;
+  AnimationController controller(ledController, configuration);
+  VirtualClock clock(33);
+  controller.setClock(clock);
+  ledController.begin();
+  controller.init();
+  std::vector<uint32_t> runs[2];
+  for (int run = 0; run < 2; run++)
+  {
+    for (int k = 0; k < 37 * (run + 1); k++)
+    {
+      controller.update();
+      clock.step();
+    }
+    clock.set(500000);
+    controller.startSeeded(find_animation(controller, "Starburst"), 4242);
+    for (int k = 0; k < 90; k++)
+    {
+      controller.update();
+      clock.step();
+      runs[run].push_back(checksum_leds(ledController));
+    }
+  }
+  TEST_ASSERT(runs[0] == runs[1]);
+}
+
+// Hands out queued datagrams as a PixelSocket, one read at a time
+class QueuedPixelSocket : public PixelSocket
+{
+public:
+  void push(uint32_t address, const PixelPackets::Packet &packet) { packets.push_back({address, packet}); }
+  void push(uint32_t address, const std::vector<PixelPackets::Packet> &frame)
+  {
+    for (const PixelPackets::Packet &packet : frame)
+    {
+      push(address, packet);
+    }
+  }
+
+  int next(uint32_t &source) override
+  {
+    if (waiting == packets.size())
+    {
+      return 0;
+    }
+    current = waiting++;
+    position = 0;
+    source = packets[current].first;
+    return (int)packets[current].second.size();
+  }
+
+  int read(uint8_t *data, size_t length) override
+  {
+    const PixelPackets::Packet &packet = packets[current].second;
+    size_t count = std::min(length, packet.size() - position);
+    memcpy(data, packet.data() + position, count);
+    position += count;
+    return (int)count;
+  }
+
+  std::vector<std::pair<uint32_t, PixelPackets::Packet>> packets;
+  size_t waiting = 0;
+  size_t current = 0;
+  size_t position = 0;
+};
+
+void test_pixel_receiver()
+{
+  TEST_CASE("PixelReceiver");
+  reset_mocks();
+
+  const int BYTES = PixelReceiver::FRAME_BYTES;
+  const uint32_t HOST_A = 0x0A00A8C0; // 192.168.0.10 as the network stack holds it
+  const uint32_t HOST_B = 0x0B00A8C0;
+  uint8_t frames[3][BYTES];
+  for (int i = 0; i < BYTES; i++)
+  {
+    frames[0][i] = (uint8_t)(i * 7);
+    frames[1][i] = (uint8_t)(i * 13 + 5);
+    frames[2][i] = (uint8_t)(255 - i);
+  }
+
+  // Every protocol lands each frame whole in ledColors and shows it once
+  for (int protocol = 0; protocol < PIXEL_PROTOCOL_COUNT; protocol++)
+  {
+    LedController ledController;
+    ledController.begin();
+    VirtualClock clock(10, 1000);
+    QueuedPixelSocket socket;
+    PixelReceiver receiver(ledController, clock);
+    TEST_ASSERT(receiver.addInput(socket, (PixelProtocol)protocol));
+    TEST_ASSERT(!receiver.update());
+
+    uint8_t sequence = 0;
+    bool matched = true;
+    for (int f = 0; f < 3; f++)
+    {
+      socket.push(HOST_A, PixelPackets::frame((PixelProtocol)protocol, frames[f], sequence));
+      matched &= receiver.update();
+      matched &= memcmp(ledController.ledColors, frames[f], BYTES) == 0;
+      clock.advance(16);
+    }
+    TEST_ASSERT(matched);
+    TEST_ASSERT(receiver.getSourceCount() == 1 && receiver.getBadPackets() == 0);
+    const PixelSourceStats &stats = receiver.getSource(0);
+    TEST_ASSERT(stats.address == HOST_A && stats.protocol == protocol);
+    TEST_ASSERT(stats.frames == 3 && stats.sequenceErrors == 0);
+    TEST_ASSERT(stats.packets == socket.packets.size());
+    TEST_ASSERT(stats.worstLatency >= stats.averageLatency());
+  }
+
+  // DDP writes at any byte offset and shows on push; anything past the
+  // buffer is dropped
+  {
+    LedController ledController;
+    ledController.begin();
+    memset(ledController.ledColors, 0, BYTES);
+    VirtualClock clock;
+    QueuedPixelSocket socket;
+    PixelReceiver receiver(ledController, clock);
+    receiver.addInput(socket, PIXEL_DDP);
+    const uint8_t white[6] = {255, 255, 255, 255, 255, 255};
+    socket.push(HOST_A, PixelPackets::ddp(30, white, 6, 0, false));
+    receiver.update();
+    TEST_ASSERT(receiver.getSource(0).frames == 0 && ledController.ledColors[30] == 255);
+    TEST_ASSERT(ledController.ledColors[29] == 0 && ledController.ledColors[36] == 0);
+    socket.push(HOST_A, PixelPackets::ddp(BYTES - 3, white, 6, 0, true));
+    receiver.update();
+    TEST_ASSERT(receiver.getSource(0).frames == 1 && ledController.ledColors[BYTES - 1] == 255);
+    TEST_ASSERT(receiver.getBadPackets() == 0);
+  }
+
+  // Senders number each universe on its own. A gap in one universe is
+  // counted, and E1.31 drops a packet that comes after a later one of the
+  // same universe.
+  {
+    LedController ledController;
+    ledController.begin();
+    VirtualClock clock;
+    QueuedPixelSocket e131;
+    QueuedPixelSocket artNet;
+    PixelReceiver receiver(ledController, clock);
+    receiver.addInput(e131, PIXEL_E131);
+    receiver.addInput(artNet, PIXEL_ARTNET);
+    uint8_t sequence = 250;
+    std::vector<PixelPackets::Packet> first = PixelPackets::frame(PIXEL_E131, frames[0], sequence);
+    std::vector<PixelPackets::Packet> second = PixelPackets::frame(PIXEL_E131, frames[1], sequence);
+    std::vector<PixelPackets::Packet> third = PixelPackets::frame(PIXEL_E131, frames[2], sequence);
+    TEST_ASSERT(first.size() > 2);
+    e131.push(HOST_A, first);
+    for (size_t i = 0; i < second.size(); i++)
+    {
+      if (i != 1) // Lost
+        e131.push(HOST_A, second[i]);
+    }
+    e131.push(HOST_A, third[0]);
+    e131.push(HOST_A, third[1]);  // One gap in universe 2...
+    e131.push(HOST_A, second[1]); // ...and late for it, so dropped
+    for (size_t i = 2; i < third.size(); i++)
+      e131.push(HOST_A, third[i]);
+    receiver.update();
+    TEST_ASSERT(receiver.getSource(0).sequenceErrors == 2 && receiver.getSource(0).frames == 3);
+    TEST_ASSERT(memcmp(ledController.ledColors, frames[2], BYTES) == 0);
+
+    // Art-Net counts 1 to 255 and wraps to 1, which is not a gap
+    uint8_t artNetSequence = 254;
+    artNet.push(HOST_B, PixelPackets::frame(PIXEL_ARTNET, frames[0], artNetSequence));
+    artNet.push(HOST_B, PixelPackets::frame(PIXEL_ARTNET, frames[2], artNetSequence));
+    receiver.update();
+    TEST_ASSERT(artNetSequence == 1);
+    TEST_ASSERT(receiver.getSourceCount() == 2 && receiver.getSource(1).sequenceErrors == 0);
+    TEST_ASSERT(receiver.getSource(1).frames == 2);
+    TEST_ASSERT(memcmp(ledController.ledColors, frames[2], BYTES) == 0);
+  }
+
+  // Junk is counted and skipped; other well formed packets are ignored
+  {
+    LedController ledController;
+    ledController.begin();
+    memset(ledController.ledColors, 0, BYTES);
+    VirtualClock clock;
+    QueuedPixelSocket ddp;
+    QueuedPixelSocket e131;
+    QueuedPixelSocket artNet;
+    PixelReceiver receiver(ledController, clock);
+    receiver.addInput(ddp, PIXEL_DDP);
+    receiver.addInput(e131, PIXEL_E131);
+    receiver.addInput(artNet, PIXEL_ARTNET);
+    PixelPackets::Packet junk(40, 0xFF);
+    PixelPackets::Packet truncated = PixelPackets::ddp(0, frames[0], 30, 0, true);
+    truncated.resize(20);
+    PixelPackets::Packet oldVersion = PixelPackets::ddp(0, frames[0], 30, 0, true);
+    oldVersion[0] = 0x80 | 0x01;
+    PixelPackets::Packet wrongLayer = PixelPackets::e131(1, frames[0], 30, 0);
+    wrongLayer[118] = 0;
+    PixelPackets::Packet poll = PixelPackets::artNet(0, frames[0], 0, 0);
+    poll[9] = 0x20; // ArtPoll
+    PixelPackets::Packet preview = PixelPackets::e131(1, frames[0], 30, 0, PixelPackets::E131_PREVIEW);
+    ddp.push(HOST_A, junk);
+    ddp.push(HOST_A, truncated);
+    ddp.push(HOST_A, oldVersion);
+    e131.push(HOST_A, junk);
+    e131.push(HOST_A, wrongLayer);
+    e131.push(HOST_A, preview);
+    artNet.push(HOST_A, junk);
+    artNet.push(HOST_A, poll);
+    TEST_ASSERT(!receiver.update());
+    TEST_ASSERT(receiver.getBadPackets() == 6);
+    bool untouched = true;
+    for (int i = 0; i < BYTES; i++)
+    {
+      untouched &= ledController.ledColors[i] == 0;
+    }
+    TEST_ASSERT(untouched);
+  }
+
+  // The animations come back after TIMEOUT of quiet, or at once when an
+  // E1.31 sender says it is done. The least recently seen sender makes room.
+  {
+    LedController ledController;
+    ledController.begin();
+    VirtualClock clock(10, 5000);
+    QueuedPixelSocket socket;
+    PixelReceiver receiver(ledController, clock);
+    receiver.addInput(socket, PIXEL_E131);
+    uint8_t sequence = 0;
+    socket.push(HOST_A, PixelPackets::frame(PIXEL_E131, frames[0], sequence));
+    TEST_ASSERT(receiver.update());
+    clock.advance(PixelReceiver::TIMEOUT - 1);
+    TEST_ASSERT(receiver.update());
+    clock.advance(1);
+    TEST_ASSERT(!receiver.update());
+
+    socket.push(HOST_A, PixelPackets::frame(PIXEL_E131, frames[1], sequence));
+    TEST_ASSERT(receiver.update() && receiver.getSource(0).frames == 2);
+    socket.push(HOST_A, PixelPackets::e131(1, frames[0], 0, ++sequence, PixelPackets::E131_TERMINATED));
+    TEST_ASSERT(!receiver.update());
+
+    // One sender ending its stream leaves another that is still sending
+    uint8_t other = 0;
+    clock.step();
+    socket.push(HOST_A, PixelPackets::frame(PIXEL_E131, frames[0], sequence));
+    socket.push(HOST_B, PixelPackets::frame(PIXEL_E131, frames[1], other));
+    TEST_ASSERT(receiver.update());
+    clock.step();
+    socket.push(HOST_A, PixelPackets::e131(1, frames[0], 0, ++sequence, PixelPackets::E131_TERMINATED));
+    TEST_ASSERT(receiver.update());
+    clock.step();
+    socket.push(HOST_B, PixelPackets::e131(1, frames[0], 0, ++other, PixelPackets::E131_TERMINATED));
+    TEST_ASSERT(!receiver.update());
+
+    for (uint32_t host = 1; host <= PixelReceiver::MAX_SOURCES; host++)
+    {
+      clock.step();
+      uint8_t count = 0;
+      socket.push(HOST_A + (host << 24), PixelPackets::frame(PIXEL_E131, frames[2], count));
+      receiver.update();
+    }
+    TEST_ASSERT(receiver.getSourceCount() == PixelReceiver::MAX_SOURCES);
+    bool evicted = true;
+    for (int i = 0; i < receiver.getSourceCount(); i++)
+    {
+      evicted &= receiver.getSource(i).address != HOST_A;
+    }
+    TEST_ASSERT(evicted);
+  }
+
+  // Receiving leaves the heap alone
+  {
+    LedController ledController;
+    ledController.begin();
+    VirtualClock clock;
+    QueuedPixelSocket socket;
+    PixelReceiver receiver(ledController, clock);
+    receiver.addInput(socket, PIXEL_DDP);
+    uint8_t sequence = 0;
+    for (int f = 0; f < 10; f++)
+    {
+      socket.push(HOST_A, PixelPackets::frame(PIXEL_DDP, frames[f % 3], sequence));
+    }
+    unsigned long before = heapAllocations;
+    for (int f = 0; f < 10; f++)
+    {
+      receiver.update();
+    }
+    TEST_ASSERT(heapAllocations == before);
+    TEST_ASSERT(receiver.getSource(0).frames == 10);
+  }
+
+  // Over real sockets the pixels go from the datagram into ledColors
+  {
+    LedController ledController;
+    ledController.begin();
+    VirtualClock clock;
+    PosixUdpSocket input;
+    PosixUdpSocket sender;
+    TEST_ASSERT(input.open(0) && sender.open(0));
+    sender.addPeer(input.getPort());
+    PixelReceiver receiver(ledController, clock);
+    receiver.addInput(input, PIXEL_DDP);
+
+    uint8_t sequence = 0;
+    PixelPackets::Packet junk(PixelPackets::DDP_CHUNK, 0xFF);
+    sender.send(junk.data(), junk.size());
+    for (const PixelPackets::Packet &packet : PixelPackets::frame(PIXEL_DDP, frames[1], sequence))
+    {
+      sender.send(packet.data(), packet.size());
+    }
+    for (int k = 0; k < 1000 && (receiver.getSourceCount() == 0 || receiver.getSource(0).frames == 0); k++)
+    {
+      receiver.update();
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    TEST_ASSERT(receiver.getSourceCount() == 1 && receiver.getSource(0).frames == 1);
+    TEST_ASSERT(receiver.getSource(0).address == htonl(INADDR_LOOPBACK));
+    TEST_ASSERT(receiver.getBadPackets() == 1);
+    TEST_ASSERT(memcmp(ledController.ledColors, frames[1], BYTES) == 0);
+  }
+}
+
 int main()
 {
   std::cout << "Starting Animation Tests..." << std::endl;
@@ -318,6 +3512,41 @@ int main()
   test_chase_animation();
   test_heartbeat_animation();
   test_wave_animation();
+  test_render_pass_optimization();
+  test_overwrite_frames_shown_undimmed();
+  test_command_queue_ordering();
+  test_command_queue_while_rendering();
+  test_snapshot_buffer();
+  test_controller_snapshots();
+  test_clocks();
+  test_virtual_clock_simulation();
+  test_blend_modes();
+  test_animation_layers();
+  test_layer_budget();
+  test_sequence_round_trip();
+  test_sequence_worst_case();
+  test_sequence_record_and_playback();
+  test_topology_tables();
+  test_topology_layout();
+  test_frame_diff();
+  test_many_strips();
+  test_distance_fields();
+  test_spatial_index();
+  test_path_library();
+  test_fixed_point_plasma();
+  test_rainbow_hue_offsets();
+  test_inferno_solver();
+  test_particle_pools();
+  test_graph_particles();
+  test_graph_field();
+  test_graph_automaton();
+  test_noise();
+  test_palette();
+  test_snake();
+  test_shader();
+  test_canvas();
+  test_wall_sync();
+  test_pixel_receiver();
 
   std::cout << "\nTest Summary:" << std::endl;
   std::cout << "Passed: " << tests_passed << std::endl;
@@ -14,6 +14,9 @@
 #include "mocks/SPIFFS.h"
 #include "Configuration.h"
 #include "Topology.h"
+#include "Clock.h"
+#include "WallSync.h"
+#include "PosixUdp.h"
 
 namespace ArduinoMock
 {
@@ -23,6 +26,21 @@ namespace ArduinoMock
 HardwareSerial Serial;
 SPIFFSFS SPIFFS;
 
+// Host wall clock; the mocked millis() only moves when a test moves it
+class HostClock : public Clock
+{
+public:
+  HostClock() : start(std::chrono::steady_clock::now()) {}
+
+  unsigned long now() override
+  {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point start;
+};
+
 struct Point
 {
   int x;
@@ -139,9 +157,10 @@ void printDisplay(LedController &ledController, AnimationController &animControl
 
       if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT)
       {
-        byte r = ledController.ledColors[s][i][0];
-        byte g = ledController.ledColors[s][i][1];
-        byte b = ledController.ledColors[s][i][2];
+        const byte *color = ledController.getPixel(s, i);
+        byte r = color[0];
+        byte g = color[1];
+        byte b = color[2];
 
         // If LED is lit, use block char, else use a faint dot or line char
         if (r > 10 || g > 10 || b > 10)
@@ -195,7 +214,7 @@ void printDisplay(LedController &ledController, AnimationController &animControl
   // Buffer output to reduce flickering
   std::stringstream ss;
   ss << "\033[H"; // Move cursor to home
-  ss << "Chromance Emulator (Time: " << millis() << "ms)" << "\n";
+  ss << "Chromance Emulator (Time: " << animController.now() << "ms)" << "\n";
 
   std::string animName = "None";
   byte currentAnim = animController.getCurrentAnimation();
@@ -241,6 +260,12 @@ int main(int argc, char *argv[])
   bool animationSet = false;
   float timeSpeed = 1.0f;
   bool speedSet = false;
+  bool fast = false;
+  unsigned int seed = std::time(0);
+  bool seedSet = false;
+  SyncRole syncRole = SYNC_OFF;
+  std::vector<uint16_t> syncPorts; // Followers' ports, or the port to follow on
+  bool quiet = false;
 
   std::vector<std::string> positionalArgs;
   for (int i = 1; i < argc; ++i)
@@ -262,6 +287,33 @@ int main(int argc, char *argv[])
         durationSet = true;
       }
     }
+    else if (arg == "-f" || arg == "--fast")
+    {
+      fast = true;
+    }
+    else if (arg == "-s" || arg == "--seed")
+    {
+      if (i + 1 < argc)
+      {
+        seed = std::stoul(argv[++i]);
+        seedSet = true;
+      }
+    }
+    else if (arg == "--sync-lead" || arg == "--sync-stream" || arg == "--sync-follow")
+    {
+      if (i + 1 < argc)
+      {
+        syncRole = arg == "--sync-lead" ? SYNC_LEADER : (arg == "--sync-stream" ? SYNC_STREAM : SYNC_FOLLOWER);
+        std::stringstream ports(argv[++i]);
+        std::string port;
+        while (std::getline(ports, port, ','))
+          syncPorts.push_back(std::stoi(port));
+      }
+    }
+    else if (arg == "-q" || arg == "--quiet")
+    {
+      quiet = true;
+    }
     else if (arg == "-a" || arg == "--animation")
     {
       if (i + 1 < argc)
@@ -283,6 +335,13 @@ int main(int argc, char *argv[])
   if (!speedSet && positionalArgs.size() > 2)
     timeSpeed = std::stof(positionalArgs[2]);
 
+  // Fast mode steps a virtual clock one frame at a time without sleeping or
+  // drawing, so it needs an end point and a fixed seed to be reproducible
+  if (fast && duration <= 0)
+    duration = 60L * 60 * 1000;
+  if (fast && !seedSet)
+    seed = 12345;
+
   std::cout << "Starting Chromance Test Suite..." << std::endl;
   if (duration > 0)
     std::cout << "Running for " << duration << " ms" << std::endl;
@@ -293,8 +352,17 @@ int main(int argc, char *argv[])
   LedController ledController;
   AnimationController animationController(ledController, configuration);
 
+  const unsigned long frameMillis = 33; // ~30fps
+  HostClock hostClock;
+  ScaledClock scaledClock(hostClock, timeSpeed);
+  VirtualClock virtualClock(frameMillis);
+  if (fast)
+    animationController.setClock(virtualClock);
+  else
+    animationController.setClock(scaledClock);
+
   // Setup
-  std::srand(std::time(0));
+  std::srand(seed);
   ledController.begin();
   animationController.init();
 
@@ -322,19 +390,92 @@ int main(int argc, char *argv[])
   else
   {
     // Fast forward for random mode
-    ArduinoMock::advanceMillis(2000);
+    virtualClock.advance(2000);
+    scaledClock.advance(2000);
   }
 
   // Loop
   int frames = 0;
-  unsigned long startMillis = millis();
+  unsigned long startMillis = animationController.now();
+  auto wallStart = std::chrono::steady_clock::now();
+
+  if (fast)
+  {
+    while (animationController.now() - startMillis <= (unsigned long)duration)
+    {
+      animationController.update();
+      frames++;
+      virtualClock.step();
+    }
+
+    printDisplay(ledController, animationController);
+    long wallMillis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - wallStart).count();
+    std::cout << "Simulated " << duration << " ms (" << frames << " frames) in " << wallMillis << " ms, seed " << seed << std::endl;
+    return 0;
+  }
+
+  // Several emulators on one machine as leader and followers (see WallSync)
+  PosixUdpSocket syncSocket;
+  WallSync wallSync(animationController, syncSocket, scaledClock);
+  if (syncRole != SYNC_OFF)
+  {
+    bool follower = syncRole == SYNC_FOLLOWER;
+    if (syncPorts.empty() || !syncSocket.open(follower ? syncPorts[0] : 0))
+    {
+      std::cerr << "Could not open the sync socket" << std::endl;
+      return 1;
+    }
+    for (size_t k = 0; !follower && k < syncPorts.size(); k++)
+      syncSocket.addPeer(syncPorts[k]);
+    wallSync.begin();
+    wallSync.setRole(syncRole);
+  }
 
   // Hide cursor
-  std::cout << "\033[?25l" << std::flush;
+  if (!quiet)
+    std::cout << "\033[?25l" << std::flush;
+
+  if (syncRole != SYNC_OFF)
+  {
+    auto syncStart = std::chrono::steady_clock::now();
+    unsigned long lastChecksumFrame = 0;
+    while (duration <= 0 || std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - syncStart).count() <= duration)
+    {
+      if (wallSync.update() > 0)
+      {
+        frames++;
+        if (!quiet && frames % 2 == 0)
+          printDisplay(ledController, animationController);
+
+        // The same epoch and frame should print the same checksum on every wall
+        unsigned long frame = wallSync.getFrame() - 1;
+        if (quiet && (syncRole != SYNC_FOLLOWER || (wallSync.isFollowing() && !wallSync.isStreaming())) &&
+            frame % 30 == 0 && frame != lastChecksumFrame)
+        {
+          uint32_t checksum = 2166136261u;
+          for (int k = 0; k < Constants::NUM_OF_PIXELS * 3; k++)
+            checksum = (checksum ^ ledController.ledColors[k]) * 16777619u;
+          const WallSyncStats &stats = wallSync.getStats();
+          std::cout << "epoch " << wallSync.getEpoch() << " frame " << frame << " checksum " << std::hex << checksum
+                    << std::dec << " offset " << wallSync.getOffset() << " ms, worst lateness " << stats.worstLateness
+                    << " ms, replayed " << stats.framesReplayed << ", skipped " << stats.framesSkipped << std::endl;
+          lastChecksumFrame = frame;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (!quiet)
+      std::cout << "\033[?25h" << std::endl;
+    const WallSyncStats &stats = wallSync.getStats();
+    std::cout << "Rendered " << stats.framesRendered << " frames, streamed " << stats.streamedFrames << " ("
+              << stats.incompleteFrames << " incomplete), " << stats.packetsSent << " packets sent, "
+              << stats.packetsReceived << " received" << std::endl;
+    return 0;
+  }
 
   while (true)
   {
-    if (duration > 0 && (millis() - startMillis > duration))
+    if (duration > 0 && animationController.now() - startMillis > (unsigned long)duration)
     {
       break;
     }
@@ -348,9 +489,7 @@ int main(int argc, char *argv[])
     }
     frames++;
 
-    // Advance time
-    ArduinoMock::advanceMillis((unsigned long)(33 * timeSpeed)); // ~30fps
-    std::this_thread::sleep_for(std::chrono::milliseconds(33));
+    std::this_thread::sleep_for(std::chrono::milliseconds(frameMillis));
   }
 
   // Show cursor again